@@ -991,6 +991,13 @@ stpp_imagereq_do(void *aux)
 }
 
 
+static void
+stpp_imagereq_cancelled(void *aux)
+{
+  asyncio_run_task(stpp_imagereq_send, aux);
+}
+
+
 
 
 /**
@@ -1153,7 +1160,8 @@ stpp_binary(stpp_t *stpp, const uint8_t *data, int len)
       sir->sir_flags = flags;
       sir->sir_stpp = stpp;
       LIST_INSERT_HEAD(&stpp->stpp_imagereqs, sir, sir_link);
-      task_run(stpp_imagereq_do, sir);
+      task_run_prio(stpp_imagereq_do, sir, TASK_PRIO_INTERACTIVE,
+                    sir->sir_cancellable, stpp_imagereq_cancelled);
     }
     break;
 
@@ -254,9 +254,8 @@ tmdb_configure(void)
       goto done;
     }
 
-    htsmsg_t *doc = htsmsg_json_deserialize2(buf_cstr(result),
-                                             errbuf, sizeof(errbuf));
-    buf_release(result);
+    htsmsg_t *doc = htsmsg_json_deserialize_buf(result,
+                                                errbuf, sizeof(errbuf));
 
     if(doc == NULL) {
       TRACE(TRACE_ERROR, "TMDB", "Got bad JSON from config -- %s", errbuf);
@@ -312,12 +311,11 @@ tmdb_load_movie_cast(const char *lookup_id)
   }
   http_headers_free(&response_headers);
 
-  htsmsg_t *doc = htsmsg_json_deserialize2(buf_cstr(result),
-                                           errbuf, sizeof(errbuf));
+  htsmsg_t *doc = htsmsg_json_deserialize_buf(result,
+                                              errbuf, sizeof(errbuf));
   if(doc == NULL) {
     TRACE(TRACE_ERROR, "TMDB", "Got bad JSON from %s -- %s", url, errbuf);
   }
-  buf_release(result);
   return doc;
 }
 
@@ -427,9 +425,8 @@ tmdb_load_movie_info(void *db, const char *item_url, const char *lookup_id,
   }
   http_headers_free(&response_headers);
 
-  htsmsg_t *doc = htsmsg_json_deserialize2(buf_cstr(result),
-                                           errbuf, sizeof(errbuf));
-  buf_release(result);
+  htsmsg_t *doc = htsmsg_json_deserialize_buf(result,
+                                              errbuf, sizeof(errbuf));
   if(doc == NULL) {
     TRACE(TRACE_ERROR, "TMDB", "Got bad JSON from %s -- %s", url, errbuf);
     return METADATA_TEMPORARY_ERROR;
@@ -572,9 +569,8 @@ tmdb_query_by_title_and_year0(void *db, const char *item_url,
   }
   http_headers_free(&response_headers);
 
-  htsmsg_t *doc = htsmsg_json_deserialize2(buf_cstr(result),
-                                           errbuf, sizeof(errbuf));
-  buf_release(result);
+  htsmsg_t *doc = htsmsg_json_deserialize_buf(result,
+                                              errbuf, sizeof(errbuf));
   if(doc == NULL) {
     TRACE(TRACE_ERROR, "TMDB", "Got bad JSON from %s -- %s", url, errbuf);
     return METADATA_TEMPORARY_ERROR;
@@ -377,6 +377,10 @@ backend_imageloader(rstr_t *url0, const image_meta_t *im0,
 
   hts_mutex_unlock(&imageloader_mutex);
 
+  if(img == NULL && !im.im_no_decoding &&
+     (img = image_cache_get(url, &im, cache_control)) != NULL)
+    goto done;
+
   if(img == NULL) {
 
     if(be != NULL) {
@@ -417,6 +421,8 @@ backend_imageloader(rstr_t *url0, const image_meta_t *im0,
 
     if(!im.im_no_decoding) {
       img = image_decode(img, &im, errbuf, errlen);
+      if(img != NULL)
+        image_cache_put(url, &im, img);
     }
 
   }
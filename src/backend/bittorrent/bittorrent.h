@@ -313,9 +313,13 @@ typedef struct torrent_piece {
   uint8_t tp_disk_fail     : 1;
   uint8_t tp_load_req      : 1;
   uint8_t tp_loadfail      : 1;
+  uint8_t tp_mapped        : 1;  // tp_data points into the cache file
 
   struct torrent_fh_list tp_active_fh;
 
+  TAILQ_ENTRY(torrent_piece) tp_hash_link;
+  struct torrent *tp_hash_torrent;  // Set while queued for hashing
+
   int64_t tp_deadline;
 
   average_t tp_download_rate;
@@ -424,6 +428,7 @@ typedef struct torrent {
   int to_num_pieces;
 
   uint8_t *to_piece_hashes;
+  uint16_t *to_piece_avail;  // Number of peers that have each piece
 
   struct torrent_file_queue to_files;
 
@@ -450,14 +455,19 @@ typedef struct torrent {
   buf_t *to_metainfo;
 
   fa_handle_t *to_cachefile;
+  uint8_t *to_cachefile_mmap;  // NULL if the cache file is not mapped
+  uint64_t to_cachefile_mmap_size;
 
-  int to_cachefile_map_offset;
+  int to_cachefile_index_offset;
   int to_cachefile_store_offset;
+  int to_cachefile_slots;
+
+  int32_t *to_cachefile_piece_map;      // Piece -> slot
+  int32_t *to_cachefile_piece_map_inv;  // Slot -> piece
+  uint32_t *to_cachefile_slot_seq;      // LRU sequence per slot
+  uint32_t to_cachefile_seq;
 
-  int32_t *to_cachefile_piece_map;
-  int32_t *to_cachefile_piece_map_inv;
-  int to_next_disk_block;
-  int to_total_disk_blocks;
+  int to_mapped_pieces;
 
   struct asyncio_timer to_output_rate_timer;
   int64_t to_output_rate_refill_time;
@@ -488,6 +498,16 @@ typedef struct torrent_fh {
 
   int64_t tfh_deadline;
 
+  /**
+   * Streaming state, offsets are within the torrent (not the file)
+   */
+  char tfh_streaming;
+  uint64_t tfh_stream_offset;  // Where last read started
+  uint64_t tfh_next_offset;    // ... and ended
+  int tfh_read_rate;           // Bytes/s, 0 if unknown
+  int64_t tfh_rate_time;
+  uint64_t tfh_rate_bytes;
+
   struct cancellable *tfh_cancellable;
   char tfh_cancelled;
 
@@ -544,6 +564,8 @@ void torrent_piece_release(torrent_piece_t *tp);
 int torrent_load(torrent_t *to, void *buf, uint64_t offset, size_t size,
 		 torrent_fh_t *tfh);
 
+void torrent_update_deadlines(torrent_t *to);
+
 void torrent_announce_all(torrent_t *to);
 
 void torrent_attempt_more_peers(torrent_t *to);
@@ -553,7 +575,7 @@ void torrent_io_do_requests(torrent_t *to);
 void torrent_receive_block(torrent_block_t *tb, const void *buf,
                            int begin, int len, torrent_t *to, peer_t *p);
 
-void torrent_hash_wakeup(void);
+void torrent_piece_hash_enqueue(torrent_t *to, torrent_piece_t *tp);
 
 int torrent_parse_infodict(torrent_t *to, struct htsmsg *info,
                            char *errbuf, size_t errlen);
@@ -603,6 +625,33 @@ void torrent_diskio_cache_clear(void);
 
 buf_t *torrent_diskio_load_infofile_from_hash(const uint8_t *hash);
 
+/**
+ * Streaming piece picker
+ */
+
+#define TORRENT_PICKER_MAX_REQUESTS 3 // Outstanding requests per block
+#define TORRENT_PICKER_BACKGROUND   4 // Pieces outside the window in flight
+
+int torrent_picker_window(int piece_length, int rate);
+
+int64_t torrent_picker_deadline(uint64_t offset, int piece, int piece_length,
+                                int rate, int64_t base);
+
+int64_t torrent_picker_block_eta(int64_t send_time, int block_delay,
+                                 int64_t now);
+
+int torrent_picker_want_dup(int64_t send_time, int block_delay,
+                            int num_requests, int64_t deadline, int64_t now,
+                            int endgame);
+
+int torrent_picker_peer_delay(const int *bd, int qdepth, int block_delay);
+
+int torrent_picker_peer_ok(int64_t now, int64_t deadline, int delay,
+                           int fastest, int qdepth, int maxq);
+
+int torrent_picker_rarest(const uint16_t *avail, int first, int last,
+                          int (*skip)(void *opaque, int piece), void *opaque);
+
 /**
  * Tracker
  */
@@ -22,6 +22,12 @@
 #include <unistd.h>
 #include <limits.h>
 
+#if defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#define BT_USE_MMAP
+#endif
+
 #include "main.h"
 #include "navigator.h"
 #include "backend/backend.h"
@@ -35,6 +41,7 @@
 
 
 static int torrent_write_thread_running;
+static int torrent_diskio_scan_needed;
 
 static void
 diskio_trace(const torrent_t *t, const char *msg, ...)
@@ -56,13 +63,51 @@ diskio_trace(const torrent_t *t, const char *msg, ...)
 }
 
 
+/**
+ * The cache file is laid out as
+ *
+ *   'bt03' | metainfo size | number of slots
+ *   metainfo
+ *   slot index, for each slot: piece index (-1 if free), LRU sequence
+ *   slots, each one piece_length long
+ *
+ * The file is preallocated to its full size when created so we never
+ * need to grow it. When all slots are in use the least recently used
+ * one is evicted.
+ */
+#define CACHE_MIN_SLOTS 16
+#define CACHE_INDEX_ENTRY_SIZE 8
+
+
+/**
+ * Offset of a slot's data, with slot == number of slots this is the
+ * size of the entire file
+ */
+static uint64_t
+cache_slot_offset(const torrent_t *to, int slot)
+{
+  return (uint64_t)slot * to->to_piece_length + to->to_cachefile_store_offset;
+}
+
+
 /**
  *
  */
 static uint64_t
-cache_file_size(const torrent_t *to, int blocks)
+cache_index_offset(const torrent_t *to, int slot)
+{
+  return to->to_cachefile_index_offset + slot * CACHE_INDEX_ENTRY_SIZE;
+}
+
+
+/**
+ *
+ */
+static int
+cache_write_at(fa_handle_t *fh, uint64_t offset, const void *data, int len)
 {
-  return blocks * to->to_piece_length + to->to_cachefile_store_offset;
+  return fa_seek(fh, offset, SEEK_SET) == offset &&
+    fa_write(fh, data, len) == len;
 }
 
 
@@ -96,7 +141,8 @@ update_disk_usage(void)
   const torrent_t *to;
   uint64_t active_total = 0;
   LIST_FOREACH(to, &torrents, to_link)
-    active_total += cache_file_size(to, to->to_total_disk_blocks);
+    if(to->to_cachefile != NULL)
+      active_total += cache_slot_offset(to, to->to_cachefile_slots);
 
   btg.btg_total_bytes_active = active_total;
 
@@ -125,111 +171,113 @@ update_disk_usage(void)
 
 
 /**
- *
+ * A slot is pinned if an active piece points straight into it
  */
-static void
-torrent_write_to_disk(torrent_t *to, torrent_piece_t *tp)
+static int
+cache_slot_pinned(const torrent_t *to, int slot)
 {
-  torrent_retain(to);
-  tp->tp_refcount++;
-
-  uint8_t mapdata[4];
-  int ok = 0;
-
-  for(int attempt = 0; attempt < 2; attempt++) {
-
-    update_disk_usage();
-
-    int growth = MAX(to->to_next_disk_block + 1 - to->to_total_disk_blocks, 0);
+  const int piece = to->to_cachefile_piece_map_inv[slot];
+  const torrent_piece_t *tp;
 
-    if(btg.btg_total_bytes_active + btg.btg_total_bytes_inactive +
-       growth * to->to_piece_length >= btg.btg_cache_limit) {
-
-      diskio_trace(to, "Write would exceed cache size, need to cleanup");
-      if(torrent_diskio_scan(0)) {
-        // Managed to clean up something
-        continue;
-      }
-      // Otherwise, just restart in our file 50% back
-      to->to_next_disk_block /= 2;
-      growth = MAX(to->to_next_disk_block + 1 - to->to_total_disk_blocks, 0);
-    }
+  TAILQ_FOREACH(tp, &to->to_active_pieces, tp_link)
+    if(tp->tp_index == piece)
+      return tp->tp_mapped;
+  return 0;
+}
 
 
-    int location = to->to_next_disk_block;
-    wr32_be(mapdata, to->to_next_disk_block);
-    to->to_next_disk_block++;
+/**
+ * Return a free slot, or the least recently used one that is not pinned
+ */
+static int
+cache_slot_alloc(const torrent_t *to)
+{
+  int victim = -1;
 
+  for(int i = 0; i < to->to_cachefile_slots; i++) {
+    if(to->to_cachefile_piece_map_inv[i] == -1)
+      return i;
 
-    if(growth > 0) {
-      btg.btg_disk_avail -= growth * to->to_piece_length;
-      to->to_total_disk_blocks = to->to_next_disk_block;
-    }
+    if(victim != -1 &&
+       to->to_cachefile_slot_seq[i] >= to->to_cachefile_slot_seq[victim])
+      continue;
 
-    const int old_piece = to->to_cachefile_piece_map_inv[location];
-    uint64_t old_map_offset = 0;
-    if(old_piece != -1) {
-      // Some other block already occupied this slot in the file
-      // We need to clear that out
+    if(cache_slot_pinned(to, i))
+      continue;
 
-      old_map_offset =
-        sizeof(uint32_t) * old_piece + to->to_cachefile_map_offset;
+    victim = i;
+  }
+  return victim;
+}
 
-      to->to_cachefile_piece_map[old_piece] = -1;
-    }
 
-    const int old_pos = to->to_cachefile_piece_map[tp->tp_index];
-    if(old_pos != -1) {
-      // Piece was already written to another location.
-      // We are writing again, probably due to hash corruption.
-      // Clear out inverse table info
-      to->to_cachefile_piece_map_inv[old_pos] = -1;
-    }
+/**
+ *
+ */
+static void
+torrent_write_to_disk(torrent_t *to, torrent_piece_t *tp)
+{
+  const int slot = cache_slot_alloc(to);
+  if(slot == -1) {
+    diskio_trace(to, "No slot available for piece %d", tp->tp_index);
+    tp->tp_disk_fail = 1;
+    return;
+  }
 
-    to->to_cachefile_piece_map[tp->tp_index] = location;
-    to->to_cachefile_piece_map_inv[location] = tp->tp_index;
+  torrent_retain(to);
+  tp->tp_refcount++;
 
+  const int old_piece = to->to_cachefile_piece_map_inv[slot];
+  if(old_piece != -1) {
+    diskio_trace(to, "Evicting piece %d from slot %d", old_piece, slot);
+    to->to_cachefile_piece_map[old_piece] = -1;
+  }
 
-    uint64_t data_offset =
-      location * to->to_piece_length + to->to_cachefile_store_offset;
+  const int old_slot = to->to_cachefile_piece_map[tp->tp_index];
+  if(old_slot != -1) {
+    // Piece was already written to another slot.
+    // We are writing again, probably due to hash corruption.
+    to->to_cachefile_piece_map_inv[old_slot] = -1;
+    to->to_cachefile_slot_seq[old_slot] = 0;
+  }
 
-    uint64_t map_offset =
-      sizeof(uint32_t) * tp->tp_index + to->to_cachefile_map_offset;
+  to->to_cachefile_piece_map[tp->tp_index] = slot;
+  to->to_cachefile_piece_map_inv[slot] = tp->tp_index;
+  to->to_cachefile_slot_seq[slot] = ++to->to_cachefile_seq;
 
-    hts_mutex_unlock(&bittorrent_mutex);
+  uint8_t entry[CACHE_INDEX_ENTRY_SIZE];
+  uint8_t empty[CACHE_INDEX_ENTRY_SIZE] = {0xff, 0xff, 0xff, 0xff};
+  wr32_be(entry, tp->tp_index);
+  wr32_be(entry + 4, to->to_cachefile_slot_seq[slot]);
 
-    if(fa_seek(to->to_cachefile, data_offset, SEEK_SET) == data_offset) {
-      if(fa_write(to->to_cachefile, tp->tp_data, tp->tp_piece_length) ==
-         tp->tp_piece_length) {
+  fa_handle_t *fh = to->to_cachefile;
+  const uint64_t data_offset = cache_slot_offset(to, slot);
+  const uint64_t index_offset = cache_index_offset(to, slot);
 
-        if(fa_seek(to->to_cachefile, map_offset, SEEK_SET) == map_offset) {
+  hts_mutex_unlock(&bittorrent_mutex);
 
-          if(fa_write(to->to_cachefile, mapdata, 4) == 4) {
-            ok = 1;
-          }
-        }
-      }
-    }
+  // Mark the slot as free while the data is in flux
+  int ok =
+    cache_write_at(fh, index_offset, empty, sizeof(empty)) &&
+    cache_write_at(fh, data_offset, tp->tp_data, tp->tp_piece_length) &&
+    cache_write_at(fh, index_offset, entry, sizeof(entry));
 
-    if(old_map_offset) {
-      if(fa_seek(to->to_cachefile, old_map_offset, SEEK_SET) ==
-         old_map_offset) {
-        memset(mapdata, 0xff, 4);
-        fa_write(to->to_cachefile, mapdata, 4);
-      }
-    }
+  if(old_slot != -1)
+    cache_write_at(fh, cache_index_offset(to, old_slot), empty, sizeof(empty));
 
-    hts_mutex_lock(&bittorrent_mutex);
+  hts_mutex_lock(&bittorrent_mutex);
 
-    diskio_trace(to, "Wrote piece %d to disk at %d (%"PRId64"). Result: %s",
-                 tp->tp_index, location, data_offset, ok ? "OK" : "FAIL");
-    break;
-  }
+  diskio_trace(to, "Wrote piece %d to slot %d (%"PRId64"). Result: %s",
+               tp->tp_index, slot, data_offset, ok ? "OK" : "FAIL");
 
   if(ok) {
     tp->tp_on_disk = 1;
   } else {
     tp->tp_disk_fail = 1;
+    if(to->to_cachefile_piece_map_inv[slot] == tp->tp_index) {
+      to->to_cachefile_piece_map_inv[slot] = -1;
+      to->to_cachefile_piece_map[tp->tp_index] = -1;
+    }
   }
 
   torrent_piece_release(tp);
@@ -239,7 +287,8 @@ torrent_write_to_disk(torrent_t *to, torrent_piece_t *tp)
 
 
 /**
- *
+ * If the cache file is mapped the piece will point straight into
+ * the mapping instead of its own buffer
  */
 static void
 torrent_read_from_disk(torrent_t *to, torrent_piece_t *tp)
@@ -247,21 +296,31 @@ torrent_read_from_disk(torrent_t *to, torrent_piece_t *tp)
   torrent_retain(to);
   tp->tp_refcount++;
 
-  int idx = to->to_cachefile_piece_map[tp->tp_index];
+  int slot = to->to_cachefile_piece_map[tp->tp_index];
   int ok;
 
-  if(idx >= 0) {
-    uint64_t data_offset =
-      idx * to->to_piece_length + to->to_cachefile_store_offset;
+  if(slot >= 0) {
+    const uint64_t data_offset = cache_slot_offset(to, slot);
 
-    hts_mutex_unlock(&bittorrent_mutex);
-    fa_seek(to->to_cachefile, data_offset, SEEK_SET);
-    int len = fa_read(to->to_cachefile, tp->tp_data, tp->tp_piece_length);
-    hts_mutex_lock(&bittorrent_mutex);
-    ok = len == tp->tp_piece_length;
+    to->to_cachefile_slot_seq[slot] = ++to->to_cachefile_seq;
 
-    diskio_trace(to, "Load piece %d from disk: %s",
-                 tp->tp_index, ok ? "OK" : "FAIL");
+    if(to->to_cachefile_mmap != NULL) {
+      free(tp->tp_data);
+      tp->tp_data = to->to_cachefile_mmap + data_offset;
+      tp->tp_mapped = 1;
+      to->to_active_pieces_mem -= tp->tp_piece_length;
+      to->to_mapped_pieces++;
+      ok = 1;
+    } else {
+      hts_mutex_unlock(&bittorrent_mutex);
+      fa_seek(to->to_cachefile, data_offset, SEEK_SET);
+      int len = fa_read(to->to_cachefile, tp->tp_data, tp->tp_piece_length);
+      hts_mutex_lock(&bittorrent_mutex);
+      ok = len == tp->tp_piece_length;
+    }
+
+    diskio_trace(to, "Load piece %d from slot %d: %s",
+                 tp->tp_index, slot, ok ? "OK" : "FAIL");
   } else {
     // Piece no longer exist on disk. We fail silently here and just
     // let the torrent streamer reload it
@@ -273,7 +332,7 @@ torrent_read_from_disk(torrent_t *to, torrent_piece_t *tp)
   if(ok) {
     tp->tp_complete = 1;
     tp->tp_on_disk = 1;
-    torrent_hash_wakeup();
+    torrent_piece_hash_enqueue(to, tp);
   } else {
     tp->tp_loadfail = 1;
     to->to_loadfail = 1;
@@ -299,6 +358,13 @@ bt_diskio_thread(void *aux)
 
     update_disk_avail();
 
+    if(torrent_diskio_scan_needed) {
+      // A new cache file was created, make room for it
+      torrent_diskio_scan_needed = 0;
+      torrent_diskio_scan(0);
+      goto restart;
+    }
+
     LIST_FOREACH(to, &torrents, to_link) {
       if(to->to_cachefile == NULL)
         continue;
@@ -358,18 +424,18 @@ torrent_diskio_verify(torrent_t *to)
   fa_seek(fh, 0, SEEK_SET);
   int64_t size = fa_fsize(fh);
 
-  uint8_t tmp[8];
+  uint8_t tmp[12];
 
   if(size < sizeof(tmp))
     return -1;
 
   if(fa_read(fh, tmp, sizeof(tmp)) != sizeof(tmp)) {
-    diskio_trace(to, "Unable to read bencode size");
+    diskio_trace(to, "Unable to read header");
     return -1;
   }
 
   uint32_t magic = rd32_be(tmp);
-  if(magic != 'bt02') {
+  if(magic != 'bt03') {
     diskio_trace(to, "Bad magic 0x%08x", magic);
     return -1;
   }
@@ -383,6 +449,12 @@ torrent_diskio_verify(torrent_t *to)
     return -1;
   }
 
+  unsigned int slots = rd32_be(tmp+8);
+  if(slots == 0 || slots > to->to_num_pieces) {
+    diskio_trace(to, "Bad number of slots %d", slots);
+    return -1;
+  }
+
   buf_t *b = buf_create(bencodesize);
   if(fa_read(fh, buf_str(b), bencodesize) != bencodesize) {
     diskio_trace(to, "Unable to read metainto");
@@ -411,40 +483,112 @@ torrent_diskio_verify(torrent_t *to)
     return -1;
   }
 
-  const int mapsize = to->to_num_pieces * sizeof(uint32_t);
+  to->to_cachefile_slots = slots;
+  to->to_cachefile_index_offset = sizeof(tmp) + bencodesize;
+  to->to_cachefile_store_offset =
+    to->to_cachefile_index_offset + slots * CACHE_INDEX_ENTRY_SIZE;
+
+  const int indexsize = slots * CACHE_INDEX_ENTRY_SIZE;
+  uint8_t *index = malloc(indexsize);
 
-  if(fa_read(fh, to->to_cachefile_piece_map, mapsize) != mapsize) {
-    diskio_trace(to, "Unable to read piece flags, clearing all on-disk pieces");
-    memset(to->to_cachefile_piece_map, 0xff, mapsize);
+  if(fa_read(fh, index, indexsize) != indexsize) {
+    diskio_trace(to, "Unable to read slot index, clearing all on-disk pieces");
+    memset(index, 0xff, indexsize);
   }
 
+  const int mapsize = to->to_num_pieces * sizeof(uint32_t);
+  memset(to->to_cachefile_piece_map, 0xff, mapsize);
   memset(to->to_cachefile_piece_map_inv, 0xff, mapsize);
+  to->to_cachefile_seq = 0;
 
   int cnt = 0;
-  int max_block = -1;
-  for(int i = 0; i < to->to_num_pieces; i++) {
-    unsigned int location = rd32_be((void *)&to->to_cachefile_piece_map[i]);
-
-    if(location >= to->to_num_pieces)
-      location = -1;
-
-    to->to_cachefile_piece_map[i] = location;
-    if(to->to_cachefile_piece_map[i] != -1) {
-      cnt++;
-      max_block = MAX(max_block, to->to_cachefile_piece_map[i]);
-      to->to_cachefile_piece_map_inv[location] = i;
-    }
+  for(int i = 0; i < slots; i++) {
+    const uint8_t *e = index + i * CACHE_INDEX_ENTRY_SIZE;
+    unsigned int piece = rd32_be(e);
+    const uint32_t seq = rd32_be(e + 4);
+
+    if(piece >= to->to_num_pieces || to->to_cachefile_piece_map[piece] != -1)
+      continue;
+
+    to->to_cachefile_piece_map[piece] = i;
+    to->to_cachefile_piece_map_inv[i] = piece;
+    to->to_cachefile_slot_seq[i] = seq;
+    to->to_cachefile_seq = MAX(to->to_cachefile_seq, seq);
+    cnt++;
   }
+  free(index);
+
+  diskio_trace(to, "%d pieces valid on disk in %d slots", cnt, slots);
+  return 0;
+}
+
+
+/**
+ * Size the cache for a new torrent. We are allowed to use whatever is
+ * left of the cache limit after other active torrents. Inactive ones
+ * will be purged by the next scan
+ */
+static int
+torrent_diskio_slots(const torrent_t *to)
+{
+  update_disk_usage();
+
+  int64_t budget = btg.btg_cache_limit - btg.btg_total_bytes_active;
+  int64_t slots = MAX(budget, 0) / to->to_piece_length;
 
-  to->to_next_disk_block = max_block + 1;
-  to->to_total_disk_blocks = to->to_next_disk_block;
+  slots = MAX(slots, CACHE_MIN_SLOTS);
+  return MIN(slots, to->to_num_pieces);
+}
 
-  diskio_trace(to, "%d pieces valid on disk", cnt);
 
-  to->to_cachefile_map_offset = 8 + bencodesize;
+/**
+ *
+ */
+static int
+torrent_diskio_create(torrent_t *to)
+{
+  fa_handle_t *fh = to->to_cachefile;
+  const int bencodesize = buf_size(to->to_metainfo);
+  const int slots = torrent_diskio_slots(to);
+
+  fa_seek(fh, 0, SEEK_SET);
+  uint8_t tmp[12];
+  wr32_be(tmp, 'bt03');
+  wr32_be(tmp + 4, bencodesize);
+  wr32_be(tmp + 8, slots);
+
+  if(fa_write(fh, tmp, sizeof(tmp)) != sizeof(tmp))
+    return -1;
+
+  if(fa_write(fh, buf_cstr(to->to_metainfo), bencodesize) != bencodesize)
+    return -1;
+
+  const int indexsize = slots * CACHE_INDEX_ENTRY_SIZE;
+  uint8_t *index = calloc(1, indexsize);
+  for(int i = 0; i < slots; i++)
+    wr32_be(index + i * CACHE_INDEX_ENTRY_SIZE, -1);
+
+  int err = fa_write(fh, index, indexsize) != indexsize;
+  free(index);
+  if(err)
+    return -1;
+
+  to->to_cachefile_slots = slots;
+  to->to_cachefile_index_offset = sizeof(tmp) + bencodesize;
   to->to_cachefile_store_offset =
-    to->to_cachefile_map_offset + to->to_num_pieces * sizeof(uint32_t);
+    to->to_cachefile_index_offset + indexsize;
+  to->to_cachefile_seq = 0;
+
+  const int mapsize = to->to_num_pieces * sizeof(uint32_t);
+  memset(to->to_cachefile_piece_map, 0xff, mapsize);
+  memset(to->to_cachefile_piece_map_inv, 0xff, mapsize);
+
+  // This also truncates any old, larger, file
+  if(fa_ftruncate(fh, cache_slot_offset(to, slots)))
+    diskio_trace(to, "Unable to preallocate cache file");
 
+  torrent_diskio_scan_needed = 1;
+  torrent_diskio_wakeup();
   return 0;
 }
 
@@ -475,59 +619,46 @@ torrent_diskio_open(torrent_t *to)
     return;
   }
 
+  to->to_cachefile_slot_seq = calloc(to->to_num_pieces, sizeof(uint32_t));
 
   if(!torrent_diskio_verify(to)) {
     diskio_trace(to, "File %s seems valid", path);
+  } else if(!torrent_diskio_create(to)) {
+    diskio_trace(to, "New disk cache initialized at %s", path);
   } else {
+    TRACE(TRACE_ERROR, "BITTORRENT",
+          "%s: Unable to create cachefile, running without diskcache",
+          to->to_title);
+    torrent_diskio_close(to);
+    return;
+  }
 
-    fa_seek(to->to_cachefile, 0, SEEK_SET);
-    uint8_t tmp[8];
-    wr32_be(tmp, 'bt02');
-    wr32_be(tmp + 4, buf_size(to->to_metainfo));
-
-    if(fa_write(to->to_cachefile, tmp, 8) != 8)
-      goto err;
-
-    int bencodesize = buf_size(to->to_metainfo);
-
-    if(fa_write(to->to_cachefile, buf_cstr(to->to_metainfo),
-                bencodesize) != bencodesize)
-      goto err;
-
-    const int mapsize = to->to_num_pieces * sizeof(uint32_t);
-
-    void *ff = malloc(mapsize);
-    memset(ff, 0xff, mapsize);
-
-    int err = fa_write(to->to_cachefile, ff, mapsize) != mapsize;
-    free(ff);
-    if(err)
-      goto err;
-
-    to->to_cachefile_map_offset = 8 + bencodesize;
-    to->to_cachefile_store_offset =
-      to->to_cachefile_map_offset + to->to_num_pieces * sizeof(uint32_t);
-
-    to->to_next_disk_block = 0;
-    diskio_trace(to, "New disk cache initialized at %s", path);
+  const uint64_t size = cache_slot_offset(to, to->to_cachefile_slots);
+
+#ifdef BT_USE_MMAP
+  if(fa_fsize(to->to_cachefile) >= size) {
+    int fd = open(path, O_RDONLY);
+    if(fd != -1) {
+      void *m = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if(m != MAP_FAILED) {
+        to->to_cachefile_mmap = m;
+        to->to_cachefile_mmap_size = size;
+      }
+    }
   }
-  diskio_trace(to, "Disk offsets: map:0x%x store:0x%x next block stored at %d",
-               to->to_cachefile_map_offset,
-               to->to_cachefile_store_offset,
-               to->to_next_disk_block);
-  return;
-
- err:
-  TRACE(TRACE_ERROR, "BITTORRENT",
-        "%s: Unable to create cachefile, running without diskcache",
-        to->to_title);
-  fa_close(to->to_cachefile);
-  to->to_cachefile = NULL;
+#endif
+
+  diskio_trace(to, "Disk offsets: index:0x%x store:0x%x slots:%d size:%"PRId64
+               " %s", to->to_cachefile_index_offset,
+               to->to_cachefile_store_offset, to->to_cachefile_slots, size,
+               to->to_cachefile_mmap ? "mapped" : "not mapped");
 }
 
 
 /**
- *
+ * The LRU sequence is only written to the index when a piece is
+ * stored, so flush the current state here
  */
 void
 torrent_diskio_close(torrent_t *to)
@@ -535,8 +666,33 @@ torrent_diskio_close(torrent_t *to)
   if(to->to_cachefile == NULL)
     return;
 
+  const int slots = to->to_cachefile_slots;
+  if(slots > 0) {
+    const int indexsize = slots * CACHE_INDEX_ENTRY_SIZE;
+    uint8_t *index = malloc(indexsize);
+    for(int i = 0; i < slots; i++) {
+      uint8_t *e = index + i * CACHE_INDEX_ENTRY_SIZE;
+      wr32_be(e,     to->to_cachefile_piece_map_inv[i]);
+      wr32_be(e + 4, to->to_cachefile_slot_seq[i]);
+    }
+    cache_write_at(to->to_cachefile, to->to_cachefile_index_offset,
+                   index, indexsize);
+    free(index);
+  }
+
+#ifdef BT_USE_MMAP
+  if(to->to_cachefile_mmap != NULL)
+    munmap(to->to_cachefile_mmap, to->to_cachefile_mmap_size);
+#endif
+  to->to_cachefile_mmap = NULL;
+  to->to_cachefile_mmap_size = 0;
+
   fa_close(to->to_cachefile);
   to->to_cachefile = NULL;
+  to->to_cachefile_slots = 0;
+
+  free(to->to_cachefile_slot_seq);
+  to->to_cachefile_slot_seq = NULL;
 }
 
 LIST_HEAD(scanned_file_list, scanned_file);
@@ -710,13 +866,13 @@ torrent_diskio_load_infofile_from_hash(const uint8_t *req_hash)
   if(fh == NULL)
     return NULL;
 
-  uint8_t tmp[8];
+  uint8_t tmp[12];
 
   if(fa_read(fh, tmp, sizeof(tmp)) != sizeof(tmp))
     goto bad;
 
   uint32_t magic = rd32_be(tmp);
-  if(magic != 'bt02')
+  if(magic != 'bt03')
     goto bad;
 
   unsigned int bencodesize = rd32_be(tmp+4);
@@ -260,6 +260,7 @@ torrent_close(fa_handle_t *fh)
   LIST_REMOVE(tfh, tfh_torrent_file_link);
   LIST_REMOVE(tfh, tfh_torrent_link);
 
+  torrent_update_deadlines(tfh->tfh_file->tf_torrent);
   torrent_release(tfh->tfh_file->tf_torrent);
 
   hts_mutex_unlock(&bittorrent_mutex);
@@ -67,6 +67,8 @@ static void peer_parse_extension(peer_t *p, htsmsg_t *msg, uint8_t msgid,
 
 static void peer_send_extension_handshake(peer_t *p);
 
+static void peer_forget_pieces(peer_t *p);
+
 
 #define PEER_DBG_CONN     0x1
 #define PEER_DBG_DOWNLOAD 0x2
@@ -339,6 +341,7 @@ peer_shutdown(peer_t *p, int next_state, int resched)
   asyncio_timer_disarm(&p->p_ka_send_timer);
   asyncio_timer_disarm(&p->p_data_recv_timer);
 
+  peer_forget_pieces(p);
   free(p->p_piece_flags);
   p->p_piece_flags = NULL;
 
@@ -530,10 +533,33 @@ peer_have_piece(peer_t *p, uint32_t pid)
     return;
   p->p_piece_flags[pid] |= PIECE_HAVE;
   p->p_num_pieces_have++;
+  p->p_torrent->to_piece_avail[pid]++;
   assert(p->p_num_pieces_have <= p->p_torrent->to_num_pieces);
 }
 
 
+/**
+ * Forget what pieces the peer has (and remove it from the
+ * piece availability)
+ */
+static void
+peer_forget_pieces(peer_t *p)
+{
+  torrent_t *to = p->p_torrent;
+
+  if(p->p_piece_flags == NULL)
+    return;
+
+  for(int i = 0; i < to->to_num_pieces; i++) {
+    if(p->p_piece_flags[i] & PIECE_HAVE) {
+      p->p_piece_flags[i] &= ~PIECE_HAVE;
+      to->to_piece_avail[i]--;
+    }
+  }
+  p->p_num_pieces_have = 0;
+}
+
+
 /**
  *
  */
@@ -548,7 +574,7 @@ parse_bitfield(peer_t *p, const uint8_t *data, unsigned int len)
   if(p->p_piece_flags == NULL)
     p->p_piece_flags = calloc(1, to->to_num_pieces);
 
-  p->p_num_pieces_have = 0;
+  peer_forget_pieces(p);
   for(int i = 0; i < to->to_num_pieces; i++) {
     if(data[i / 8] & (0x80 >> (i & 0x7)))
       peer_have_piece(p, i);
@@ -650,10 +676,8 @@ recv_have_all(peer_t *p)
   if(p->p_piece_flags == NULL)
     p->p_piece_flags = calloc(1, to->to_num_pieces);
 
-  for(int i = 0; i < to->to_num_pieces; i++) {
-    p->p_piece_flags[i] |= PIECE_HAVE;
-  }
-  p->p_num_pieces_have = to->to_num_pieces;
+  for(int i = 0; i < to->to_num_pieces; i++)
+    peer_have_piece(p, i);
 
   peer_update_interest(to, p);
   if(p->p_peer_choking == 0)
@@ -1422,10 +1446,8 @@ peer_activate_pending_data(torrent_t *to)
       if(p->p_piece_flags == NULL)
         p->p_piece_flags = calloc(1, to->to_num_pieces);
 
-      for(int i = 0; i < to->to_num_pieces; i++) {
-        p->p_piece_flags[i] |= PIECE_HAVE;
-      }
-      p->p_num_pieces_have = to->to_num_pieces;
+      for(int i = 0; i < to->to_num_pieces; i++)
+        peer_have_piece(p, i);
     }
 
     if(p->p_pending_bitfield != NULL) {
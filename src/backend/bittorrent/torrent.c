@@ -35,6 +35,7 @@
 #include "usage.h"
 
 #define TORRENT_REQ_SIZE 16384
+#define TORRENT_MAX_MAPPED_PIECES 64
 
 //----------------------------------------------------------------
 
@@ -45,7 +46,11 @@ struct torrent_list torrents;
 static int torrent_pendings_signal;
 static int torrent_boot_periodic_signal;
 static int torrent_metainfo_signal;
-static int torrent_hash_thread_running;
+static int torrent_hash_threads;       // Running hasher threads
+static int torrent_hash_threads_idle;  // ... of which are waiting for work
+static int torrent_hash_max_threads;   // 0 = one per core
+static struct torrent_piece_queue torrent_hash_queue;
+static int torrent_hash_queue_len;
 
 hts_cond_t torrent_piece_hash_needed_cond;
 hts_cond_t torrent_piece_io_needed_cond;
@@ -376,6 +381,7 @@ torrent_destroy(torrent_t *to)
   buf_release(to->to_metainfo);
   free(to->to_cachefile_piece_map);
   free(to->to_cachefile_piece_map_inv);
+  free(to->to_piece_avail);
   free(to->to_piece_hashes);
   free(to->to_title);
   free(to);
@@ -490,7 +496,7 @@ torrent_receive_block(torrent_block_t *tb, const void *buf,
     // Piece complete
 
     tp->tp_complete = 1;
-    torrent_hash_wakeup();
+    torrent_piece_hash_enqueue(to, tp);
   }
   torrent_io_do_requests(to);
 }
@@ -676,6 +682,7 @@ torrent_parse_infodict(torrent_t *to, htsmsg_t *info,
   to->to_cachefile_piece_map_inv = malloc(mapsize);
   memset(to->to_cachefile_piece_map, 0xff, mapsize);
   memset(to->to_cachefile_piece_map_inv, 0xff, mapsize);
+  to->to_piece_avail = calloc(to->to_num_pieces, sizeof(uint16_t));
 
   to->to_piece_hashes = malloc(pieces_size);
   memcpy(to->to_piece_hashes, pieces_data, pieces_size);
@@ -817,6 +824,18 @@ torrent_piece_find(torrent_t *to, int piece_index)
 /**
  *
  */
+static int
+torrent_fh_last_piece(const torrent_t *to, const torrent_fh_t *tfh)
+{
+  const torrent_file_t *tf = tfh->tfh_file;
+  return (tf->tf_offset + MAX(tf->tf_size, 1) - 1) / to->to_piece_length;
+}
+
+
+/**
+ * A piece is needed by whoever is blocked reading it and by every
+ * reader that has it in its streaming window
+ */
 static void
 piece_update_deadline(torrent_t *to, torrent_piece_t *tp)
 {
@@ -825,6 +844,17 @@ piece_update_deadline(torrent_t *to, torrent_piece_t *tp)
   LIST_FOREACH(tfh, &tp->tp_active_fh, tfh_piece_link)
     deadline = MIN(tfh->tfh_deadline, deadline);
 
+  LIST_FOREACH(tfh, &to->to_fhs, tfh_torrent_link) {
+    if(!tfh->tfh_streaming || tp->tp_index > torrent_fh_last_piece(to, tfh))
+      continue;
+
+    deadline = MIN(torrent_picker_deadline(tfh->tfh_stream_offset,
+                                           tp->tp_index, to->to_piece_length,
+                                           tfh->tfh_read_rate,
+                                           tfh->tfh_deadline),
+                   deadline);
+  }
+
   if(tp->tp_deadline == deadline)
     return;
 
@@ -837,6 +867,57 @@ piece_update_deadline(torrent_t *to, torrent_piece_t *tp)
 
 
 
+/**
+ *
+ */
+void
+torrent_update_deadlines(torrent_t *to)
+{
+  torrent_piece_t *tp;
+  TAILQ_FOREACH(tp, &to->to_active_pieces, tp_link)
+    piece_update_deadline(to, tp);
+}
+
+
+/**
+ * Keep track of how fast the reader consumes data (only sequential
+ * reads count) and make sure all pieces in its window are active
+ */
+static void
+torrent_stream_update(torrent_t *to, torrent_fh_t *tfh, uint64_t offset,
+                      size_t size)
+{
+  const int64_t now = arch_get_ts();
+
+  if(!tfh->tfh_streaming || offset != tfh->tfh_next_offset) {
+    tfh->tfh_rate_time = now;
+    tfh->tfh_rate_bytes = 0;
+  } else if(now - tfh->tfh_rate_time >= 1000000) {
+    const int rate = tfh->tfh_rate_bytes * 1000000 /
+      (now - tfh->tfh_rate_time);
+    tfh->tfh_read_rate = tfh->tfh_read_rate ?
+      (tfh->tfh_read_rate * 3 + rate) / 4 : rate;
+    tfh->tfh_rate_time = now;
+    tfh->tfh_rate_bytes = 0;
+  }
+
+  tfh->tfh_rate_bytes += size;
+  tfh->tfh_streaming = 1;
+  tfh->tfh_stream_offset = offset;
+  tfh->tfh_next_offset = offset + size;
+
+  const int first = offset / to->to_piece_length;
+  const int last = MIN(first + torrent_picker_window(to->to_piece_length,
+                                                     tfh->tfh_read_rate),
+                       torrent_fh_last_piece(to, tfh) + 1);
+
+  for(int i = first; i < last; i++)
+    torrent_piece_find(to, i);
+
+  torrent_update_deadlines(to);
+}
+
+
 /**
  *
  */
@@ -850,11 +931,8 @@ torrent_load(torrent_t *to, void *buf, uint64_t offset, size_t size,
   int piece = offset        / to->to_piece_length;
   int piece_offset = offset % to->to_piece_length;
 
-  // Poor mans read-ahead
-  if(piece + 1 < to->to_num_pieces)
-    torrent_piece_find(to, piece + 1);
-  if(piece + 2 < to->to_num_pieces)
-    torrent_piece_find(to, piece + 2);
+  torrent_stream_update(to, tfh, offset, size);
+
   while(size > 0) {
 
     torrent_piece_t *tp = torrent_piece_find(to, piece);
@@ -960,43 +1038,56 @@ check_peer_bad(const torrent_piece_t *tp, const peer_t *p)
 
 
 /**
- *
+ * Peer expected to deliver a block of the given piece first, among
+ * those that are allowed to take it (see torrent_picker_peer_ok())
  */
 static peer_t *
-find_optimal_peer(torrent_t *to, const torrent_piece_t *tp)
+find_deadline_peer(torrent_t *to, const torrent_piece_t *tp, int64_t now)
 {
-  int best_score = INT32_MAX;
+  int best_delay = INT32_MAX;
+  int fastest = INT32_MAX;
   peer_t *best = NULL;
   peer_t *p;
 
+  LIST_FOREACH(p, &to->to_unchoked_peers, p_unchoked_link) {
+    if(p->p_block_delay == 0 || p->p_piece_flags == NULL ||
+       !(p->p_piece_flags[tp->tp_index] & PIECE_HAVE) ||
+       check_peer_bad(tp, p))
+      continue;
+
+    const int qdepth = MIN(p->p_active_requests, 9);
+    fastest = MIN(fastest, torrent_picker_peer_delay(p->p_bd, qdepth,
+                                                     p->p_block_delay));
+  }
+
   LIST_FOREACH(p, &to->to_unchoked_peers, p_unchoked_link) {
 
     if(p->p_piece_flags == NULL ||
        !(p->p_piece_flags[tp->tp_index] & PIECE_HAVE))
       continue;
 
-    if(check_peer_bad(tp, p))
+    if(p->p_active_requests >= p->p_maxq)
       continue;
 
-    int score;
+    if(check_peer_bad(tp, p))
+      continue;
 
-    if(p->p_block_delay == 0) {
-      // Delay not known yet
-      
-      if(p->p_active_requests) {
-	// We have a request already, skip this peer
-	continue;
-      }
+    if(p->p_block_delay == 0 && p->p_active_requests) {
+      // Delay not known yet and we have a request already, skip this peer
+      continue;
+    }
 
-      score = 0; // Assume it's super fast
-    } else {
+    // 0 if delay is not known yet, assume it's super fast
+    const int delay = torrent_picker_peer_delay(p->p_bd, p->p_active_requests,
+                                                p->p_block_delay);
 
-      score = p->p_block_delay;
-    }
+    if(!torrent_picker_peer_ok(now, tp->tp_deadline, delay, fastest,
+                               p->p_active_requests, p->p_maxq))
+      continue;
 
-    if(best == NULL || score < best_score) {
+    if(best == NULL || delay < best_delay) {
       best = p;
-      best_score = score;
+      best_delay = delay;
     }
   }
   return best;
@@ -1055,9 +1146,9 @@ serve_waiting_blocks(torrent_t *to, torrent_piece_t *tp, int optimal,
     next = LIST_NEXT(tb, tb_piece_link);
 
     if(optimal) {
-      peer_t *p = find_optimal_peer(to, tp);
+      peer_t *p = find_deadline_peer(to, tp, now);
 
-      if(p == NULL || p->p_active_requests >= p->p_maxq)
+      if(p == NULL)
 	break;
 
       add_request(tb, p, now);
@@ -1128,7 +1219,7 @@ find_faster_peer(torrent_t *to, const torrent_block_t *tb,
  */
 static void
 check_active_requests(torrent_t *to, torrent_piece_t *tp,
-		      int64_t deadline, int64_t now)
+		      int64_t deadline, int64_t now, int endgame)
 {
   torrent_block_t *tb, *next;
 
@@ -1146,19 +1237,18 @@ check_active_requests(torrent_t *to, torrent_piece_t *tp,
     peer_t *curpeer = cur->tr_peer;
     assert(curpeer != NULL);
 
-    int64_t eta, delay = 0;
-
-    eta = cur->tr_send_time + curpeer->p_block_delay;
-    if(eta < now) {
-      // Didn't arrive on time, assume the delay will worse
-      // the longer it takes
-      delay = now - eta;
-      eta += delay * 2;
-    }
+    int num_requests = 0;
+    const torrent_request_t *tr;
+    LIST_FOREACH(tr, &tb->tb_requests, tr_block_link)
+      num_requests++;
 
-    if(eta < deadline)
+    if(!torrent_picker_want_dup(cur->tr_send_time, curpeer->p_block_delay,
+                                num_requests, deadline, now, endgame))
       continue; // Nothing to worry about
 
+    const int64_t eta = torrent_picker_block_eta(cur->tr_send_time,
+                                                 curpeer->p_block_delay, now);
+
     // Now, let's see if we can find a peer that we think can beat
     // the current (offsetted) ETA for this block
 
@@ -1169,9 +1259,9 @@ check_active_requests(torrent_t *to, torrent_piece_t *tp,
 #if 0
     if(0)
     printf("Block %s: Added dup request on peer %s bd:%d "
-	   "computed ETA:%ld delay:%ld\n",
+	   "computed ETA:%ld\n",
 	   block_name(tb), p->p_name, p->p_block_delay,
-	   eta - async_now, delay);
+	   eta - async_now);
 #endif
 
     add_request(tb, p, now);
@@ -1196,7 +1286,8 @@ torrent_piece_release(torrent_piece_t *tp)
 
   torrent_piece_remove_contributors(tp, 0);
 
-  free(tp->tp_data);
+  if(!tp->tp_mapped)
+    free(tp->tp_data);
   free(tp);
 }
 
@@ -1211,7 +1302,10 @@ torrent_piece_destroy(torrent_t *to, torrent_piece_t *tp)
   assert(LIST_FIRST(&tp->tp_waiting_blocks) == NULL);
   assert(LIST_FIRST(&tp->tp_sent_blocks) == NULL);
   assert(LIST_FIRST(&tp->tp_sendreqs) == NULL);
-  to->to_active_pieces_mem -= tp->tp_piece_length;
+  if(tp->tp_mapped)
+    to->to_mapped_pieces--;
+  else
+    to->to_active_pieces_mem -= tp->tp_piece_length;
   to->to_num_active_pieces--;
 
   TAILQ_REMOVE(&to->to_active_pieces, tp, tp_link);
@@ -1232,9 +1326,18 @@ flush_active_pieces(torrent_t *to)
   for(tp = TAILQ_FIRST(&to->to_active_pieces); tp != NULL; tp = next) {
     next = TAILQ_NEXT(tp, tp_link);
 
-    if(to->to_active_pieces_mem <= 32 * 1024 * 1024)
+    // Mapped pieces don't use any memory but they pin their slot
+    // in the cache file so we don't keep too many of them around
+    const int mem_ok = to->to_active_pieces_mem <= 32 * 1024 * 1024;
+    const int map_ok = to->to_mapped_pieces <=
+      MIN(TORRENT_MAX_MAPPED_PIECES, to->to_cachefile_slots / 2);
+
+    if(mem_ok && map_ok)
       break;
 
+    if(tp->tp_mapped ? map_ok : mem_ok)
+      continue;
+
     if(tp->tp_load_req)
       continue;
 
@@ -1251,6 +1354,11 @@ flush_active_pieces(torrent_t *to)
        to->to_active_pieces_mem <= 64 * 1024 * 1024)
       continue;
 
+    // Not written to the cache yet
+    if(to->to_cachefile != NULL && tp->tp_hash_ok && !tp->tp_on_disk &&
+       !tp->tp_disk_fail && to->to_active_pieces_mem <= 64 * 1024 * 1024)
+      continue;
+
     torrent_piece_destroy(to, tp);
   }
 }
@@ -1386,19 +1494,101 @@ torrent_io_do_requests(torrent_t *to)
 #endif
 
 
+  // Endgame is when every block that has a deadline has been requested
+
+  int endgame = 1;
+  LIST_FOREACH(tp, &to->to_serve_order, tp_serve_link) {
+    if(tp->tp_deadline == INT64_MAX)
+      break;
+    if(LIST_FIRST(&tp->tp_waiting_blocks) != NULL) {
+      endgame = 0;
+      break;
+    }
+  }
+
   LIST_FOREACH(tp, &to->to_serve_order, tp_serve_link) {
     if(tp->tp_deadline == INT64_MAX)
       break;
-    check_active_requests(to, tp, tp->tp_deadline, now);
+    check_active_requests(to, tp, tp->tp_deadline, now, endgame);
   }
 
   LIST_FOREACH(tp, &to->to_serve_order, tp_serve_link) {
-    //    deadline = MIN(tp->tp_deadline, deadline);
+    if(tp->tp_deadline == INT64_MAX)
+      break;
     serve_waiting_blocks(to, tp, 1, now);
   }
 
+  // Pieces nobody is waiting for only get what's left
+
   LIST_FOREACH(tp, &to->to_serve_order, tp_serve_link)
-    serve_waiting_blocks(to, tp, 0, now);
+    if(tp->tp_deadline == INT64_MAX)
+      serve_waiting_blocks(to, tp, 0, now);
+}
+
+
+/**
+ *
+ */
+static int
+torrent_piece_skip_background(void *opaque, int piece)
+{
+  torrent_t *to = opaque;
+  torrent_piece_t *tp;
+
+  if(to->to_cachefile_piece_map[piece] != -1)
+    return 1;
+
+  TAILQ_FOREACH(tp, &to->to_active_pieces, tp_link)
+    if(tp->tp_index == piece)
+      return 1;
+  return 0;
+}
+
+
+/**
+ * Once everything in the streaming windows has been requested we
+ * fetch the rarest pieces further ahead in the files being read.
+ * Only makes sense if we have somewhere to store them
+ */
+static void
+torrent_pick_background(torrent_t *to)
+{
+  torrent_piece_t *tp;
+  int inflight = 0;
+
+  if(to->to_cachefile == NULL || to->to_piece_avail == NULL)
+    return;
+
+  LIST_FOREACH(tp, &to->to_serve_order, tp_serve_link) {
+    if(tp->tp_deadline == INT64_MAX) {
+      if(LIST_FIRST(&tp->tp_waiting_blocks) != NULL ||
+         LIST_FIRST(&tp->tp_sent_blocks) != NULL)
+        inflight++;
+    } else if(LIST_FIRST(&tp->tp_waiting_blocks) != NULL) {
+      return;
+    }
+  }
+
+  torrent_fh_t *tfh;
+  LIST_FOREACH(tfh, &to->to_fhs, tfh_torrent_link) {
+    if(!tfh->tfh_streaming)
+      continue;
+
+    const int first = tfh->tfh_stream_offset / to->to_piece_length +
+      torrent_picker_window(to->to_piece_length, tfh->tfh_read_rate);
+    const int last = torrent_fh_last_piece(to, tfh);
+
+    while(inflight < TORRENT_PICKER_BACKGROUND &&
+          to->to_active_pieces_mem < 24 * 1024 * 1024) {
+      const int piece =
+        torrent_picker_rarest(to->to_piece_avail, first, last,
+                              torrent_piece_skip_background, to);
+      if(piece == -1)
+        break;
+      torrent_piece_find(to, piece);
+      inflight++;
+    }
+  }
 }
 
 
@@ -1421,6 +1611,14 @@ torrent_reload_corrupt_pieces(torrent_t *to)
 
       if(tp->tp_on_disk) {
         tp->tp_on_disk = 0;
+
+        if(tp->tp_mapped) {
+          // Need a buffer of our own to download into
+          tp->tp_mapped = 0;
+          tp->tp_data = malloc(to->to_piece_length);
+          to->to_active_pieces_mem += tp->tp_piece_length;
+          to->to_mapped_pieces--;
+        }
         /**
          * This is pretty easy, we just create and enqueue the requests
          * (we never did this in the first place if we figured we
@@ -1602,6 +1800,7 @@ torrent_periodic_one(torrent_t *to, int second)
   }
 
   flush_active_pieces(to);
+  torrent_pick_background(to);
 
   if(to->to_last_unchoke_check + 5 < second) {
     to->to_last_unchoke_check = second;
@@ -1707,52 +1906,69 @@ torrent_piece_verify_hash(torrent_t *to, torrent_piece_t *tp)
 
 
 /**
- *
+ * Hasher threads are started on demand (up to one per core) and exit
+ * after being idle for a minute
  */
 static void *
 bt_hash_thread(void *aux)
 {
-  torrent_t *to;
+  torrent_piece_t *tp;
 
   hts_mutex_lock(&bittorrent_mutex);
 
   while(1) {
 
-  restart:
-
-    LIST_FOREACH(to, &torrents, to_link) {
-      torrent_piece_t *tp;
-      TAILQ_FOREACH(tp, &to->to_active_pieces, tp_link) {
-	if(tp->tp_complete && !tp->tp_hash_computed) {
-	  torrent_piece_verify_hash(to, tp);
-          /**
-           * 'to' may be invalid here because we have unlocked so restart
-           * from begining
-           */
-	  goto restart;
-	}
-      }
+    if((tp = TAILQ_FIRST(&torrent_hash_queue)) == NULL) {
+      torrent_hash_threads_idle++;
+      int timeout = hts_cond_wait_timeout(&torrent_piece_hash_needed_cond,
+                                          &bittorrent_mutex, 60000);
+      torrent_hash_threads_idle--;
+      if(timeout && TAILQ_FIRST(&torrent_hash_queue) == NULL)
+        break;
+      continue;
     }
 
-    if(hts_cond_wait_timeout(&torrent_piece_hash_needed_cond,
-			     &bittorrent_mutex, 60000))
-      break;
+    TAILQ_REMOVE(&torrent_hash_queue, tp, tp_hash_link);
+    torrent_hash_queue_len--;
+    torrent_t *to = tp->tp_hash_torrent;
+    tp->tp_hash_torrent = NULL;
+
+    if(tp->tp_complete && !tp->tp_hash_computed)
+      torrent_piece_verify_hash(to, tp);
+
+    torrent_piece_release(tp);
+    torrent_release(to);
   }
 
-  torrent_hash_thread_running = 0;
+  torrent_hash_threads--;
   hts_mutex_unlock(&bittorrent_mutex);
   return NULL;
 }
 
 
 /**
+ * Queue a completed piece for hash verification
  *
+ * Must be called with bittorrent_mutex held
  */
 void
-torrent_hash_wakeup(void)
+torrent_piece_hash_enqueue(torrent_t *to, torrent_piece_t *tp)
 {
-  if(!torrent_hash_thread_running) {
-    torrent_hash_thread_running = 1;
+  if(tp->tp_hash_torrent != NULL)
+    return;
+
+  torrent_retain(to);
+  tp->tp_refcount++;
+  tp->tp_hash_torrent = to;
+  TAILQ_INSERT_TAIL(&torrent_hash_queue, tp, tp_hash_link);
+  torrent_hash_queue_len++;
+
+  const int max_threads = torrent_hash_max_threads ?:
+    MAX(1, gconf.concurrency);
+
+  if(torrent_hash_queue_len > torrent_hash_threads_idle &&
+     torrent_hash_threads < max_threads) {
+    torrent_hash_threads++;
     hts_thread_create_detached("bthasher", bt_hash_thread, NULL,
 			       THREAD_PRIO_BGTASK);
   }
@@ -1809,6 +2025,7 @@ torrent_early_init(void)
   torrent_boot_periodic_signal = asyncio_add_worker(torrent_boot_periodic);
   torrent_metainfo_signal = asyncio_add_worker(torrent_check_metainfo);
 
+  TAILQ_INIT(&torrent_hash_queue);
   hts_cond_init(&torrent_piece_hash_needed_cond, &bittorrent_mutex);
   hts_cond_init(&torrent_piece_io_needed_cond, &bittorrent_mutex);
   hts_cond_init(&torrent_piece_verified_cond, &bittorrent_mutex);
@@ -1831,3 +2048,98 @@ torrent_asyncio_init(void)
 }
 
 INITME(INIT_GROUP_ASYNCIO, torrent_asyncio_init, NULL, 0);
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Push a set of synthetic pieces through the hash queue with an
+ * increasing number of hasher threads
+ */
+static void
+torrent_hash_bench(void)
+{
+  const int num_pieces = 256;
+  const int piece_length = 512 * 1024;
+  torrent_piece_t *pieces[num_pieces];
+  torrent_t *to = calloc(1, sizeof(torrent_t));
+  uint32_t seed = 1;
+
+  to->to_title = strdup("hashbench");
+  to->to_refcount = 1;
+  to->to_num_pieces = num_pieces;
+  to->to_piece_length = piece_length;
+  to->to_piece_hashes = malloc(num_pieces * 20);
+
+  for(int i = 0; i < num_pieces; i++) {
+    torrent_piece_t *tp = calloc(1, sizeof(torrent_piece_t));
+    tp->tp_index = i;
+    tp->tp_refcount = 1;
+    tp->tp_piece_length = piece_length;
+    tp->tp_data = malloc(piece_length);
+    for(int j = 0; j < piece_length; j++) {
+      seed = seed * 1664525 + 1013904223;
+      tp->tp_data[j] = seed >> 24;
+    }
+    sha1_decl(shactx);
+    sha1_init(shactx);
+    sha1_update(shactx, tp->tp_data, piece_length);
+    sha1_final(shactx, to->to_piece_hashes + i * 20);
+    pieces[i] = tp;
+  }
+
+  const int max_threads = MAX(1, gconf.concurrency);
+  int64_t single = 0;
+
+  hts_mutex_lock(&bittorrent_mutex);
+
+  for(int threads = 1; ; threads = MIN(threads * 2, max_threads)) {
+    torrent_hash_max_threads = threads;
+
+    for(int i = 0; i < num_pieces; i++) {
+      pieces[i]->tp_complete = 1;
+      pieces[i]->tp_hash_computed = 0;
+    }
+
+    int64_t ts = arch_get_ts();
+
+    for(int i = 0; i < num_pieces; i++)
+      torrent_piece_hash_enqueue(to, pieces[i]);
+
+    int done = 0;
+    while(done < num_pieces) {
+      hts_cond_wait(&torrent_piece_verified_cond, &bittorrent_mutex);
+      for(; done < num_pieces && pieces[done]->tp_hash_computed; done++) {}
+    }
+
+    ts = arch_get_ts() - ts;
+    if(threads == 1)
+      single = ts;
+
+    int ok = 0;
+    for(int i = 0; i < num_pieces; i++)
+      ok += pieces[i]->tp_hash_ok;
+
+    TRACE(TRACE_INFO, "bench",
+          "bthash: %2d threads %7.1f MB/s %5.2fx  %d/%d pieces OK",
+          threads,
+          (double)num_pieces * piece_length / ts,
+          (double)single / ts, ok, num_pieces);
+
+    if(threads == max_threads)
+      break;
+  }
+
+  torrent_hash_max_threads = 0;
+
+  for(int i = 0; i < num_pieces; i++)
+    torrent_piece_release(pieces[i]);
+
+  hts_mutex_unlock(&bittorrent_mutex);
+
+  free(to->to_piece_hashes);
+  free(to->to_title);
+  free(to);
+}
+
+BENCHMARK("bthash", torrent_hash_bench);
+#endif
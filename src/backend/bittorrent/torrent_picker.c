@@ -0,0 +1,790 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "misc/minmax.h"
+#include "bittorrent.h"
+
+/**
+ * Streaming piece picker
+ *
+ * The pieces just ahead of the read position form a window. Each piece
+ * in the window gets a deadline based on when the reader is expected
+ * to get there. Outside the window we fetch the rarest pieces of the
+ * file first, but only with whatever request slots are left over.
+ *
+ * Nothing in here touches torrent_t or peer_t so the same policy can
+ * be driven by the simulator at the bottom of this file.
+ */
+
+#define TORRENT_PICKER_WINDOW_TIME   20     // Seconds of playback
+#define TORRENT_PICKER_WINDOW_BYTES  (16 * 1024 * 1024)
+#define TORRENT_PICKER_DEFAULT_RATE  1000000  // Bytes/s if unknown
+
+
+/**
+ * Number of pieces in the high priority window
+ */
+int
+torrent_picker_window(int piece_length, int rate)
+{
+  if(rate <= 0)
+    rate = TORRENT_PICKER_DEFAULT_RATE;
+
+  const int64_t bytes = MIN((int64_t)rate * TORRENT_PICKER_WINDOW_TIME,
+                            TORRENT_PICKER_WINDOW_BYTES);
+  return MAX(2, bytes / piece_length);
+}
+
+
+/**
+ * Deadline for a piece given that the byte at 'offset' is needed at
+ * 'base'. Returns INT64_MAX for pieces outside the window
+ */
+int64_t
+torrent_picker_deadline(uint64_t offset, int piece, int piece_length,
+                        int rate, int64_t base)
+{
+  const int first = offset / piece_length;
+
+  if(piece < first || piece >= first + torrent_picker_window(piece_length,
+                                                              rate))
+    return INT64_MAX;
+
+  if(rate <= 0)
+    rate = TORRENT_PICKER_DEFAULT_RATE;
+
+  const uint64_t start = (uint64_t)piece * piece_length;
+  if(start <= offset)
+    return base;
+  return base + (int64_t)(start - offset) * 1000000 / rate;
+}
+
+
+/**
+ * When a block is expected to arrive. If it's overdue we assume
+ * it will get worse the longer it takes
+ */
+int64_t
+torrent_picker_block_eta(int64_t send_time, int block_delay, int64_t now)
+{
+  int64_t eta = send_time + block_delay;
+  if(eta < now)
+    eta += (now - eta) * 2;
+  return eta;
+}
+
+
+/**
+ * Returns 1 if an outstanding block should be requested from
+ * another peer as well.
+ *
+ * In endgame (nothing left to request in the window) any block that
+ * is overdue is duplicated, otherwise only those that won't make
+ * their deadline
+ */
+int
+torrent_picker_want_dup(int64_t send_time, int block_delay,
+                        int num_requests, int64_t deadline, int64_t now,
+                        int endgame)
+{
+  if(num_requests >= TORRENT_PICKER_MAX_REQUESTS)
+    return 0;
+
+  if(torrent_picker_block_eta(send_time, block_delay, now) >= deadline)
+    return 1;
+
+  return endgame && send_time + block_delay < now;
+}
+
+
+/**
+ * Expected delay of a request sent to a peer that already has 'qdepth'
+ * requests outstanding. 'bd' holds the delay measured per queue depth
+ * (0 where unknown), if we have nothing for this depth we extrapolate
+ * from the closest shallower one
+ */
+int
+torrent_picker_peer_delay(const int *bd, int qdepth, int block_delay)
+{
+  if(bd[qdepth])
+    return bd[qdepth];
+
+  for(int i = qdepth - 1; i >= 0; i--)
+    if(bd[i])
+      return (int64_t)bd[i] * (qdepth + 1) / (i + 1);
+
+  return block_delay;
+}
+
+
+/**
+ * Returns 1 if a block with the given deadline may be sent to a peer
+ * with expected delay 'delay' and 'qdepth' requests outstanding.
+ *
+ * Blocks that will make it in time only get half of the peer's queue,
+ * the rest is kept for blocks that are in a hurry. Those in turn are
+ * only sent to a peer that is as fast as the fastest one we know of
+ * ('fastest' is its expected delay), otherwise they would end up
+ * behind a long queue on a slow peer just because the fast one
+ * happened to be busy for a moment
+ */
+int
+torrent_picker_peer_ok(int64_t now, int64_t deadline, int delay, int fastest,
+                       int qdepth, int maxq)
+{
+  if(now + delay <= deadline)
+    return qdepth < MAX(1, maxq / 2);
+  return delay <= fastest;
+}
+
+
+/**
+ * Rarest piece in [first, last] that some peer has. Ties go to the
+ * lowest index (ie, closest to the reader). 'skip' is only asked about
+ * pieces that would otherwise be picked
+ */
+int
+torrent_picker_rarest(const uint16_t *avail, int first, int last,
+                      int (*skip)(void *opaque, int piece), void *opaque)
+{
+  int best = -1;
+  int best_avail = INT32_MAX;
+
+  for(int i = first; i <= last; i++) {
+    if(avail[i] == 0 || avail[i] >= best_avail)
+      continue;
+    if(skip(opaque, i))
+      continue;
+    best = i;
+    best_avail = avail[i];
+    if(best_avail == 1)
+      break;
+  }
+  return best;
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Playback simulator
+ *
+ * A single reader plays a file at constant bitrate. Fake peers each
+ * have a bandwidth, a round trip latency and a chance of stalling for
+ * a while (as a congested TCP connection would do). Requests to a peer
+ * are served in order. Cancelled requests still use up the peer's
+ * bandwidth so duplicates are not free.
+ *
+ * The 'legacy' policy is what torrent_load() used to do: the piece
+ * being read has a deadline and the next two are fetched when
+ * there's nothing better to do.
+ */
+
+#define SIM_STEP          10000       // µs
+#define SIM_PIECE_LENGTH  (512 * 1024)
+#define SIM_BLOCK_LENGTH  16384
+#define SIM_BLOCKS        (SIM_PIECE_LENGTH / SIM_BLOCK_LENGTH)
+#define SIM_MAXQ          10
+#define SIM_RING          256
+#define SIM_HICCUP        2000000     // µs
+#define SIM_START_BUFFER  2           // Seconds buffered before playing
+#define SIM_MAX_BUFFER    30          // Seconds the demuxer reads ahead
+
+typedef struct sim_peer_conf {
+  int bw;          // kB/s
+  int latency;     // ms, round trip
+  int hiccup;      // Per mille of requests that stall
+  int have;        // Percent of pieces
+} sim_peer_conf_t;
+
+typedef struct sim_scenario {
+  const char *name;
+  int bitrate;     // kB/s
+  int num_pieces;
+  const sim_peer_conf_t *peers;
+  int num_peers;
+} sim_scenario_t;
+
+typedef struct sim_request {
+  int sr_block;
+  int64_t sr_send;
+  int64_t sr_arrive;
+  int sr_cancelled;
+  int sr_qdepth;
+} sim_request_t;
+
+typedef struct sim_peer {
+  const sim_peer_conf_t *sp_conf;
+  uint8_t *sp_have;
+  int64_t sp_busy;     // Until when the uplink is busy
+  int sp_active;       // Outstanding (non cancelled) requests
+  int sp_delay;        // Like p_block_delay
+  int sp_bd[SIM_MAXQ]; // Like p_bd
+  sim_request_t sp_ring[SIM_RING];
+  int sp_head;
+  int sp_len;
+} sim_peer_t;
+
+typedef struct sim_block {
+  uint8_t sb_state;    // 0 = waiting, 1 = requested, 2 = received
+  uint8_t sb_requests;
+  uint8_t sb_peer;     // Most recent request
+  int64_t sb_send;
+} sim_block_t;
+
+typedef struct sim_piece {
+  int spc_received;
+  int64_t spc_deadline;
+  uint8_t spc_active;
+  uint8_t spc_complete;
+} sim_piece_t;
+
+typedef struct sim_result {
+  int64_t startup;
+  int stalls;
+  int64_t stall_time;
+  int64_t downloaded;
+  int64_t wasted;
+  int64_t duration;
+} sim_result_t;
+
+typedef struct sim {
+  const sim_scenario_t *s_sc;
+  int s_streaming;
+  uint32_t s_seed;
+  int64_t s_now;
+
+  sim_peer_t *s_peers;
+  sim_piece_t *s_pieces;
+  sim_block_t *s_blocks;
+  uint16_t *s_avail;
+
+  uint64_t s_rpos;       // Read by demuxer
+  uint64_t s_ppos;       // Played
+  int s_rate;            // Measured read rate
+  uint64_t s_rate_pos;
+  int64_t s_rate_time;
+
+  sim_result_t s_res;
+} sim_t;
+
+
+static uint32_t
+sim_rand(sim_t *s)
+{
+  s->s_seed = s->s_seed * 1664525 + 1013904223;
+  return s->s_seed >> 8;
+}
+
+
+/**
+ *
+ */
+static void
+sim_request(sim_t *s, int block, int peer)
+{
+  sim_peer_t *sp = &s->s_peers[peer];
+  sim_block_t *sb = &s->s_blocks[block];
+
+  if(sp->sp_len == SIM_RING)
+    return;
+
+  int64_t start = MAX(sp->sp_busy, s->s_now + sp->sp_conf->latency * 500);
+  if(sim_rand(s) % 1000 < sp->sp_conf->hiccup)
+    start += SIM_HICCUP;
+  sp->sp_busy = start + SIM_BLOCK_LENGTH * 1000LL / sp->sp_conf->bw;
+
+  sim_request_t *sr = &sp->sp_ring[(sp->sp_head + sp->sp_len) % SIM_RING];
+  sr->sr_block = block;
+  sr->sr_send = s->s_now;
+  sr->sr_arrive = sp->sp_busy + sp->sp_conf->latency * 500;
+  sr->sr_cancelled = 0;
+  sr->sr_qdepth = sp->sp_active;
+  sp->sp_len++;
+  sp->sp_active++;
+
+  sb->sb_state = 1;
+  sb->sb_requests++;
+  sb->sb_peer = peer;
+  sb->sb_send = s->s_now;
+}
+
+
+/**
+ *
+ */
+static void
+sim_cancel(sim_t *s, int block)
+{
+  for(int i = 0; i < s->s_sc->num_peers; i++) {
+    sim_peer_t *sp = &s->s_peers[i];
+    for(int j = 0; j < sp->sp_len; j++) {
+      sim_request_t *sr = &sp->sp_ring[(sp->sp_head + j) % SIM_RING];
+      if(sr->sr_block == block && !sr->sr_cancelled) {
+        sr->sr_cancelled = 1;
+        sp->sp_active--;
+      }
+    }
+  }
+}
+
+
+/**
+ *
+ */
+static void
+sim_deliver(sim_t *s)
+{
+  for(int i = 0; i < s->s_sc->num_peers; i++) {
+    sim_peer_t *sp = &s->s_peers[i];
+
+    while(sp->sp_len && sp->sp_ring[sp->sp_head].sr_arrive <= s->s_now) {
+      const sim_request_t *sr = &sp->sp_ring[sp->sp_head];
+      sp->sp_head = (sp->sp_head + 1) % SIM_RING;
+      sp->sp_len--;
+
+      if(sr->sr_cancelled) {
+        s->s_res.wasted += SIM_BLOCK_LENGTH;
+        continue;
+      }
+
+      sp->sp_active--;
+      const int delay = sr->sr_arrive - sr->sr_send;
+      sp->sp_delay = sp->sp_delay ? (sp->sp_delay * 7 + delay) / 8 : delay;
+      int *bd = &sp->sp_bd[sr->sr_qdepth];
+      *bd = *bd ? (*bd * 7 + delay) / 8 : delay;
+
+      sim_block_t *sb = &s->s_blocks[sr->sr_block];
+      sb->sb_state = 2;
+      s->s_res.downloaded += SIM_BLOCK_LENGTH;
+      sim_cancel(s, sr->sr_block);
+
+      sim_piece_t *spc = &s->s_pieces[sr->sr_block / SIM_BLOCKS];
+      spc->spc_received++;
+      if(spc->spc_received == SIM_BLOCKS)
+        spc->spc_complete = 1;
+    }
+  }
+}
+
+
+/**
+ * What find_optimal_peer() used to do, for the legacy policy
+ */
+static int
+sim_optimal_peer(sim_t *s, int piece)
+{
+  int best = -1, best_score = INT32_MAX;
+
+  for(int i = 0; i < s->s_sc->num_peers; i++) {
+    const sim_peer_t *sp = &s->s_peers[i];
+    if(!sp->sp_have[piece])
+      continue;
+
+    int score = sp->sp_delay;
+    if(score == 0 && sp->sp_active)
+      continue;
+
+    if(best == -1 || score < best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+
+/**
+ * Same as find_deadline_peer()
+ */
+static int
+sim_deadline_peer(sim_t *s, int piece, int64_t deadline)
+{
+  int best = -1, best_delay = INT32_MAX, fastest = INT32_MAX;
+
+  for(int i = 0; i < s->s_sc->num_peers; i++) {
+    const sim_peer_t *sp = &s->s_peers[i];
+    if(sp->sp_have[piece] && sp->sp_delay)
+      fastest = MIN(fastest,
+                    torrent_picker_peer_delay(sp->sp_bd,
+                                              MIN(sp->sp_active, SIM_MAXQ - 1),
+                                              sp->sp_delay));
+  }
+
+  for(int i = 0; i < s->s_sc->num_peers; i++) {
+    const sim_peer_t *sp = &s->s_peers[i];
+    if(!sp->sp_have[piece] || sp->sp_active >= SIM_MAXQ)
+      continue;
+
+    if(sp->sp_delay == 0 && sp->sp_active)
+      continue;
+
+    const int delay = torrent_picker_peer_delay(sp->sp_bd, sp->sp_active,
+                                                sp->sp_delay);
+    if(!torrent_picker_peer_ok(s->s_now, deadline, delay, fastest,
+                               sp->sp_active, SIM_MAXQ))
+      continue;
+
+    if(delay < best_delay) {
+      best = i;
+      best_delay = delay;
+    }
+  }
+  return best;
+}
+
+
+/**
+ * Same as find_any_peer()
+ */
+static int
+sim_any_peer(sim_t *s, int piece)
+{
+  for(int i = 0; i < s->s_sc->num_peers; i++) {
+    const sim_peer_t *sp = &s->s_peers[i];
+    if(sp->sp_have[piece] && sp->sp_active < SIM_MAXQ / 2)
+      return i;
+  }
+  return -1;
+}
+
+
+/**
+ * Same as find_faster_peer()
+ */
+static int
+sim_faster_peer(sim_t *s, int block, int64_t eta)
+{
+  const int piece = block / SIM_BLOCKS;
+  int best = -1;
+
+  for(int i = 0; i < s->s_sc->num_peers; i++) {
+    const sim_peer_t *sp = &s->s_peers[i];
+    if(!sp->sp_have[piece] || sp->sp_delay == 0 || sp->sp_active >= SIM_MAXQ ||
+       i == s->s_blocks[block].sb_peer)
+      continue;
+
+    const int64_t t = s->s_now + sp->sp_delay * 2;
+    if(t < eta) {
+      eta = t;
+      best = i;
+    }
+  }
+  return best;
+}
+
+
+static int
+sim_skip(void *opaque, int piece)
+{
+  const sim_t *s = opaque;
+  return s->s_pieces[piece].spc_active || s->s_pieces[piece].spc_complete;
+}
+
+
+/**
+ * Pick pieces, assign deadlines and send requests,
+ * mirrors torrent_io_do_requests()
+ */
+static void
+sim_schedule(sim_t *s, int64_t base)
+{
+  const sim_scenario_t *sc = s->s_sc;
+  const int playhead = s->s_rpos / SIM_PIECE_LENGTH;
+  int order[64];
+  int n = 0;
+
+  if(playhead >= sc->num_pieces)
+    return;
+
+  if(s->s_streaming) {
+    const int window = torrent_picker_window(SIM_PIECE_LENGTH, s->s_rate);
+    const int last = MIN(playhead + window, sc->num_pieces) - 1;
+
+    for(int i = 0; i < sc->num_pieces; i++) {
+      sim_piece_t *spc = &s->s_pieces[i];
+      spc->spc_deadline = torrent_picker_deadline(s->s_rpos, i,
+                                                  SIM_PIECE_LENGTH,
+                                                  s->s_rate, base);
+      if(spc->spc_deadline != INT64_MAX)
+        spc->spc_active = 1;
+    }
+
+    int background = 0;
+    for(int i = last + 1; i < sc->num_pieces; i++)
+      if(s->s_pieces[i].spc_active && !s->s_pieces[i].spc_complete)
+        background++;
+
+    for(int i = playhead; i <= last; i++)
+      for(int b = 0; b < SIM_BLOCKS; b++)
+        if(s->s_blocks[i * SIM_BLOCKS + b].sb_state == 0)
+          background = TORRENT_PICKER_BACKGROUND;
+
+    while(background < TORRENT_PICKER_BACKGROUND) {
+      int i = torrent_picker_rarest(s->s_avail, last + 1, sc->num_pieces - 1,
+                                    sim_skip, s);
+      if(i == -1)
+        break;
+      s->s_pieces[i].spc_active = 1;
+      background++;
+    }
+  } else {
+    for(int i = playhead; i < MIN(playhead + 3, sc->num_pieces); i++) {
+      s->s_pieces[i].spc_active = 1;
+      s->s_pieces[i].spc_deadline = i == playhead ? base : INT64_MAX;
+    }
+  }
+
+  // Active, incomplete pieces in deadline order
+
+  for(int i = 0; i < sc->num_pieces && n < 64; i++) {
+    const sim_piece_t *spc = &s->s_pieces[i];
+    if(!spc->spc_active || spc->spc_complete)
+      continue;
+    int j = n++;
+    while(j > 0 &&
+          s->s_pieces[order[j - 1]].spc_deadline > spc->spc_deadline) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+
+  int endgame = s->s_streaming;
+  for(int k = 0; k < n && s->s_pieces[order[k]].spc_deadline != INT64_MAX; k++)
+    for(int b = 0; b < SIM_BLOCKS; b++)
+      if(s->s_blocks[order[k] * SIM_BLOCKS + b].sb_state == 0)
+        endgame = 0;
+
+  for(int k = 0; k < n; k++) {
+    const sim_piece_t *spc = &s->s_pieces[order[k]];
+    if(spc->spc_deadline == INT64_MAX)
+      break;
+
+    for(int b = 0; b < SIM_BLOCKS; b++) {
+      const int block = order[k] * SIM_BLOCKS + b;
+      const sim_block_t *sb = &s->s_blocks[block];
+      if(sb->sb_state != 1)
+        continue;
+
+      const int delay = s->s_peers[sb->sb_peer].sp_delay;
+      if(!torrent_picker_want_dup(sb->sb_send, delay,
+                                  s->s_streaming ? sb->sb_requests : 0,
+                                  spc->spc_deadline, s->s_now, endgame))
+        continue;
+
+      const int p = sim_faster_peer(s, block,
+                                    torrent_picker_block_eta(sb->sb_send,
+                                                             delay, s->s_now));
+      if(p != -1)
+        sim_request(s, block, p);
+    }
+  }
+
+  for(int k = 0; k < n; k++) {
+    if(s->s_streaming && s->s_pieces[order[k]].spc_deadline == INT64_MAX)
+      break;
+    for(int b = 0; b < SIM_BLOCKS; b++) {
+      const int block = order[k] * SIM_BLOCKS + b;
+      if(s->s_blocks[block].sb_state != 0)
+        continue;
+      const int p = s->s_streaming ?
+        sim_deadline_peer(s, order[k], s->s_pieces[order[k]].spc_deadline) :
+        sim_optimal_peer(s, order[k]);
+      if(p == -1 || s->s_peers[p].sp_active >= SIM_MAXQ)
+        break;
+      sim_request(s, block, p);
+    }
+  }
+
+  for(int k = 0; k < n; k++) {
+    if(s->s_streaming && s->s_pieces[order[k]].spc_deadline != INT64_MAX)
+      continue;
+    for(int b = 0; b < SIM_BLOCKS; b++) {
+      const int block = order[k] * SIM_BLOCKS + b;
+      if(s->s_blocks[block].sb_state != 0)
+        continue;
+      const int p = sim_any_peer(s, order[k]);
+      if(p == -1)
+        break;
+      sim_request(s, block, p);
+    }
+  }
+}
+
+
+/**
+ *
+ */
+static void
+sim_run(const sim_scenario_t *sc, int streaming, sim_result_t *res)
+{
+  sim_t s = {0};
+  const int64_t bitrate = sc->bitrate * 1000LL;
+  const uint64_t length = (uint64_t)sc->num_pieces * SIM_PIECE_LENGTH;
+  int playing = 0, stalled = 0;
+
+  s.s_sc = sc;
+  s.s_streaming = streaming;
+  s.s_seed = 1;
+  s.s_peers = calloc(sc->num_peers, sizeof(sim_peer_t));
+  s.s_pieces = calloc(sc->num_pieces, sizeof(sim_piece_t));
+  s.s_blocks = calloc(sc->num_pieces * SIM_BLOCKS, sizeof(sim_block_t));
+  s.s_avail = calloc(sc->num_pieces, sizeof(uint16_t));
+  s.s_res.startup = -1;
+
+  for(int i = 0; i < sc->num_peers; i++) {
+    sim_peer_t *sp = &s.s_peers[i];
+    sp->sp_conf = &sc->peers[i];
+    sp->sp_have = calloc(1, sc->num_pieces);
+    for(int j = 0; j < sc->num_pieces; j++) {
+      if(sim_rand(&s) % 100 < sp->sp_conf->have) {
+        sp->sp_have[j] = 1;
+        s.s_avail[j]++;
+      }
+    }
+  }
+
+  while(s.s_ppos < length && s.s_now < 3600000000LL) {
+
+    sim_deliver(&s);
+
+    // Demuxer reads as far as it can
+
+    while(s.s_rpos < length &&
+          s.s_rpos < s.s_ppos + bitrate * SIM_MAX_BUFFER &&
+          s.s_pieces[s.s_rpos / SIM_PIECE_LENGTH].spc_complete)
+      s.s_rpos = (s.s_rpos / SIM_PIECE_LENGTH + 1) * SIM_PIECE_LENGTH;
+
+    // Same estimate as torrent_stream_update()
+
+    if(s.s_now - s.s_rate_time >= 1000000) {
+      const int rate = (s.s_rpos - s.s_rate_pos) * 1000000 /
+        (s.s_now - s.s_rate_time);
+      s.s_rate = s.s_rate ? (s.s_rate * 3 + rate) / 4 : rate;
+      s.s_rate_pos = s.s_rpos;
+      s.s_rate_time = s.s_now;
+    }
+
+    const uint64_t buffered = s.s_rpos - s.s_ppos;
+
+    if(!playing) {
+      if(buffered >= bitrate * SIM_START_BUFFER || s.s_rpos == length) {
+        playing = 1;
+        s.s_res.startup = s.s_now;
+      }
+    } else if(stalled) {
+      s.s_res.stall_time += SIM_STEP;
+      if(buffered >= bitrate || s.s_rpos == length)
+        stalled = 0;
+    } else {
+      s.s_ppos = MIN(s.s_ppos + bitrate * SIM_STEP / 1000000, s.s_rpos);
+      if(s.s_ppos == s.s_rpos && s.s_rpos < length) {
+        stalled = 1;
+        s.s_res.stalls++;
+      }
+    }
+
+    // Same as fa_video.c: fa_deadline() with a third of the buffer
+
+    const int64_t base = s.s_now +
+      (playing ? (int64_t)buffered * 1000000 / bitrate / 3 : 0);
+
+    sim_schedule(&s, base);
+    s.s_now += SIM_STEP;
+  }
+
+  s.s_res.duration = s.s_now;
+  *res = s.s_res;
+
+  for(int i = 0; i < sc->num_peers; i++)
+    free(s.s_peers[i].sp_have);
+  free(s.s_peers);
+  free(s.s_pieces);
+  free(s.s_blocks);
+  free(s.s_avail);
+}
+
+
+/**
+ *
+ */
+static void
+torrent_picker_bench(void)
+{
+  static const sim_peer_conf_t fast[] = {
+    { 400,  40, 0, 100 },
+    { 400,  60, 0, 100 },
+    { 400,  80, 0, 100 },
+    { 400, 100, 0, 100 },
+  };
+
+  static const sim_peer_conf_t mixed[] = {
+    { 250,  60, 10, 100 },
+    { 200, 120, 10, 100 },
+    { 150,  80, 10, 100 },
+    { 120, 200, 10, 100 },
+    { 100, 300, 10, 100 },
+    {  80, 150, 10, 100 },
+    {  60, 400, 10, 100 },
+    {  40, 600, 10, 100 },
+  };
+
+  // Only a slow seed has every piece
+  static const sim_peer_conf_t sparse[] = {
+    { 250,  60, 10, 60 },
+    { 200, 120, 10, 50 },
+    { 150,  80, 10, 60 },
+    { 120, 200, 10, 70 },
+    { 100, 300, 10, 50 },
+    {  80, 150, 10, 60 },
+    {  60, 400, 10, 80 },
+    {  40, 600, 10, 100 },
+  };
+
+  static const sim_scenario_t scenarios[] = {
+    { "fast",   500, 300, fast,   4 },
+    { "mixed",  700, 300, mixed,  8 },
+    { "sparse", 600, 300, sparse, 8 },
+  };
+
+  static const char *policies[] = { "legacy", "streaming" };
+
+  TRACE(TRACE_INFO, "bench", "btpicker: %-8s %-10s %8s %6s %10s %8s %8s",
+        "scenario", "policy", "start ms", "stalls", "stalled ms",
+        "MB recv", "MB waste");
+
+  for(int i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    for(int p = 0; p < 2; p++) {
+      sim_result_t res;
+      sim_run(&scenarios[i], p, &res);
+      TRACE(TRACE_INFO, "bench", "btpicker: %-8s %-10s %8d %6d %10d %8d %8d",
+            scenarios[i].name, policies[p],
+            (int)(res.startup / 1000), res.stalls,
+            (int)(res.stall_time / 1000),
+            (int)(res.downloaded >> 20), (int)(res.wasted >> 20));
+    }
+  }
+}
+
+BENCHMARK("btpicker", torrent_picker_bench);
+#endif
@@ -590,6 +590,28 @@ check_audio_only(hls_demuxer_t *hd)
 
 
 
+/**
+ * Update bandwidth estimate from a completed segment download
+ */
+static void
+hls_demuxer_update_bw(hls_demuxer_t *hd, int64_t bytes, int64_t ts)
+{
+  hls_t *h = hd->hd_hls;
+
+  if(ts <= 1000)
+    return;
+
+  hls_abr_estimator_add(&hd->hd_bw_estimator, bytes, ts);
+  hd->hd_bw = MIN(100000000, hls_abr_estimator_get(&hd->hd_bw_estimator));
+
+  HLS_TRACE(h, "Estimated bandwidth updated %d bps "
+            "(most recent segment %d bps) buffer: %ds",
+            hd->hd_bw, (int)MIN(100000000, 8000000LL * bytes / ts),
+            (int)(h->h_mp->mp_buffer_delay / 1000000));
+  hd->hd_bw_updated = 1;
+}
+
+
 /**
  *
  */
@@ -604,6 +626,20 @@ hls_segment_open(hls_segment_t *hs)
   const hls_t *h = hd->hd_hls;
 
   assert(hs->hs_fh == NULL);
+
+  int64_t dltime;
+  fh = hls_prefetch_open(hd->hd_prefetch, hs, &dltime);
+  if(fh != NULL) {
+    hs->hs_fh = fh;
+    hs->hs_size = fa_fsize(fh);
+    hs->hs_prefetched = 1;
+    hls_demuxer_update_bw(hd, hs->hs_size, dltime);
+    hls_prefetch_schedule(hd->hd_prefetch, hs);
+    HLS_TRACE(h, "Opened %s (sequence %d) from prefetch buffer",
+              hs->hs_url, hs->hs_seq);
+    return 0;
+  }
+
   hs->hs_open_time = arch_get_ts();
   hs->hs_blocked_counter = h->h_blocked;
 
@@ -661,6 +697,7 @@ hls_segment_open(hls_segment_t *hs)
     fh = fa_aescbc_open(fh, hs->hs_iv, buf_c8(hv->hv_key));
   }
   hs->hs_fh = fh;
+  hls_prefetch_schedule(hd->hd_prefetch, hs);
   HLS_TRACE(h, "Opened %s (sequence %d) ranges:[%d + %d] OK",
             hs->hs_url, hs->hs_seq, hs->hs_byte_offset, hs->hs_byte_size);
   return 0;
@@ -679,41 +716,13 @@ hls_segment_close(hls_segment_t *hs)
   hls_demuxer_t *hd = hs->hs_variant->hv_demuxer;
   hls_t *h = hd->hd_hls;
 
-  if(hs->hs_blocked_counter == h->h_blocked) {
-    int64_t ts = arch_get_ts() - hs->hs_open_time;
-    if(ts > 1000) {
-      int64_t bw = 8000000LL * hs->hs_size / ts;
-      bw = MIN(100000000, bw);
-
-
-      int low_buffer = h->h_mp->mp_buffer_delay < 5000000;
-      const char *delta;
-      if(hd->hd_bw == 0) {
-        hd->hd_bw = bw;
-        delta = "Initial";
-      } else if(bw < hd->hd_bw) {
-        delta = "Decrease";
-        if(low_buffer)
-          hd->hd_bw = (hd->hd_bw + bw) / 2;
-        else
-          hd->hd_bw = (hd->hd_bw * 7 + bw) / 8;
-      } else {
-        delta = "Increase";
-        hd->hd_bw = (hd->hd_bw + bw) / 2;
-      }
-      HLS_TRACE(h, "Estimated bandwidth updated %d bps "
-                "(most recent segment %d bps) "
-                "buffer: %ds (%s) delta: %s\n",
-                hd->hd_bw, (int)bw,
-                (int)(h->h_mp->mp_buffer_delay / 1000000),
-                low_buffer ? "Low" : "OK",
-                delta);
-      hd->hd_bw_updated = 1;
-    }
-  }
+  // Prefetched segments are accounted for when they are opened
+  if(!hs->hs_prefetched && hs->hs_blocked_counter == h->h_blocked)
+    hls_demuxer_update_bw(hd, hs->hs_size, arch_get_ts() - hs->hs_open_time);
 
   fa_close(hs->hs_fh);
   hs->hs_fh = NULL;
+  hs->hs_prefetched = 0;
 }
 
 
@@ -844,6 +853,9 @@ hls_variant_close(hls_variant_t *hv)
     hls_segment_close(hv->hv_current_seg);
     hv->hv_current_seg = NULL;
   }
+
+  if(hv == hv->hv_demuxer->hd_current)
+    hls_prefetch_flush(hv->hv_demuxer->hd_prefetch);
 }
 
 
@@ -999,10 +1011,14 @@ hls_select_default_variant(hls_demuxer_t *hd)
  *
  */
 static hls_variant_t *
-demuxer_select_variant_simple(hls_demuxer_t *hd, int64_t now, int bw)
+demuxer_select_variant_abr(hls_demuxer_t *hd, int64_t now, int bw)
 {
   hls_variant_t *hv;
-  hls_variant_t *best = NULL;
+  hls_variant_t *ladder[32];
+  int bitrates[32];
+  int num = 0;
+  int current = -1;
+  const media_pipe_t *mp = hd->hd_hls->h_mp;
 
   int lcc = INT32_MAX;
 
@@ -1016,10 +1032,10 @@ demuxer_select_variant_simple(hls_demuxer_t *hd, int64_t now, int bw)
     lcc = MIN(lcc, hv->hv_corrupt_counter);
   }
 
-  // First, try to select best mathcing bandwidth among streams with
-  // lowest corruption
+  // Let the ABR policy pick among streams with lowest corruption,
+  // variants are sorted on descending bitrate
 
-  TAILQ_FOREACH(hv, &hd->hd_variants, hv_link) {
+  TAILQ_FOREACH_REVERSE(hv, &hd->hd_variants, hls_variant_queue, hv_link) {
     if(hv->hv_audio_only)
       continue;
     if(hv->hv_corruptions_last_period >= 3)
@@ -1028,15 +1044,30 @@ demuxer_select_variant_simple(hls_demuxer_t *hd, int64_t now, int bw)
     if(hv->hv_corrupt_counter != lcc)
       continue;
 
-    if(hv->hv_bitrate >= bw)
-      continue;
+    if(num == 32)
+      break;
 
-    if(best == NULL)
-      best = hv;
+    if(hv == hd->hd_current)
+      current = num;
+    ladder[num] = hv;
+    bitrates[num] = hv->hv_bitrate;
+    num++;
   }
 
-  if(best != NULL)
-    return best;
+  if(num > 0) {
+    const hls_abr_input_t hai = {
+      .hai_bitrates         = bitrates,
+      .hai_num_bitrates     = num,
+      .hai_current          = current,
+      .hai_throughput       = bw,
+      .hai_buffer           = (mp->mp_buffer_delay == INT32_MAX ?
+                               0 : mp->mp_buffer_delay),
+      .hai_segment_duration = (hd->hd_current ?
+                               hd->hd_current->hv_target_duration : 0)
+                               * 1000000LL,
+    };
+    return ladder[hd->hd_abr_policy->hap_select(&hai)];
+  }
 
   // Try to select something that's not corrupted
 
@@ -1091,7 +1122,7 @@ hls_demuxer_select_variant(hls_demuxer_t *hd, int64_t now, int bw)
   if(0)
     return demuxer_select_variant_random(hd);
 
-  return demuxer_select_variant_simple(hd, now, bw);
+  return demuxer_select_variant_abr(hd, now, bw);
 }
 
 
@@ -1123,15 +1154,9 @@ hls_check_bw_switch(hls_demuxer_t *hd)
   if(hv == NULL || hv == hd->hd_current)
     return;
 
-
-  if(hv->hv_bitrate > hd->hd_current->hv_bitrate) {
-    // Stepping up, only do it if we have more than 10s worth of buffer
-    if(mp->mp_buffer_delay < 10000000) {
-      hd->hd_last_switch = now;
-      return;
-    }
-  }
-
+  HLS_TRACE(h, "%s: ABR policy %s selected %s (estimate %d bps, buffer %ds)",
+            hd->hd_type, hd->hd_abr_policy->hap_name, hv->hv_name,
+            hd->hd_bw, (int)(mp->mp_buffer_delay / 1000000));
 
   hd->hd_last_switch = now;
   hd->hd_req = hv;
@@ -1513,6 +1538,8 @@ hls_demuxer_seek(media_pipe_t *mp, hls_demuxer_t *hd, int64_t pos)
 {
   hd->hd_seek_to_segment = pos;
 
+  hls_prefetch_flush(hd->hd_prefetch);
+
   if(hd->hd_current != NULL && hd->hd_current->hv_demuxer_flush)
     hd->hd_current->hv_demuxer_flush(hd->hd_current);
 
@@ -2144,6 +2171,9 @@ hls_demuxer_init(hls_demuxer_t *hd, hls_t *h, const char *type)
   hd->hd_seek_to_segment = PTS_UNSET;
   hd->hd_last_dts = PTS_UNSET;
   hd->hd_cancellable = cancellable_create();
+  hd->hd_prefetch = hls_prefetch_create(hd);
+  hd->hd_abr_policy = gconf.enable_hls_abr_throughput ?
+    &hls_abr_throughput : &hls_abr_bola;
 }
 
 
@@ -2154,6 +2184,7 @@ static void
 hls_demuxer_close(media_pipe_t *mp, hls_demuxer_t *hd)
 {
   variants_destroy(&hd->hd_variants);
+  hls_prefetch_destroy(hd->hd_prefetch);
   if(hd->hd_audio_codec != NULL)
     media_codec_deref(hd->hd_audio_codec);
   hls_free_mbp(mp, &hd->hd_mb);
@@ -17,6 +17,8 @@
  *  This program is also available under a commercial proprietary license.
  *  For more information, contact andreas@lonelycoder.com
  */
+#include "hls_abr.h"
+
 event_t *hls_play_extm3u(char *s, const char *url, media_pipe_t *mp,
 			 char *errbuf, size_t errlen,
 			 video_queue_t *vq, struct vsource_list *vsl,
@@ -85,6 +87,8 @@ typedef struct hls_segment {
   int64_t hs_open_time;
   int hs_blocked_counter;
 
+  char hs_prefetched;  // hs_fh is reading from the prefetch buffer
+
 } hls_segment_t;
 
 
@@ -186,6 +190,8 @@ typedef struct hls_demuxer {
 
   int hd_bw;
   int hd_bw_updated;
+  hls_abr_estimator_t hd_bw_estimator;
+  const hls_abr_policy_t *hd_abr_policy;
   int64_t hd_download_counter_reset_at;
   int64_t hd_download_counter;
   int64_t hd_download_counter2;
@@ -200,6 +206,8 @@ typedef struct hls_demuxer {
 
   cancellable_t *hd_cancellable;
 
+  struct hls_prefetch *hd_prefetch;
+
   struct hls *hd_hls;
 
   // When set, nothing seems to be working, bail out
@@ -298,6 +306,21 @@ hls_segment_t *hv_find_segment_by_seq(hls_variant_t *hv, int seq);
 
 void hls_bad_variant(hls_variant_t *hv, hls_error_t err);
 
+// Segment prefetcher
+
+typedef struct hls_prefetch hls_prefetch_t;
+
+hls_prefetch_t *hls_prefetch_create(hls_demuxer_t *hd);
+
+void hls_prefetch_destroy(hls_prefetch_t *hp);
+
+void hls_prefetch_flush(hls_prefetch_t *hp);
+
+void hls_prefetch_schedule(hls_prefetch_t *hp, const hls_segment_t *hs);
+
+fa_handle_t *hls_prefetch_open(hls_prefetch_t *hp, const hls_segment_t *hs,
+                               int64_t *timep);
+
 // TS demuxer
 
 media_buf_t *hls_ts_demuxer_read(hls_demuxer_t *hd);
@@ -0,0 +1,370 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <math.h>
+#include <string.h>
+
+#include "main.h"
+#include "misc/minmax.h"
+#include "hls_abr.h"
+
+/**
+ * Relevant docs:
+ *
+ * BOLA: Near-Optimal Bitrate Adaptation for Online Videos
+ *    https://arxiv.org/abs/1601.06748
+ *
+ * The estimator follows what dash.js does (two download time weighted
+ * EWMAs) with a harmonic mean on top
+ */
+
+#define HLS_ABR_FAST_HALFLIFE 3.0   // Seconds of download time
+#define HLS_ABR_SLOW_HALFLIFE 8.0
+
+#define HLS_ABR_SAFETY        0.9   // Fraction of estimate we dare to use
+
+#define HLS_ABR_STEP_UP_BUFFER 10000000
+
+#define BOLA_MIN_BUFFER    10.0     // Seconds
+#define BOLA_TARGET_BUFFER 24.0
+
+
+/**
+ *
+ */
+void
+hls_abr_estimator_add(hls_abr_estimator_t *hae, int64_t bytes,
+                      int64_t duration)
+{
+  if(duration <= 1000)
+    return;
+
+  const double secs = duration / 1000000.0;
+  const double bps = bytes * 8 / secs;
+
+  double a;
+
+  a = pow(0.5, secs / HLS_ABR_FAST_HALFLIFE);
+  hae->hae_fast = a * hae->hae_fast + (1 - a) * bps;
+
+  a = pow(0.5, secs / HLS_ABR_SLOW_HALFLIFE);
+  hae->hae_slow = a * hae->hae_slow + (1 - a) * bps;
+
+  hae->hae_total_time += secs;
+
+  hae->hae_samples[hae->hae_sample_ptr] = MAX(1, MIN(bps, INT32_MAX));
+  hae->hae_sample_ptr = (hae->hae_sample_ptr + 1) % HLS_ABR_HISTORY;
+  hae->hae_num_samples = MIN(hae->hae_num_samples + 1, HLS_ABR_HISTORY);
+}
+
+
+/**
+ *
+ */
+int
+hls_abr_estimator_get(const hls_abr_estimator_t *hae)
+{
+  if(hae->hae_num_samples == 0)
+    return 0;
+
+  // The EWMAs starts at zero, correct for that while we have few samples
+  const double t = hae->hae_total_time;
+  const double fast = hae->hae_fast / (1 - pow(0.5, t / HLS_ABR_FAST_HALFLIFE));
+  const double slow = hae->hae_slow / (1 - pow(0.5, t / HLS_ABR_SLOW_HALFLIFE));
+
+  double inv = 0;
+  for(int i = 0; i < hae->hae_num_samples; i++)
+    inv += 1.0 / hae->hae_samples[i];
+  const double harmonic = hae->hae_num_samples / inv;
+
+  return MIN(MIN(fast, slow), harmonic);
+}
+
+
+/**
+ * Highest bitrate that fits within the (derated) throughput
+ */
+static int
+throughput_index(const hls_abr_input_t *hai)
+{
+  int i;
+  for(i = hai->hai_num_bitrates - 1; i > 0; i--)
+    if(hai->hai_bitrates[i] <= hai->hai_throughput * HLS_ABR_SAFETY)
+      break;
+  return i;
+}
+
+
+/**
+ * Pure throughput based. Stepping up is only done if we have more than
+ * 10s worth of buffer
+ */
+static int
+throughput_select(const hls_abr_input_t *hai)
+{
+  if(hai->hai_throughput == 0)
+    return 0;
+
+  const int i = throughput_index(hai);
+  if(hai->hai_current != -1 && i > hai->hai_current &&
+     hai->hai_buffer < HLS_ABR_STEP_UP_BUFFER)
+    return hai->hai_current;
+  return i;
+}
+
+const hls_abr_policy_t hls_abr_throughput = {
+  .hap_name   = "throughput",
+  .hap_select = throughput_select,
+};
+
+
+/**
+ * BOLA-BASIC with the utility of a bitrate being ln(bitrate/lowest)
+ *
+ * Lowest bitrate is picked at BOLA_MIN_BUFFER and highest at
+ * BOLA_TARGET_BUFFER. At startup (no estimate or less than one segment
+ * buffered) we go by throughput instead, and we never step up beyond
+ * what the throughput supports (the BOLA-O variant) to avoid
+ * oscillating on bursty links
+ */
+static int
+bola_select(const hls_abr_input_t *hai)
+{
+  const int n = hai->hai_num_bitrates;
+
+  if(hai->hai_throughput == 0 || n == 1)
+    return 0;
+
+  const int tput = throughput_index(hai);
+
+  if(hai->hai_current == -1 || hai->hai_buffer < hai->hai_segment_duration ||
+     hai->hai_bitrates[0] <= 0)
+    return tput;
+
+  const double b0 = hai->hai_bitrates[0];
+  const double umax = log(hai->hai_bitrates[n - 1] / b0) + 1;
+  const double gp = (umax - 1) / (BOLA_TARGET_BUFFER / BOLA_MIN_BUFFER - 1);
+  const double vp = BOLA_MIN_BUFFER / gp;
+  const double q = hai->hai_buffer / 1000000.0;
+
+  int best = 0;
+  double best_score = -INFINITY;
+
+  for(int i = 0; i < n; i++) {
+    const double u = log(hai->hai_bitrates[i] / b0) + 1;
+    const double score = (vp * (u + gp) - q) / hai->hai_bitrates[i];
+    if(score >= best_score) {
+      best_score = score;
+      best = i;
+    }
+  }
+
+  if(best > hai->hai_current && best > tput)
+    best = MAX(tput, hai->hai_current);
+
+  return best;
+}
+
+const hls_abr_policy_t hls_abr_bola = {
+  .hap_name   = "bola",
+  .hap_select = bola_select,
+};
+
+
+#define HLS_ABR_SIM_LATENCY 80000  // Request latency in µs
+
+/**
+ * Returns time when download of 'bytes' started at 'now' completes
+ */
+static int64_t
+sim_download(const hls_abr_trace_t *tr, int64_t now, int64_t bytes)
+{
+  const int64_t period = tr->tr_period_ms * 1000LL;
+  int64_t bits = bytes * 8;
+
+  while(bits > 0) {
+    const int64_t slot = now / period;
+    const int64_t end = (slot + 1) * period;
+    const int64_t bps = tr->tr_kbps[slot % tr->tr_num_samples] * 1000LL;
+    const int64_t avail = bps * (end - now) / 1000000;
+
+    if(avail >= bits)
+      return now + (bits * 1000000 + bps - 1) / bps;
+
+    bits -= avail;
+    now = end;
+  }
+  return now;
+}
+
+
+/**
+ *
+ */
+void
+hls_abr_simulate(const hls_abr_policy_t *hap, const hls_abr_trace_t *tr,
+                 const int *bitrates, int num_bitrates,
+                 int64_t segment_duration, int64_t max_buffer,
+                 int64_t session_duration, hls_abr_sim_result_t *hsr)
+{
+  hls_abr_estimator_t hae = {0};
+  int64_t now = 0;
+  int64_t buffer = 0;
+  int64_t played = 0;
+  int64_t bitrate_sum = 0;
+  int playing = 0;
+  int current = -1;
+
+  memset(hsr, 0, sizeof(hls_abr_sim_result_t));
+
+  while(played + buffer < session_duration) {
+
+    // Demuxer blocks when buffer is full
+    if(playing && buffer + segment_duration > max_buffer) {
+      const int64_t wait = buffer + segment_duration - max_buffer;
+      now += wait;
+      played += wait;
+      buffer -= wait;
+    }
+
+    const hls_abr_input_t hai = {
+      .hai_bitrates         = bitrates,
+      .hai_num_bitrates     = num_bitrates,
+      .hai_current          = current,
+      .hai_throughput       = hls_abr_estimator_get(&hae),
+      .hai_buffer           = buffer,
+      .hai_segment_duration = segment_duration,
+    };
+
+    const int idx = hap->hap_select(&hai);
+    if(current != -1 && idx != current)
+      hsr->hsr_switches++;
+    current = idx;
+
+    const int64_t bytes = bitrates[idx] * segment_duration / 8000000;
+    const int64_t start = now;
+    now = sim_download(tr, now + HLS_ABR_SIM_LATENCY, bytes);
+    const int64_t elapsed = now - start;
+
+    hls_abr_estimator_add(&hae, bytes, elapsed);
+
+    if(playing) {
+      if(elapsed > buffer) {
+        hsr->hsr_rebuffers++;
+        hsr->hsr_rebuffer_time += elapsed - buffer;
+        played += buffer;
+        buffer = 0;
+      } else {
+        played += elapsed;
+        buffer -= elapsed;
+      }
+    }
+
+    buffer += segment_duration;
+
+    if(!playing) {
+      playing = 1;
+      hsr->hsr_startup_time = now;
+    }
+
+    bitrate_sum += bitrates[idx];
+    hsr->hsr_segments++;
+  }
+
+  if(hsr->hsr_segments)
+    hsr->hsr_avg_bitrate = bitrate_sum / hsr->hsr_segments;
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Replay a few bandwidth traces against all policies
+ */
+
+static uint32_t
+sim_rand(uint32_t *seed)
+{
+  *seed = *seed * 1664525 + 1013904223;
+  return *seed >> 8;
+}
+
+
+static void
+hls_abr_bench(void)
+{
+  static const int ladder[] = {
+    300000, 750000, 1200000, 2500000, 4500000, 7800000
+  };
+  const int num_bitrates = sizeof(ladder) / sizeof(ladder[0]);
+
+  static const hls_abr_policy_t *policies[] = {
+    &hls_abr_throughput,
+    &hls_abr_bola,
+  };
+
+  static const int steady[] = { 6000 };
+  static const int steps[] = { 8000, 1500, 5000, 800, 6000 };
+  static int jittery[600];
+  static int mobile[600];
+  uint32_t seed = 1;
+
+  // ±60% uniform jitter around 4 Mbit/s
+  for(int i = 0; i < 600; i++)
+    jittery[i] = 1600 + sim_rand(&seed) % 4800;
+
+  // Two state link, good 3-9 Mbit/s and bad 0.2-1 Mbit/s
+  int good = 1;
+  for(int i = 0; i < 600; i++) {
+    if(sim_rand(&seed) % 100 < (good ? 5 : 20))
+      good = !good;
+    mobile[i] = good ?
+      3000 + sim_rand(&seed) % 6000 :
+      200 + sim_rand(&seed) % 800;
+  }
+
+  const hls_abr_trace_t traces[] = {
+    { "steady",   1000,  steady,  1 },
+    { "steps",    60000, steps,   5 },
+    { "jittery",  1000,  jittery, 600 },
+    { "mobile",   1000,  mobile,  600 },
+  };
+
+  TRACE(TRACE_INFO, "bench",
+        "hlsabr: %-8s %-10s %8s %8s %8s %10s %8s",
+        "trace", "policy", "avg kbps", "switches", "stalls",
+        "stalled ms", "start ms");
+
+  for(int t = 0; t < sizeof(traces) / sizeof(traces[0]); t++) {
+    for(int p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+      hls_abr_sim_result_t hsr;
+      hls_abr_simulate(policies[p], &traces[t], ladder, num_bitrates,
+                       6000000, 30000000, 600000000LL, &hsr);
+
+      TRACE(TRACE_INFO, "bench",
+            "hlsabr: %-8s %-10s %8d %8d %8d %10d %8d",
+            traces[t].tr_name, policies[p]->hap_name,
+            hsr.hsr_avg_bitrate / 1000, hsr.hsr_switches,
+            hsr.hsr_rebuffers, (int)(hsr.hsr_rebuffer_time / 1000),
+            (int)(hsr.hsr_startup_time / 1000));
+    }
+  }
+}
+
+BENCHMARK("hlsabr", hls_abr_bench);
+#endif
@@ -0,0 +1,112 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Adaptive bitrate selection
+ *
+ * Nothing in here knows about HLS playlists or the media pipe, the
+ * demuxer feeds segment download timings into the estimator and asks
+ * a policy for a variant given the estimate and the buffer level.
+ * This way the same code can be driven by the simulator below.
+ */
+
+#define HLS_ABR_HISTORY 5
+
+/**
+ * Throughput estimator
+ *
+ * Two EWMAs with different half-lives (weighted by download time) and
+ * the harmonic mean of the most recent samples. The estimate is the
+ * lowest of the three; it drops quickly when the link gets worse and
+ * recovers slowly, and a single fast download can't pull it up.
+ */
+typedef struct hls_abr_estimator {
+  double hae_fast;
+  double hae_slow;
+  double hae_total_time;  // Seconds, for zero bias correction
+
+  int hae_samples[HLS_ABR_HISTORY];  // bps
+  int hae_num_samples;
+  int hae_sample_ptr;
+} hls_abr_estimator_t;
+
+void hls_abr_estimator_add(hls_abr_estimator_t *hae,
+                           int64_t bytes, int64_t duration);
+
+/**
+ * Returns estimated throughput in bps, 0 if nothing is known yet
+ */
+int hls_abr_estimator_get(const hls_abr_estimator_t *hae);
+
+
+/**
+ * What a policy gets to look at
+ */
+typedef struct hls_abr_input {
+  const int *hai_bitrates;     // bps, ascending
+  int hai_num_bitrates;
+  int hai_current;             // Index of current variant, -1 if none
+  int hai_throughput;          // bps, 0 if unknown
+  int64_t hai_buffer;          // Buffered media in µs
+  int64_t hai_segment_duration;  // µs
+} hls_abr_input_t;
+
+
+typedef struct hls_abr_policy {
+  const char *hap_name;
+  int (*hap_select)(const hls_abr_input_t *hai); // Returns index
+} hls_abr_policy_t;
+
+extern const hls_abr_policy_t hls_abr_throughput;
+extern const hls_abr_policy_t hls_abr_bola;
+
+
+/**
+ * Deterministic playback simulator
+ *
+ * Replays a bandwidth trace (one sample every tr_period_ms, looped
+ * if the session is longer than the trace) against a policy and a
+ * bitrate ladder.
+ */
+typedef struct hls_abr_trace {
+  const char *tr_name;
+  int tr_period_ms;
+  const int *tr_kbps;
+  int tr_num_samples;
+} hls_abr_trace_t;
+
+typedef struct hls_abr_sim_result {
+  int hsr_segments;
+  int hsr_avg_bitrate;     // bps, averaged over segments
+  int hsr_switches;
+  int hsr_rebuffers;       // Number of stalls after startup
+  int64_t hsr_rebuffer_time;
+  int64_t hsr_startup_time;
+} hls_abr_sim_result_t;
+
+void hls_abr_simulate(const hls_abr_policy_t *hap,
+                      const hls_abr_trace_t *tr,
+                      const int *bitrates, int num_bitrates,
+                      int64_t segment_duration, int64_t max_buffer,
+                      int64_t session_duration,
+                      hls_abr_sim_result_t *hsr);
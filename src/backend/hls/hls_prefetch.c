@@ -0,0 +1,611 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+
+#include <libavutil/aes.h>
+#include <libavutil/mem.h>
+
+#include "main.h"
+#include "media/media.h"
+#include "backend/backend.h"
+#include "fileaccess/fileaccess.h"
+#include "misc/minmax.h"
+#include "hls.h"
+
+/**
+ * Segment prefetcher
+ *
+ * Once a segment has been opened the segments following it in the
+ * same variant are queued and downloaded in full by a small pool of
+ * worker threads. AES-128 segments are decrypted as soon as they
+ * arrive, so opening a prefetched segment is just a memory read and
+ * the connection setup and time to first byte is hidden behind
+ * the playback of the current segment.
+ *
+ * The workers never look at hls_segment_t (a playlist reload may free
+ * segments at any time), each item carries a copy of what's needed to
+ * fetch it. Items are only created, consumed and dropped by the
+ * demuxer thread.
+ *
+ * Data that has been downloaded but not yet consumed is bounded by
+ * HLS_PREFETCH_MAX_BYTES. A new download is not started unless there
+ * is room for one more segment of average size.
+ */
+
+#define HLS_PREFETCH_DEPTH     3
+#define HLS_PREFETCH_THREADS   2
+#define HLS_PREFETCH_MAX_BYTES (32 * 1024 * 1024)
+
+#define HLS_PREFETCH_CHUNK     65536
+
+TAILQ_HEAD(hls_prefetch_item_queue, hls_prefetch_item);
+
+typedef enum {
+  HPI_QUEUED,
+  HPI_LOADING,
+  HPI_DONE,
+  HPI_FAILED,
+} hpi_state_t;
+
+
+/**
+ *
+ */
+typedef struct hls_prefetch_item {
+  TAILQ_ENTRY(hls_prefetch_item) hpi_link;
+
+  const hls_variant_t *hpi_variant;  // Only used for matching
+  int hpi_seq;
+  char *hpi_url;
+  int hpi_byte_offset;
+  int hpi_byte_size;
+
+  uint8_t hpi_crypto;
+  uint8_t hpi_iv[16];
+  rstr_t *hpi_key_url;
+
+  hpi_state_t hpi_state;
+  char hpi_orphaned;   // Dropped while loading, worker will free it
+  cancellable_t *hpi_cancellable;
+
+  buf_t *hpi_buf;
+  int64_t hpi_time;    // Download time, adjusted for concurrency
+} hls_prefetch_item_t;
+
+
+/**
+ *
+ */
+struct hls_prefetch {
+  hts_mutex_t hp_mutex;
+  hts_cond_t hp_cond;
+
+  struct hls_prefetch_item_queue hp_items;
+
+  hls_demuxer_t *hp_hd;
+
+  hts_thread_t hp_threads[HLS_PREFETCH_THREADS];
+  int hp_num_threads;  // Started on first use
+  int hp_run;
+
+  int hp_active;        // Downloads in progress
+  size_t hp_bytes;      // Held by completed items
+  size_t hp_avg_size;   // Running average of segment sizes
+
+  rstr_t *hp_key_url;
+  buf_t *hp_key;
+
+  // Stats, only touched by demuxer thread
+  int hp_hits;
+  int hp_misses;
+};
+
+
+/**
+ *
+ */
+static void
+item_free(hls_prefetch_item_t *hpi)
+{
+  buf_release(hpi->hpi_buf);
+  rstr_release(hpi->hpi_key_url);
+  cancellable_release(hpi->hpi_cancellable);
+  free(hpi->hpi_url);
+  free(hpi);
+}
+
+
+/**
+ * Must be called with hp_mutex held
+ */
+static void
+item_drop(hls_prefetch_t *hp, hls_prefetch_item_t *hpi)
+{
+  TAILQ_REMOVE(&hp->hp_items, hpi, hpi_link);
+
+  switch(hpi->hpi_state) {
+  case HPI_LOADING:
+    hpi->hpi_orphaned = 1;
+    cancellable_cancel(hpi->hpi_cancellable);
+    return;
+  case HPI_DONE:
+    hp->hp_bytes -= buf_len(hpi->hpi_buf);
+    break;
+  default:
+    break;
+  }
+  item_free(hpi);
+}
+
+
+/**
+ *
+ */
+static hls_prefetch_item_t *
+item_find(hls_prefetch_t *hp, const hls_segment_t *hs)
+{
+  hls_prefetch_item_t *hpi;
+  TAILQ_FOREACH(hpi, &hp->hp_items, hpi_link)
+    if(hpi->hpi_variant == hs->hs_variant && hpi->hpi_seq == hs->hs_seq &&
+       !strcmp(hpi->hpi_url, hs->hs_url))
+      return hpi;
+  return NULL;
+}
+
+
+/**
+ *
+ */
+static int
+item_cmp(const hls_prefetch_item_t *a, const hls_prefetch_item_t *b)
+{
+  return a->hpi_seq - b->hpi_seq;
+}
+
+
+/**
+ * Get AES key, the most recent one is cached
+ */
+static buf_t *
+prefetch_get_key(hls_prefetch_t *hp, rstr_t *url)
+{
+  buf_t *key = NULL;
+  char errbuf[256];
+
+  hts_mutex_lock(&hp->hp_mutex);
+  if(rstr_eq(url, hp->hp_key_url))
+    key = buf_retain(hp->hp_key);
+  hts_mutex_unlock(&hp->hp_mutex);
+
+  if(key != NULL)
+    return key;
+
+  key = fa_load(rstr_get(url),
+                FA_LOAD_ERRBUF(errbuf, sizeof(errbuf)),
+                NULL);
+  if(key == NULL) {
+    TRACE(TRACE_ERROR, "HLS", "Unable to load key file %s -- %s",
+          rstr_get(url), errbuf);
+    return NULL;
+  }
+
+  if(buf_len(key) < 16) {
+    TRACE(TRACE_ERROR, "HLS", "Key file %s is too short", rstr_get(url));
+    buf_release(key);
+    return NULL;
+  }
+
+  hts_mutex_lock(&hp->hp_mutex);
+  buf_release(hp->hp_key);
+  hp->hp_key = buf_retain(key);
+  rstr_set(&hp->hp_key_url, url);
+  hts_mutex_unlock(&hp->hp_mutex);
+  return key;
+}
+
+
+/**
+ * Decrypt in place and strip the PKCS7 padding, returns new size or -1
+ */
+static int
+prefetch_decrypt(uint8_t *data, int size, const uint8_t *key,
+                 const uint8_t *iv0)
+{
+  uint8_t iv[16];
+
+  if(size == 0 || size & 15)
+    return -1;
+
+  memcpy(iv, iv0, 16);
+
+  struct AVAES *aes = av_aes_alloc();
+  av_aes_init(aes, key, 128, 1);
+  av_aes_crypt(aes, data, data, size / 16, iv, 1);
+  av_free(aes);
+
+  const int pad = data[size - 1];
+  if(pad < 1 || pad > 16)
+    return -1;
+  return size - pad;
+}
+
+
+/**
+ * Read an entire segment
+ */
+static buf_t *
+prefetch_load(hls_prefetch_t *hp, hls_prefetch_item_t *hpi)
+{
+  const hls_t *h = hp->hp_hd->hd_hls;
+  fa_open_extra_t foe = {0};
+  char errbuf[256];
+
+  foe.foe_open_timeout = 3000;
+  foe.foe_cancellable = hpi->hpi_cancellable;
+
+  int flags = FA_STREAMING;
+  if(hpi->hpi_byte_offset != -1)
+    flags &= ~FA_STREAMING;
+
+  fa_handle_t *fh = fa_open_ex(hpi->hpi_url, errbuf, sizeof(errbuf),
+                               flags, &foe);
+  if(fh == NULL) {
+    HLS_TRACE(h, "Prefetch of %s (sequence %d) failed -- %s",
+              hpi->hpi_url, hpi->hpi_seq, errbuf);
+    return NULL;
+  }
+
+  fa_set_read_timeout(fh, 3000);
+
+  if(hpi->hpi_byte_size != -1 && hpi->hpi_byte_offset != -1)
+    fh = fa_slice_open(fh, hpi->hpi_byte_offset, hpi->hpi_byte_size);
+
+  int64_t fsize = fa_fsize(fh);
+  size_t alloced = fsize > 0 ? fsize : HLS_PREFETCH_CHUNK;
+  size_t size = 0;
+  uint8_t *mem = malloc(alloced);
+
+  while(mem != NULL) {
+    if(cancellable_is_cancelled(hpi->hpi_cancellable))
+      break;
+
+    if(size == alloced) {
+      if(fsize > 0)
+        break; // Got everything
+      alloced *= 2;
+      mem = myreallocf(mem, alloced);
+      if(mem == NULL)
+        break;
+    }
+
+    int r = fa_read(fh, mem + size, MIN(alloced - size, HLS_PREFETCH_CHUNK));
+    if(r < 0) {
+      HLS_TRACE(h, "Prefetch of %s (sequence %d) read error",
+                hpi->hpi_url, hpi->hpi_seq);
+      break;
+    }
+    if(r == 0) {
+      if(fsize > 0 && size != fsize)
+        break;
+      fsize = size;
+      break;
+    }
+    size += r;
+  }
+
+  fa_close(fh);
+
+  if(mem == NULL || size != fsize ||
+     cancellable_is_cancelled(hpi->hpi_cancellable)) {
+    free(mem);
+    return NULL;
+  }
+
+  if(hpi->hpi_crypto == HLS_CRYPTO_AES128) {
+    buf_t *key = prefetch_get_key(hp, hpi->hpi_key_url);
+    if(key == NULL) {
+      free(mem);
+      return NULL;
+    }
+
+    int r = prefetch_decrypt(mem, size, buf_c8(key), hpi->hpi_iv);
+    buf_release(key);
+    if(r < 0) {
+      HLS_TRACE(h, "Prefetch of %s (sequence %d) failed to decrypt",
+                hpi->hpi_url, hpi->hpi_seq);
+      free(mem);
+      return NULL;
+    }
+    size = r;
+  }
+  return buf_create_and_adopt(size, mem, &free);
+}
+
+
+/**
+ * Must be called with hp_mutex held
+ */
+static hls_prefetch_item_t *
+prefetch_next_job(hls_prefetch_t *hp)
+{
+  hls_prefetch_item_t *hpi;
+
+  if(hp->hp_bytes + (hp->hp_active + 1) * hp->hp_avg_size >
+     HLS_PREFETCH_MAX_BYTES)
+    return NULL;
+
+  TAILQ_FOREACH(hpi, &hp->hp_items, hpi_link)
+    if(hpi->hpi_state == HPI_QUEUED)
+      return hpi;
+  return NULL;
+}
+
+
+/**
+ *
+ */
+static void *
+prefetch_thread(void *aux)
+{
+  hls_prefetch_t *hp = aux;
+  hls_prefetch_item_t *hpi;
+
+  hts_mutex_lock(&hp->hp_mutex);
+
+  while(hp->hp_run) {
+
+    if((hpi = prefetch_next_job(hp)) == NULL) {
+      hts_cond_wait(&hp->hp_cond, &hp->hp_mutex);
+      continue;
+    }
+
+    hpi->hpi_state = HPI_LOADING;
+    const int active_at_start = ++hp->hp_active;
+    hts_mutex_unlock(&hp->hp_mutex);
+
+    const int64_t start = arch_get_ts();
+    buf_t *b = prefetch_load(hp, hpi);
+    const int64_t elapsed = arch_get_ts() - start;
+
+    hts_mutex_lock(&hp->hp_mutex);
+
+    /*
+     * Parallel downloads share the link so the time it took is
+     * scaled with the number of downloads that were running
+     * alongside (averaged between start and end) to make it
+     * comparable to a single download
+     */
+    hpi->hpi_time = elapsed * 2 / (active_at_start + hp->hp_active);
+    hp->hp_active--;
+
+    if(hpi->hpi_orphaned) {
+      buf_release(b);
+      item_free(hpi);
+    } else if(b == NULL) {
+      hpi->hpi_state = HPI_FAILED;
+    } else {
+      hpi->hpi_buf = b;
+      hpi->hpi_state = HPI_DONE;
+      hp->hp_bytes += buf_len(b);
+      if(hp->hp_avg_size == 0)
+        hp->hp_avg_size = buf_len(b);
+      else
+        hp->hp_avg_size = (hp->hp_avg_size * 3 + buf_len(b)) / 4;
+    }
+    hts_cond_broadcast(&hp->hp_cond);
+  }
+
+  hts_mutex_unlock(&hp->hp_mutex);
+  return NULL;
+}
+
+
+/**
+ *
+ */
+hls_prefetch_t *
+hls_prefetch_create(hls_demuxer_t *hd)
+{
+  hls_prefetch_t *hp = calloc(1, sizeof(hls_prefetch_t));
+  hts_mutex_init(&hp->hp_mutex);
+  hts_cond_init(&hp->hp_cond, &hp->hp_mutex);
+  TAILQ_INIT(&hp->hp_items);
+  hp->hp_hd = hd;
+  hp->hp_run = 1;
+  return hp;
+}
+
+
+/**
+ *
+ */
+void
+hls_prefetch_destroy(hls_prefetch_t *hp)
+{
+  hls_prefetch_flush(hp);
+
+  hts_mutex_lock(&hp->hp_mutex);
+  hp->hp_run = 0;
+  hts_cond_broadcast(&hp->hp_cond);
+  hts_mutex_unlock(&hp->hp_mutex);
+
+  for(int i = 0; i < hp->hp_num_threads; i++)
+    hts_thread_join(&hp->hp_threads[i]);
+
+  assert(TAILQ_FIRST(&hp->hp_items) == NULL);
+  assert(hp->hp_bytes == 0);
+
+  buf_release(hp->hp_key);
+  rstr_release(hp->hp_key_url);
+  hts_cond_destroy(&hp->hp_cond);
+  hts_mutex_destroy(&hp->hp_mutex);
+  free(hp);
+}
+
+
+/**
+ *
+ */
+void
+hls_prefetch_flush(hls_prefetch_t *hp)
+{
+  hls_prefetch_item_t *hpi;
+  hts_mutex_lock(&hp->hp_mutex);
+  while((hpi = TAILQ_FIRST(&hp->hp_items)) != NULL)
+    item_drop(hp, hpi);
+  hts_mutex_unlock(&hp->hp_mutex);
+}
+
+
+/**
+ * Queue the segments following hs and drop everything else
+ */
+void
+hls_prefetch_schedule(hls_prefetch_t *hp, const hls_segment_t *hs)
+{
+  const hls_variant_t *hv = hs->hs_variant;
+  hls_prefetch_item_t *hpi, *next;
+  const hls_segment_t *n;
+  const int first = hs->hs_seq + 1;
+  const int last  = hs->hs_seq + HLS_PREFETCH_DEPTH;
+
+  if(hp->hp_num_threads == 0) {
+    for(int i = 0; i < HLS_PREFETCH_THREADS; i++)
+      hts_thread_create_joinable("hlsprefetch", &hp->hp_threads[i],
+                                 prefetch_thread, hp, THREAD_PRIO_DEMUXER);
+    hp->hp_num_threads = HLS_PREFETCH_THREADS;
+  }
+
+  hts_mutex_lock(&hp->hp_mutex);
+
+  for(hpi = TAILQ_FIRST(&hp->hp_items); hpi != NULL; hpi = next) {
+    next = TAILQ_NEXT(hpi, hpi_link);
+    if(hpi->hpi_variant != hv || hpi->hpi_seq < first || hpi->hpi_seq > last)
+      item_drop(hp, hpi);
+  }
+
+  n = TAILQ_NEXT(hs, hs_link);
+  for(int i = 0; i < HLS_PREFETCH_DEPTH && n != NULL;
+      i++, n = TAILQ_NEXT(n, hs_link)) {
+
+    if(n->hs_permanent_error || n->hs_fh != NULL || item_find(hp, n))
+      continue;
+
+    hpi = calloc(1, sizeof(hls_prefetch_item_t));
+    hpi->hpi_variant     = hv;
+    hpi->hpi_seq         = n->hs_seq;
+    hpi->hpi_url         = strdup(n->hs_url);
+    hpi->hpi_byte_offset = n->hs_byte_offset;
+    hpi->hpi_byte_size   = n->hs_byte_size;
+    hpi->hpi_crypto      = n->hs_crypto;
+    memcpy(hpi->hpi_iv, n->hs_iv, 16);
+    hpi->hpi_key_url     = rstr_dup(n->hs_key_url);
+    hpi->hpi_cancellable = cancellable_create();
+    TAILQ_INSERT_SORTED(&hp->hp_items, hpi, hpi_link, item_cmp,
+                        hls_prefetch_item_t);
+  }
+
+  hts_cond_broadcast(&hp->hp_cond);
+  hts_mutex_unlock(&hp->hp_mutex);
+}
+
+
+/**
+ *
+ */
+static void
+prefetch_update_stats(hls_prefetch_t *hp, int depth)
+{
+  const hls_demuxer_t *hd = hp->hp_hd;
+  const hls_t *h = hd->hd_hls;
+
+  if(hd != &h->h_primary)
+    return;
+
+  media_pipe_t *mp = h->h_mp;
+  prop_set(mp->mp_prop_io, "prefetchDepth", PROP_SET_INT, depth);
+  prop_set(mp->mp_prop_io, "prefetchHitRate", PROP_SET_INT,
+           100 * hp->hp_hits / (hp->hp_hits + hp->hp_misses));
+}
+
+
+/**
+ * Open a segment from the prefetch buffer. If the segment is still
+ * being downloaded we wait for it. Returns NULL if the segment has not
+ * been prefetched (or prefetch failed), the caller should then open
+ * it directly.
+ *
+ * On success *timep is set to the time it took to download the segment
+ */
+fa_handle_t *
+hls_prefetch_open(hls_prefetch_t *hp, const hls_segment_t *hs,
+                  int64_t *timep)
+{
+  const hls_demuxer_t *hd = hp->hp_hd;
+  hls_prefetch_item_t *hpi;
+  buf_t *b = NULL;
+  int depth = 0;
+
+  hts_mutex_lock(&hp->hp_mutex);
+
+  hpi = item_find(hp, hs);
+
+  if(hpi != NULL) {
+
+    while(hpi->hpi_state == HPI_LOADING &&
+          !cancellable_is_cancelled(hd->hd_cancellable))
+      hts_cond_wait_timeout(&hp->hp_cond, &hp->hp_mutex, 100);
+
+    switch(hpi->hpi_state) {
+    case HPI_DONE:
+      b = hpi->hpi_buf;
+      hpi->hpi_buf = NULL;
+      hp->hp_bytes -= buf_len(b);
+      *timep = hpi->hpi_time;
+      TAILQ_REMOVE(&hp->hp_items, hpi, hpi_link);
+      item_free(hpi);
+      hts_cond_broadcast(&hp->hp_cond);
+      break;
+
+    case HPI_LOADING:
+      // Cancelled while waiting, keep it around
+      break;
+
+    default:
+      item_drop(hp, hpi);
+      break;
+    }
+  }
+
+  TAILQ_FOREACH(hpi, &hp->hp_items, hpi_link)
+    if(hpi->hpi_state == HPI_DONE)
+      depth++;
+
+  hts_mutex_unlock(&hp->hp_mutex);
+
+  if(b != NULL)
+    hp->hp_hits++;
+  else
+    hp->hp_misses++;
+
+  prefetch_update_stats(hp, depth);
+
+  return b != NULL ? memfile_make_buf(b) : NULL;
+}
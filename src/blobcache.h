@@ -26,7 +26,7 @@ buf_t *blobcache_get(const char *key, const char *stash, int pad,
 		    int *is_expired, char **etag, time_t *mtime);
 
 int blobcache_get_meta(const char *key, const char *stash,
-		       char **etag, time_t *mtime);
+		       char **etag, time_t *mtime, int *is_expired);
 
 int blobcache_put(const char *key, const char *stash, buf_t *buf,
 		  int maxage, const char *etag, time_t mtime,
@@ -34,6 +34,12 @@ int blobcache_put(const char *key, const char *stash, buf_t *buf,
 
 void blobcache_evict(const char *key, const char *stash);
 
+/**
+ * Limit how much of the cache a stash may use (in percent of total
+ * size). Stashes without an explicit budget get a default share
+ */
+void blobcache_set_stash_budget(const char *stash, int percent);
+
 #define BLOBCACHE_IMPORTANT_ITEM 0x1
 
 void blobcache_init(void);
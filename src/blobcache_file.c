@@ -22,6 +22,12 @@
 #include <errno.h>
 #include <unistd.h>
 
+#if defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#define BC_USE_MMAP
+#endif
+
 #include "main.h"
 #include "blobcache.h"
 #include "misc/pool.h"
@@ -39,23 +45,32 @@
 
 // Flags
 
+#define BC2_MAGIC_09      0x62630209
+#define BC2_MAGIC_08      0x62630208
 #define BC2_MAGIC_07      0x62630207
 #define BC2_MAGIC_06      0x62630206
 #define BC2_MAGIC_05      0x62630205
 
 typedef struct blobcache_item {
   struct blobcache_item *bi_link;
+  TAILQ_ENTRY(blobcache_item) bi_lru_link;
   char *bi_etag;
+  buf_t *bi_pending;  // Content not yet written to disk
   uint64_t bi_key_hash;
   uint64_t bi_content_hash;
   uint32_t bi_lastaccess;
   uint32_t bi_expiry;
   uint32_t bi_modtime;
   uint32_t bi_size;
+  uint32_t bi_offset;   // Offset in segment
+  uint16_t bi_segment;  // BC_SEGMENT_NONE if stored in a file of its own
   uint8_t bi_content_type_len;
   uint8_t bi_flags;
+  uint8_t bi_stash;
 } blobcache_item_t;
 
+TAILQ_HEAD(blobcache_item_queue, blobcache_item);
+
 typedef struct blobcache_diskitem_06 {
   uint64_t di_key_hash;
   uint64_t di_content_hash;
@@ -81,6 +96,37 @@ typedef struct blobcache_diskitem_07 {
   uint8_t di_etag[0];
 } __attribute__((packed)) blobcache_diskitem_07_t;
 
+typedef struct blobcache_diskitem_08 {
+  uint64_t di_key_hash;
+  uint64_t di_content_hash;
+  uint32_t di_lastaccess;
+  uint32_t di_expiry;
+  uint32_t di_modtime;
+  uint32_t di_size;
+  uint32_t di_offset;
+  uint16_t di_segment;
+  uint8_t di_flags;
+  uint8_t di_etaglen;
+  uint8_t di_content_type_len;
+  uint8_t di_etag[0];
+} __attribute__((packed)) blobcache_diskitem_08_t;
+
+typedef struct blobcache_diskitem_09 {
+  uint64_t di_key_hash;
+  uint64_t di_content_hash;
+  uint32_t di_lastaccess;
+  uint32_t di_expiry;
+  uint32_t di_modtime;
+  uint32_t di_size;
+  uint32_t di_offset;
+  uint16_t di_segment;
+  uint8_t di_stash;
+  uint8_t di_flags;
+  uint8_t di_etaglen;
+  uint8_t di_content_type_len;
+  uint8_t di_etag[0];
+} __attribute__((packed)) blobcache_diskitem_09_t;
+
 
 TAILQ_HEAD(blobcache_flush_queue, blobcache_flush);
 
@@ -92,15 +138,32 @@ typedef struct blobcache_flush {
 
 
 
-#define ITEM_HASH_SIZE 256
-#define ITEM_HASH_MASK (ITEM_HASH_SIZE - 1)
+/**
+ * The index is split into shards, each with its own lock and a hash
+ * table that grows as items are added. The shard is selected using
+ * bits of the key hash that are not used for the bucket index.
+ *
+ * Lock order: A shard lock may be held when taking cache_lock or
+ * lru_lock but not the other way around. Multiple shard locks must be
+ * taken in order
+ */
+#define BC_NUM_SHARDS            16
+#define BC_SHARD_INITIAL_BUCKETS 64
+
+typedef struct blobcache_shard {
+  hts_mutex_t bs_mutex;
+  pool_t *bs_pool;   // Items and flush entries for keys in this shard
+  blobcache_item_t **bs_hash;
+  unsigned int bs_mask;
+  unsigned int bs_items;
+  uint64_t bs_size;
+} blobcache_shard_t;
 
-static blobcache_item_t *hashvector[ITEM_HASH_SIZE];
+static blobcache_shard_t shards[BC_NUM_SHARDS];
 
 static struct blobcache_flush_queue flush_queue;
 
-static pool_t *item_pool;
-static hts_mutex_t cache_lock;
+static hts_mutex_t cache_lock;  // Protects flush_queue and bcstate
 static hts_cond_t cache_cond;
 static hts_thread_t bcthread;
 static enum {
@@ -116,7 +179,304 @@ static int index_dirty;
 #define BLOB_CACHE_MINSIZE   (10 * 1000 * 1000)
 #define BLOB_CACHE_MAXSIZE (1000 * 1000 * 1000)
 
-static uint64_t current_cache_size;
+
+/**
+ * Each stash (the namespace passed by callers) keeps its items on LRU
+ * lists ordered by last access, so eviction just takes from the head
+ * instead of sorting the entire index. Items flagged as important go
+ * on a separate list that is only evicted from once the normal lists
+ * are empty.
+ *
+ * A stash may only use a share of the total cache size so a single
+ * plugin can't push out everything else.
+ *
+ * Stash 0 holds items from older index formats and items from stashes
+ * that did not fit in the table.
+ *
+ * Entries are never removed from the stash table so it can be scanned
+ * without locking up to num_stashes. All list and size updates are
+ * protected by lru_lock.
+ */
+#define BC_MAX_STASHES            64
+#define BC_STASH_DEFAULT_SHARE    25  // Percent of the cache size
+
+typedef struct blobcache_stash {
+  char *bst_name;
+  struct blobcache_item_queue bst_lru;
+  struct blobcache_item_queue bst_lru_important;
+  uint64_t bst_size;
+  int bst_share;
+  atomic_t bst_hits;
+  atomic_t bst_misses;
+  atomic_t bst_evictions;
+  prop_t *bst_prop;
+} blobcache_stash_t;
+
+static blobcache_stash_t stashes[BC_MAX_STASHES];
+static atomic_t num_stashes;
+static hts_mutex_t lru_lock;
+
+static prop_t *blobcache_prop;
+
+
+/**
+ *
+ */
+static void
+stash_init(blobcache_stash_t *bst, const char *name, int share)
+{
+  bst->bst_name = strdup(name);
+  bst->bst_share = share;
+  TAILQ_INIT(&bst->bst_lru);
+  TAILQ_INIT(&bst->bst_lru_important);
+}
+
+
+/**
+ * Find or create stash
+ */
+static int
+stash_get(const char *name)
+{
+  int i, n = atomic_get(&num_stashes);
+
+  if(strlen(name) > 255)
+    return 0;
+
+  __sync_synchronize();
+  for(i = 1; i < n; i++)
+    if(!strcmp(stashes[i].bst_name, name))
+      return i;
+
+  hts_mutex_lock(&lru_lock);
+  n = atomic_get(&num_stashes);
+  for(; i < n; i++)
+    if(!strcmp(stashes[i].bst_name, name))
+      break;
+
+  if(i == n) {
+    if(n == BC_MAX_STASHES) {
+      i = 0;
+    } else {
+      stash_init(&stashes[n], name, BC_STASH_DEFAULT_SHARE);
+      // Entry must be fully visible before it can be found
+      __sync_synchronize();
+      atomic_set(&num_stashes, n + 1);
+    }
+  }
+  hts_mutex_unlock(&lru_lock);
+  return i;
+}
+
+
+/**
+ *
+ */
+void
+blobcache_set_stash_budget(const char *stash, int percent)
+{
+  blobcache_stash_t *bst = &stashes[stash_get(stash)];
+  hts_mutex_lock(&lru_lock);
+  bst->bst_share = MAX(1, MIN(percent, 100));
+  hts_mutex_unlock(&lru_lock);
+}
+
+
+/**
+ *
+ */
+static struct blobcache_item_queue *
+lru_for(blobcache_item_t *p)
+{
+  blobcache_stash_t *bst = &stashes[p->bi_stash];
+  return p->bi_flags & BLOBCACHE_IMPORTANT_ITEM ?
+    &bst->bst_lru_important : &bst->bst_lru;
+}
+
+
+/**
+ * Add item as most recently used. Assume lru_lock is held
+ */
+static void
+lru_link(blobcache_item_t *p)
+{
+  TAILQ_INSERT_TAIL(lru_for(p), p, bi_lru_link);
+  stashes[p->bi_stash].bst_size += p->bi_size;
+}
+
+
+/**
+ * Assume lru_lock is held
+ */
+static void
+lru_unlink(blobcache_item_t *p)
+{
+  TAILQ_REMOVE(lru_for(p), p, bi_lru_link);
+  stashes[p->bi_stash].bst_size -= p->bi_size;
+}
+
+
+/**
+ * Pick the least recently used item of a stash. Assume lru_lock is held
+ */
+static blobcache_item_t *
+lru_stash_victim(const blobcache_stash_t *bst)
+{
+  blobcache_item_t *p = TAILQ_FIRST(&bst->bst_lru);
+  return p != NULL ? p : TAILQ_FIRST(&bst->bst_lru_important);
+}
+
+
+/**
+ * Pick the least recently used item across all stashes. Assume
+ * lru_lock is held
+ */
+static blobcache_item_t *
+lru_victim(void)
+{
+  blobcache_item_t *p, *best = NULL;
+  const int n = atomic_get(&num_stashes);
+
+  for(int i = 0; i < n; i++) {
+    p = TAILQ_FIRST(&stashes[i].bst_lru);
+    if(p != NULL && (best == NULL || p->bi_lastaccess < best->bi_lastaccess))
+      best = p;
+  }
+
+  if(best != NULL)
+    return best;
+
+  for(int i = 0; i < n; i++) {
+    p = TAILQ_FIRST(&stashes[i].bst_lru_important);
+    if(p != NULL && (best == NULL || p->bi_lastaccess < best->bi_lastaccess))
+      best = p;
+  }
+  return best;
+}
+
+
+/**
+ *
+ */
+static blobcache_shard_t *
+shard_for(uint64_t dk)
+{
+  return &shards[(dk >> 32) & (BC_NUM_SHARDS - 1)];
+}
+
+
+/**
+ *
+ */
+static void
+shards_lock_all(void)
+{
+  for(int i = 0; i < BC_NUM_SHARDS; i++)
+    hts_mutex_lock(&shards[i].bs_mutex);
+}
+
+
+/**
+ *
+ */
+static void
+shards_unlock_all(void)
+{
+  for(int i = BC_NUM_SHARDS - 1; i >= 0; i--)
+    hts_mutex_unlock(&shards[i].bs_mutex);
+}
+
+
+/**
+ * Assume shard is locked
+ */
+static blobcache_item_t **
+shard_lookup(blobcache_shard_t *bs, uint64_t dk)
+{
+  blobcache_item_t *p, **q;
+  for(q = &bs->bs_hash[dk & bs->bs_mask]; (p = *q) != NULL; q = &p->bi_link)
+    if(p->bi_key_hash == dk)
+      break;
+  return q;
+}
+
+
+/**
+ * Assume shard is locked
+ */
+static void
+shard_grow(blobcache_shard_t *bs)
+{
+  const unsigned int oldsize = bs->bs_mask + 1;
+  const unsigned int newsize = oldsize * 2;
+  blobcache_item_t **h = calloc(newsize, sizeof(blobcache_item_t *));
+  if(h == NULL)
+    return;
+
+  for(int i = 0; i < oldsize; i++) {
+    blobcache_item_t *p, *n;
+    for(p = bs->bs_hash[i]; p != NULL; p = n) {
+      n = p->bi_link;
+      p->bi_link = h[p->bi_key_hash & (newsize - 1)];
+      h[p->bi_key_hash & (newsize - 1)] = p;
+    }
+  }
+  free(bs->bs_hash);
+  bs->bs_hash = h;
+  bs->bs_mask = newsize - 1;
+}
+
+
+/**
+ * Assume shard is locked
+ */
+static void
+shard_insert(blobcache_shard_t *bs, blobcache_item_t *p)
+{
+  if(bs->bs_items >= (bs->bs_mask + 1) * 2)
+    shard_grow(bs);
+
+  blobcache_item_t **q = &bs->bs_hash[p->bi_key_hash & bs->bs_mask];
+  p->bi_link = *q;
+  *q = p;
+  bs->bs_items++;
+  bs->bs_size += p->bi_size;
+
+  hts_mutex_lock(&lru_lock);
+  lru_link(p);
+  hts_mutex_unlock(&lru_lock);
+}
+
+
+/**
+ * Assume shard is locked, q is from shard_lookup()
+ */
+static blobcache_item_t *
+shard_remove(blobcache_shard_t *bs, blobcache_item_t **q)
+{
+  blobcache_item_t *p = *q;
+  *q = p->bi_link;
+  bs->bs_items--;
+  bs->bs_size -= p->bi_size;
+
+  hts_mutex_lock(&lru_lock);
+  lru_unlink(p);
+  hts_mutex_unlock(&lru_lock);
+  return p;
+}
+
+
+/**
+ * Unlocked read, it's only used to make decisions about pruning
+ */
+static uint64_t
+current_cache_size(void)
+{
+  uint64_t size = 0;
+  for(int i = 0; i < BC_NUM_SHARDS; i++)
+    size += shards[i].bs_size;
+  return size;
+}
 
 /**
  *
@@ -129,7 +489,7 @@ blobcache_compute_maxsize(void)
 
   snprintf(path, sizeof(path), "%s", gconf.cache_path);
   if(!fa_fsinfo(path, &ffi)) {
-    uint64_t avail = ffi.ffi_avail + current_cache_size;
+    uint64_t avail = ffi.ffi_avail + current_cache_size();
     avail = MAX(BLOB_CACHE_MINSIZE, MIN(avail / 10, BLOB_CACHE_MAXSIZE));
     return avail;
   }
@@ -182,7 +542,268 @@ make_filename(char *buf, size_t len, uint64_t hash, int for_write)
 
 
 /**
+ * Small items are appended to a few large segment files (bc2/segNNN.dat)
+ * instead of being stored in a file of their own. This avoids a file
+ * open, stat and unlink per item and wastes less space on the
+ * filesystem. Segments are only appended to by the flush thread.
+ * Space held by removed items is reclaimed by compaction, which moves
+ * any remaining items out of a mostly dead segment and then deletes it.
+ *
+ * Where supported, segments are read through a read-only mapping.
+ *
+ * Lock order: segment_lock may be taken while holding a shard lock
+ */
+#define BC_SEGMENT_NONE   0xffff
+#define BC_MAX_SEGMENTS   128
+#define BC_SEGMENT_SIZE   (16 * 1024 * 1024)
+#define BC_PACK_MAX_ITEM  (256 * 1024)
+
+typedef struct blobcache_segment {
+  uint32_t seg_size;    // Bytes written, zero if segment is unused
+  uint32_t seg_live;    // Bytes referenced by items in the index
+  int seg_readers;
+#ifdef BC_USE_MMAP
+  void *seg_map;
+#endif
+} blobcache_segment_t;
+
+static blobcache_segment_t segments[BC_MAX_SEGMENTS];
+static hts_mutex_t segment_lock;
+static hts_cond_t segment_cond;
+
+static int append_segment = -1;  // Only accessed by flush thread
+static fa_handle_t *append_fh;   // Only accessed by flush thread
+static int segment_gc_needed;    // Protected by cache_lock
+
+
+/**
+ *
+ */
+static void
+segment_filename(char *buf, size_t len, int seg)
+{
+  snprintf(buf, len, "%s/bc2/seg%03d.dat", gconf.cache_path, seg);
+}
+
+
+/**
+ * Drop the item's reference to its segment storage
+ */
+static void
+item_release_storage(blobcache_item_t *p)
+{
+  if(p->bi_segment == BC_SEGMENT_NONE)
+    return;
+
+  hts_mutex_lock(&segment_lock);
+  segments[p->bi_segment].seg_live -= p->bi_size + p->bi_content_type_len;
+  hts_mutex_unlock(&segment_lock);
+  p->bi_segment = BC_SEGMENT_NONE;
+}
+
+
+/**
+ * Make sure the segment is not deleted while we read from it
+ */
+static int
+segment_acquire(int seg, uint32_t offset, uint32_t len)
+{
+  int r = -1;
+  hts_mutex_lock(&segment_lock);
+  blobcache_segment_t *bs = &segments[seg];
+  if((uint64_t)offset + len <= bs->seg_size) {
+    bs->seg_readers++;
+    r = 0;
+  }
+  hts_mutex_unlock(&segment_lock);
+  return r;
+}
+
+
+/**
+ *
+ */
+static void
+segment_release(int seg)
+{
+  hts_mutex_lock(&segment_lock);
+  if(--segments[seg].seg_readers == 0)
+    hts_cond_broadcast(&segment_cond);
+  hts_mutex_unlock(&segment_lock);
+}
+
+
+/**
+ * Caller must have acquired the segment
+ */
+static int
+segment_read(int seg, uint32_t offset, void *dst, size_t len)
+{
+  char path[PATH_MAX];
+  segment_filename(path, sizeof(path), seg);
+
+#ifdef BC_USE_MMAP
+  hts_mutex_lock(&segment_lock);
+  blobcache_segment_t *bs = &segments[seg];
+  if(bs->seg_map == NULL) {
+    int fd = open(path, O_RDONLY);
+    if(fd != -1) {
+      // Map the maximum size of a segment so we don't need to remap
+      // as the segment grows. We never touch anything beyond seg_size
+      void *m = mmap(NULL, BC_SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if(m != MAP_FAILED)
+        bs->seg_map = m;
+    }
+  }
+  const uint8_t *map = bs->seg_map;
+  hts_mutex_unlock(&segment_lock);
+
+  if(map != NULL) {
+    memcpy(dst, map + offset, len);
+    return 0;
+  }
+#endif
+
+  fa_handle_t *fh = fa_open(path, NULL, 0);
+  if(fh == NULL)
+    return -1;
+
+  int r = 0;
+  if(fa_seek(fh, offset, SEEK_SET) != offset || fa_read(fh, dst, len) != len)
+    r = -1;
+  fa_close(fh);
+  return r;
+}
+
+
+/**
+ * Append data to the current segment, called on flush thread only
+ */
+static int
+segment_append(const void *hdr, size_t hdrlen, const void *data, size_t len,
+               uint16_t *segp, uint32_t *offsetp)
+{
+  char path[PATH_MAX];
+  const uint32_t total = hdrlen + len;
+
+  if(append_segment != -1 &&
+     segments[append_segment].seg_size + total > BC_SEGMENT_SIZE) {
+    fa_close(append_fh);
+    append_fh = NULL;
+    append_segment = -1;
+  }
+
+  if(append_segment == -1) {
+    int seg;
+    hts_mutex_lock(&segment_lock);
+    for(seg = 0; seg < BC_MAX_SEGMENTS; seg++) {
+      const blobcache_segment_t *bs = &segments[seg];
+      if(bs->seg_size == 0 && bs->seg_live == 0 && bs->seg_readers == 0)
+        break;
+    }
+    hts_mutex_unlock(&segment_lock);
+
+    if(seg == BC_MAX_SEGMENTS)
+      return -1;
+
+    segment_filename(path, sizeof(path), seg);
+    append_fh = fa_open_ex(path, NULL, 0, FA_WRITE, NULL);
+    if(append_fh == NULL)
+      return -1;
+    append_segment = seg;
+  }
+
+  blobcache_segment_t *bs = &segments[append_segment];
+  const uint32_t offset = bs->seg_size;
+
+  int ok = 1;
+  if(hdrlen && fa_write(append_fh, hdr, hdrlen) != hdrlen)
+    ok = 0;
+  if(ok && fa_write(append_fh, data, len) != len)
+    ok = 0;
+
+  // Even if the write failed the space is consumed (as dead data)
+  // Caller accounts for live data once an item refers to it
+  hts_mutex_lock(&segment_lock);
+  bs->seg_size += total;
+  hts_mutex_unlock(&segment_lock);
+
+  if(!ok) {
+    fa_close(append_fh);
+    append_fh = NULL;
+    append_segment = -1;
+    return -1;
+  }
+
+  *segp = append_segment;
+  *offsetp = offset;
+  return 0;
+}
+
+
+/**
+ * Delete segments that are no longer referenced, called on flush
+ * thread only
+ */
+static void
+segments_gc(void)
+{
+  char path[PATH_MAX];
+
+  for(int seg = 0; seg < BC_MAX_SEGMENTS; seg++) {
+    blobcache_segment_t *bs = &segments[seg];
+
+    if(seg == append_segment)
+      continue;
+
+    hts_mutex_lock(&segment_lock);
+    if(bs->seg_size == 0 || bs->seg_live != 0) {
+      hts_mutex_unlock(&segment_lock);
+      continue;
+    }
+
+    // No items refer to the segment and setting size to zero makes
+    // segment_acquire() fail so no new readers can arrive
+    bs->seg_size = 0;
+    while(bs->seg_readers > 0)
+      hts_cond_wait(&segment_cond, &segment_lock);
+
+#ifdef BC_USE_MMAP
+    if(bs->seg_map != NULL) {
+      munmap(bs->seg_map, BC_SEGMENT_SIZE);
+      bs->seg_map = NULL;
+    }
+#endif
+    hts_mutex_unlock(&segment_lock);
+
+    segment_filename(path, sizeof(path), seg);
+    fa_unlink(path, NULL, 0);
+  }
+}
+
+
+/**
+ * Item must have been removed from the index
+ */
+static void
+item_destroy(blobcache_item_t *p)
+{
+  blobcache_shard_t *bs = shard_for(p->bi_key_hash);
+  item_release_storage(p);
+  buf_release(p->bi_pending);
+  free(p->bi_etag);
+  hts_mutex_lock(&bs->bs_mutex);
+  pool_put(bs->bs_pool, p);
+  hts_mutex_unlock(&bs->bs_mutex);
+}
+
+
+/**
+ * Items are written in LRU order so the lists can be rebuilt by
+ * appending when loading.
  *
+ * Must be called without any locks held
  */
 static void
 save_index(void)
@@ -190,9 +811,8 @@ save_index(void)
   char errbuf[512];
   char filename[PATH_MAX];
   uint8_t *out, *base;
-  int i;
   blobcache_item_t *p;
-  blobcache_diskitem_07_t *di;
+  blobcache_diskitem_09_t *di;
   size_t siz;
 
   if(!index_dirty)
@@ -200,68 +820,105 @@ save_index(void)
 
   snprintf(filename, sizeof(filename), "%s/bc2/index.dat", gconf.cache_path);
 
-  fa_handle_t *fh = fa_open_ex(filename, errbuf, sizeof(errbuf),
-                               FA_WRITE, NULL);
-  if(fh == NULL) {
-    TRACE(TRACE_ERROR, "blobcache", "Unable to write index %s -- %s",
-          filename, errbuf);
-    return;
-  }
-
   int items = 0;
-  siz = 12 + 20;
+  siz = 12 + 4 + 20;
+
+  // Serialize into memory with all shards locked, do I/O after
+  shards_lock_all();
+  hts_mutex_lock(&lru_lock);
+
+  const int n = atomic_get(&num_stashes);
 
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
-    for(p = hashvector[i]; p != NULL; p = p->bi_link) {
-      siz += sizeof(blobcache_diskitem_07_t);
-      siz += p->bi_etag ? strlen(p->bi_etag) : 0;
-      items++;
+  for(int i = 0; i < n; i++) {
+    blobcache_stash_t *bst = &stashes[i];
+    if(i > 0)
+      siz += 1 + strlen(bst->bst_name);
+
+    for(int j = 0; j < 2; j++) {
+      TAILQ_FOREACH(p, j ? &bst->bst_lru_important : &bst->bst_lru,
+                    bi_lru_link) {
+        siz += sizeof(blobcache_diskitem_09_t);
+        siz += p->bi_etag ? strlen(p->bi_etag) : 0;
+        items++;
+      }
     }
   }
 
   base = out = mymalloc(siz);
   if(out == NULL) {
-    fa_close(fh);
+    hts_mutex_unlock(&lru_lock);
+    shards_unlock_all();
     return;
   }
-  *(uint32_t *)out = BC2_MAGIC_07;
+  index_dirty = 0;
+
+  *(uint32_t *)out = BC2_MAGIC_09;
   out += 4;
   *(uint32_t *)out = items;
   out += 4;
   *(uint32_t *)out = time(NULL);
   out += 4;
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
-    for(p = hashvector[i]; p != NULL; p = p->bi_link) {
-      const int etaglen = p->bi_etag ? strlen(p->bi_etag) : 0;
-      di = (blobcache_diskitem_07_t *)out;
-      di->di_key_hash     = p->bi_key_hash;
-      di->di_content_hash = p->bi_content_hash;
-      di->di_lastaccess   = p->bi_lastaccess;
-      di->di_expiry       = p->bi_expiry;
-      di->di_modtime      = p->bi_modtime;
-      di->di_size         = p->bi_size;
-      di->di_flags        = p->bi_flags;
-      di->di_etaglen      = etaglen;
-      di->di_content_type_len = p->bi_content_type_len;
-      out += sizeof(blobcache_diskitem_07_t);
-      if(etaglen) {
-	memcpy(out, p->bi_etag, etaglen);
-	out += etaglen;
-      }
+  *(uint32_t *)out = n;
+  out += 4;
 
+  for(int i = 1; i < n; i++) {
+    const int len = strlen(stashes[i].bst_name);
+    *out++ = len;
+    memcpy(out, stashes[i].bst_name, len);
+    out += len;
+  }
+
+  for(int i = 0; i < n; i++) {
+    blobcache_stash_t *bst = &stashes[i];
+
+    for(int j = 0; j < 2; j++) {
+      TAILQ_FOREACH(p, j ? &bst->bst_lru_important : &bst->bst_lru,
+                    bi_lru_link) {
+        const int etaglen = p->bi_etag ? strlen(p->bi_etag) : 0;
+        di = (blobcache_diskitem_09_t *)out;
+        di->di_key_hash     = p->bi_key_hash;
+        di->di_content_hash = p->bi_content_hash;
+        di->di_lastaccess   = p->bi_lastaccess;
+        di->di_expiry       = p->bi_expiry;
+        di->di_modtime      = p->bi_modtime;
+        di->di_size         = p->bi_size;
+        di->di_offset       = p->bi_offset;
+        di->di_segment      = p->bi_segment;
+        di->di_stash        = p->bi_stash;
+        di->di_flags        = p->bi_flags;
+        di->di_etaglen      = etaglen;
+        di->di_content_type_len = p->bi_content_type_len;
+        out += sizeof(blobcache_diskitem_09_t);
+        if(etaglen) {
+          memcpy(out, p->bi_etag, etaglen);
+          out += etaglen;
+        }
+      }
     }
   }
 
+  hts_mutex_unlock(&lru_lock);
+  shards_unlock_all();
+
   sha1_decl(shactx);
   sha1_init(shactx);
   sha1_update(shactx, base, siz - 20);
   sha1_final(shactx, out);
 
+  fa_handle_t *fh = fa_open_ex(filename, errbuf, sizeof(errbuf),
+                               FA_WRITE, NULL);
+  if(fh == NULL) {
+    TRACE(TRACE_ERROR, "blobcache", "Unable to write index %s -- %s",
+          filename, errbuf);
+    index_dirty = 1;
+    free(base);
+    return;
+  }
+
   if(fa_write(fh, base, siz) != siz) {
     TRACE(TRACE_INFO, "blobcache", "Unable to store index file %s -- %s",
 	  filename, strerror(errno));
-  } else {
-    index_dirty = 0;
+    index_dirty = 1;
   }
 
   free(base);
@@ -272,6 +929,48 @@ save_index(void)
 /**
  *
  */
+static int
+accesstimecmp(const void *A, const void *B)
+{
+  const blobcache_item_t *a = *(const blobcache_item_t **)A;
+  const blobcache_item_t *b = *(const blobcache_item_t **)B;
+
+  return a->bi_lastaccess - b->bi_lastaccess;
+}
+
+
+/**
+ * Order list by last access, only needed when upgrading the index
+ */
+static void
+lru_sort(struct blobcache_item_queue *q)
+{
+  blobcache_item_t *p, **v;
+  int cnt = 0;
+
+  TAILQ_FOREACH(p, q, bi_lru_link)
+    cnt++;
+
+  if(cnt == 0 || (v = malloc(sizeof(blobcache_item_t *) * cnt)) == NULL)
+    return;
+
+  cnt = 0;
+  TAILQ_FOREACH(p, q, bi_lru_link)
+    v[cnt++] = p;
+
+  qsort(v, cnt, sizeof(blobcache_item_t *), accesstimecmp);
+
+  TAILQ_INIT(q);
+  for(int i = 0; i < cnt; i++)
+    TAILQ_INSERT_TAIL(q, v[i], bi_lru_link);
+  free(v);
+}
+
+
+/**
+ * Called during init before the flush thread is started so no locking
+ * is needed
+ */
 static void
 load_index(void)
 {
@@ -331,13 +1030,36 @@ load_index(void)
 
   TRACE(TRACE_DEBUG, "blobcache", "Cache magic 0x%08x %d items", magic, items);
 
+  uint8_t stashmap[BC_MAX_STASHES] = {0};
+
   switch(magic) {
   case BC2_MAGIC_06:
-    TRACE(TRACE_INFO, "blobcache", "Upgrading from older format 0x%08x", magic);
-    // FALLTHRU
   case BC2_MAGIC_07:
+  case BC2_MAGIC_08:
+    TRACE(TRACE_INFO, "blobcache", "Upgrading from older format 0x%08x", magic);
+    loaded_cache_is_from = *(uint32_t *)in;
+    in += 4;
+    break;
+
+  case BC2_MAGIC_09: {
     loaded_cache_is_from = *(uint32_t *)in;
     in += 4;
+    const int num = *(uint32_t *)in;
+    in += 4;
+    if(num > BC_MAX_STASHES) {
+      TRACE(TRACE_INFO, "blobcache", "Invalid number of stashes %d", num);
+      free(base);
+      return;
+    }
+    for(i = 1; i < num; i++) {
+      char name[256];
+      const int len = *in++;
+      memcpy(name, in, len);
+      name[len] = 0;
+      in += len;
+      stashmap[i] = stash_get(name);
+    }
+  }
     break;
 
   case BC2_MAGIC_05:
@@ -352,7 +1074,8 @@ load_index(void)
 
 
   for(i = 0; i < items; i++) {
-    p = pool_get(item_pool);
+    blobcache_item_t tmp;
+    p = &tmp;
     int etaglen;
 
     switch(magic) {
@@ -368,8 +1091,11 @@ load_index(void)
       p->bi_size             = di->di_size;
       p->bi_content_type_len = di->di_content_type_len;
       p->bi_flags            = 0;
+      p->bi_segment          = BC_SEGMENT_NONE;
+      p->bi_offset           = 0;
       etaglen                = di->di_etaglen;
       in += sizeof(blobcache_diskitem_06_t);
+      p->bi_stash            = 0;
     }
       break;
 
@@ -384,8 +1110,55 @@ load_index(void)
       p->bi_size             = di->di_size;
       p->bi_content_type_len = di->di_content_type_len;
       p->bi_flags            = di->di_flags;
+      p->bi_segment          = BC_SEGMENT_NONE;
+      p->bi_offset           = 0;
       etaglen                = di->di_etaglen;
       in += sizeof(blobcache_diskitem_07_t);
+      p->bi_stash            = 0;
+    }
+      break;
+
+    case BC2_MAGIC_08: {
+      const blobcache_diskitem_08_t *di = (blobcache_diskitem_08_t *)in;
+
+      p->bi_key_hash         = di->di_key_hash;
+      p->bi_content_hash     = di->di_content_hash;
+      p->bi_lastaccess       = di->di_lastaccess;
+      p->bi_expiry           = di->di_expiry;
+      p->bi_modtime          = di->di_modtime;
+      p->bi_size             = di->di_size;
+      p->bi_content_type_len = di->di_content_type_len;
+      p->bi_flags            = di->di_flags;
+      p->bi_segment          = di->di_segment;
+      p->bi_offset           = di->di_offset;
+      etaglen                = di->di_etaglen;
+      in += sizeof(blobcache_diskitem_08_t);
+      p->bi_stash            = 0;
+
+      if(p->bi_segment >= BC_MAX_SEGMENTS)
+        p->bi_segment = BC_SEGMENT_NONE;
+    }
+      break;
+
+    case BC2_MAGIC_09: {
+      const blobcache_diskitem_09_t *di = (blobcache_diskitem_09_t *)in;
+
+      p->bi_key_hash         = di->di_key_hash;
+      p->bi_content_hash     = di->di_content_hash;
+      p->bi_lastaccess       = di->di_lastaccess;
+      p->bi_expiry           = di->di_expiry;
+      p->bi_modtime          = di->di_modtime;
+      p->bi_size             = di->di_size;
+      p->bi_content_type_len = di->di_content_type_len;
+      p->bi_flags            = di->di_flags;
+      p->bi_segment          = di->di_segment;
+      p->bi_offset           = di->di_offset;
+      p->bi_stash = di->di_stash < BC_MAX_STASHES ? stashmap[di->di_stash] : 0;
+      etaglen                = di->di_etaglen;
+      in += sizeof(blobcache_diskitem_09_t);
+
+      if(p->bi_segment >= BC_MAX_SEGMENTS)
+        p->bi_segment = BC_SEGMENT_NONE;
     }
       break;
     default:
@@ -400,11 +1173,23 @@ load_index(void)
     } else {
       p->bi_etag = NULL;
     }
-    p->bi_link = hashvector[p->bi_key_hash & ITEM_HASH_MASK];
-    hashvector[p->bi_key_hash & ITEM_HASH_MASK] = p;
-    current_cache_size += p->bi_size;
+    p->bi_pending = NULL;
+
+    blobcache_shard_t *bs = shard_for(tmp.bi_key_hash);
+    p = pool_get(bs->bs_pool);
+    *p = tmp;
+    shard_insert(bs, p);
+
+    if(p->bi_segment != BC_SEGMENT_NONE)
+      segments[p->bi_segment].seg_live += p->bi_size + p->bi_content_type_len;
   }
   free(base);
+
+  if(magic != BC2_MAGIC_09) {
+    // Older formats are not stored in LRU order
+    lru_sort(&stashes[0].bst_lru);
+    lru_sort(&stashes[0].bst_lru_important);
+  }
 }
 
 
@@ -419,6 +1204,7 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
   uint64_t dk = digest_key(key, stash);
   uint64_t dc = digest_content(b->b_ptr, b->b_size);
   uint32_t now = time(NULL);
+  blobcache_shard_t *bs = shard_for(dk);
   blobcache_item_t *p;
 
   if(etag != NULL && strlen(etag) > 255)
@@ -426,26 +1212,35 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
 
   bcprintf("cache: Writing %s ... ", key);
 
-  hts_mutex_lock(&cache_lock);
   if(bcstate != BLOBCACHE_RUN) {
     bcprintf("Cache not running\n");
-    hts_mutex_unlock(&cache_lock);
     return 0;
   }
 
-  for(p = hashvector[dk & ITEM_HASH_MASK]; p != NULL; p = p->bi_link)
-    if(p->bi_key_hash == dk)
-      break;
+  const int stash_id = stash_get(stash);
+
+  hts_mutex_lock(&bs->bs_mutex);
+
+  p = *shard_lookup(bs, dk);
 
-  hts_cond_signal(&cache_cond);
   index_dirty = 1;
 
   if(p != NULL && p->bi_content_hash == dc && p->bi_size == b->b_size) {
     p->bi_modtime = mtime;
     p->bi_expiry = now + maxage;
+    mystrset(&p->bi_etag, etag);
+
+    hts_mutex_lock(&lru_lock);
+    lru_unlink(p);
     p->bi_lastaccess = now;
     p->bi_flags = flags;
-    mystrset(&p->bi_etag, etag);
+    lru_link(p);
+    hts_mutex_unlock(&lru_lock);
+
+    hts_mutex_unlock(&bs->bs_mutex);
+
+    hts_mutex_lock(&cache_lock);
+    hts_cond_signal(&cache_cond);
     hts_mutex_unlock(&cache_lock);
     bcprintf("Already in\n");
     return 1;
@@ -453,20 +1248,22 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
 
   bcprintf("Ok\n");
 
-  blobcache_flush_t *bf = pool_get(item_pool);
-  bf->bf_key_hash = dk;
-  bf->bf_buf = buf_retain(b);
-  TAILQ_INSERT_TAIL(&flush_queue, bf, bf_link);
-  hts_cond_signal(&cache_cond);
+  const int is_new = p == NULL;
 
-  if(p == NULL) {
-    p = pool_get(item_pool);
+  if(is_new) {
+    p = pool_get(bs->bs_pool);
     p->bi_key_hash = dk;
-    p->bi_size = 0;
-    p->bi_content_type_len = 0;
-    p->bi_link = hashvector[dk & ITEM_HASH_MASK];
     p->bi_etag = NULL;
-    hashvector[dk & ITEM_HASH_MASK] = p;
+    p->bi_pending = NULL;
+    p->bi_segment = BC_SEGMENT_NONE;
+    p->bi_stash = stash_id;
+  } else {
+    // Old content is no longer needed
+    item_release_storage(p);
+    bs->bs_size -= p->bi_size;
+    hts_mutex_lock(&lru_lock);
+    lru_unlink(p);
+    hts_mutex_unlock(&lru_lock);
   }
 
   int64_t expiry = (int64_t)maxage + now;
@@ -476,45 +1273,87 @@ blobcache_put(const char *key, const char *stash, buf_t *b,
   p->bi_expiry = MIN(INT32_MAX, expiry);
   p->bi_lastaccess = now;
   p->bi_content_hash = dc;
-  current_cache_size -= p->bi_size;
   p->bi_size = b->b_size;
-  current_cache_size += p->bi_size;
   p->bi_content_type_len = b->b_content_type ?
     strlen(rstr_get(b->b_content_type)) : 0;
   p->bi_flags = flags;
+
+  if(is_new) {
+    shard_insert(bs, p);
+  } else {
+    bs->bs_size += p->bi_size;
+    hts_mutex_lock(&lru_lock);
+    lru_link(p);
+    hts_mutex_unlock(&lru_lock);
+  }
+
+  buf_release(p->bi_pending);
+  p->bi_pending = buf_retain(b);
+
+  blobcache_flush_t *bf = pool_get(bs->bs_pool);
+  bf->bf_key_hash = dk;
+  bf->bf_buf = buf_retain(b);
+
+  // Enqueue while still holding the shard lock so writes for the
+  // same key are flushed in the same order as they were put
+  hts_mutex_lock(&cache_lock);
+  TAILQ_INSERT_TAIL(&flush_queue, bf, bf_link);
+  hts_cond_signal(&cache_cond);
   hts_mutex_unlock(&cache_lock);
+
+  hts_mutex_unlock(&bs->bs_mutex);
   return 0;
 }
 
 
+/**
+ * Remove item from index if it's still the same as when we looked at it
+ */
+static void
+blobcache_drop(uint64_t dk, uint64_t content_hash)
+{
+  blobcache_shard_t *bs = shard_for(dk);
+  blobcache_item_t *p = NULL, **q;
+
+  hts_mutex_lock(&bs->bs_mutex);
+  q = shard_lookup(bs, dk);
+  if(*q != NULL && (*q)->bi_content_hash == content_hash &&
+     (*q)->bi_pending == NULL) {
+    p = shard_remove(bs, q);
+    index_dirty = 1;
+  }
+  hts_mutex_unlock(&bs->bs_mutex);
+
+  if(p != NULL)
+    item_destroy(p);
+}
+
+
 /**
  *
  */
-buf_t *
-blobcache_get(const char *key, const char *stash, int pad,
-	      int *ignore_expiry, char **etagp, time_t *mtimep)
+static buf_t *
+blobcache_load(uint64_t dk, int pad,
+               int *ignore_expiry, char **etagp, time_t *mtimep)
 {
-  uint64_t dk = digest_key(key, stash);
+  blobcache_shard_t *bs = shard_for(dk);
   blobcache_item_t *p, **q;
   char filename[PATH_MAX];
   uint32_t now;
 
   bcprintf("cache: Reading %s ... ", key);
 
-  hts_mutex_lock(&cache_lock);
-
   if(bcstate == BLOBCACHE_STOPPING) {
-    bcprintf("Cache stopped ... ");
-    p = NULL;
-  } else {
-    for(q = &hashvector[dk & ITEM_HASH_MASK]; (p = *q); q = &p->bi_link)
-      if(p->bi_key_hash == dk)
-	break;
+    bcprintf("Cache stopped\n");
+    return NULL;
   }
 
-  if(p == NULL) {
+  hts_mutex_lock(&bs->bs_mutex);
+
+  q = shard_lookup(bs, dk);
+  if((p = *q) == NULL) {
     bcprintf("Item not found\n");
-    hts_mutex_unlock(&cache_lock);
+    hts_mutex_unlock(&bs->bs_mutex);
     return NULL;
   }
 
@@ -528,82 +1367,144 @@ blobcache_get(const char *key, const char *stash, int pad,
            expired ? "yes":"no",
            clock_ok ? "" : " (Bad system clock)");
 
-  if(expired && ignore_expiry == NULL)
-    goto bad;
-
-  blobcache_flush_t *bf;
-  buf_t *b = NULL;
-  fa_handle_t *fh = NULL;
-  TAILQ_FOREACH_REVERSE(bf, &flush_queue, blobcache_flush_queue, bf_link) {
-    if(bf->bf_key_hash == p->bi_key_hash) {
-      // Item is not yet written to disk
-      b = buf_retain(bf->bf_buf);
-      break;
-    }
+  if(expired && ignore_expiry == NULL) {
+    p = shard_remove(bs, q);
+    index_dirty = 1;
+    hts_mutex_unlock(&bs->bs_mutex);
+    item_destroy(p);
+    return NULL;
   }
 
-  if(b == NULL) {
-    make_filename(filename, sizeof(filename), p->bi_key_hash, 0);
-    fh = fa_open(filename, NULL, 0);
-    if(fh == NULL) {
-    bad:
-      *q = p->bi_link;
-      pool_put(item_pool, p);
-      hts_mutex_unlock(&cache_lock);
-      return NULL;
-    }
+  // Item might not yet be written to disk
+  buf_t *b = p->bi_pending ? buf_retain(p->bi_pending) : NULL;
+
+  // Copy what we need, the item may go away once we unlock
+  const uint64_t content_hash = p->bi_content_hash;
+  const uint32_t size = p->bi_size;
+  const int content_type_len = p->bi_content_type_len;
+  const time_t mtime = p->bi_modtime;
+  const int segment = p->bi_segment;
+  const uint32_t offset = p->bi_offset;
+
+  if(b == NULL && segment != BC_SEGMENT_NONE &&
+     segment_acquire(segment, offset, size + content_type_len)) {
+    // Segment is truncated
+    p = shard_remove(bs, q);
+    index_dirty = 1;
+    hts_mutex_unlock(&bs->bs_mutex);
+    item_destroy(p);
+    return NULL;
+  }
 
-    int64_t size = fa_fsize(fh);
+  char *etag = etagp != NULL && p->bi_etag ? strdup(p->bi_etag) : NULL;
 
-    if(size != p->bi_size + p->bi_content_type_len) {
-      fa_unlink(filename, NULL, 0);
-      goto bad;
-    }
+  // Only mark lastaccess if clock is good. Items accessed within the
+  // same second are already in the right place on the LRU list
+  if(bcstate == BLOBCACHE_RUN && p->bi_lastaccess != now) {
+    hts_mutex_lock(&lru_lock);
+    lru_unlink(p);
+    p->bi_lastaccess = now;
+    lru_link(p);
+    hts_mutex_unlock(&lru_lock);
   }
 
-  if(mtimep)
-    *mtimep = p->bi_modtime;
+  index_dirty = 1; // We don't deem it important enough to wakeup on get
+
+  hts_mutex_unlock(&bs->bs_mutex);
 
-  if(etagp != NULL)
-    *etagp = p->bi_etag ? strdup(p->bi_etag) : NULL;
+  if(b == NULL && segment != BC_SEGMENT_NONE) {
 
-  // Only mark lastaccess if clock is good
-  if(bcstate == BLOBCACHE_RUN)
-    p->bi_lastaccess = now;
+    b = buf_create(size + pad);
+    if(b != NULL) {
+      b->b_size = size; // Get rid of padding in reported length
+      if(content_type_len)
+        b->b_content_type = rstr_allocl(NULL, content_type_len);
 
-  index_dirty = 1; // We don't deem it important enough to wakeup on get
+      if((content_type_len &&
+          segment_read(segment, offset, rstr_data(b->b_content_type),
+                       content_type_len)) ||
+         segment_read(segment, offset + content_type_len, b->b_ptr, size)) {
+        buf_release(b);
+        b = NULL;
+      } else {
+        memset(b->b_ptr + size, 0, pad);
+      }
+    }
+    segment_release(segment);
 
-  if(ignore_expiry != NULL)
-    *ignore_expiry = expired;
+    if(b == NULL) {
+      free(etag);
+      return NULL;
+    }
 
-  hts_mutex_unlock(&cache_lock);
+  } else if(b == NULL) {
+    make_filename(filename, sizeof(filename), dk, 0);
+    fa_handle_t *fh = fa_open(filename, NULL, 0);
+    if(fh == NULL) {
+      blobcache_drop(dk, content_hash);
+      free(etag);
+      return NULL;
+    }
 
-  if(b == NULL) {
+    if(fa_fsize(fh) != size + content_type_len) {
+      fa_close(fh);
+      blobcache_drop(dk, content_hash);
+      free(etag);
+      return NULL;
+    }
 
-    b = buf_create(p->bi_size + pad);
+    b = buf_create(size + pad);
     if(b == NULL) {
       fa_close(fh);
+      free(etag);
       return NULL;
     }
-    b->b_size = p->bi_size; // Get rid of padding in reported length
-    if(p->bi_content_type_len) {
-      b->b_content_type = rstr_allocl(NULL, p->bi_content_type_len);
-      if(fa_read(fh, rstr_data(b->b_content_type), p->bi_content_type_len) !=
-	 p->bi_content_type_len) {
+    b->b_size = size; // Get rid of padding in reported length
+    if(content_type_len) {
+      b->b_content_type = rstr_allocl(NULL, content_type_len);
+      if(fa_read(fh, rstr_data(b->b_content_type), content_type_len) !=
+	 content_type_len) {
 	buf_release(b);
 	fa_close(fh);
+        free(etag);
 	return NULL;
       }
     }
 
-    if(fa_read(fh, b->b_ptr, p->bi_size) != p->bi_size) {
+    if(fa_read(fh, b->b_ptr, size) != size) {
       buf_release(b);
       fa_close(fh);
+      free(etag);
       return NULL;
     }
-    memset(b->b_ptr + p->bi_size, 0, pad);
+    memset(b->b_ptr + size, 0, pad);
     fa_close(fh);
   }
+
+  if(mtimep)
+    *mtimep = mtime;
+
+  if(etagp != NULL)
+    *etagp = etag;
+
+  if(ignore_expiry != NULL)
+    *ignore_expiry = expired;
+
+  return b;
+}
+
+
+/**
+ *
+ */
+buf_t *
+blobcache_get(const char *key, const char *stash, int pad,
+	      int *ignore_expiry, char **etagp, time_t *mtimep)
+{
+  blobcache_stash_t *bst = &stashes[stash_get(stash)];
+  buf_t *b = blobcache_load(digest_key(key, stash), pad,
+                            ignore_expiry, etagp, mtimep);
+  atomic_inc(b != NULL ? &bst->bst_hits : &bst->bst_misses);
   return b;
 }
 
@@ -616,20 +1517,19 @@ blobcache_get(const char *key, const char *stash, int pad,
  */
 int
 blobcache_get_meta(const char *key, const char *stash, 
-		   char **etagp, time_t *mtimep)
+		   char **etagp, time_t *mtimep, int *is_expired)
 {
   uint64_t dk = digest_key(key, stash);
+  blobcache_shard_t *bs = shard_for(dk);
   blobcache_item_t *p;
   int r;
-  hts_mutex_lock(&cache_lock);
 
-  if(bcstate == BLOBCACHE_STOPPING) {
-    p = NULL;
-  } else {
-    for(p = hashvector[dk & ITEM_HASH_MASK]; p != NULL; p = p->bi_link)
-      if(p->bi_key_hash == dk)
-	break;
-  }
+  if(bcstate == BLOBCACHE_STOPPING)
+    return -1;
+
+  hts_mutex_lock(&bs->bs_mutex);
+
+  p = *shard_lookup(bs, dk);
 
   if(p != NULL) {
     r = 0;
@@ -640,26 +1540,32 @@ blobcache_get_meta(const char *key, const char *stash,
     if(etagp != NULL)
       *etagp = p->bi_etag ? strdup(p->bi_etag) : NULL;
 
+    if(is_expired != NULL) {
+      const uint32_t now = time(NULL);
+      *is_expired = now > p->bi_expiry && now >= 1426926328;
+    }
+
   } else {
     r = -1;
   }
 
-  hts_mutex_unlock(&cache_lock);
+  hts_mutex_unlock(&bs->bs_mutex);
   return r;
 }
 
 
 /**
- * Assume we're locked
+ *
  */
-static blobcache_item_t *
-lookup_item(uint64_t dk)
+static int
+item_uses_file(uint64_t dk)
 {
-  blobcache_item_t *p;
-  for(p = hashvector[dk & ITEM_HASH_MASK]; p != NULL; p = p->bi_link)
-    if(p->bi_key_hash == dk)
-      return p;
-  return NULL;
+  blobcache_shard_t *bs = shard_for(dk);
+  hts_mutex_lock(&bs->bs_mutex);
+  const blobcache_item_t *p = *shard_lookup(bs, dk);
+  int r = p != NULL && p->bi_segment == BC_SEGMENT_NONE;
+  hts_mutex_unlock(&bs->bs_mutex);
+  return r;
 }
 
 /**
@@ -682,6 +1588,15 @@ prune_stale(void)
 
   RB_FOREACH(de1, &d1->fd_entries, fde_link) {
     const char *n1 = rstr_get(de1->fde_filename);
+    int seg;
+    if(sscanf(n1, "seg%03d.dat", &seg) == 1) {
+      // Runs before anything is appended so unused segments are stale
+      if(seg < 0 || seg >= BC_MAX_SEGMENTS || segments[seg].seg_size == 0) {
+        snprintf(path2, sizeof(path2), "%s/bc2/%s", gconf.cache_path, n1);
+        fa_unlink(path2, NULL, 0);
+      }
+      continue;
+    }
     if(n1[0] != '.') {
       snprintf(path2, sizeof(path2), "%s/bc2/%s",
 	       gconf.cache_path, n1);
@@ -695,14 +1610,11 @@ prune_stale(void)
 	    snprintf(path3, sizeof(path3), "%s/bc2/%s/%s",
 		     gconf.cache_path, n1, n2);
 
-            hts_mutex_lock(&cache_lock);
-
-	    if(sscanf(n2, "%016"PRIx64, &k) != 1 ||
-	       lookup_item(k) == NULL) {
+	    if(strlen(n2) != 16 || sscanf(n2, "%016"PRIx64, &k) != 1 ||
+	       !item_uses_file(k)) {
 	      TRACE(TRACE_DEBUG, "blobcache", "Removed stale file %s", path3);
 	      fa_unlink(path3, NULL, 0);
 	    }
-            hts_mutex_unlock(&cache_lock);
 	  }
 	}
         fa_dir_free(d2);
@@ -716,15 +1628,17 @@ prune_stale(void)
 
 
 /**
- *
+ * Item must have been removed from the index
  */
 static void
 prune_item(blobcache_item_t *p)
 {
-  char filename[PATH_MAX];
-  make_filename(filename, sizeof(filename), p->bi_key_hash, 0);
-  fa_unlink(filename, NULL, 0);
-  pool_put(item_pool, p);
+  if(p->bi_segment == BC_SEGMENT_NONE) {
+    char filename[PATH_MAX];
+    make_filename(filename, sizeof(filename), p->bi_key_hash, 0);
+    fa_unlink(filename, NULL, 0);
+  }
+  item_destroy(p);
 }
 
 
@@ -736,86 +1650,83 @@ void
 blobcache_evict(const char *key, const char *stash)
 {
   uint64_t dk = digest_key(key, stash);
+  blobcache_shard_t *bs = shard_for(dk);
+  blobcache_item_t *p = NULL, **q;
 
-  hts_mutex_lock(&cache_lock);
-  if(bcstate == BLOBCACHE_RUN) {
-    blobcache_item_t *p, **q;
-    q = &hashvector[dk & ITEM_HASH_MASK];
-    while((p = *q) != NULL) {
-      if(p->bi_key_hash == dk) {
-        current_cache_size -= p->bi_size;
-        *q = p->bi_link;
-        prune_item(p);
-        break;
-      }
-      q = &p->bi_link;
-    }
-  }
-  hts_mutex_unlock(&cache_lock);
-}
-
-
-/**
- *
- */
-static int
-accesstimecmp(const void *A, const void *B)
-{
-  const blobcache_item_t *a = *(const blobcache_item_t **)A;
-  const blobcache_item_t *b = *(const blobcache_item_t **)B;
-
-  const int a_imp = !!(a->bi_flags & BLOBCACHE_IMPORTANT_ITEM);
-  const int b_imp = !!(b->bi_flags & BLOBCACHE_IMPORTANT_ITEM);
+  if(bcstate != BLOBCACHE_RUN)
+    return;
 
-  if(a_imp != b_imp)
-    return a_imp - b_imp;
+  hts_mutex_lock(&bs->bs_mutex);
+  q = shard_lookup(bs, dk);
+  if(*q != NULL) {
+    p = shard_remove(bs, q);
+    index_dirty = 1;
+  }
+  hts_mutex_unlock(&bs->bs_mutex);
 
-  return a->bi_lastaccess - b->bi_lastaccess;
+  if(p != NULL)
+    prune_item(p);
 }
 
 
 /**
+ * Evict least recently used items from stashes that are over their
+ * budget and then from all stashes until the cache fits in maxsize.
  *
+ * Must be called without any locks held
  */
 static void
 prune_to_size(uint64_t maxsize)
 {
-  int i, tot = 0, j = 0;
-  blobcache_item_t *p, **sv;
+  blobcache_item_t *p, **q, *victims = NULL;
+  const int n = atomic_get(&num_stashes);
+
+  // Last round (i == n) is for the total size
+  for(int i = 0; i <= n; i++) {
+    blobcache_stash_t *bst = i < n ? &stashes[i] : NULL;
+
+    while(1) {
+      hts_mutex_lock(&lru_lock);
+      if(bst != NULL) {
+        const uint64_t budget = maxsize * bst->bst_share / 100;
+        p = bst->bst_size > budget ? lru_stash_victim(bst) : NULL;
+      } else {
+        uint64_t size = 0;
+        for(int j = 0; j < n; j++)
+          size += stashes[j].bst_size;
+        p = size > maxsize ? lru_victim() : NULL;
+      }
 
-  for(i = 0; i < ITEM_HASH_SIZE; i++)
-    for(p = hashvector[i]; p != NULL; p = p->bi_link)
-      tot++;
+      if(p == NULL) {
+        hts_mutex_unlock(&lru_lock);
+        break;
+      }
 
-  sv = malloc(sizeof(blobcache_item_t *) * tot);
-  current_cache_size = 0;
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
-    for(p = hashvector[i]; p != NULL; p = p->bi_link) {
-      sv[j++] = p;
-      current_cache_size += p->bi_size;
+      const uint64_t dk = p->bi_key_hash;
+      const uint32_t lastaccess = p->bi_lastaccess;
+      hts_mutex_unlock(&lru_lock);
+
+      // If the item was accessed or removed while we didn't hold any
+      // lock it's no longer the head of its list so just try again
+      blobcache_shard_t *bs = shard_for(dk);
+      hts_mutex_lock(&bs->bs_mutex);
+      q = shard_lookup(bs, dk);
+      if(*q == p && p->bi_lastaccess == lastaccess) {
+        shard_remove(bs, q);
+        p->bi_link = victims;
+        victims = p;
+        atomic_inc(&stashes[p->bi_stash].bst_evictions);
+        index_dirty = 1;
+      }
+      hts_mutex_unlock(&bs->bs_mutex);
     }
-    hashvector[i] = NULL;
   }
 
-  assert(j == tot);
-
-  qsort(sv, j, sizeof(blobcache_item_t *), accesstimecmp);
-  for(i = 0; i < j; i++) {
-    p = sv[i];
-    if(current_cache_size < maxsize)
-      break;
-    current_cache_size -= p->bi_size;
+  while((p = victims) != NULL) {
+    victims = p->bi_link;
     prune_item(p);
-    index_dirty = 1;
-  }
-
-  for(; i < j; i++) {
-    p = sv[i];
-    p->bi_link = hashvector[p->bi_key_hash & ITEM_HASH_MASK];
-    hashvector[p->bi_key_hash & ITEM_HASH_MASK] = p;
   }
 
-  free(sv);
   save_index();
 }
 
@@ -848,26 +1759,256 @@ static void
 cache_clear(void *opaque, prop_event_t event, ...)
 {
   int i;
-  blobcache_item_t *p, *n;
+  blobcache_item_t *p, *n, *victims = NULL;
 
-  hts_mutex_lock(&cache_lock);
+  shards_lock_all();
 
-  for(i = 0; i < ITEM_HASH_SIZE; i++) {
-    for(p = hashvector[i]; p != NULL; p = n) {
-      n = p->bi_link;
-      prune_item(p);
-      index_dirty = 1;
+  for(int s = 0; s < BC_NUM_SHARDS; s++) {
+    blobcache_shard_t *bs = &shards[s];
+    for(i = 0; i <= bs->bs_mask; i++) {
+      for(p = bs->bs_hash[i]; p != NULL; p = n) {
+        n = p->bi_link;
+        p->bi_link = victims;
+        victims = p;
+      }
+      bs->bs_hash[i] = NULL;
     }
-    hashvector[i] = NULL;
+    bs->bs_items = 0;
+    bs->bs_size = 0;
+  }
+
+  hts_mutex_lock(&lru_lock);
+  for(i = 0; i < atomic_get(&num_stashes); i++) {
+    TAILQ_INIT(&stashes[i].bst_lru);
+    TAILQ_INIT(&stashes[i].bst_lru_important);
+    stashes[i].bst_size = 0;
+  }
+  hts_mutex_unlock(&lru_lock);
+
+  index_dirty = 1;
+  shards_unlock_all();
+
+  while((p = victims) != NULL) {
+    victims = p->bi_link;
+    prune_item(p);
   }
-  current_cache_size = 0;
+
   save_index();
+
+  hts_mutex_lock(&cache_lock);
+  segment_gc_needed = 1;
+  hts_cond_signal(&cache_cond);
   hts_mutex_unlock(&cache_lock);
+
   notify_add(NULL, NOTIFY_INFO, NULL, 3, _("Cache cleared"));
 }
 
 
 
+/**
+ * Write item to a file of its own. We write to a temporary file and
+ * rename it in place so readers never see a partially written file
+ */
+static void
+flush_to_file(uint64_t key_hash, buf_t *b, const char *ct, size_t ctlen)
+{
+  char filename[PATH_MAX];
+  char tmpname[PATH_MAX];
+  make_filename(filename, sizeof(filename), key_hash, 1);
+  if(snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename) >=
+     sizeof(tmpname))
+    return;
+
+  fa_handle_t *fh = fa_open_ex(tmpname, NULL, 0, FA_WRITE, NULL);
+  if(fh == NULL)
+    return;
+
+  int ok = 1;
+
+  if(ctlen && fa_write(fh, ct, ctlen) != ctlen)
+    ok = 0;
+
+  if(ok && fa_write(fh, b->b_ptr, b->b_size) != b->b_size)
+    ok = 0;
+
+  fa_close(fh);
+
+  if(!ok || fa_rename(tmpname, filename, NULL, 0))
+    fa_unlink(tmpname, NULL, 0);
+}
+
+
+/**
+ * If less than half of a segment is in use, move the remaining items
+ * to the current append segment and delete it. Only the segment with
+ * the most dead data is compacted per call. Called on flush thread only
+ */
+static void
+segments_compact(void)
+{
+  int victim = -1;
+  uint32_t dead = 0;
+
+  hts_mutex_lock(&segment_lock);
+  for(int seg = 0; seg < BC_MAX_SEGMENTS; seg++) {
+    const blobcache_segment_t *bs = &segments[seg];
+    if(seg == append_segment || bs->seg_size == 0)
+      continue;
+    if(bs->seg_live < bs->seg_size / 2 && bs->seg_size - bs->seg_live > dead) {
+      victim = seg;
+      dead = bs->seg_size - bs->seg_live;
+    }
+  }
+  hts_mutex_unlock(&segment_lock);
+
+  if(victim == -1) {
+    segments_gc();
+    return;
+  }
+
+  typedef struct {
+    uint64_t key_hash;
+    uint32_t offset;
+    uint32_t len;
+  } relocation_t;
+
+  relocation_t *rv = NULL;
+  int cnt = 0, capacity = 0;
+
+  shards_lock_all();
+  for(int s = 0; s < BC_NUM_SHARDS; s++) {
+    const blobcache_shard_t *bs = &shards[s];
+    for(int i = 0; i <= bs->bs_mask; i++) {
+      const blobcache_item_t *p;
+      for(p = bs->bs_hash[i]; p != NULL; p = p->bi_link) {
+        if(p->bi_segment != victim)
+          continue;
+        if(cnt == capacity) {
+          capacity = MAX(capacity * 2, 64);
+          rv = realloc(rv, capacity * sizeof(relocation_t));
+        }
+        rv[cnt].key_hash = p->bi_key_hash;
+        rv[cnt].offset = p->bi_offset;
+        rv[cnt].len = p->bi_size + p->bi_content_type_len;
+        cnt++;
+      }
+    }
+  }
+  shards_unlock_all();
+
+  void *tmp = cnt ? malloc(BC_PACK_MAX_ITEM + 255) : NULL;
+
+  for(int i = 0; i < cnt && tmp != NULL; i++) {
+    const relocation_t *r = &rv[i];
+    uint16_t seg;
+    uint32_t offset;
+
+    if(r->len > BC_PACK_MAX_ITEM + 255 ||
+       segment_acquire(victim, r->offset, r->len))
+      continue;
+    const int err = segment_read(victim, r->offset, tmp, r->len);
+    segment_release(victim);
+    if(err)
+      continue;
+
+    if(segment_append(NULL, 0, tmp, r->len, &seg, &offset))
+      break;
+
+    blobcache_shard_t *bs = shard_for(r->key_hash);
+    hts_mutex_lock(&bs->bs_mutex);
+    blobcache_item_t *p = *shard_lookup(bs, r->key_hash);
+    if(p != NULL && p->bi_segment == victim && p->bi_offset == r->offset) {
+      item_release_storage(p);
+      p->bi_segment = seg;
+      p->bi_offset = offset;
+      hts_mutex_lock(&segment_lock);
+      segments[seg].seg_live += r->len;
+      hts_mutex_unlock(&segment_lock);
+      index_dirty = 1;
+    }
+    hts_mutex_unlock(&bs->bs_mutex);
+  }
+
+  free(tmp);
+  free(rv);
+
+  TRACE(TRACE_DEBUG, "blobcache", "Compacted segment %d, moved %d items",
+        victim, cnt);
+
+  segments_gc();
+}
+
+
+/**
+ *
+ */
+static int
+cache_over_budget(uint64_t maxsize)
+{
+  uint64_t size = 0;
+  int r = 0;
+  const int n = atomic_get(&num_stashes);
+
+  hts_mutex_lock(&lru_lock);
+  for(int i = 0; i < n; i++) {
+    const blobcache_stash_t *bst = &stashes[i];
+    size += bst->bst_size;
+    if(bst->bst_size > maxsize * bst->bst_share / 100)
+      r = 1;
+  }
+  hts_mutex_unlock(&lru_lock);
+  return r || size > maxsize;
+}
+
+
+/**
+ * Publish cache statistics, called on flush thread only
+ */
+static void
+stats_update(uint64_t maxsize)
+{
+  int hits = 0, misses = 0, evictions = 0;
+  uint64_t size = 0;
+  const int n = atomic_get(&num_stashes);
+  prop_t *list = prop_create(blobcache_prop, "stashes");
+
+  for(int i = 0; i < n; i++) {
+    blobcache_stash_t *bst = &stashes[i];
+
+    if(bst->bst_prop == NULL) {
+      bst->bst_prop = prop_create(list, NULL);
+      prop_set(bst->bst_prop, "name", PROP_SET_STRING, bst->bst_name);
+    }
+
+    hts_mutex_lock(&lru_lock);
+    const uint64_t stash_size = bst->bst_size;
+    const uint64_t budget = maxsize * bst->bst_share / 100;
+    hts_mutex_unlock(&lru_lock);
+
+    const int h = atomic_get(&bst->bst_hits);
+    const int m = atomic_get(&bst->bst_misses);
+    const int e = atomic_get(&bst->bst_evictions);
+
+    prop_set(bst->bst_prop, "size", PROP_SET_INT, (int)stash_size);
+    prop_set(bst->bst_prop, "budget", PROP_SET_INT, (int)budget);
+    prop_set(bst->bst_prop, "hits", PROP_SET_INT, h);
+    prop_set(bst->bst_prop, "misses", PROP_SET_INT, m);
+    prop_set(bst->bst_prop, "evictions", PROP_SET_INT, e);
+
+    size += stash_size;
+    hits += h;
+    misses += m;
+    evictions += e;
+  }
+
+  prop_set(blobcache_prop, "size", PROP_SET_INT, (int)size);
+  prop_set(blobcache_prop, "maxsize", PROP_SET_INT, (int)maxsize);
+  prop_set(blobcache_prop, "hits", PROP_SET_INT, hits);
+  prop_set(blobcache_prop, "misses", PROP_SET_INT, misses);
+  prop_set(blobcache_prop, "evictions", PROP_SET_INT, evictions);
+}
+
+
 /**
  *
  */
@@ -882,15 +2023,22 @@ flushthread(void *aux)
 
   uint64_t maxsize = blobcache_compute_maxsize();
 
-  hts_mutex_lock(&cache_lock);
   prune_to_size(maxsize);
+  segments_compact();
+  stats_update(maxsize);
+
+  int items = 0;
+  for(int i = 0; i < BC_NUM_SHARDS; i++)
+    items += shards[i].bs_items;
 
   TRACE(TRACE_INFO, "blobcache",
 	"Initialized: %d items consuming %.2f MB "
         "(out of maximum %.2f MB) on disk in %s/bc2",
-	pool_num(item_pool), current_cache_size / 1000000.0,
+	items, current_cache_size() / 1000000.0,
         maxsize / 1000000.0, gconf.cache_path);
 
+  hts_mutex_lock(&cache_lock);
+
   // First make sure clock is valid
   while(bcstate == BLOBCACHE_RUN_BAD_CLOCK) {
     time_t now;
@@ -909,52 +2057,102 @@ flushthread(void *aux)
 
     if((bf = TAILQ_FIRST(&flush_queue)) == NULL) {
 
-      if(index_dirty) {
-        if(hts_cond_wait_timeout(&cache_cond, &cache_lock, 5000))
+      if(segment_gc_needed) {
+        segment_gc_needed = 0;
+        hts_mutex_unlock(&cache_lock);
+        segments_compact();
+        hts_mutex_lock(&cache_lock);
+      } else if(index_dirty) {
+        if(hts_cond_wait_timeout(&cache_cond, &cache_lock, 5000)) {
+          hts_mutex_unlock(&cache_lock);
           save_index();
+          segments_compact();
+          stats_update(blobcache_compute_maxsize());
+          hts_mutex_lock(&cache_lock);
+        }
       } else {
         hts_cond_wait(&cache_cond, &cache_lock);
       }
       continue;
     }
 
+    TAILQ_REMOVE(&flush_queue, bf, bf_link);
     hts_mutex_unlock(&cache_lock);
-    char filename[PATH_MAX];
-    make_filename(filename, sizeof(filename), bf->bf_key_hash, 1);
-    buf_t *b = bf->bf_buf;
-
-    fa_handle_t *fh = fa_open_ex(filename, NULL, 0, FA_WRITE, NULL);
-    if(fh != NULL) {
 
-      if(b->b_content_type != NULL) {
-	const char *str = rstr_get(b->b_content_type);
-	size_t len = strlen(str);
-	if(fa_write(fh, str, len) != len)
-	  fa_unlink(filename, NULL, 0);
+    buf_t *b = bf->bf_buf;
+    const char *ct = b->b_content_type ? rstr_get(b->b_content_type) : NULL;
+    const size_t ctlen = ct ? strlen(ct) : 0;
+    uint16_t seg = BC_SEGMENT_NONE;
+    uint32_t offset = 0;
+
+    if(ctlen + b->b_size > BC_PACK_MAX_ITEM || ctlen > 255 ||
+       segment_append(ct, ctlen, b->b_ptr, b->b_size, &seg, &offset))
+      flush_to_file(bf->bf_key_hash, b, ct, ctlen);
+
+    // If this is still the most recent content for the item it's
+    // now readable from disk
+    blobcache_shard_t *bs = shard_for(bf->bf_key_hash);
+    hts_mutex_lock(&bs->bs_mutex);
+    blobcache_item_t *p = *shard_lookup(bs, bf->bf_key_hash);
+    if(p != NULL && p->bi_pending == b) {
+      buf_release(p->bi_pending);
+      p->bi_pending = NULL;
+
+      if(seg != BC_SEGMENT_NONE) {
+        p->bi_segment = seg;
+        p->bi_offset = offset;
+        hts_mutex_lock(&segment_lock);
+        segments[seg].seg_live += p->bi_size + p->bi_content_type_len;
+        hts_mutex_unlock(&segment_lock);
       }
-
-      if(fa_write(fh, b->b_ptr, b->b_size) != b->b_size)
-        fa_unlink(filename, NULL, 0);
-
-      fa_close(fh);
     }
-    hts_mutex_lock(&cache_lock);
+    pool_put(bs->bs_pool, bf);
+    hts_mutex_unlock(&bs->bs_mutex);
 
-    assert(TAILQ_FIRST(&flush_queue) == bf);
-    TAILQ_REMOVE(&flush_queue, bf, bf_link);
-    buf_release(bf->bf_buf);
-    pool_put(item_pool, bf);
+    buf_release(b);
 
     uint64_t maxsize = blobcache_compute_maxsize();
 
-    if(maxsize < current_cache_size)
+    if(cache_over_budget(maxsize)) {
       prune_to_size(maxsize);
+      segments_compact();
+    }
+
+    hts_mutex_lock(&cache_lock);
   }
-  save_index();
   hts_mutex_unlock(&cache_lock);
+  save_index();
+
+  if(append_fh != NULL) {
+    fa_close(append_fh);
+    append_fh = NULL;
+  }
   return NULL;
 }
 
+/**
+ * Figure out how much has been written to segments in use
+ */
+static void
+segments_init(void)
+{
+  char path[PATH_MAX];
+
+  for(int seg = 0; seg < BC_MAX_SEGMENTS; seg++) {
+    blobcache_segment_t *bs = &segments[seg];
+    if(bs->seg_live == 0)
+      continue;
+
+    segment_filename(path, sizeof(path), seg);
+    fa_handle_t *fh = fa_open(path, NULL, 0);
+    if(fh == NULL)
+      continue;
+    bs->seg_size = MIN(fa_fsize(fh), BC_SEGMENT_SIZE);
+    fa_close(fh);
+  }
+}
+
+
 static_assert(sizeof(blobcache_flush_t) <= sizeof(blobcache_item_t),
               "blobcache_flush too big");
 
@@ -978,10 +2176,26 @@ blobcache_init(void)
 
   hts_mutex_init(&cache_lock);
   hts_cond_init(&cache_cond, &cache_lock);
-  item_pool = pool_create("blobcacheitems", sizeof(blobcache_item_t), 0);
+  hts_mutex_init(&segment_lock);
+  hts_cond_init(&segment_cond, &segment_lock);
+  hts_mutex_init(&lru_lock);
+
+  stash_init(&stashes[0], "other", 100);
+  atomic_set(&num_stashes, 1);
+
+  blobcache_prop = prop_create(prop_get_global(), "blobcache");
+
+  for(int i = 0; i < BC_NUM_SHARDS; i++) {
+    blobcache_shard_t *bs = &shards[i];
+    hts_mutex_init(&bs->bs_mutex);
+    bs->bs_pool = pool_create("blobcacheitems", sizeof(blobcache_item_t), 0);
+    bs->bs_mask = BC_SHARD_INITIAL_BUCKETS - 1;
+    bs->bs_hash = calloc(BC_SHARD_INITIAL_BUCKETS, sizeof(blobcache_item_t *));
+  }
 
 
   load_index();
+  segments_init();
 
 
   prop_t *dir = setting_get_dir("general:resets");
@@ -1002,3 +2216,92 @@ blobcache_fini(void)
   hts_mutex_unlock(&cache_lock);
   hts_thread_join(&bcthread);
 }
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Concurrent get/put benchmark, run with --bench blobcache
+ */
+#define BC_BENCH_THREADS 8
+#define BC_BENCH_KEYS    20000
+#define BC_BENCH_OPS     50000
+
+static atomic_t bc_bench_hits;
+static atomic_t bc_bench_misses;
+
+static void *
+blobcache_bench_thread(void *aux)
+{
+  unsigned int seed = (intptr_t)aux;
+  char key[64];
+  uint8_t payload[2048];
+
+  memset(payload, (intptr_t)aux, sizeof(payload));
+
+  for(int i = 0; i < BC_BENCH_OPS; i++) {
+    seed = seed * 1103515245 + 12345;
+    const int k = (seed >> 8) % BC_BENCH_KEYS;
+    snprintf(key, sizeof(key), "bench:%d", k);
+
+    if(((seed >> 4) & 7) == 0) {
+      buf_t *b = buf_create_and_copy(512 + k % 1024, payload);
+      blobcache_put(key, "bench", b, 3600, NULL, 0, 0);
+      buf_release(b);
+    } else {
+      buf_t *b = blobcache_get(key, "bench", 0, NULL, NULL, NULL);
+      if(b != NULL) {
+        atomic_inc(&bc_bench_hits);
+        buf_release(b);
+      } else {
+        atomic_inc(&bc_bench_misses);
+      }
+    }
+  }
+  return NULL;
+}
+
+
+static void
+blobcache_bench(void)
+{
+  hts_thread_t tids[BC_BENCH_THREADS];
+  char key[64];
+  uint8_t payload[1024] = {0};
+
+  while(bcstate != BLOBCACHE_RUN)
+    usleep(100000);
+
+  for(int i = 0; i < BC_BENCH_KEYS / 2; i++) {
+    snprintf(key, sizeof(key), "bench:%d", i * 2);
+    buf_t *b = buf_create_and_copy(sizeof(payload), payload);
+    blobcache_put(key, "bench", b, 3600, NULL, 0, 0);
+    buf_release(b);
+  }
+
+  int64_t ts = arch_get_ts();
+
+  for(int i = 0; i < BC_BENCH_THREADS; i++)
+    hts_thread_create_joinable("bcbench", &tids[i], blobcache_bench_thread,
+                               (void *)(intptr_t)(i + 1),
+                               THREAD_PRIO_BGTASK);
+
+  for(int i = 0; i < BC_BENCH_THREADS; i++)
+    hts_thread_join(&tids[i]);
+
+  ts = arch_get_ts() - ts;
+
+  const int ops = BC_BENCH_THREADS * BC_BENCH_OPS;
+  TRACE(TRACE_INFO, "bench",
+        "blobcache: %d ops from %d threads in %dms, %.0f ops/s "
+        "(%d hits, %d misses)",
+        ops, BC_BENCH_THREADS, (int)(ts / 1000), ops * 1000000.0 / ts,
+        atomic_get(&bc_bench_hits), atomic_get(&bc_bench_misses));
+
+  for(int i = 0; i < BC_BENCH_KEYS; i++) {
+    snprintf(key, sizeof(key), "bench:%d", i);
+    blobcache_evict(key, "bench");
+  }
+}
+
+BENCHMARK("blobcache", blobcache_bench);
+#endif
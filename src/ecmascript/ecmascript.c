@@ -612,7 +612,8 @@ es_context_create(const char *id, int flags, const char *url,
 
   ec->ec_prop_unload_destroy = prop_vec_create(16);
 
-  ec->ec_prop_dispatch_group = prop_dispatch_group_create();
+  ec->ec_prop_dispatch_group =
+    prop_dispatch_group_create(PROP_COURIER_COALESCE);
 
   ec->ec_duk = duk_create_heap(es_mem_alloc, es_mem_realloc, es_mem_free,
                                ec, NULL);
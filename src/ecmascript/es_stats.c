@@ -67,6 +67,14 @@ dump_context(htsbuf_queue_t *out, es_context_t *ec)
   htsbuf_qprintf(out, "  Rooted Ecmascript objects: %d\n",
                  ec->ec_rooted_objects);
 
+  if(ec->ec_duk != NULL) {
+    int notifies, coalesced;
+    prop_dispatch_group_get_stats(ec->ec_prop_dispatch_group,
+                                  &notifies, &coalesced);
+    htsbuf_qprintf(out, "  Prop notifications: %d dispatched, "
+                   "%d coalesced away\n", notifies, coalesced);
+  }
+
   htsbuf_qprintf(out, "  Native objects referenced:\n",
                  ec->ec_rooted_objects);
   for(int i = 0; i < ECMASCRIPT_MAX_NATIVE_CLASSES; i++) {
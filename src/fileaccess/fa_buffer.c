@@ -24,6 +24,7 @@
 #include "fa_proto.h"
 #include "misc/minmax.h"
 #include "misc/callout.h"
+#include "prop/prop.h"
 
 #define FILE_PARKING 1
 
@@ -32,6 +33,11 @@
 #define BF_ZONES 8
 #define BF_MASK (BF_ZONES - 1)
 
+#define BF_CURSORS        4  // Number of sequential streams we track
+#define BF_CURSOR_SLACK   (64 * 1024) // Forward gap still seen as sequential
+#define BF_PREFETCH_DEPTH 3  // Requests to keep in flight ahead of a cursor
+#define BF_STALL_TIME     5000 // Source reads taking longer (us) are stalls
+
 static HTS_MUTEX_DECL(buffered_global_mutex);
 
 typedef struct buffered_zone {
@@ -40,6 +46,19 @@ typedef struct buffered_zone {
   int bz_size;
 } buffered_zone_t;
 
+
+/**
+ * A cursor tracks one sequential read pattern. A demuxer reading
+ * interleaved audio and video from different parts of a file will
+ * typically give rise to two cursors
+ */
+typedef struct buffered_cursor {
+  int64_t bc_next;        // Where we expect the next read to start
+  int64_t bc_prefetched;  // Prefetch hints have been issued up to here
+  int bc_hits;
+  int bc_used;            // For LRU replacement
+} buffered_cursor_t;
+
 /**
  *
  */
@@ -72,6 +91,19 @@ typedef struct buffered_file {
 
   buffered_zone_t bf_zones[BF_ZONES];
 
+  buffered_cursor_t bf_cursors[BF_CURSORS];
+  int bf_cursor_tally;
+
+  /**
+   * Statistics. Source reads that are served from memory (prefetched
+   * ranges, socket buffers) are quick, the ones that take longer than
+   * BF_STALL_TIME actually blocked the reader and count as stalls
+   */
+  prop_t *bf_stats;
+  int64_t bf_read_time;
+  int64_t bf_stall_time;
+  int64_t bf_src_bytes;
+  int bf_stalls;
 
 } buffered_file_t;
 
@@ -242,6 +274,7 @@ fab_destroy(buffered_file_t *bf)
   if(bf->bf_mem != NULL)
     hfree(bf->bf_mem, bf->bf_mem_size);
   free(bf->bf_url);
+  prop_ref_dec(bf->bf_stats);
   cancellable_release(bf->bf_outbound_cancellable);
   free(bf);
 }
@@ -278,6 +311,9 @@ fab_park(fa_handle_t *handle)
   buffered_file_t *closeme = NULL;
   fa_handle_t *src = bf->bf_src;
 
+  prop_ref_dec(bf->bf_stats);
+  bf->bf_stats = NULL;
+
 
   if((src->fh_proto->fap_no_parking != NULL &&
       src->fh_proto->fap_no_parking(src)) ||
@@ -417,6 +453,104 @@ store_in_cache(buffered_file_t *bf, const void *buf, size_t size)
 
 
 
+/**
+ * Match a read against the cursors and, once a cursor has seen a few
+ * sequential reads, ask the source to start fetching what comes next
+ */
+static void
+fab_predict(buffered_file_t *bf, int64_t fpos, size_t size)
+{
+  fa_handle_t *src = bf->bf_src;
+  buffered_cursor_t *bc = NULL, *victim = &bf->bf_cursors[0];
+  int i;
+
+  if(bf->bf_min_request == 0)
+    return;
+
+  for(i = 0; i < BF_CURSORS; i++) {
+    buffered_cursor_t *c = &bf->bf_cursors[i];
+    if(c->bc_hits && fpos >= c->bc_next - bf->bf_min_request &&
+       fpos <= c->bc_next + BF_CURSOR_SLACK) {
+      bc = c;
+      break;
+    }
+    if(c->bc_used < victim->bc_used)
+      victim = c;
+  }
+
+  if(bc == NULL) {
+    bc = victim;
+    bc->bc_hits = 0;
+    bc->bc_prefetched = 0;
+  }
+
+  bc->bc_hits++;
+  bc->bc_next = MAX(bc->bc_next, fpos + size);
+  bc->bc_used = ++bf->bf_cursor_tally;
+
+  if(bc->bc_hits < 2 || src->fh_proto->fap_prefetch == NULL)
+    return;
+
+  int64_t pos = MAX(bc->bc_prefetched, fpos);
+  int64_t end = bc->bc_next + bf->bf_min_request * BF_PREFETCH_DEPTH;
+  if(bf->bf_size != -1)
+    end = MIN(end, bf->bf_size);
+
+  while(pos < end) {
+    int mpos;
+    int cs = resolve_zone(bf, pos, end - pos, &mpos);
+    if(cs > 0) {
+      // Already in cache
+      pos += cs;
+      continue;
+    }
+    if(pos < fpos + size) {
+      // Will be fetched synchronously by the current read
+      pos += bf->bf_min_request;
+      continue;
+    }
+    int n = need_to_fill(bf, pos, bf->bf_min_request);
+    if(bf->bf_size != -1)
+      n = MIN(n, bf->bf_size - pos);
+    if(src->fh_proto->fap_prefetch(src, pos, n))
+      break;
+    pos += n;
+  }
+  bc->bc_prefetched = pos;
+}
+
+
+/**
+ * Read from source and account the time we were blocked
+ */
+static int
+fab_src_read(buffered_file_t *bf, void *buf, size_t size)
+{
+  fa_handle_t *src = bf->bf_src;
+  const int64_t ts = arch_get_ts();
+  int r = src->fh_proto->fap_read(src, buf, size);
+  const int64_t delta = arch_get_ts() - ts;
+
+  bf->bf_read_time += delta;
+  if(delta > BF_STALL_TIME) {
+    bf->bf_stall_time += delta;
+    bf->bf_stalls++;
+  }
+  if(r > 0)
+    bf->bf_src_bytes += r;
+
+  if(bf->bf_stats != NULL && bf->bf_read_time > 0) {
+    prop_set(bf->bf_stats, "stalls", PROP_SET_INT, bf->bf_stalls);
+    prop_set(bf->bf_stats, "stallTime", PROP_SET_INT,
+             (int)(bf->bf_stall_time / 1000));
+    // kbit/s delivered by the source for this handle
+    prop_set(bf->bf_stats, "throughput", PROP_SET_INT,
+             (int)(bf->bf_src_bytes * 8000 / bf->bf_read_time));
+  }
+  return r;
+}
+
+
 /**
  *
  */
@@ -435,6 +569,8 @@ fab_read(fa_handle_t *handle, void *buf, size_t size)
   if(bf->bf_size != -1 && bf->bf_fpos + size > bf->bf_size)
     size = bf->bf_size - bf->bf_fpos;
 
+  fab_predict(bf, bf->bf_fpos, size);
+
   size_t rval = 0;
   while(size > 0) {
     int mpos = -1;
@@ -455,7 +591,7 @@ fab_read(fa_handle_t *handle, void *buf, size_t size)
       if(src->fh_proto->fap_seek(src, bf->bf_fpos, SEEK_SET, 0) != bf->bf_fpos)
 	return -1;
 
-      int r = src->fh_proto->fap_read(src, buf, rreq);
+      int r = fab_src_read(bf, buf, rreq);
       if(r > 0) {
 	store_in_cache(bf, buf, r);
 	rval += r;
@@ -478,8 +614,8 @@ fab_read(fa_handle_t *handle, void *buf, size_t size)
     if(src->fh_proto->fap_seek(src, bf->bf_fpos, SEEK_SET, 0) != bf->bf_fpos)
       return -1;
 
-    int r = src->fh_proto->fap_read(src, bf->bf_mem + bf->bf_mem_ptr,
-				    bf->bf_min_request);
+    int r = fab_src_read(bf, bf->bf_mem + bf->bf_mem_ptr,
+                         bf->bf_min_request);
     if(r < 1) {
       bf->bf_size = bf->bf_fpos;
       return r < 0 ? r : rval;
@@ -625,11 +761,20 @@ fa_buffered_open(const char *url, char *errbuf, size_t errsize, int flags,
   hts_mutex_unlock(&buffered_global_mutex);
 
   if(fh != NULL) {
+    buffered_file_t *bf = (buffered_file_t *)fh;
     fap_release(fap);
     free(filename);
 
+    prop_ref_dec(bf->bf_stats);
+    bf->bf_stats = foe != NULL ? prop_ref_inc(foe->foe_stats) : NULL;
+
+    // Statistics are per opener
+    bf->bf_read_time = 0;
+    bf->bf_stall_time = 0;
+    bf->bf_src_bytes = 0;
+    bf->bf_stalls = 0;
+
     if(foe != NULL && foe->foe_cancellable != NULL) {
-      buffered_file_t *bf = (buffered_file_t *)fh;
       assert(bf->bf_inbound_cancellable == NULL);
       bf->bf_inbound_cancellable =
         cancellable_bind(foe->foe_cancellable, fab_cancel, fh);
@@ -653,6 +798,7 @@ fa_buffered_open(const char *url, char *errbuf, size_t errsize, int flags,
     }
 
     foe->foe_cancellable = bf->bf_outbound_cancellable;
+    bf->bf_stats = prop_ref_inc(foe->foe_stats);
   } else {
     memset(&new_foe, 0, sizeof(fa_open_extra_t));
     new_foe.foe_cancellable = bf->bf_outbound_cancellable;
@@ -664,6 +810,7 @@ fa_buffered_open(const char *url, char *errbuf, size_t errsize, int flags,
   free(filename);
   if(fh == NULL) {
     cancellable_unbind(bf->bf_inbound_cancellable, bf);
+    prop_ref_dec(bf->bf_stats);
     free(bf);
     return NULL;
   }
@@ -492,3 +492,51 @@ memfile_make(const void *mem, size_t len)
   fh->h.fh_proto = &fa_protocol_memfile;
   return &fh->h;
 }
+
+
+/**
+ * Memory file backed by a buf_t, the buffer is released on close
+ */
+typedef struct fa_buf_fh {
+  fa_bundle_fh_t fh;
+  buf_t *buf;
+} fa_buf_fh_t;
+
+
+/**
+ *
+ */
+static void
+bf_close(fa_handle_t *fh0)
+{
+  fa_buf_fh_t *fh = (fa_buf_fh_t *)fh0;
+  buf_release(fh->buf);
+  free(fh);
+}
+
+
+/**
+ *
+ */
+static fa_protocol_t fa_protocol_buffile = {
+  .fap_name  = "buffile",
+  .fap_close = bf_close,
+  .fap_read  = b_read,
+  .fap_seek  = b_seek,
+  .fap_fsize = b_fsize,
+};
+
+
+/**
+ *
+ */
+fa_handle_t *
+memfile_make_buf(buf_t *b)
+{
+  fa_buf_fh_t *fh = calloc(1, sizeof(fa_buf_fh_t));
+  fh->fh.ptr = buf_c8(b);
+  fh->fh.size = buf_len(b);
+  fh->fh.h.fh_proto = &fa_protocol_buffile;
+  fh->buf = b;
+  return &fh->fh.h;
+}
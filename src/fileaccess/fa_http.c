@@ -34,6 +34,9 @@
 #include "fileaccess.h"
 #include "http_client.h"
 #include "networking/net.h"
+#if ENABLE_HTTP2
+#include "networking/http2.h"
+#endif
 #include "fa_proto.h"
 #include "task.h"
 #include "htsmsg/htsmsg_xml.h"
@@ -65,6 +68,21 @@ static struct http_request_inspector_list http_request_inspectors;
 #define STREAMING_LIMIT 128000
 
 
+/**
+ * Max number of range requests a file handle may have in flight (or
+ * completed but not yet consumed) as a result of prefetch hints
+ */
+#define HTTP_PREFETCH_MAX 6
+
+/**
+ * How long (ms) a read waits for a range still being prefetched before
+ * it gives up and reads it itself, unless the handle has a read timeout.
+ * The wait is done in slices so cancellation is noticed
+ */
+#define HTTP_PREFETCH_WAIT       5000
+#define HTTP_PREFETCH_WAIT_SLICE 100
+
+
 
 static int http_tokenize(char *buf, char **vec, int vecsize, int delimiter);
 
@@ -95,6 +113,14 @@ static hts_cond_t http_connections_cond;
 static atomic_t http_connection_tally;
 static atomic_t http_file_tally;
 
+/**
+ * Prefetched ranges
+ */
+TAILQ_HEAD(http_prefetch_queue, http_prefetch);
+
+static hts_mutex_t http_prefetch_mutex;
+static hts_cond_t http_prefetch_cond;
+
 typedef struct http_connection {
   atomic_t hc_refcount;
 
@@ -107,6 +133,7 @@ typedef struct http_connection {
 
   char hc_ssl;
   char hc_reused;
+  char hc_multiplexed;  // HTTP/2 stream, does not count towards max_concurrent
 
   atomic_t hc_inspecting;
 
@@ -169,7 +196,7 @@ typedef struct http_file {
 
   char hf_want_close;
 
-  char hf_accept_ranges;
+  char hf_accept_ranges; // Server has replied with 206 to a range request
 
   char hf_version;
 
@@ -210,9 +237,33 @@ typedef struct http_file {
 
   int hf_id;
 
+  struct http_prefetch_queue hf_prefetches;
+  cancellable_t *hf_prefetch_cancellable;
+
 } http_file_t;
 
 
+/**
+ * A range fetched in the background on a separate connection (which
+ * is picked from the parked connections or is a stream on a shared
+ * HTTP/2 session). All fields except hp_link are owned by the task
+ * until hp_state leaves HP_RUNNING. Protected by http_prefetch_mutex
+ */
+typedef struct http_prefetch {
+  TAILQ_ENTRY(http_prefetch) hp_link;
+  int64_t hp_pos;
+  int hp_size;
+  char hp_state;
+#define HP_RUNNING 0
+#define HP_DONE    1
+#define HP_FAILED  2
+  char hp_orphaned;  // File handle is gone, task frees when done
+  uint8_t *hp_data;
+  http_file_t *hp_hf;
+  struct http_header_list hp_request_headers;
+} http_prefetch_t;
+
+
 /**
  *
  */
@@ -325,6 +376,7 @@ http_connection_get(const char *hostname, int port, int ssl,
         if(!strcmp(hc->hc_hostname, hostname) &&
            hc->hc_port == port &&
            hc->hc_ssl == ssl &&
+           !hc->hc_multiplexed &&
            atomic_get(&hc->hc_inspecting) == 0) {
           num_concurrent++;
         }
@@ -392,8 +444,16 @@ http_connection_get(const char *hostname, int port, int ssl,
     TRACE(TRACE_INFO, "HTTP", "Connect to %s:%d",
           hostname, port);
 
-  if((tc = tcp_connect(hostname, port, errbuf, errlen,
-                       timeout, tcp_connect_flags, c)) == NULL) {
+#if ENABLE_HTTP2
+  if(ssl && !gconf.disable_http2)
+    tc = http2_connect(hostname, port, tcp_connect_flags, errbuf, errlen,
+                       timeout, c);
+  else
+#endif
+    tc = tcp_connect(hostname, port, errbuf, errlen,
+                     timeout, tcp_connect_flags, c);
+
+  if(tc == NULL) {
     HTTP_TRACE(dbg, "Connection to %s:%d failed -- %s%s",
                hostname, port, errbuf,
                cancellable_is_cancelled(c) ? ", Cancelled by user" : "");
@@ -407,6 +467,16 @@ http_connection_get(const char *hostname, int port, int ssl,
 
   HTTP_TRACE(dbg, "Connected to %s:%d (cid=%d)", hostname, port, id);
 
+#if ENABLE_HTTP2
+  if(http2_is_stream(tc)) {
+    HTTP_TRACE(dbg, "Using HTTP/2 for %s:%d (cid=%d)", hostname, port, id);
+    hts_mutex_lock(&http_connections_mutex);
+    hc->hc_multiplexed = 1;
+    hts_cond_broadcast(&http_connections_cond);
+    hts_mutex_unlock(&http_connections_mutex);
+  }
+#endif
+
   hc->hc_tc = tc;
   hc->hc_id = id;
   return hc;
@@ -1712,6 +1782,7 @@ http_open0(http_file_t *hf, int probe, char *errbuf, int errlen,
     return 0;
 
   case 206:
+    hf->hf_accept_ranges = 1;
     if(hf->hf_filesize == -1)
       HF_TRACE(hf, "%s: No known filesize, seeking may be slower", hf->hf_url);
     return 0;
@@ -1755,12 +1826,54 @@ http_open0(http_file_t *hf, int probe, char *errbuf, int errlen,
 }
 
 
+/**
+ *
+ */
+static void
+http_prefetch_destroy(http_prefetch_t *hp)
+{
+  http_headers_free(&hp->hp_request_headers);
+  free(hp->hp_data);
+  free(hp);
+}
+
+
+/**
+ * Drop all prefetched ranges. Ranges still being fetched are
+ * left for their tasks to free
+ */
+static void
+http_prefetch_flush(http_file_t *hf)
+{
+  http_prefetch_t *hp;
+
+  if(hf->hf_prefetch_cancellable == NULL)
+    return;
+
+  cancellable_cancel(hf->hf_prefetch_cancellable);
+
+  hts_mutex_lock(&http_prefetch_mutex);
+  while((hp = TAILQ_FIRST(&hf->hf_prefetches)) != NULL) {
+    TAILQ_REMOVE(&hf->hf_prefetches, hp, hp_link);
+    if(hp->hp_state == HP_RUNNING)
+      hp->hp_orphaned = 1;
+    else
+      http_prefetch_destroy(hp);
+  }
+  hts_mutex_unlock(&http_prefetch_mutex);
+
+  cancellable_release(hf->hf_prefetch_cancellable);
+  hf->hf_prefetch_cancellable = NULL;
+}
+
+
 /**
  *
  */
 static void
 http_destroy(http_file_t *hf)
 {
+  http_prefetch_flush(hf);
   http_detach(hf,
 	      hf->hf_rsize == 0 &&
 	      hf->hf_connection_mode == CONNECTION_MODE_PERSISTENT,
@@ -1854,6 +1967,71 @@ http_reset_url(http_file_t *hf)
 }
 
 
+/**
+ * Serve as much as possible of a read from prefetched ranges.
+ * If the range we need is still being fetched we wait for it
+ * instead of issuing a request of our own. If that takes too long
+ * (or we are cancelled) the range is abandoned and the caller reads
+ * the rest directly
+ */
+static size_t
+http_prefetch_read(http_file_t *hf, void *buf, size_t size)
+{
+  http_prefetch_t *hp;
+  size_t total = 0;
+  const int timeout = hf->hf_read_timeout ?: HTTP_PREFETCH_WAIT;
+  const int64_t deadline = arch_get_ts() + timeout * 1000LL;
+
+  hts_mutex_lock(&http_prefetch_mutex);
+
+  while(total < size) {
+
+    TAILQ_FOREACH(hp, &hf->hf_prefetches, hp_link)
+      if(hf->hf_pos >= hp->hp_pos && hf->hf_pos < hp->hp_pos + hp->hp_size)
+        break;
+
+    if(hp == NULL)
+      break;
+
+    if(hp->hp_state == HP_RUNNING) {
+      if(cancellable_is_cancelled(hf->hf_cancellable))
+        break;
+
+      if(arch_get_ts() >= deadline) {
+        HF_TRACE(hf, "read() gave up waiting for prefetch of %"PRId64" + %d",
+                 hp->hp_pos, hp->hp_size);
+        // Task frees it when done
+        TAILQ_REMOVE(&hf->hf_prefetches, hp, hp_link);
+        hp->hp_orphaned = 1;
+        break;
+      }
+
+      HF_TRACE(hf, "read() waiting for prefetch of %"PRId64" + %d",
+               hp->hp_pos, hp->hp_size);
+      hts_cond_wait_timeout(&http_prefetch_cond, &http_prefetch_mutex,
+                            HTTP_PREFETCH_WAIT_SLICE);
+      continue;
+    }
+
+    if(hp->hp_state == HP_DONE) {
+      int offset = hf->hf_pos - hp->hp_pos;
+      size_t n = MIN(size - total, hp->hp_size - offset);
+      memcpy(buf + total, hp->hp_data + offset, n);
+      total      += n;
+      hf->hf_pos += n;
+      if(offset + n < hp->hp_size)
+        break;
+    }
+
+    TAILQ_REMOVE(&hf->hf_prefetches, hp, hp_link);
+    http_prefetch_destroy(hp);
+  }
+
+  hts_mutex_unlock(&http_prefetch_mutex);
+  return total;
+}
+
+
 /**
  * Read from file
  */
@@ -1874,6 +2052,12 @@ http_read_i(http_file_t *hf, void *buf, const size_t size)
   if(size == 0)
     return 0;
 
+  if(hf->hf_rsize == 0 && !TAILQ_EMPTY(&hf->hf_prefetches)) {
+    totsize = http_prefetch_read(hf, buf, size);
+    if(totsize == size)
+      return totsize;
+  }
+
   /* Max 5 retries */
   for(i = 0; i < 5; i++) {
     /* If not connected, try to (re-)connect */
@@ -1962,6 +2146,7 @@ http_read_i(http_file_t *hf, void *buf, const size_t size)
       switch(code) {
       case 206:
 	// Range transfer OK
+        hf->hf_accept_ranges = 1;
 	break;
 
       case 301:
@@ -2111,6 +2296,150 @@ http_read(fa_handle_t *handle, void *buf, const size_t size)
   return r;
 }
 
+/**
+ * Release the private file handle of a prefetch and wake up any
+ * reader waiting for it
+ */
+static void
+http_prefetch_finish(http_prefetch_t *hp, int r)
+{
+  // Connection is parked for reuse if the range was read completely
+  http_destroy(hp->hp_hf);
+
+  hts_mutex_lock(&http_prefetch_mutex);
+  hp->hp_hf = NULL;
+  hp->hp_state = r == hp->hp_size ? HP_DONE : HP_FAILED;
+  if(hp->hp_orphaned)
+    http_prefetch_destroy(hp);
+  else
+    hts_cond_broadcast(&http_prefetch_cond);
+  hts_mutex_unlock(&http_prefetch_mutex);
+}
+
+
+/**
+ * Fetch a prefetch range using a private file handle
+ */
+static void
+http_prefetch_task(void *aux)
+{
+  http_prefetch_t *hp = aux;
+  http_file_t *hf = hp->hp_hf;
+  int r = -1;
+
+  if(!cancellable_is_cancelled(hf->hf_cancellable)) {
+    HF_TRACE(hf, "Prefetching %"PRId64" + %d", hp->hp_pos, hp->hp_size);
+    r = http_read_i(hf, hp->hp_data, hp->hp_size);
+  }
+  http_prefetch_finish(hp, r);
+}
+
+
+/**
+ * Cancelled before it even started
+ */
+static void
+http_prefetch_cancelled(void *aux)
+{
+  http_prefetch_finish(aux, -1);
+}
+
+
+/**
+ * Start fetching a range on another connection so it's ready when
+ * the reader gets there. Only done once the server is known to
+ * honour range requests, otherwise we might end up downloading the
+ * entire file just to get a few bytes
+ */
+static int
+http_prefetch(fa_handle_t *handle, int64_t pos, int size)
+{
+  http_file_t *hf = (http_file_t *)handle;
+  http_prefetch_t *hp, *next;
+  int num = 0;
+
+  if(!hf->hf_accept_ranges || hf->hf_no_ranges || hf->hf_streaming ||
+     hf->hf_filesize == -1 || size <= 0)
+    return -1;
+
+  if(pos >= hf->hf_filesize)
+    return 0;
+
+  size = MIN(size, hf->hf_filesize - pos);
+
+  // Already on its way on our own connection
+  if(hf->hf_rsize > 0 && pos >= hf->hf_pos &&
+     pos - hf->hf_pos + size <= hf->hf_rsize)
+    return 0;
+
+  if(hf->hf_prefetch_cancellable == NULL) {
+    hf->hf_prefetch_cancellable = cancellable_create();
+    TAILQ_INIT(&hf->hf_prefetches);
+  }
+
+  hts_mutex_lock(&http_prefetch_mutex);
+
+  for(hp = TAILQ_FIRST(&hf->hf_prefetches); hp != NULL; hp = next) {
+    next = TAILQ_NEXT(hp, hp_link);
+
+    if(hp->hp_state != HP_RUNNING && hp->hp_pos + hp->hp_size <= hf->hf_pos) {
+      // Reader has moved past this one
+      TAILQ_REMOVE(&hf->hf_prefetches, hp, hp_link);
+      http_prefetch_destroy(hp);
+      continue;
+    }
+
+    if(pos < hp->hp_pos + hp->hp_size && pos + size > hp->hp_pos) {
+      hts_mutex_unlock(&http_prefetch_mutex);
+      return 0;
+    }
+    num++;
+  }
+
+  if(num >= HTTP_PREFETCH_MAX) {
+    hts_mutex_unlock(&http_prefetch_mutex);
+    return -1;
+  }
+
+  hp = calloc(1, sizeof(http_prefetch_t));
+  hp->hp_data = malloc(size);
+  if(hp->hp_data == NULL) {
+    free(hp);
+    hts_mutex_unlock(&http_prefetch_mutex);
+    return -1;
+  }
+  hp->hp_pos = pos;
+  hp->hp_size = size;
+  LIST_INIT(&hp->hp_request_headers);
+  if(hf->hf_user_request_headers != NULL)
+    http_header_merge(&hp->hp_request_headers, hf->hf_user_request_headers);
+
+  http_file_t *phf = calloc(1, sizeof(http_file_t));
+  phf->hf_id = atomic_add_and_fetch(&http_file_tally, 1);
+  phf->hf_version = 1;
+  phf->hf_url = strdup(hf->hf_url);
+  phf->hf_auth = hf->hf_auth ? strdup(hf->hf_auth) : NULL;
+  phf->hf_debug = hf->hf_debug;
+  phf->hf_ssl_verify = hf->hf_ssl_verify;
+  phf->hf_no_cookies = hf->hf_no_cookies;
+  phf->hf_connect_timeout = hf->hf_connect_timeout;
+  phf->hf_read_timeout = hf->hf_read_timeout;
+  phf->hf_accept_ranges = 1;
+  phf->hf_filesize = hf->hf_filesize;
+  phf->hf_pos = pos;
+  phf->hf_user_request_headers = &hp->hp_request_headers;
+  phf->hf_cancellable = cancellable_retain(hf->hf_prefetch_cancellable);
+  hp->hp_hf = phf;
+
+  TAILQ_INSERT_TAIL(&hf->hf_prefetches, hp, hp_link);
+  hts_mutex_unlock(&http_prefetch_mutex);
+
+  task_run_prio(http_prefetch_task, hp, TASK_PRIO_PREFETCH,
+                hf->hf_prefetch_cancellable, http_prefetch_cancelled);
+  return 0;
+}
+
+
 /**
  * Seek in file
  */
@@ -2392,6 +2721,8 @@ http_init(void)
   hts_mutex_init(&http_redirects_mutex);
   hts_mutex_init(&http_cookies_mutex);
   hts_mutex_init(&http_auth_caches_mutex);
+  hts_mutex_init(&http_prefetch_mutex);
+  hts_cond_init(&http_prefetch_cond, &http_prefetch_mutex);
   load_cookies();
 }
 
@@ -2412,6 +2743,7 @@ static fa_protocol_t fa_protocol_http = {
   .fap_get_last_component = http_get_last_component,
   .fap_set_read_timeout = http_set_read_timeout,
   .fap_no_parking = http_no_parking,
+  .fap_prefetch = http_prefetch,
 };
 
 FAP_REGISTER(http);
@@ -2433,6 +2765,7 @@ static fa_protocol_t fa_protocol_https = {
   .fap_get_last_component = http_get_last_component,
   .fap_set_read_timeout = http_set_read_timeout,
   .fap_no_parking = http_no_parking,
+  .fap_prefetch = http_prefetch,
 };
 
 FAP_REGISTER(https);
@@ -2760,6 +3093,7 @@ static fa_protocol_t fa_protocol_webdav = {
   .fap_get_last_component = http_get_last_component,
   .fap_set_read_timeout = http_set_read_timeout,
   .fap_no_parking = http_no_parking,
+  .fap_prefetch = http_prefetch,
 };
 FAP_REGISTER(webdav);
 
@@ -2780,6 +3114,7 @@ static fa_protocol_t fa_protocol_webdavs = {
   .fap_get_last_component = http_get_last_component,
   .fap_set_read_timeout = http_set_read_timeout,
   .fap_no_parking = http_no_parking,
+  .fap_prefetch = http_prefetch,
 };
 FAP_REGISTER(webdavs);
 
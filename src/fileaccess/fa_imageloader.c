@@ -250,7 +250,8 @@ fa_imageloader(const char *url, const struct image_meta *im,
 
 #if ENABLE_LIBJPEG
     if(!im->im_no_decoding) {
-      pixmap_t *pm = libjpeg_decode(fh, im, errbuf, errlen);
+      pixmap_t *pm = libjpeg_decode(fh, im, ji.ji_orientation,
+                                    errbuf, errlen);
       if(pm != NULL) {
         image_t *im = image_create_from_pixmap(pm);
         im->im_origin_coded_type = IMAGE_JPEG;
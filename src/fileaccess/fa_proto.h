@@ -240,6 +240,16 @@ typedef struct fa_protocol {
    */
   int (*fap_no_parking)(fa_handle_t *fh);
 
+  /**
+   * Hint that the given range is likely to be read soon. The protocol
+   * may start fetching it in the background. Does not affect the
+   * current file position
+   *
+   * Return 0 if the hint was accepted (or the range is already being
+   * fetched), -1 if the protocol can not take more hints right now
+   */
+  int (*fap_prefetch)(fa_handle_t *fh, int64_t pos, int size);
+
   /**
    * Check if a file URL should be redirected to something else
    */
@@ -1424,6 +1424,8 @@ fileaccess_unregister_dynamic(fa_protocol_t *fap)
 }
 
 
+#define FA_LOAD_CACHE_STASH "fa-load"
+
 /**
  *
  */
@@ -1433,6 +1435,9 @@ fileaccess_init(void)
   fa_protocol_t *fap;
   fa_imageloader_init();
 
+  // Most cached content is loaded through us, allow it to use everything
+  blobcache_set_stash_budget(FA_LOAD_CACHE_STASH, 100);
+
   LIST_FOREACH(fap, &fileaccess_all_protocols, fap_link)
     if(fap->fap_init != NULL)
       fap->fap_init();
@@ -1481,9 +1486,6 @@ typedef struct loadarg {
   const char *value;
 } loadarg_t;
 
-#define FA_LOAD_CACHE_STASH "fa-load"
-
-
 /**
  *
  */
@@ -1685,7 +1687,7 @@ fa_load(const char *url, ...)
     }
 
     if(cache_control == BYPASS_CACHE)
-      blobcache_get_meta(url, FA_LOAD_CACHE_STASH, &etag, &mtime);
+      blobcache_get_meta(url, FA_LOAD_CACHE_STASH, &etag, &mtime, NULL);
 
     data2 = fap->fap_load(fap, filename, errbuf, errlen,
 			  &etag, &mtime, &max_age, flags, cb, opaque, c,
@@ -1800,6 +1802,42 @@ fa_load(const char *url, ...)
 }
 
 
+/**
+ *
+ */
+int
+fa_get_version(const char *url, char **etagp, time_t *mtimep,
+               int *is_expired)
+{
+  fa_protocol_t *fap;
+  char *filename;
+  struct fa_stat fs;
+  char errbuf[256];
+  int r = -1;
+
+  *etagp = NULL;
+  *mtimep = 0;
+  *is_expired = 0;
+
+  if(!blobcache_get_meta(url, FA_LOAD_CACHE_STASH, etagp, mtimep, is_expired))
+    return 0;
+
+  if((filename = fa_resolve_proto(url, &fap, errbuf, sizeof(errbuf))) == NULL)
+    return -1;
+
+  // Protocols that can be cached are too slow to stat()
+  if(!(fap->fap_flags & FAP_ALLOW_CACHE) && fap->fap_stat != NULL &&
+     !fap->fap_stat(fap, filename, &fs, FA_NON_INTERACTIVE,
+                    errbuf, sizeof(errbuf))) {
+    *mtimep = fs.fs_mtime;
+    r = 0;
+  }
+  fap_release(fap);
+  free(filename);
+  return r;
+}
+
+
 /**
  *
  */
@@ -334,6 +334,16 @@ buf_t *fa_load(const char *url, ...) attribute_null_sentinel;
 
 buf_t *fa_load_and_close(fa_handle_t *fh);
 
+/**
+ * Get the version of the object at 'url' without loading it. The
+ * etag and mtime come from the fa_load() cache, or from a stat if
+ * the protocol is fast enough to do that. 'etag' must be freed
+ *
+ * Returns -1 if the version can not be cheaply determined
+ */
+int fa_get_version(const char *url, char **etag, time_t *mtime,
+                   int *is_expired);
+
 int fa_parent(char *dst, size_t dstlen, const char *url)
   attribute_unused_result;
 
@@ -364,6 +374,9 @@ void memfile_unregister(int id);
 
 fa_handle_t *memfile_make(const void *mem, size_t len);
 
+// Takes ownership of the reference to b
+fa_handle_t *memfile_make_buf(buf_t *b);
+
 // Expose part of a file as a new file, fa is owned by the slicer
 // so you must never touch it again
 
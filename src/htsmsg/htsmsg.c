@@ -28,6 +28,211 @@
 #include "htsmsg.h"
 
 #include "main.h"
+#include "misc/minmax.h"
+
+#define HTSMSG_ARENA_BLOCK_SIZE      512
+#define HTSMSG_ARENA_MAX_BLOCK_SIZE  65536
+
+// Maps with fewer fields than this are never indexed
+#define HTSMSG_INDEX_MIN_FIELDS 16
+
+static int htsmsg_index_enabled = 1;
+
+typedef union htsmsg_arena_block {
+  union htsmsg_arena_block *hab_next;
+  double hab_align;
+} htsmsg_arena_block_t;
+
+typedef struct htsmsg_arena {
+  int ha_refcount;
+  char *ha_ptr;
+  size_t ha_avail;
+  size_t ha_block_size;
+  htsmsg_arena_block_t *ha_blocks;
+} htsmsg_arena_t;
+
+
+/**
+ *
+ */
+static void *
+htsmsg_arena_alloc(htsmsg_arena_t *ha, size_t size)
+{
+  size = (size + 7) & ~7;
+
+  if(size > ha->ha_avail) {
+    const size_t bs = MAX(ha->ha_block_size,
+                          size + sizeof(htsmsg_arena_block_t));
+    htsmsg_arena_block_t *hab = malloc(bs);
+    hab->hab_next = ha->ha_blocks;
+    ha->ha_blocks = hab;
+    ha->ha_ptr = (char *)(hab + 1);
+    ha->ha_avail = bs - sizeof(htsmsg_arena_block_t);
+    ha->ha_block_size = MIN(bs * 2, HTSMSG_ARENA_MAX_BLOCK_SIZE);
+  }
+
+  void *r = ha->ha_ptr;
+  ha->ha_ptr += size;
+  ha->ha_avail -= size;
+  return r;
+}
+
+
+/**
+ *
+ */
+static htsmsg_arena_t *
+htsmsg_arena_create(size_t size)
+{
+  htsmsg_arena_t tmp = {
+    .ha_block_size = size ? MIN(MAX(size, 256), HTSMSG_ARENA_MAX_BLOCK_SIZE) :
+    HTSMSG_ARENA_BLOCK_SIZE,
+  };
+
+  // The arena itself lives in its first block
+  htsmsg_arena_t *ha = htsmsg_arena_alloc(&tmp, sizeof(htsmsg_arena_t));
+  *ha = tmp;
+  return ha;
+}
+
+
+/**
+ *
+ */
+static void
+htsmsg_arena_release(htsmsg_arena_t *ha)
+{
+  htsmsg_arena_block_t *hab, *next;
+
+  if(--ha->ha_refcount > 0)
+    return;
+
+  for(hab = ha->ha_blocks; hab != NULL; hab = next) {
+    next = hab->hab_next;
+    free(hab);
+  }
+}
+
+
+/**
+ * Allocate memory with the same lifetime as the fields in \p msg
+ */
+static void *
+htsmsg_alloc(htsmsg_t *msg, size_t size)
+{
+  if(msg->hm_arena != NULL)
+    return htsmsg_arena_alloc(msg->hm_arena, size);
+  return malloc(size);
+}
+
+
+/**
+ *
+ */
+static char *
+htsmsg_strndup(htsmsg_t *msg, const char *str, size_t len)
+{
+  char *r = htsmsg_alloc(msg, len + 1);
+  memcpy(r, str, len);
+  r[len] = 0;
+  return r;
+}
+
+
+/**
+ * Flags for fields allocated with htsmsg_alloc()
+ */
+static int
+htsmsg_alloc_flags(htsmsg_t *msg, int flags)
+{
+  return msg->hm_arena != NULL ? 0 : flags;
+}
+
+
+/**
+ * FNV-1a
+ */
+static unsigned int
+htsmsg_hash(const char *s)
+{
+  unsigned int h = 2166136261U;
+  for(; *s; s++)
+    h = (h ^ (uint8_t)*s) * 16777619;
+  return h;
+}
+
+
+/**
+ * Add field to index unless there is already a field with the same
+ * name (htsmsg_field_find() returns the first one)
+ */
+static void
+htsmsg_index_insert(htsmsg_t *msg, htsmsg_field_t *f)
+{
+  unsigned int i = htsmsg_hash(f->hmf_name) & msg->hm_index_mask;
+  htsmsg_field_t *e;
+
+  while((e = msg->hm_index[i]) != NULL) {
+    if(!strcmp(e->hmf_name, f->hmf_name))
+      return;
+    i = (i + 1) & msg->hm_index_mask;
+  }
+  msg->hm_index[i] = f;
+}
+
+
+/**
+ *
+ */
+static void
+htsmsg_index_build(htsmsg_t *msg)
+{
+  htsmsg_field_t *f;
+  unsigned int size = 32;
+
+  while(size < msg->hm_num_fields * 2)
+    size *= 2;
+
+  free(msg->hm_index);
+  msg->hm_index = calloc(size, sizeof(htsmsg_field_t *));
+  msg->hm_index_mask = size - 1;
+
+  HTSMSG_FOREACH(f, msg)
+    if(f->hmf_name != NULL)
+      htsmsg_index_insert(msg, f);
+}
+
+
+/**
+ *
+ */
+static void
+htsmsg_index_clear(htsmsg_t *msg)
+{
+  free(msg->hm_index);
+  msg->hm_index = NULL;
+  msg->hm_scan_cost = 0;
+}
+
+
+/**
+ *
+ */
+static htsmsg_field_t *
+htsmsg_index_find(htsmsg_t *msg, const char *name)
+{
+  unsigned int i = htsmsg_hash(name) & msg->hm_index_mask;
+  htsmsg_field_t *f;
+
+  while((f = msg->hm_index[i]) != NULL) {
+    if(!strcmp(f->hmf_name, name))
+      return f;
+    i = (i + 1) & msg->hm_index_mask;
+  }
+  return NULL;
+}
+
+
 /**
  *
  */
@@ -35,6 +240,10 @@ void
 htsmsg_field_destroy(htsmsg_t *msg, htsmsg_field_t *f)
 {
   TAILQ_REMOVE(&msg->hm_fields, f, hmf_link);
+  msg->hm_num_fields--;
+
+  if(msg->hm_index != NULL)
+    htsmsg_index_clear(msg);
 
   htsmsg_release(f->hmf_childs);
 
@@ -51,7 +260,8 @@ htsmsg_field_destroy(htsmsg_t *msg, htsmsg_field_t *f)
   if(f->hmf_flags & HMF_NAME_ALLOCED)
     free(f->hmf_name);
   rstr_release(f->hmf_namespace);
-  free(f);
+  if(msg->hm_arena == NULL)
+    free(f);
 }
 
 /**
@@ -60,10 +270,11 @@ htsmsg_field_destroy(htsmsg_t *msg, htsmsg_field_t *f)
 htsmsg_field_t *
 htsmsg_field_add(htsmsg_t *msg, const char *name, int type, int flags)
 {
-  htsmsg_field_t *f = malloc(sizeof(htsmsg_field_t));
+  htsmsg_field_t *f = htsmsg_alloc(msg, sizeof(htsmsg_field_t));
   f->hmf_childs = NULL;
   f->hmf_namespace = NULL;
   TAILQ_INSERT_TAIL(&msg->hm_fields, f, hmf_link);
+  msg->hm_num_fields++;
 
   if(msg->hm_islist) {
     assert(name == NULL);
@@ -71,13 +282,27 @@ htsmsg_field_add(htsmsg_t *msg, const char *name, int type, int flags)
     assert(name != NULL);
   }
 
-  if(flags & HMF_NAME_ALLOCED)
-    f->hmf_name = name ? strdup(name) : NULL;
-  else
+  if(flags & HMF_NAME_ALLOCED) {
+    if(name != NULL) {
+      f->hmf_name = htsmsg_strndup(msg, name, strlen(name));
+      if(msg->hm_arena != NULL)
+        flags &= ~HMF_NAME_ALLOCED;
+    } else {
+      f->hmf_name = NULL;
+    }
+  } else {
     f->hmf_name = (char *)name;
+  }
 
   f->hmf_type = type;
   f->hmf_flags = flags;
+
+  if(msg->hm_index != NULL && name != NULL) {
+    if(msg->hm_num_fields * 2 > msg->hm_index_mask + 1)
+      htsmsg_index_build(msg);
+    else
+      htsmsg_index_insert(msg, f);
+  }
   return f;
 }
 
@@ -99,11 +324,24 @@ htsmsg_field_find(htsmsg_t *msg, const char *name)
     return NULL;
   }
 
+  if(msg->hm_index != NULL)
+    return htsmsg_index_find(msg, name);
+
+  unsigned int cost = 0;
   TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
+    cost++;
     if(f->hmf_name != NULL && !strcmp(f->hmf_name, name))
-      return f;
+      break;
   }
-  return NULL;
+
+  // Index large maps once linear lookups have cost more than building it
+  if(msg->hm_num_fields >= HTSMSG_INDEX_MIN_FIELDS && !msg->hm_islist &&
+     htsmsg_index_enabled) {
+    msg->hm_scan_cost += cost;
+    if(msg->hm_scan_cost > msg->hm_num_fields * 2)
+      htsmsg_index_build(msg);
+  }
+  return f;
 }
 
 
@@ -149,6 +387,67 @@ htsmsg_create_list(void)
 }
 
 
+/**
+ *
+ */
+static htsmsg_t *
+htsmsg_create_in_arena(htsmsg_arena_t *ha, int islist)
+{
+  htsmsg_t *msg = htsmsg_arena_alloc(ha, sizeof(htsmsg_t));
+  memset(msg, 0, sizeof(htsmsg_t));
+  msg->hm_refcount = 1;
+  TAILQ_INIT(&msg->hm_fields);
+  msg->hm_islist = islist;
+  msg->hm_arena = ha;
+  ha->ha_refcount++;
+  return msg;
+}
+
+
+/**
+ *
+ */
+htsmsg_t *
+htsmsg_create_map_arena(size_t size)
+{
+  return htsmsg_create_in_arena(htsmsg_arena_create(size), 0);
+}
+
+
+/**
+ *
+ */
+htsmsg_t *
+htsmsg_create_list_arena(size_t size)
+{
+  return htsmsg_create_in_arena(htsmsg_arena_create(size), 1);
+}
+
+
+/**
+ *
+ */
+htsmsg_t *
+htsmsg_create_map_in(htsmsg_t *parent)
+{
+  if(parent->hm_arena == NULL)
+    return htsmsg_create_map();
+  return htsmsg_create_in_arena(parent->hm_arena, 0);
+}
+
+
+/**
+ *
+ */
+htsmsg_t *
+htsmsg_create_list_in(htsmsg_t *parent)
+{
+  if(parent->hm_arena == NULL)
+    return htsmsg_create_list();
+  return htsmsg_create_in_arena(parent->hm_arena, 1);
+}
+
+
 /**
  *
  */
@@ -165,11 +464,16 @@ htsmsg_release(htsmsg_t *msg)
     return;
 
 
+  htsmsg_index_clear(msg);
+
   while((f = TAILQ_FIRST(&msg->hm_fields)) != NULL)
     htsmsg_field_destroy(msg, f);
 
   buf_release(msg->hm_backing_store);
-  free(msg);
+  if(msg->hm_arena != NULL)
+    htsmsg_arena_release(msg->hm_arena);
+  else
+    free(msg);
 }
 
 /**
@@ -252,9 +556,19 @@ htsmsg_add_dbl(htsmsg_t *msg, const char *name, double dbl)
 void
 htsmsg_add_str(htsmsg_t *msg, const char *name, const char *str)
 {
-  htsmsg_field_t *f = htsmsg_field_add(msg, name, HMF_STR, 
-				        HMF_ALLOCED | HMF_NAME_ALLOCED);
-  f->hmf_str = strdup(str);
+  htsmsg_add_strn(msg, name, str, strlen(str));
+}
+
+/*
+ *
+ */
+void
+htsmsg_add_strn(htsmsg_t *msg, const char *name, const char *str, size_t len)
+{
+  htsmsg_field_t *f =
+    htsmsg_field_add(msg, name, HMF_STR,
+                     htsmsg_alloc_flags(msg, HMF_ALLOCED) | HMF_NAME_ALLOCED);
+  f->hmf_str = htsmsg_strndup(msg, str, len);
 }
 
 /*
@@ -263,10 +577,11 @@ htsmsg_add_str(htsmsg_t *msg, const char *name, const char *str)
 void
 htsmsg_add_bin(htsmsg_t *msg, const char *name, const void *bin, size_t len)
 {
-  htsmsg_field_t *f = htsmsg_field_add(msg, name, HMF_BIN, 
-				       HMF_ALLOCED | HMF_NAME_ALLOCED);
+  htsmsg_field_t *f =
+    htsmsg_field_add(msg, name, HMF_BIN,
+                     htsmsg_alloc_flags(msg, HMF_ALLOCED) | HMF_NAME_ALLOCED);
   void *v;
-  f->hmf_bin = v = malloc(len);
+  f->hmf_bin = v = htsmsg_alloc(msg, len);
   f->hmf_binsize = len;
   memcpy(v, bin, len);
 }
@@ -720,10 +1035,231 @@ htsmsg_get_map_by_field_if_name(htsmsg_field_t *f, const char *name)
  */
 int
 htsmsg_get_children(htsmsg_t *msg)
+{
+  return msg->hm_num_fields;
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Benchmark, run with --bench htsmsg
+ */
+static const char *bench_tmdb_keys[] = {
+  "adult", "backdrop_path", "budget", "homepage", "id", "imdb_id",
+  "original_language", "original_title", "overview", "popularity",
+  "poster_path", "release_date", "revenue", "runtime", "status",
+  "tagline", "title", "video", "vote_average", "vote_count",
+};
+
+static const char *bench_cast_keys[] = {
+  "cast_id", "character", "credit_id", "gender", "id", "name", "order",
+  "profile_path",
+};
+
+
+static htsmsg_t *
+bench_create_map(int arena)
+{
+  return arena ? htsmsg_create_map_arena(0) : htsmsg_create_map();
+}
+
+
+/**
+ * Something like a HTSP eventAdd message
+ */
+static htsmsg_t *
+bench_htsp_build(int arena, int i)
+{
+  htsmsg_t *m = bench_create_map(arena);
+  htsmsg_add_str(m, "method", "eventAdd");
+  htsmsg_add_u32(m, "eventId", i);
+  htsmsg_add_u32(m, "channelId", i % 50);
+  htsmsg_add_s64(m, "start", 1400000000 + i * 1800);
+  htsmsg_add_s64(m, "stop", 1400000000 + i * 1800 + 1800);
+  htsmsg_add_str(m, "title", "The evening news");
+  htsmsg_add_str(m, "summary", "News and weather from around the country");
+  htsmsg_add_str(m, "description", "Tonight's top stories, followed by "
+                 "sport and a look at the weather for the coming week.");
+  htsmsg_add_u32(m, "contentType", 32);
+  htsmsg_add_u32(m, "nextEventId", i + 1);
+  htsmsg_t *l = htsmsg_create_list_in(m);
+  for(int j = 0; j < 3; j++)
+    htsmsg_add_u32(l, NULL, 16 + j);
+  htsmsg_add_msg(m, "genre", l);
+  return m;
+}
+
+
+static int
+bench_htsp_lookup(htsmsg_t *m)
+{
+  int r = 0;
+  r += strlen(htsmsg_get_str(m, "method"));
+  r += htsmsg_get_u32_or_default(m, "eventId", 0);
+  r += htsmsg_get_u32_or_default(m, "channelId", 0);
+  r += htsmsg_get_s32_or_default(m, "start", 0);
+  r += htsmsg_get_s32_or_default(m, "stop", 0);
+  r += strlen(htsmsg_get_str(m, "title"));
+  r += strlen(htsmsg_get_str(m, "summary"));
+  r += strlen(htsmsg_get_str(m, "description"));
+  r += htsmsg_get_u32_or_default(m, "nextEventId", 0);
+  r += htsmsg_get_children(htsmsg_get_list(m, "genre"));
+  r += htsmsg_get_u32_or_default(m, "missing", 0);
+  return r;
+}
+
+
+/**
+ * Something like a TMDB movie with credits
+ */
+static htsmsg_t *
+bench_tmdb_build(int arena, int i)
+{
+  htsmsg_t *m = bench_create_map(arena);
+  char tmp[64];
+
+  for(int j = 0; j < ARRAYSIZE(bench_tmdb_keys); j++) {
+    if(j & 1) {
+      snprintf(tmp, sizeof(tmp), "/%d/%s.jpg", i, bench_tmdb_keys[j]);
+      htsmsg_add_str(m, bench_tmdb_keys[j], tmp);
+    } else {
+      htsmsg_add_s64(m, bench_tmdb_keys[j], i * j);
+    }
+  }
+
+  htsmsg_t *credits = htsmsg_create_map_in(m);
+  htsmsg_t *cast = htsmsg_create_list_in(m);
+  for(int k = 0; k < 40; k++) {
+    htsmsg_t *c = htsmsg_create_map_in(m);
+    for(int j = 0; j < ARRAYSIZE(bench_cast_keys); j++) {
+      if(j & 1) {
+        snprintf(tmp, sizeof(tmp), "Person %d", k);
+        htsmsg_add_str(c, bench_cast_keys[j], tmp);
+      } else {
+        htsmsg_add_u32(c, bench_cast_keys[j], k * j);
+      }
+    }
+    htsmsg_add_msg(cast, NULL, c);
+  }
+  htsmsg_add_msg(credits, "cast", cast);
+  htsmsg_add_msg(m, "credits", credits);
+  return m;
+}
+
+
+static int
+bench_tmdb_lookup(htsmsg_t *m)
 {
   htsmsg_field_t *f;
-  int cnt = 0;
-  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link)
-    cnt++;
-  return cnt;
+  int r = 0;
+
+  for(int j = 0; j < ARRAYSIZE(bench_tmdb_keys); j++) {
+    if(j & 1)
+      r += strlen(htsmsg_get_str(m, bench_tmdb_keys[j]));
+    else
+      r += htsmsg_get_s32_or_default(m, bench_tmdb_keys[j], 0);
+  }
+
+  htsmsg_t *cast = htsmsg_get_list(htsmsg_get_map(m, "credits"), "cast");
+  HTSMSG_FOREACH(f, cast) {
+    htsmsg_t *c = htsmsg_get_map_by_field(f);
+    r += htsmsg_get_u32_or_default(c, "id", 0);
+    r += strlen(htsmsg_get_str(c, "name"));
+    r += strlen(htsmsg_get_str(c, "character"));
+    r += htsmsg_get_u32_or_default(c, "order", 0);
+  }
+  return r;
+}
+
+
+/**
+ * A big dictionary, such as a keyring or a settings store
+ */
+static char bench_dict_keys[500][16];
+
+static htsmsg_t *
+bench_dict_build(int arena, int i)
+{
+  htsmsg_t *m = bench_create_map(arena);
+  for(int j = 0; j < ARRAYSIZE(bench_dict_keys); j++) {
+    if(bench_dict_keys[j][0] == 0)
+      snprintf(bench_dict_keys[j], sizeof(bench_dict_keys[j]),
+               "entry-%d", j * 7919 % 10007);
+    htsmsg_add_u32(m, bench_dict_keys[j], j);
+  }
+  return m;
+}
+
+
+static int
+bench_dict_lookup(htsmsg_t *m)
+{
+  int r = 0;
+  for(int j = 0; j < ARRAYSIZE(bench_dict_keys); j += 3)
+    r += htsmsg_get_u32_or_default(m, bench_dict_keys[j], 0);
+  return r;
+}
+
+
+typedef struct htsmsg_bench_payload {
+  const char *name;
+  int count;
+  htsmsg_t *(*build)(int arena, int i);
+  int (*lookup)(htsmsg_t *m);
+} htsmsg_bench_payload_t;
+
+static const htsmsg_bench_payload_t htsmsg_bench_payloads[] = {
+  { "htsp", 2000, bench_htsp_build, bench_htsp_lookup },
+  { "tmdb", 100,  bench_tmdb_build, bench_tmdb_lookup },
+  { "dict", 20,   bench_dict_build, bench_dict_lookup },
+};
+
+
+static void
+htsmsg_bench(void)
+{
+  const int rounds = 50;
+
+  for(int p = 0; p < ARRAYSIZE(htsmsg_bench_payloads); p++) {
+    const htsmsg_bench_payload_t *hbp = &htsmsg_bench_payloads[p];
+    htsmsg_t **v = malloc(sizeof(htsmsg_t *) * hbp->count);
+
+    for(int mode = 0; mode < 3; mode++) {
+      const int arena = mode > 0;
+      int64_t build = 0, lookup = 0, release = 0, t0;
+      int sum = 0;
+
+      htsmsg_index_enabled = mode == 2;
+
+      for(int r = 0; r < rounds; r++) {
+        t0 = arch_get_ts();
+        for(int i = 0; i < hbp->count; i++)
+          v[i] = hbp->build(arena, i);
+        build += arch_get_ts() - t0;
+
+        t0 = arch_get_ts();
+        for(int k = 0; k < 4; k++)
+          for(int i = 0; i < hbp->count; i++)
+            sum += hbp->lookup(v[i]);
+        lookup += arch_get_ts() - t0;
+
+        t0 = arch_get_ts();
+        for(int i = 0; i < hbp->count; i++)
+          htsmsg_release(v[i]);
+        release += arch_get_ts() - t0;
+      }
+
+      const double n = (double)hbp->count * rounds;
+      TRACE(TRACE_INFO, "bench",
+            "htsmsg: %-5s %-12s build %7.2f  lookup %7.2f  free %7.2f "
+            "us/msg (%d)",
+            hbp->name, (const char *[]){"malloc", "arena", "arena+index"}[mode],
+            build / n, lookup / n, release / n, sum);
+    }
+    free(v);
+  }
+  htsmsg_index_enabled = 1;
 }
+
+BENCHMARK("htsmsg", htsmsg_bench);
+#endif
@@ -30,9 +30,16 @@
 
 TAILQ_HEAD(htsmsg_field_queue, htsmsg_field);
 
+struct htsmsg_arena;
+
 typedef struct htsmsg {
   struct htsmsg_field_queue hm_fields;
   buf_t *hm_backing_store;
+  struct htsmsg_arena *hm_arena;     // If set, fields are allocated here
+  struct htsmsg_field **hm_index;    // Hash index for lookup by name
+  unsigned int hm_index_mask;
+  unsigned int hm_num_fields;
+  unsigned int hm_scan_cost;         // Fields compared in linear lookups
   uint8_t hm_islist;
   int hm_refcount;
 } htsmsg_t;
@@ -98,6 +105,27 @@ htsmsg_t *htsmsg_create_map(void);
  */
 htsmsg_t *htsmsg_create_list(void);
 
+/**
+ * Create a new map or list that allocates its fields, names and strings
+ * from an arena instead of doing one malloc() for each of them.
+ * Everything is freed at once when the last message in the arena
+ * is released. \p size is the size of the first block, 0 for default.
+ *
+ * Removing fields does not give any memory back so this is best suited
+ * for messages that are built, read and then thrown away.
+ */
+htsmsg_t *htsmsg_create_map_arena(size_t size);
+
+htsmsg_t *htsmsg_create_list_arena(size_t size);
+
+/**
+ * Create a new map or list to be added to \p parent. It will use the
+ * same arena as \p parent (if any)
+ */
+htsmsg_t *htsmsg_create_map_in(htsmsg_t *parent);
+
+htsmsg_t *htsmsg_create_list_in(htsmsg_t *parent);
+
 /**
  * Remove a given field from a msg
  */
@@ -128,6 +156,12 @@ void htsmsg_add_s64(htsmsg_t *msg, const char *name,  int64_t s64);
  */
 void htsmsg_add_str(htsmsg_t *msg, const char *name, const char *str);
 
+/**
+ * Add a string field from a string that is not zero terminated
+ */
+void htsmsg_add_strn(htsmsg_t *msg, const char *name, const char *str,
+                     size_t len);
+
 /**
  * Add an field where source is a list or map message.
  */
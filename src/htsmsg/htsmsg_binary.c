@@ -34,7 +34,8 @@ htsmsg_binary_des0(htsmsg_t *msg, const uint8_t *buf, size_t len, buf_t *src)
   unsigned type, namelen, datalen;
   htsmsg_field_t *f;
   htsmsg_t *sub;
-  char *n;
+  const char *name;
+  char namebuf[256];
   uint64_t u64;
   int i;
 
@@ -53,66 +54,44 @@ htsmsg_binary_des0(htsmsg_t *msg, const uint8_t *buf, size_t len, buf_t *src)
     if(len < namelen + datalen)
       return -1;
 
-    f = calloc(1, sizeof(htsmsg_field_t));
-    f->hmf_type  = type;
+    memcpy(namebuf, buf, namelen);
+    namebuf[namelen] = 0;
+    buf += namelen;
+    len -= namelen;
 
-    if(namelen > 0) {
-      n = malloc(namelen + 1);
-      memcpy(n, buf, namelen);
-      n[namelen] = 0;
-
-      buf += namelen;
-      len -= namelen;
-      f->hmf_flags = HMF_NAME_ALLOCED;
-
-    } else {
-      n = NULL;
-      f->hmf_flags = 0;
-    }
-
-    f->hmf_name  = n;
+    name = msg->hm_islist ? NULL : namebuf;
 
     switch(type) {
     case HMF_STR:
-      f->hmf_str = n = malloc(datalen + 1);
-      memcpy(n, buf, datalen);
-      n[datalen] = 0;
-      f->hmf_flags |= HMF_ALLOCED;
+      htsmsg_add_strn(msg, name, (const char *)buf, datalen);
       break;
 
     case HMF_BIN:
-      f->hmf_bin = (void *)buf;
-      f->hmf_binsize = datalen;
-
-      if(msg->hm_backing_store == NULL)
-        msg->hm_backing_store = buf_retain(src);
+      htsmsg_add_binptr(msg, name, (void *)buf, datalen);
+      htsmsg_set_backing_store(msg, src);
       break;
 
     case HMF_S64:
       u64 = 0;
       for(i = datalen - 1; i >= 0; i--)
 	  u64 = (u64 << 8) | buf[i];
-      f->hmf_s64 = u64;
+      htsmsg_add_s64(msg, name, u64);
       break;
 
     case HMF_MAP:
-      sub = htsmsg_create_map();
-      if(0)
     case HMF_LIST:
-        sub = htsmsg_create_list();
-
+      sub = type == HMF_MAP ? htsmsg_create_map_in(msg) :
+        htsmsg_create_list_in(msg);
+      f = htsmsg_field_add(msg, name, type, HMF_NAME_ALLOCED);
       f->hmf_childs = sub;
       if(htsmsg_binary_des0(sub, buf, datalen, src) < 0)
 	return -1;
       break;
 
     default:
-      free(n);
-      free(f);
       return -1;
     }
 
-    TAILQ_INSERT_TAIL(&msg->hm_fields, f, hmf_link);
     buf += datalen;
     len -= datalen;
   }
@@ -121,12 +100,12 @@ htsmsg_binary_des0(htsmsg_t *msg, const uint8_t *buf, size_t len, buf_t *src)
 
 
 /**
- *
+ * Messages are usually short lived so they are built in an arena
  */
 htsmsg_t *
 htsmsg_binary_deserialize(buf_t *buf)
 {
-  htsmsg_t *msg = htsmsg_create_map();
+  htsmsg_t *msg = htsmsg_create_map_arena(0);
   if(htsmsg_binary_des0(msg, buf_data(buf), buf_len(buf), buf) < 0) {
     htsmsg_release(msg);
     return NULL;
@@ -27,7 +27,10 @@
 #include "htsbuf.h"
 #include "misc/str.h"
 #include "misc/json.h"
+#include "misc/json_stream.h"
 #include "misc/dbl.h"
+#include "misc/minmax.h"
+#include "main.h"
 
 
 /**
@@ -138,8 +141,11 @@ htsmsg_json_serialize_to_rstr(htsmsg_t *msg, const char *prefix)
 }
 
 
+#if ENABLE_BENCHMARKS
 /**
- *
+ * Callback based htsmsg deserializer, what htsmsg_json_deserialize()
+ * used before the token builder below. Only kept as the reference in
+ * the benchmark
  */
 
 static void *
@@ -210,6 +216,168 @@ static const json_deserializer_t json_to_htsmsg = {
   .jd_add_bool        = add_bool,
   .jd_add_null        = add_null,
 };
+#endif
+
+
+/**
+ * Return a zero terminated string for a key or string token
+ *
+ * In the common case the string is terminated (and unescaped if needed)
+ * in place in the source buffer. Only strings with broken UTF-8 (which
+ * may grow when fixed up) are allocated.
+ */
+static char *
+json_token_str(const json_token_t *jt, int *alloced)
+{
+  char *s = (char *)jt->jt_str;
+  size_t len = jt->jt_len;
+
+  if(jt->jt_flags & JSON_STR_BADUTF8) {
+    char *r = malloc(json_string_decode(NULL, s, len) + 1);
+    r[json_string_decode(r, s, len)] = 0;
+    *alloced = 1;
+    return r;
+  }
+
+  if(jt->jt_flags & JSON_STR_ESCAPED)
+    len = json_string_decode(s, s, len);
+
+  s[len] = 0;
+  *alloced = 0;
+  return s;
+}
+
+
+/**
+ * Deserialize JSON without copying keys and strings
+ *
+ * The buf is consumed and is kept alive by the returned message.
+ */
+static htsmsg_t *
+htsmsg_json_parse(buf_t *buf, char *errbuf, size_t errlen, int arena)
+{
+  json_stream_t js;
+  json_token_t jt;
+  htsmsg_t *stack[JSON_STREAM_MAX_DEPTH];
+  htsmsg_t *root = NULL, *m = NULL, *c;
+  htsmsg_field_t *f;
+  char *name = NULL, *str;
+  int name_flags = 0;
+  int depth = 0;
+  int alloced;
+
+  buf = buf_make_writable(buf);
+
+  json_stream_init(&js);
+  json_stream_data(&js, buf_cstr(buf), buf_len(buf), 1);
+
+  while(1) {
+    json_token_type_t t = json_stream_next(&js, &jt);
+
+    if(root == NULL &&
+       t != JSON_TOKEN_MAP_BEGIN && t != JSON_TOKEN_LIST_BEGIN) {
+      snprintf(errbuf, errlen, "Invalid JSON, expected '{' or '['");
+      buf_release(buf);
+      return NULL;
+    }
+
+    switch(t) {
+    case JSON_TOKEN_NEED_MORE:
+    case JSON_TOKEN_ERROR:
+      goto bad;
+
+    case JSON_TOKEN_END:
+      buf_release(buf);
+      return root;
+
+    case JSON_TOKEN_MAP_BEGIN:
+    case JSON_TOKEN_LIST_BEGIN:
+      if(m == NULL) {
+        if(arena)
+          c = t == JSON_TOKEN_MAP_BEGIN ?
+            htsmsg_create_map_arena(buf_len(buf)) :
+            htsmsg_create_list_arena(buf_len(buf));
+        else
+          c = t == JSON_TOKEN_MAP_BEGIN ? htsmsg_create_map() :
+            htsmsg_create_list();
+        root = c;
+      } else {
+        c = t == JSON_TOKEN_MAP_BEGIN ? htsmsg_create_map_in(m) :
+          htsmsg_create_list_in(m);
+        f = htsmsg_field_add(m, name, c->hm_islist ? HMF_LIST : HMF_MAP,
+                             name_flags);
+        f->hmf_childs = c;
+      }
+      htsmsg_set_backing_store(c, buf);
+      stack[depth++] = m = c;
+      break;
+
+    case JSON_TOKEN_MAP_END:
+    case JSON_TOKEN_LIST_END:
+      depth--;
+      m = depth ? stack[depth - 1] : NULL;
+      break;
+
+    case JSON_TOKEN_KEY:
+      name = json_token_str(&jt, &alloced);
+      name_flags = alloced ? HMF_NAME_ALLOCED : 0;
+      continue;
+
+    case JSON_TOKEN_STRING:
+      str = json_token_str(&jt, &alloced);
+      f = htsmsg_field_add(m, name, HMF_STR,
+                           name_flags | (alloced ? HMF_ALLOCED : 0));
+      f->hmf_str = str;
+      break;
+
+    case JSON_TOKEN_INTEGER:
+    case JSON_TOKEN_BOOL:
+      f = htsmsg_field_add(m, name, HMF_S64, name_flags);
+      f->hmf_s64 = jt.jt_s64;
+      break;
+
+    case JSON_TOKEN_DOUBLE:
+      f = htsmsg_field_add(m, name, HMF_DBL, name_flags);
+      f->hmf_dbl = jt.jt_dbl;
+      break;
+
+    case JSON_TOKEN_NULL:
+      if(name_flags & HMF_NAME_ALLOCED)
+        free(name);
+      break;
+    }
+    name = NULL;
+    name_flags = 0;
+  }
+
+ bad:
+  if(name_flags & HMF_NAME_ALLOCED)
+    free(name);
+  htsmsg_release(root);
+
+  int offset = js.js_pos - 10;
+  if(offset < 0)
+    offset = 0;
+  snprintf(errbuf, errlen, "%s at offset %d : '%.20s'", js.js_errmsg,
+           offset, buf_cstr(buf) + offset);
+  buf_release(buf);
+  return NULL;
+}
+
+
+/**
+ * Deserialize JSON from a buf. The buf is consumed.
+ *
+ * The message is built in an arena so this is meant for documents that
+ * are parsed, looked at and thrown away (such as API responses).
+ * Messages that are kept around and modified should be deserialized
+ * with htsmsg_json_deserialize() instead.
+ */
+htsmsg_t *
+htsmsg_json_deserialize_buf(buf_t *buf, char *errbuf, size_t errlen)
+{
+  return htsmsg_json_parse(buf, errbuf, errlen, 1);
+}
 
 
 /**
@@ -218,7 +386,7 @@ static const json_deserializer_t json_to_htsmsg = {
 htsmsg_t *
 htsmsg_json_deserialize(const char *src)
 {
-  return json_deserialize(src, &json_to_htsmsg, NULL, NULL, 0);
+  return htsmsg_json_deserialize2(src, NULL, 0);
 }
 
 /**
@@ -227,5 +395,172 @@ htsmsg_json_deserialize(const char *src)
 htsmsg_t *
 htsmsg_json_deserialize2(const char *src, char *errbuf, size_t errlen)
 {
-  return json_deserialize(src, &json_to_htsmsg, NULL, errbuf, errlen);
+  buf_t *b = buf_create_and_copy(strlen(src), src);
+  return htsmsg_json_parse(b, errbuf, errlen, 0);
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Parser benchmark, run with --bench json
+ */
+static char *
+json_bench_payload(int plugins, int items)
+{
+  htsbuf_queue_t hq;
+  char *str;
+  htsbuf_queue_init(&hq, 0);
+
+  if(plugins) {
+    // Looks like a plugin repository
+    htsbuf_qprintf(&hq, "{\"version\":1,\"plugins\":[");
+    for(int i = 0; i < items; i++) {
+      htsbuf_qprintf(&hq,
+                     "%s{\"id\":\"plugin%d\",\"type\":\"ext\","
+                     "\"version\":\"1.%d.%d\",\"showtimeVersion\":\"4.8\","
+                     "\"title\":\"Plugin number %d\","
+                     "\"synopsis\":\"Access to videos from site %d\","
+                     "\"author\":\"Some Author <author%d@example.com>\","
+                     "\"category\":\"video\",\"icon\":"
+                     "\"http:\\/\\/example.com\\/plugins\\/%d\\/logo.png\","
+                     "\"downloadURL\":"
+                     "\"http:\\/\\/example.com\\/plugins\\/%d.zip\","
+                     "\"downloads\":%d,\"enabled\":true}",
+                     i ? "," : "", i, i % 10, i % 7, i, i, i, i, i, i * 37);
+    }
+    htsbuf_qprintf(&hq, "]}");
+  } else {
+    // Looks like a TMDB search result
+    htsbuf_qprintf(&hq, "{\"page\":1,\"results\":[");
+    for(int i = 0; i < items; i++) {
+      htsbuf_qprintf(&hq,
+                     "%s{\"adult\":false,\"backdrop_path\":\"\\/bd%d.jpg\","
+                     "\"genre_ids\":[18,%d,53],\"id\":%d,"
+                     "\"original_language\":\"en\","
+                     "\"original_title\":\"Movie %d\","
+                     "\"overview\":\"A \\\"retired\\\" operative is pulled "
+                     "back for one last job in Z\\u00fcrich, \\u00e5 long "
+                     "story that spans decades and continents.\\n\","
+                     "\"release_date\":\"20%02d-0%d-1%d\","
+                     "\"poster_path\":\"\\/p%d.jpg\",\"popularity\":%d.%d,"
+                     "\"title\":\"Movie %d\",\"video\":false,"
+                     "\"vote_average\":%d.%d,\"vote_count\":%d,"
+                     "\"tagline\":null}",
+                     i ? "," : "", i, 10 + i % 90, 1000 + i, i,
+                     i, i % 100, 1 + i % 9, i % 10, i, i % 500, i % 1000, i,
+                     i % 10, i % 10, i * 13);
+    }
+    htsbuf_qprintf(&hq, "],\"total_pages\":%d,\"total_results\":%d}",
+                   items / 20, items);
+  }
+  str = htsbuf_to_string(&hq);
+  htsbuf_queue_flush(&hq);
+  return str;
+}
+
+
+static void
+json_bench_report(const char *payload, const char *what, size_t len,
+                  int rounds, int64_t ts, int64_t ref_ts, const char *result)
+{
+  TRACE(TRACE_INFO, "bench", "json: %-8s %-12s %8.1f MB/s %5.2fx%s",
+        payload, what, (double)len * rounds / MAX(ts, 1),
+        (double)ref_ts / MAX(ts, 1), result);
+}
+
+
+static void
+json_bench(void)
+{
+  for(int p = 0; p < 2; p++) {
+    const char *payload = p ? "plugins" : "tmdb";
+    char *src = json_bench_payload(p, 2000);
+    const size_t len = strlen(src);
+    const int rounds = MAX(3, 200000000 / len);
+    char *ref = NULL, *out = NULL;
+    int64_t ts, ref_ts = 0, t0;
+    htsmsg_t *m;
+
+    // Old recursive parser
+    ts = 0;
+    for(int i = 0; i < rounds; i++) {
+      t0 = arch_get_ts();
+      m = json_deserialize(src, &json_to_htsmsg, NULL, NULL, 0);
+      ts += arch_get_ts() - t0;
+      if(i == 0)
+        ref = htsmsg_json_serialize_to_str(m, 0);
+      htsmsg_release(m);
+    }
+    ref_ts = ts;
+    json_bench_report(payload, "callbacks", len, rounds, ts, ref_ts, "");
+
+    // Tokenizer + builder from a C string (includes copy into a buf)
+    ts = 0;
+    for(int i = 0; i < rounds; i++) {
+      t0 = arch_get_ts();
+      m = htsmsg_json_deserialize(src);
+      ts += arch_get_ts() - t0;
+      if(i == 0)
+        out = htsmsg_json_serialize_to_str(m, 0);
+      htsmsg_release(m);
+    }
+    json_bench_report(payload, "cstr", len, rounds, ts, ref_ts,
+                      strcmp(ref, out) ? " MISMATCH" : "");
+    free(out);
+
+    // Tokenizer + builder from a buf, as done for HTTP responses
+    ts = 0;
+    for(int i = 0; i < rounds; i++) {
+      buf_t *b = buf_create_and_copy(len, src);
+      t0 = arch_get_ts();
+      m = htsmsg_json_deserialize_buf(b, NULL, 0);
+      ts += arch_get_ts() - t0;
+      if(i == 0)
+        out = htsmsg_json_serialize_to_str(m, 0);
+      htsmsg_release(m);
+    }
+    json_bench_report(payload, "buf", len, rounds, ts, ref_ts,
+                      strcmp(ref, out) ? " MISMATCH" : "");
+    free(out);
+
+    // Just the tokenizer, all data at once and fed in 1400 byte pieces
+    int tokens = 0, ref_tokens = 0;
+    for(int chunk = 0; chunk <= 1400; chunk += 1400) {
+      ts = 0;
+      for(int i = 0; i < rounds; i++) {
+        json_stream_t js;
+        json_token_t jt;
+        json_token_type_t t;
+        size_t avail = chunk ?: len;
+
+        tokens = 0;
+        t0 = arch_get_ts();
+        json_stream_init(&js);
+        json_stream_data(&js, src, avail, avail == len);
+        while((t = json_stream_next(&js, &jt)) > JSON_TOKEN_END ||
+              t == JSON_TOKEN_NEED_MORE) {
+          if(t == JSON_TOKEN_NEED_MORE) {
+            avail = MIN(avail + chunk, len);
+            json_stream_data(&js, src, avail, avail == len);
+          } else {
+            tokens++;
+          }
+        }
+        ts += arch_get_ts() - t0;
+        if(t != JSON_TOKEN_END)
+          tokens = -1;
+      }
+      if(chunk == 0)
+        ref_tokens = tokens;
+      json_bench_report(payload, chunk ? "tokens/1400" : "tokens", len,
+                        rounds, ts, ref_ts,
+                        tokens < 0 || tokens != ref_tokens ? " MISMATCH" : "");
+    }
+
+    free(ref);
+    free(src);
+  }
 }
+
+BENCHMARK("json", json_bench);
+#endif
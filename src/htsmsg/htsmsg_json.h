@@ -31,6 +31,8 @@ htsmsg_t *htsmsg_json_deserialize(const char *src);
 htsmsg_t *htsmsg_json_deserialize2(const char *src,
                                    char *errbuf, size_t errlen);
 
+htsmsg_t *htsmsg_json_deserialize_buf(buf_t *b, char *errbuf, size_t errlen);
+
 void htsmsg_json_serialize(htsmsg_t *msg, htsbuf_queue_t *hq, int pretty);
 
 char *htsmsg_json_serialize_to_str(htsmsg_t *msg, int pretty);
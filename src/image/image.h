@@ -66,6 +66,7 @@ typedef enum image_component_type {
   IMAGE_CODED,
   IMAGE_VECTOR,
   IMAGE_TEXT_INFO,
+  IMAGE_GLYPHS,
 } image_component_type_t;
 
 
@@ -120,6 +121,32 @@ typedef struct image_component_text_info {
 } image_component_text_info_t;
 
 
+/**
+ * A rasterized glyph placed in a text image
+ *
+ * 'pm' is the coverage (PIXMAP_I) of the glyph and 'id' uniquely
+ * identifies that bitmap so it can be shared between images (in a
+ * texture atlas for example). 'x' and 'y' is the top left corner
+ * in image coordinates (including margin)
+ */
+typedef struct image_glyph {
+  struct pixmap *pm;
+  uint32_t id;
+  uint32_t color; // ABGR host order
+  int16_t x;
+  int16_t y;
+} image_glyph_t;
+
+
+/**
+ *
+ */
+typedef struct image_component_glyphs {
+  image_glyph_t *ig_glyphs;
+  int ig_count;
+} image_component_glyphs_t;
+
+
 /**
  *
  */
@@ -131,6 +158,7 @@ typedef struct image_component {
     image_component_coded_t coded;
     image_component_vector_t vector;
     image_component_text_info_t text_info;
+    image_component_glyphs_t glyphs;
   };
 
 } image_component_t;
@@ -212,10 +240,19 @@ extern struct pixmap *(*accel_image_decode)(image_coded_type_t type,
 
 #if ENABLE_LIBJPEG
 struct pixmap *libjpeg_decode(struct fa_handle *fh,
-                              const image_meta_t *meta,
+                              const image_meta_t *meta, int orientation,
                               char *errbuf, size_t errlen);
 #endif
 
+/***************************************************************************
+ * Cache of decoded images
+ */
+image_t *image_cache_get(const char *url, const image_meta_t *im,
+                         int *cache_control);
+
+void image_cache_put(const char *url, const image_meta_t *im,
+                     const image_t *img);
+
 /***************************************************************************
  * SVG Parser
  */
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+#include <stdio.h>
+
+#include "main.h"
+#include "image.h"
+#include "pixmap.h"
+#include "blobcache.h"
+#include "fileaccess/fileaccess.h"
+
+/**
+ * Cache of decoded and post processed images
+ *
+ * Images are stored in the blobcache keyed on URL and everything in
+ * image_meta_t that affects the result. The etag and mtime of the
+ * source (see fa_get_version()) are stored with the item and must
+ * match for a hit.
+ *
+ * Pixels are stored exactly as laid out in memory so a hit costs
+ * a single copy.
+ */
+
+#define IMAGE_CACHE_STASH    "decoded-images"
+#define IMAGE_CACHE_MAGIC    0x31434d49 // 'IMC1'
+#define IMAGE_CACHE_MAX_SIZE (2 * 1024 * 1024)
+
+typedef struct image_cache_hdr {
+  uint32_t ich_magic;
+  uint8_t ich_type;
+  uint8_t ich_orientation;
+  uint8_t ich_origin_coded_type;
+  uint8_t ich_im_flags;
+  uint16_t ich_width;
+  uint16_t ich_height;
+  uint16_t ich_margin;
+  uint16_t ich_pm_flags;
+  int32_t ich_linesize;
+  float ich_aspect;
+  float ich_intensity;
+  float ich_primary_color[3];
+} image_cache_hdr_t;
+
+
+/**
+ *
+ */
+static void
+image_cache_key(char *dst, size_t dstlen, const char *url,
+                const image_meta_t *im)
+{
+  snprintf(dst, dstlen, "%s|%d|%d|%d|%d|%.4f|%d%d%d%d%d|%x|%d|%d|%d",
+           url,
+           im->im_req_width, im->im_req_height,
+           im->im_max_width, im->im_max_height,
+           im->im_req_aspect,
+           im->im_can_mono, im->im_32bit_swizzle, im->im_want_thumb,
+           im->im_intensity_analysis, im->im_primary_color_analysis,
+           im->im_corner_selection, im->im_corner_radius,
+           im->im_shadow, im->im_margin);
+}
+
+
+/**
+ *
+ */
+static int
+image_cache_same_version(const char *etag1, time_t mtime1,
+                         const char *etag2, time_t mtime2)
+{
+  if(mtime1 != mtime2)
+    return 0;
+  if(etag1 == NULL || etag2 == NULL)
+    return etag1 == etag2;
+  return !strcmp(etag1, etag2);
+}
+
+
+/**
+ * Return a decoded image if we have one for the current version of
+ * the source.
+ *
+ * If 'cache_control' points to an int (ie, the caller only wants
+ * cached data) it's set if the source itself has expired so the
+ * caller knows to refresh it
+ */
+image_t *
+image_cache_get(const char *url, const image_meta_t *im, int *cache_control)
+{
+  char key[URL_MAX + 128];
+  char *etag, *cached_etag = NULL;
+  time_t mtime, cached_mtime;
+  int is_expired;
+  image_t *img = NULL;
+
+  if(cache_control == BYPASS_CACHE || cache_control == DISABLE_CACHE)
+    return NULL;
+
+  if(fa_get_version(url, &etag, &mtime, &is_expired))
+    return NULL;
+
+  image_cache_key(key, sizeof(key), url, im);
+
+  buf_t *b = blobcache_get(key, IMAGE_CACHE_STASH, 0, NULL,
+                           &cached_etag, &cached_mtime);
+  if(b == NULL)
+    goto out;
+
+  if(!image_cache_same_version(etag, mtime, cached_etag, cached_mtime)) {
+    blobcache_evict(key, IMAGE_CACHE_STASH);
+    goto out;
+  }
+
+  const image_cache_hdr_t *ich = buf_data(b);
+  if(buf_size(b) < sizeof(image_cache_hdr_t) ||
+     ich->ich_magic != IMAGE_CACHE_MAGIC)
+    goto out;
+
+  const int w = ich->ich_width  - ich->ich_margin * 2;
+  const int h = ich->ich_height - ich->ich_margin * 2;
+  pixmap_t *pm = pixmap_create(w, h, ich->ich_type, ich->ich_margin);
+  if(pm == NULL)
+    goto out;
+
+  const size_t size = pm->pm_linesize * pm->pm_height;
+
+  if(pm->pm_linesize != ich->ich_linesize ||
+     buf_size(b) != sizeof(image_cache_hdr_t) + size) {
+    pixmap_release(pm);
+    goto out;
+  }
+
+  memcpy(pm->pm_data, buf_c8(b) + sizeof(image_cache_hdr_t), size);
+  pm->pm_aspect    = ich->ich_aspect;
+  pm->pm_flags     = ich->ich_pm_flags;
+  pm->pm_intensity = ich->ich_intensity;
+  memcpy(pm->pm_primary_color, ich->ich_primary_color,
+         sizeof(pm->pm_primary_color));
+
+  img = image_create_from_pixmap(pm);
+  pixmap_release(pm);
+  img->im_flags = ich->ich_im_flags;
+  img->im_orientation = ich->ich_orientation;
+  img->im_origin_coded_type = ich->ich_origin_coded_type;
+
+  if(ONLY_CACHED(cache_control))
+    *cache_control = is_expired;
+
+ out:
+  if(b != NULL)
+    buf_release(b);
+  free(etag);
+  free(cached_etag);
+  return img;
+}
+
+
+/**
+ * Store a decoded image
+ */
+void
+image_cache_put(const char *url, const image_meta_t *im, const image_t *img)
+{
+  char key[URL_MAX + 128];
+  char *etag;
+  time_t mtime;
+  int is_expired;
+
+  if(img->im_num_components != 1 ||
+     img->im_components[0].type != IMAGE_PIXMAP)
+    return;
+
+  const pixmap_t *pm = img->im_components[0].pm;
+  const size_t size = pm->pm_linesize * pm->pm_height;
+
+  if(size > IMAGE_CACHE_MAX_SIZE || pm->pm_type == PIXMAP_NULL)
+    return;
+
+  if(fa_get_version(url, &etag, &mtime, &is_expired))
+    return;
+
+  buf_t *b = buf_create(sizeof(image_cache_hdr_t) + size);
+  if(b != NULL) {
+    image_cache_hdr_t *ich = b->b_ptr;
+    memset(ich, 0, sizeof(image_cache_hdr_t));
+    ich->ich_magic = IMAGE_CACHE_MAGIC;
+    ich->ich_type = pm->pm_type;
+    ich->ich_orientation = img->im_orientation;
+    ich->ich_origin_coded_type = img->im_origin_coded_type;
+    ich->ich_im_flags = img->im_flags;
+    ich->ich_width = pm->pm_width;
+    ich->ich_height = pm->pm_height;
+    ich->ich_margin = pm->pm_margin;
+    ich->ich_pm_flags = pm->pm_flags;
+    ich->ich_linesize = pm->pm_linesize;
+    ich->ich_aspect = pm->pm_aspect;
+    ich->ich_intensity = pm->pm_intensity;
+    memcpy(ich->ich_primary_color, pm->pm_primary_color,
+           sizeof(ich->ich_primary_color));
+    memcpy(ich + 1, pm->pm_data, size);
+
+    image_cache_key(key, sizeof(key), url, im);
+
+    // Validity is governed by the source version, this just makes sure
+    // entries for sources that are gone don't stay around forever
+    blobcache_put(key, IMAGE_CACHE_STASH, b, 30 * 86400, etag, mtime, 0);
+    buf_release(b);
+  }
+  free(etag);
+}
+
+
+/**
+ *
+ */
+static void
+image_cache_init(void)
+{
+  blobcache_set_stash_budget(IMAGE_CACHE_STASH, 25);
+}
+
+INITME(INIT_GROUP_GRAPHICS, image_cache_init, NULL, 0);
@@ -23,11 +23,13 @@
 #include <jpeglib.h>
 #include <unistd.h>
 
+#include "main.h"
 #include "fileaccess/fileaccess.h"
 
 #include "image.h"
 #include "pixmap.h"
 #include "misc/buf.h"
+#include "misc/str.h"
 
 
 struct my_error_mgr {
@@ -48,13 +50,57 @@ my_error_exit(j_common_ptr cinfo)
 }
 
 
+#if ENABLE_BENCHMARKS
+/**
+ * For benchmarking, decode as before IDCT scaling was used: always at
+ * full size and in buffered image mode
+ */
+static int libjpeg_bench_before;
+#else
+#define libjpeg_bench_before 0
+#endif
+
+
+/**
+ * libjpeg can scale down by 1/2, 1/4 and 1/8 while doing the IDCT,
+ * which is a lot cheaper than decoding at full size. Pick the largest
+ * such reduction that still produces an image at least as big as the
+ * one requested. Whatever scaling that remains is done by whoever
+ * consumes the pixmap, just as for full size decodes
+ */
+static int
+libjpeg_scale_denom(const image_meta_t *im, int orientation,
+                    int src_width, int src_height)
+{
+  int w, h, denom;
+
+  if(src_width < 1 || src_height < 1 || libjpeg_bench_before)
+    return 1;
+
+  if(orientation >= 5) {
+    // EXIF orientation 5 - 8 transposes the image
+    pixmap_compute_rescale_dim(im, src_height, src_width, &h, &w);
+  } else {
+    pixmap_compute_rescale_dim(im, src_width, src_height, &w, &h);
+  }
+
+  for(denom = 8; denom > 1; denom >>= 1)
+    if(src_width / denom >= w && src_height / denom >= h)
+      break;
+  return denom;
+}
+
+
+/**
+ *
+ */
 pixmap_t *
-libjpeg_decode(fa_handle_t *fh, const image_meta_t *im,
+libjpeg_decode(fa_handle_t *fh, const image_meta_t *im, int orientation,
                char *errbuf, size_t errlen)
 {
   struct jpeg_decompress_struct cinfo;
   struct my_error_mgr jerr;
-  JSAMPARRAY buffer = NULL;
+  JSAMPROW row;
   fa_seek(fh, 0, SEEK_SET);
   FILE *f = fa_fopen(fh, 1);
   pixmap_t *pm = NULL;
@@ -75,12 +121,35 @@ libjpeg_decode(fa_handle_t *fh, const image_meta_t *im,
 
   jpeg_read_header(&cinfo, TRUE);
 
-  cinfo.buffered_image = 1;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = libjpeg_scale_denom(im, orientation,
+                                          cinfo.image_width,
+                                          cinfo.image_height);
+  /*
+   * In buffered image mode libjpeg keeps the DCT coefficients for the
+   * entire image around. Only worth it if there are multiple scans
+   * to display while loading
+   */
+  cinfo.buffered_image = libjpeg_bench_before ||
+    (cinfo.progressive_mode && im->im_incremental != NULL);
   cinfo.out_color_space = JCS_RGB;
   cinfo.output_components = 3;
   jpeg_start_decompress(&cinfo);
 
-  while(!jpeg_input_complete(&cinfo)) {
+  if(!cinfo.buffered_image) {
+    pm = pixmap_create(cinfo.output_width,
+                       cinfo.output_height,
+                       PIXMAP_RGB24, 0);
+    if(pm == NULL)
+      goto nomem;
+
+    while(cinfo.output_scanline < cinfo.output_height) {
+      row = pm->pm_data + cinfo.output_scanline * pm->pm_linesize;
+      jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+  }
+
+  while(cinfo.buffered_image && !jpeg_input_complete(&cinfo)) {
 
     if(pm != NULL) {
 
@@ -92,19 +161,14 @@ libjpeg_decode(fa_handle_t *fh, const image_meta_t *im,
     pm = pixmap_create(cinfo.output_width,
                        cinfo.output_height,
                        PIXMAP_RGB24, 0);
-
-    if(buffer == NULL) {
-      buffer = (*cinfo.mem->alloc_sarray)
-        ((j_common_ptr) &cinfo, JPOOL_IMAGE,
-         pm->pm_linesize, 1);
-    }
+    if(pm == NULL)
+      goto nomem;
 
     jpeg_start_output(&cinfo, cinfo.input_scan_number);
 
     while(cinfo.output_scanline < cinfo.output_height) {
-      jpeg_read_scanlines(&cinfo, buffer, 1);
-      memcpy(pm->pm_data + (cinfo.output_scanline - 1) * pm->pm_linesize,
-             buffer[0], pm->pm_linesize);
+      row = pm->pm_data + cinfo.output_scanline * pm->pm_linesize;
+      jpeg_read_scanlines(&cinfo, &row, 1);
     }
     jpeg_finish_output(&cinfo);
   }
@@ -112,4 +176,133 @@ libjpeg_decode(fa_handle_t *fh, const image_meta_t *im,
   jpeg_destroy_decompress(&cinfo);
   fclose(f);
   return pm;
+
+ nomem:
+  snprintf(errbuf, errlen, "Out of memory");
+  jpeg_destroy_decompress(&cinfo);
+  fclose(f);
+  return NULL;
 }
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Decode benchmark, run with --bench jpeg
+ *
+ * Decodes all JPEGs in $MOVIAN_JPEG_CORPUS (a directory URL, defaults to
+ * the images bundled with the old skin) at a few requested sizes, both
+ * as before (see libjpeg_bench_before) and as now. Peak RSS is measured by resetting the
+ * high water mark (Linux only) so it includes whatever the rest of the
+ * app allocates at the same time
+ */
+#ifdef __linux__
+static int
+libjpeg_bench_rss(const char *key, int reset)
+{
+  char line[128];
+  int kb = 0;
+
+  if(reset) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if(f != NULL) {
+      fputs("5", f);
+      fclose(f);
+    }
+  }
+
+  FILE *f = fopen("/proc/self/status", "r");
+  if(f == NULL)
+    return 0;
+  while(fgets(line, sizeof(line), f) != NULL)
+    if(mystrbegins(line, key) != NULL)
+      kb = atoi(line + strlen(key));
+  fclose(f);
+  return kb;
+}
+#else
+static int
+libjpeg_bench_rss(const char *key, int reset)
+{
+  return 0;
+}
+#endif
+
+
+static void
+libjpeg_bench(void)
+{
+  static const int sizes[] = {-1, 1280, 640, 320, 160};
+  char errbuf[256];
+  char url[1024];
+  const char *corpus = getenv("MOVIAN_JPEG_CORPUS");
+
+  if(corpus == NULL || *corpus == 0) {
+    snprintf(url, sizeof(url), "%s/glwskins/old/graphics", app_dataroot());
+    corpus = url;
+  }
+
+  fa_dir_t *fd = fa_scandir(corpus, errbuf, sizeof(errbuf));
+  if(fd == NULL) {
+    TRACE(TRACE_ERROR, "bench", "jpeg: Unable to scan %s -- %s",
+          corpus, errbuf);
+    return;
+  }
+
+  for(int i = 0; i < ARRAYSIZE(sizes); i++) {
+    for(int before = 1; before >= 0; before--) {
+      image_meta_t im = {0};
+      int files = 0, errors = 0;
+      int64_t pixels = 0, ts = 0;
+
+      im.im_req_width = sizes[i];
+      im.im_req_height = -1;
+      libjpeg_bench_before = before;
+
+      const int rss = libjpeg_bench_rss("VmRSS:", 1);
+
+      fa_dir_entry_t *fde;
+      RB_FOREACH(fde, &fd->fd_entries, fde_link) {
+        const char *fn = rstr_get(fde->fde_filename);
+        const char *ext = strrchr(fn, '.');
+        if(ext == NULL ||
+           (strcasecmp(ext, ".jpg") && strcasecmp(ext, ".jpeg")))
+          continue;
+
+        fa_handle_t *fh = fa_open(rstr_get(fde->fde_url),
+                                  errbuf, sizeof(errbuf));
+        if(fh == NULL) {
+          errors++;
+          continue;
+        }
+
+        // libjpeg_decode() closes the file
+        const int64_t t0 = arch_get_ts();
+        pixmap_t *pm = libjpeg_decode(fh, &im, 0, errbuf, sizeof(errbuf));
+        ts += arch_get_ts() - t0;
+
+        if(pm == NULL) {
+          errors++;
+          continue;
+        }
+        files++;
+        pixels += pm->pm_width * pm->pm_height;
+        pixmap_release(pm);
+      }
+
+      const int peak = libjpeg_bench_rss("VmHWM:", 0);
+
+      TRACE(TRACE_INFO, "bench",
+            "jpeg: width %-4d %-8s %3d files %6.1f ms/file "
+            "%5.1f Mpixel out, peak RSS +%d kB%s",
+            sizes[i], before ? "before" : "after", files,
+            files ? ts / 1000.0 / files : 0.0, pixels / 1000000.0,
+            peak > rss ? peak - rss : 0,
+            errors ? " (errors)" : "");
+    }
+  }
+  libjpeg_bench_before = 0;
+  fa_dir_free(fd);
+}
+
+BENCHMARK("jpeg", libjpeg_bench);
+#endif
@@ -27,6 +27,7 @@
 #include "main.h"
 #include "arch/atomic.h"
 #include "pixmap.h"
+#include "pixmap_simd.h"
 #include "misc/minmax.h"
 #include "image/jpeg.h"
 #include "backend/backend.h"
@@ -217,8 +218,13 @@ rgb24_to_bgr32(pixmap_t *src)
   for(y = 0; y < src->pm_height; y++) {
     const uint8_t *s = src->pm_data + y * src->pm_linesize;
     uint32_t *d = (uint32_t *)(dst->pm_data + y * dst->pm_linesize);
-    int x;
-    for(x = 0; x < src->pm_width; x++) {
+    int x = 0;
+    if(pixmap_kernels.pk_rgb24_to_bgr32 != NULL) {
+      x = pixmap_kernels.pk_rgb24_to_bgr32(d, s, src->pm_width);
+      s += x * 3;
+      d += x;
+    }
+    for(; x < src->pm_width; x++) {
       *d++ = 0xff000000 | s[2] << 16 | s[1] << 8 | s[0]; 
       s+= 3;
     }
@@ -304,8 +310,13 @@ composite_GRAY8_on_IA(uint8_t *dst, const uint8_t *src,
 			 int width)
 {
   int i, a, pa, y;
-  int x;
-  for(x = 0; x < width; x++) {
+  int x = 0;
+  if(pixmap_kernels.pk_composite_ia != NULL) {
+    x = pixmap_kernels.pk_composite_ia(dst, src, i0, a0, width);
+    src += x;
+    dst += x * 2;
+  }
+  for(; x < width; x++) {
 
     if(*src) {
       i = dst[0];
@@ -336,8 +347,13 @@ composite_GRAY8_on_IA_full_alpha(uint8_t *dst, const uint8_t *src,
 				    int width)
 {
   int i, a, pa, y;
-  int x;
-  for(x = 0; x < width; x++) {
+  int x = 0;
+  if(pixmap_kernels.pk_composite_ia != NULL) {
+    x = pixmap_kernels.pk_composite_ia(dst, src, i0, 255, width);
+    src += x;
+    dst += x * 2;
+  }
+  for(; x < width; x++) {
 
     if(*src == 255) {
       dst[0] = i0;
@@ -414,11 +430,17 @@ composite_GRAY8_on_BGR32(uint8_t *dst_, const uint8_t *src,
 			 int CR, int CG, int CB, int CA,
 			 int width)
 {
-  int x;
+  int x = 0;
   uint32_t *dst = (uint32_t *)dst_;
   uint32_t u32;
 
-  for(x = 0; x < width; x++) {
+  if(pixmap_kernels.pk_composite_bgr32 != NULL) {
+    x = pixmap_kernels.pk_composite_bgr32(dst_, src, CR, CG, CB, CA, width);
+    src += x;
+    dst += x;
+  }
+
+  for(; x < width; x++) {
 
     int SA = DIV255(*src * CA);
     int SR = CR;
@@ -537,6 +559,14 @@ box_blur_line_2chan(uint8_t *d, const uint32_t *a, const uint32_t *b,
     *d++ = (v * m) >> 16;
   }
 
+  if(x < width - boxw && pixmap_kernels.pk_box_blur != NULL) {
+    const int n = pixmap_kernels.pk_box_blur(d, a + 2 * x, b + 2 * x,
+                                             2 * (width - boxw - x),
+                                             2 * boxw, m) / 2;
+    x += n;
+    d += 2 * n;
+  }
+
   for(; x < width - boxw; x++) {
     const int x1 = 2 * (x + boxw);
     const int x2 = 2 * (x - boxw);
@@ -580,6 +610,14 @@ box_blur_line_4chan(uint8_t *d, const uint32_t *a, const uint32_t *b,
     *d++ = (v * m) >> 16;
   }
 
+  if(x < width - boxw && pixmap_kernels.pk_box_blur != NULL) {
+    const int n = pixmap_kernels.pk_box_blur(d, a + 4 * x, b + 4 * x,
+                                             4 * (width - boxw - x),
+                                             4 * boxw, m) / 4;
+    x += n;
+    d += 4 * n;
+  }
+
   for(; x < width - boxw; x++) {
     const int x1 = 4 * (x + boxw);
     const int x2 = 4 * (x - boxw);
@@ -664,6 +702,23 @@ pixmap_box_blur(pixmap_t *pm, int boxw, int boxh)
     s = pm->pm_data + y * ls;
     t = tmp + y * ls;
 
+    if(pixmap_kernels.pk_sat_add != NULL) {
+      // Sum along the row first, then add the row above
+      for(i = 0; i < z; i++)
+        *t++ = *s++;
+
+      for(x = 0; x < (w-1)*z; x++) {
+        t[0] = *s++ + t[-z];
+        t++;
+      }
+
+      t = tmp + y * ls;
+      i = pixmap_kernels.pk_sat_add(t, t - ls, w * z);
+      for(; i < w * z; i++)
+        t[i] += t[i - ls];
+      continue;
+    }
+
     for(i = 0; i < z; i++) {
       t[0] = *s++ + t[-ls];
       t++;
@@ -752,6 +807,13 @@ drop_shadow_rgba(uint8_t *D, const uint32_t *a, const uint32_t *b,
     d++;
   }
 
+  if(x < width - boxw && pixmap_kernels.pk_shadow_bgr32 != NULL) {
+    const int n = pixmap_kernels.pk_shadow_bgr32(d, a + x, b + x,
+                                                 width - boxw - x, boxw, m);
+    x += n;
+    d += n;
+  }
+
   for(; x < width - boxw; x++) {
     const int x1 = (x + boxw);
     const int x2 = (x - boxw);
@@ -815,7 +877,7 @@ drop_shadow_ia(uint8_t *d, const uint32_t *a, const uint32_t *b,
   unsigned int v;
   int s;
   for(x = 0; x < boxw; x++) {
-    const int x1 = 2 * MIN(x + boxw, width - 1);
+    const int x1 = MIN(x + boxw, width - 1);
     const int x2 = 0;
 
     v = b[x1 + 0] + a[x2 + 0] - b[x2 + 0] - a[x1 + 0];
@@ -825,9 +887,16 @@ drop_shadow_ia(uint8_t *d, const uint32_t *a, const uint32_t *b,
     d+=2;
   }
 
+  if(x < width - boxw && pixmap_kernels.pk_shadow_ia != NULL) {
+    const int n = pixmap_kernels.pk_shadow_ia(d, a + x, b + x,
+                                              width - boxw - x, boxw, m);
+    x += n;
+    d += 2 * n;
+  }
+
   for(; x < width - boxw; x++) {
-    const int x1 = 2 * (x + boxw);
-    const int x2 = 2 * (x - boxw);
+    const int x1 = (x + boxw);
+    const int x2 = (x - boxw);
 
     v = b[x1 + 0] + a[x2 + 0] - b[x2 + 0] - a[x1 + 0];
     s = (v * m) >> 16;
@@ -836,8 +905,8 @@ drop_shadow_ia(uint8_t *d, const uint32_t *a, const uint32_t *b,
   }
 
   for(; x < width; x++) {
-    const int x1 = 2 * (width - 1);
-    const int x2 = 2 * (x - boxw);
+    const int x1 = (width - 1);
+    const int x2 = (x - boxw);
 
     v = b[x1 + 0] + a[x2 + 0] - b[x2 + 0] - a[x1 + 0];
     s = (v * m) >> 16;
@@ -866,6 +935,7 @@ pixmap_drop_shadow(pixmap_t *pm, int boxw, int boxh)
   assert(boxh > 0);
 
   boxw = MIN(boxw, w);
+  boxh = MIN(boxh, h);
 
   void (*fn)(uint8_t *dst, const uint32_t *a, const uint32_t *b, int width,
 	     int boxw, int m);
@@ -903,7 +973,22 @@ pixmap_drop_shadow(pixmap_t *pm, int boxw, int boxh)
     s = pm->pm_data + (y - boxh) * ls + ach;
     for(x = 0; x < boxw; x++)
       *t++ = 0;
-    
+
+    if(pixmap_kernels.pk_sat_add != NULL) {
+      // Sum along the row first, then add the row above
+      for(; x < w; x++) {
+        t[0] = *s + t[-1];
+        s += z;
+        t++;
+      }
+      t -= w - boxw;
+      x = pixmap_kernels.pk_sat_add(t, t - w, w - boxw);
+      for(; x < w - boxw; x++)
+        t[x] += t[x - w];
+      t += w - boxw;
+      continue;
+    }
+
     for(; x < w; x++) {
       t[0] = *s + t[-1] + t[-w] - t[-w - 1];
       s += z;
@@ -1024,33 +1109,195 @@ pixmap_intensity_analysis(pixmap_t *pm)
 
 
 
-// gcc -O3 src/misc/pixmap.c -o /tmp/pixmap -Isrc -DLOCAL_MAIN
+#if ENABLE_BENCHMARKS
+/**
+ * Effects benchmark, run with --bench pixmap
+ *
+ * Each effect is run with all kernel sets usable on this CPU and the
+ * output is compared with the one from the plain C code
+ */
+typedef struct pixmap_bench_effect {
+  const char *name;
+  pixmap_type_t type;
+  pixmap_t *(*fn)(pixmap_t *pm, const pixmap_t *mask);
+} pixmap_bench_effect_t;
 
-#ifdef LOCAL_MAIN
 
-static int64_t
-get_ts(void)
+static pixmap_t *
+bench_box_blur(pixmap_t *pm, const pixmap_t *mask)
 {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+  pixmap_box_blur(pm, 4, 4);
+  return pm;
 }
 
-int
-main(int argc, char **argv)
+static pixmap_t *
+bench_drop_shadow(pixmap_t *pm, const pixmap_t *mask)
 {
-  pixmap_t *dst = pixmap_create(2048, 2048, PIXMAP_BGR32);
-  pixmap_t *src = pixmap_create(2048, 2048, PIXMAP_GRAY8);
+  pixmap_drop_shadow(pm, 8, 8);
+  return pm;
+}
 
-  memset(src->pm_pixels, 0xff, src->pm_linesize * src->pm_height);
+static pixmap_t *
+bench_composite(pixmap_t *pm, const pixmap_t *mask)
+{
+  pixmap_composite(pm, mask, 0, 0, 0xc0a0b0c0);
+  return pm;
+}
 
-  int64_t a = get_ts();
-  pixmap_composite(dst, src, 0, 0, 0xffffffff);
-  printf("Compositing in %dµs\n",(int)( get_ts() - a));
-  printf("dst pixel(0,0) = 0x%x\n", dst->pm_pixels[0]);
-  return 0;
+static pixmap_t *
+bench_composite_opaque(pixmap_t *pm, const pixmap_t *mask)
+{
+  pixmap_composite(pm, mask, 0, 0, 0xffa0b0c0);
+  return pm;
+}
+
+static pixmap_t *
+bench_rounded_corners(pixmap_t *pm, const pixmap_t *mask)
+{
+  return pixmap_rounded_corners(pm, 16, 0xf);
+}
+
+static const pixmap_bench_effect_t pixmap_bench_effects[] = {
+  { "blur",             PIXMAP_BGR32, bench_box_blur },
+  { "blur",             PIXMAP_IA,    bench_box_blur },
+  { "shadow",           PIXMAP_BGR32, bench_drop_shadow },
+  { "shadow",           PIXMAP_IA,    bench_drop_shadow },
+  { "composite",        PIXMAP_BGR32, bench_composite },
+  { "composite",        PIXMAP_IA,    bench_composite },
+  { "composite-opaque", PIXMAP_IA,    bench_composite_opaque },
+  { "rounded-corners",  PIXMAP_RGB24, bench_rounded_corners },
+};
+
+static const int pixmap_bench_sizes[][2] = {
+  {64, 64}, {256, 256}, {1280, 720}, {1920, 1080},
+};
+
+
+static pixmap_t *
+bench_pixmap(int w, int h, pixmap_type_t type, int seed)
+{
+  pixmap_t *pm = pixmap_create(w, h, type, 0);
+  uint32_t r = seed;
+  for(int i = 0; i < pm->pm_linesize * h; i++) {
+    r = r * 1103515245 + 12345;
+    const int v = r >> 16;
+    // Mostly fully transparent or opaque, like glyphs and icons
+    pm->pm_data[i] = v & 0x300 ? v & 0x400 ? 255 : 0 : v;
+  }
+  return pm;
+}
+
+
+/**
+ * The alpha of a drop shadow does not depend on colour, so the IA and
+ * BGR32 paths must agree on it. Includes boxes larger than the image
+ */
+static int
+pixmap_shadow_check(int w, int h, int boxw, int boxh)
+{
+  pixmap_t *bgr = bench_pixmap(w, h, PIXMAP_BGR32, w * h + boxh);
+  pixmap_t *ia = pixmap_create(w, h, PIXMAP_IA, 0);
+  int ok = 1;
+
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      const uint8_t *src = bgr->pm_data + y * bgr->pm_linesize + x * 4;
+      uint8_t *dst = ia->pm_data + y * ia->pm_linesize + x * 2;
+      dst[0] = src[1];
+      dst[1] = src[3];
+    }
+  }
+
+  pixmap_drop_shadow(bgr, boxw, boxh);
+  pixmap_drop_shadow(ia, boxw, boxh);
+
+  for(int y = 0; y < h; y++)
+    for(int x = 0; x < w; x++)
+      if(bgr->pm_data[y * bgr->pm_linesize + x * 4 + 3] !=
+         ia->pm_data[y * ia->pm_linesize + x * 2 + 1])
+        ok = 0;
+
+  pixmap_release(ia);
+  pixmap_release(bgr);
+  return ok;
+}
+
+
+static void
+pixmap_bench(void)
+{
+  const pixmap_kernels_t saved = pixmap_kernels;
+  static const int shadow_checks[][4] = {
+    {64, 64, 8, 8}, {37, 5, 3, 20}, {5, 37, 20, 3}, {300, 17, 16, 16},
+  };
+
+  for(int k = 0; pixmap_kernel_sets[k] != NULL; k++) {
+    pixmap_kernels = *pixmap_kernel_sets[k];
+    int ok = 0;
+    for(int i = 0; i < ARRAYSIZE(shadow_checks); i++)
+      ok += pixmap_shadow_check(shadow_checks[i][0], shadow_checks[i][1],
+                                shadow_checks[i][2], shadow_checks[i][3]);
+    TRACE(TRACE_INFO, "bench", "pixmap: shadow IA/BGR32 alpha %-4s %d/%d OK",
+          pixmap_kernels.pk_name, ok, (int)ARRAYSIZE(shadow_checks));
+  }
+
+  for(int e = 0; e < ARRAYSIZE(pixmap_bench_effects); e++) {
+    const pixmap_bench_effect_t *pbe = &pixmap_bench_effects[e];
+
+    for(int i = 0; i < ARRAYSIZE(pixmap_bench_sizes); i++) {
+      const int w = pixmap_bench_sizes[i][0];
+      const int h = pixmap_bench_sizes[i][1];
+      const int rounds = MAX(3, 20000000 / (w * h));
+      pixmap_t *src  = bench_pixmap(w, h, pbe->type, 1);
+      pixmap_t *mask = bench_pixmap(w, h, PIXMAP_I, 2);
+      pixmap_t *ref = NULL;
+      int64_t ref_ts = 0;
+
+      for(int k = 0; pixmap_kernel_sets[k] != NULL; k++) {
+        pixmap_kernels = *pixmap_kernel_sets[k];
+        pixmap_t *out = NULL;
+        int64_t ts = 0;
+
+        for(int j = 0; j < rounds; j++) {
+          pixmap_t *pm = pixmap_create(w, h, pbe->type, 0);
+          memcpy(pm->pm_data, src->pm_data, src->pm_linesize * h);
+
+          const int64_t t0 = arch_get_ts();
+          pm = pbe->fn(pm, mask);
+          ts += arch_get_ts() - t0;
+
+          if(out != NULL)
+            pixmap_release(out);
+          out = pm;
+        }
+
+        const char *result = "";
+        if(ref == NULL) {
+          ref = out;
+          ref_ts = ts;
+        } else {
+          if(memcmp(ref->pm_data, out->pm_data, ref->pm_linesize * h))
+            result = " MISMATCH";
+          pixmap_release(out);
+        }
+
+        TRACE(TRACE_INFO, "bench",
+              "pixmap: %-16s %-5s %4dx%-4d %-4s %8.1f Mpixel/s %5.2fx%s",
+              pbe->name, pbe->type == PIXMAP_IA ? "IA" :
+              pbe->type == PIXMAP_RGB24 ? "RGB24" : "BGR32",
+              w, h, pixmap_kernels.pk_name,
+              (double)w * h * rounds / MAX(ts, 1),
+              (double)ref_ts / MAX(ts, 1), result);
+      }
+      pixmap_release(ref);
+      pixmap_release(mask);
+      pixmap_release(src);
+    }
+  }
+  pixmap_kernels = saved;
 }
 
+BENCHMARK("pixmap", pixmap_bench);
 #endif
 
 
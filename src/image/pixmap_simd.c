@@ -0,0 +1,729 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+
+#include "compiler.h"
+#include "pixmap_simd.h"
+
+/**
+ * The NEON kernels have not yet been built or verified against the C
+ * code on ARM hardware. Define this (and run --bench pixmap) to use them
+ */
+// #define PIXMAP_SIMD_ENABLE_NEON
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXMAP_SIMD_X86
+#include <immintrin.h>
+#elif defined(PIXMAP_SIMD_ENABLE_NEON) && \
+  (defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define PIXMAP_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+pixmap_kernels_t pixmap_kernels;
+
+static const pixmap_kernels_t pixmap_kernels_c = {
+  .pk_name = "c",
+};
+
+
+#ifdef PIXMAP_SIMD_X86
+
+/**
+ * All intermediate values in the alpha blending math are kept in 32 bit
+ * lanes. Most products are of two 8 bit values and fit in 16 bits so
+ * the 16 bit multiply can be used for those even on SSE2.
+ *
+ * Division (by the final alpha) is done in float and then corrected
+ * so the result is the same as the truncating integer division.
+ * Numerators are always below 2^24 so the correction step is exact.
+ */
+
+#define SSE2  __attribute__((target("sse2")))
+#define SSSE3 __attribute__((target("ssse3")))
+#define AVX2  __attribute__((target("avx2")))
+
+
+static inline __m128i SSE2
+ld128(const void *p)
+{
+  return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline __m128i SSE2
+mullo32_sse2(__m128i a, __m128i b)
+{
+  __m128i e = _mm_mul_epu32(a, b);
+  __m128i o = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(e, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(o, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i SSE2
+div255_sse2(__m128i x)
+{
+  const __m128i c255 = _mm_set1_epi32(255);
+  return _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(x, c255),
+                                                     8), x), 8);
+}
+
+static inline __m128i SSE2
+div_sse2(__m128i n, __m128i d)
+{
+  const __m128 fn = _mm_cvtepi32_ps(n);
+  const __m128 fd = _mm_cvtepi32_ps(d);
+  __m128i q = _mm_cvttps_epi32(_mm_div_ps(fn, fd));
+  const __m128 r = _mm_sub_ps(fn, _mm_mul_ps(_mm_cvtepi32_ps(q), fd));
+  q = _mm_sub_epi32(q, _mm_castps_si128(_mm_cmpge_ps(r, fd)));
+  q = _mm_add_epi32(q, _mm_castps_si128(_mm_cmplt_ps(r, _mm_setzero_ps())));
+  return q;
+}
+
+/**
+ * Box filter of four elements, returns values in 0 - 255
+ */
+static inline __m128i SSE2
+box4_sse2(const uint32_t *a, const uint32_t *b, int off, __m128i m)
+{
+  __m128i v = _mm_add_epi32(ld128(b + off), ld128(a - off));
+  v = _mm_sub_epi32(v, ld128(b - off));
+  v = _mm_sub_epi32(v, ld128(a + off));
+  v = _mm_srli_epi32(mullo32_sse2(v, m), 16);
+  return _mm_and_si128(v, _mm_set1_epi32(0xff));
+}
+
+
+/**
+ *
+ */
+static int SSE2
+sat_add_sse2(uint32_t *t, const uint32_t *above, int n)
+{
+  int i;
+  for(i = 0; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i *)(t + i),
+                     _mm_add_epi32(ld128(t + i), ld128(above + i)));
+  return i;
+}
+
+
+/**
+ *
+ */
+static int SSE2
+box_blur_sse2(uint8_t *d, const uint32_t *a, const uint32_t *b,
+              int n, int off, int m)
+{
+  const __m128i vm = _mm_set1_epi32(m);
+  int i;
+  for(i = 0; i + 16 <= n; i += 16) {
+    __m128i r0 = box4_sse2(a + i,      b + i,      off, vm);
+    __m128i r1 = box4_sse2(a + i + 4,  b + i + 4,  off, vm);
+    __m128i r2 = box4_sse2(a + i + 8,  b + i + 8,  off, vm);
+    __m128i r3 = box4_sse2(a + i + 12, b + i + 12, off, vm);
+    _mm_storeu_si128((__m128i *)(d + i),
+                     _mm_packus_epi16(_mm_packs_epi32(r0, r1),
+                                      _mm_packs_epi32(r2, r3)));
+  }
+  return i;
+}
+
+
+/**
+ * Same as mix_bgr32(*d, s << 24)
+ */
+static int SSE2
+shadow_bgr32_sse2(uint32_t *d, const uint32_t *a, const uint32_t *b,
+                  int n, int off, int m)
+{
+  const __m128i vm = _mm_set1_epi32(m);
+  const __m128i c255 = _mm_set1_epi32(255);
+  const __m128i one = _mm_set1_epi32(1);
+  int i;
+  for(i = 0; i + 4 <= n; i += 4) {
+    const __m128i DA = box4_sse2(a + i, b + i, off, vm);
+    const __m128i px = ld128(d + i);
+    const __m128i SA = _mm_srli_epi32(px, 24);
+
+    const __m128i FA =
+      _mm_add_epi32(SA, div255_sse2(_mm_mullo_epi16(_mm_sub_epi32(c255, SA),
+                                                    DA)));
+
+    // FA == 0 implies SA == 0 so everything below turns into zero anyway
+    const __m128i SA2 = div_sse2(_mm_mullo_epi16(SA, c255),
+                                 _mm_max_epi16(FA, one));
+
+    const __m128i R = div255_sse2(_mm_mullo_epi16(_mm_and_si128(px, c255),
+                                                  SA2));
+    const __m128i G = div255_sse2(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(px, 8), c255), SA2));
+    const __m128i B = div255_sse2(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(px, 16), c255), SA2));
+
+    __m128i r = _mm_or_si128(_mm_slli_epi32(FA, 24), _mm_slli_epi32(B, 16));
+    r = _mm_or_si128(r, _mm_or_si128(_mm_slli_epi32(G, 8), R));
+    _mm_storeu_si128((__m128i *)(d + i), r);
+  }
+  return i;
+}
+
+
+/**
+ * Four IA pixels unpacked as (I | A << 16) per lane
+ */
+static inline __m128i SSE2
+shadow_ia4_sse2(__m128i px, __m128i DA)
+{
+  const __m128i c255 = _mm_set1_epi32(255);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i SR = _mm_and_si128(px, _mm_set1_epi32(0xffff));
+  const __m128i SA = _mm_srli_epi32(px, 16);
+
+  const __m128i FA =
+    _mm_add_epi32(SA, div255_sse2(_mm_mullo_epi16(_mm_sub_epi32(c255, SA),
+                                                  DA)));
+  const __m128i SA2 = div_sse2(_mm_mullo_epi16(SA, c255),
+                               _mm_max_epi16(FA, one));
+  const __m128i DR = div255_sse2(_mm_mullo_epi16(SR, SA2));
+  return _mm_or_si128(DR, _mm_slli_epi32(FA, 16));
+}
+
+/**
+ * Same as mix_ia(d, d, 0, s)
+ */
+static int SSE2
+shadow_ia_sse2(uint8_t *d, const uint32_t *a, const uint32_t *b,
+               int n, int off, int m)
+{
+  const __m128i vm = _mm_set1_epi32(m);
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+  for(i = 0; i + 8 <= n; i += 8) {
+    const __m128i px = ld128(d + i * 2);
+    __m128i lo = shadow_ia4_sse2(_mm_unpacklo_epi8(px, zero),
+                                 box4_sse2(a + i, b + i, off, vm));
+    __m128i hi = shadow_ia4_sse2(_mm_unpackhi_epi8(px, zero),
+                                 box4_sse2(a + i + 4, b + i + 4, off, vm));
+    _mm_storeu_si128((__m128i *)(d + i * 2), _mm_packus_epi16(lo, hi));
+  }
+  return i;
+}
+
+
+/**
+ * Load four bytes and zero extend them into 32 bit lanes
+ */
+static inline __m128i SSE2
+ld4x8_sse2(const uint8_t *p)
+{
+  int32_t i32;
+  const __m128i zero = _mm_setzero_si128();
+  memcpy(&i32, p, 4);
+  return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(i32), zero),
+                            zero);
+}
+
+
+/**
+ * Same as composite_GRAY8_on_BGR32()
+ */
+static int SSE2
+composite_bgr32_sse2(uint8_t *dst, const uint8_t *src,
+                     int CR, int CG, int CB, int CA, int width)
+{
+  const __m128i c255 = _mm_set1_epi32(255);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i vCA = _mm_set1_epi32(CA);
+  const __m128i vCR = _mm_set1_epi32(CR);
+  const __m128i vCG = _mm_set1_epi32(CG);
+  const __m128i vCB = _mm_set1_epi32(CB);
+  int x;
+
+  for(x = 0; x + 4 <= width; x += 4) {
+    const __m128i SA = div255_sse2(_mm_mullo_epi16(ld4x8_sse2(src + x), vCA));
+    const __m128i px = ld128(dst + x * 4);
+    const __m128i DA = _mm_srli_epi32(px, 24);
+
+    const __m128i FA =
+      _mm_add_epi32(SA, div255_sse2(_mm_mullo_epi16(_mm_sub_epi32(c255, SA),
+                                                    DA)));
+    const __m128i SA2 = div_sse2(_mm_mullo_epi16(SA, c255),
+                                 _mm_max_epi16(FA, one));
+    const __m128i DA2 = _mm_sub_epi32(c255, SA2);
+
+#define BLEND(C, shift)                                                 \
+    div255_sse2(_mm_add_epi32(_mm_mullo_epi16(C, SA2),                  \
+                              _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(px, shift), c255), DA2)))
+
+    const __m128i R = BLEND(vCR, 0);
+    const __m128i G = BLEND(vCG, 8);
+    const __m128i B = BLEND(vCB, 16);
+#undef BLEND
+
+    __m128i r = _mm_or_si128(_mm_slli_epi32(FA, 24), _mm_slli_epi32(B, 16));
+    r = _mm_or_si128(r, _mm_or_si128(_mm_slli_epi32(G, 8), R));
+    r = _mm_andnot_si128(_mm_cmpeq_epi32(FA, _mm_setzero_si128()), r);
+    _mm_storeu_si128((__m128i *)(dst + x * 4), r);
+  }
+  return x;
+}
+
+
+/**
+ * Same as composite_GRAY8_on_IA(), composite_GRAY8_on_IA_full_alpha()
+ * is the special case of a0 == 255 and gives the same result
+ */
+static int SSE2
+composite_ia_sse2(uint8_t *dst, const uint8_t *src,
+                  int i0, int a0, int width)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i c255 = _mm_set1_epi32(255);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i vi0 = _mm_set1_epi32(i0);
+  const __m128i va0 = _mm_set1_epi32(a0);
+  int x;
+
+  for(x = 0; x + 4 <= width; x += 4) {
+    const __m128i s = ld4x8_sse2(src + x);
+    const __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)
+                                                         (dst + x * 2)),
+                                         zero);
+    const __m128i I = _mm_and_si128(px, _mm_set1_epi32(0xffff));
+    const __m128i pa = _mm_srli_epi32(px, 16);
+
+    const __m128i y = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi16(va0, s),
+                                                   c255), 8);
+    const __m128i ny = _mm_sub_epi32(c255, y);
+    const __m128i A =
+      _mm_add_epi32(y, _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi16(pa, ny),
+                                                    c255), 8));
+
+    const __m128i t1 =
+      _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi16(vi0, y), c255), 8);
+    const __m128i t3 =
+      _mm_srli_epi32(_mm_add_epi32(mullo32_sse2(_mm_mullo_epi16(I, pa), ny),
+                                   _mm_set1_epi32(65535)), 16);
+    const __m128i t = _mm_add_epi32(t1, t3);
+    __m128i I2 = div_sse2(_mm_sub_epi32(_mm_slli_epi32(t, 8), t),
+                          _mm_max_epi16(A, one));
+    I2 = _mm_andnot_si128(_mm_cmpeq_epi32(A, zero), I2);
+
+    __m128i r = _mm_or_si128(_mm_and_si128(I2, c255),
+                             _mm_slli_epi32(_mm_and_si128(A, c255), 16));
+
+    const __m128i keep = _mm_cmpeq_epi32(s, zero);
+    r = _mm_or_si128(_mm_and_si128(keep, px), _mm_andnot_si128(keep, r));
+    _mm_storel_epi64((__m128i *)(dst + x * 2), _mm_packus_epi16(r, r));
+  }
+  return x;
+}
+
+
+/**
+ *
+ */
+static int SSSE3
+rgb24_to_bgr32_ssse3(uint32_t *dst, const uint8_t *src, int width)
+{
+  const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+                                     6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32(0xff000000);
+  int x;
+
+  // Each load reads 16 bytes but only 12 is used, so stop early
+  for(x = 0; x + 6 <= width; x += 4) {
+    __m128i v = _mm_shuffle_epi8(ld128(src + x * 3), shuf);
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(v, alpha));
+  }
+  return x;
+}
+
+
+/**
+ * AVX2 versions, same as above but eight lanes wide
+ */
+static inline __m256i AVX2
+ld256(const void *p)
+{
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static inline __m256i AVX2
+div255_avx2(__m256i x)
+{
+  const __m256i c255 = _mm256_set1_epi32(255);
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(_mm256_add_epi32(x, c255), 8), x), 8);
+}
+
+static inline __m256i AVX2
+div_avx2(__m256i n, __m256i d)
+{
+  const __m256 fn = _mm256_cvtepi32_ps(n);
+  const __m256 fd = _mm256_cvtepi32_ps(d);
+  __m256i q = _mm256_cvttps_epi32(_mm256_div_ps(fn, fd));
+  const __m256 r = _mm256_sub_ps(fn, _mm256_mul_ps(_mm256_cvtepi32_ps(q), fd));
+  q = _mm256_sub_epi32(q, _mm256_castps_si256(_mm256_cmp_ps(r, fd,
+                                                            _CMP_GE_OQ)));
+  q = _mm256_add_epi32(q, _mm256_castps_si256(_mm256_cmp_ps(r, _mm256_setzero_ps(), _CMP_LT_OQ)));
+  return q;
+}
+
+static inline __m256i AVX2
+box8_avx2(const uint32_t *a, const uint32_t *b, int off, __m256i m)
+{
+  __m256i v = _mm256_add_epi32(ld256(b + off), ld256(a - off));
+  v = _mm256_sub_epi32(v, ld256(b - off));
+  v = _mm256_sub_epi32(v, ld256(a + off));
+  v = _mm256_srli_epi32(_mm256_mullo_epi32(v, m), 16);
+  return _mm256_and_si256(v, _mm256_set1_epi32(0xff));
+}
+
+
+/**
+ *
+ */
+static int AVX2
+sat_add_avx2(uint32_t *t, const uint32_t *above, int n)
+{
+  int i;
+  for(i = 0; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i *)(t + i),
+                        _mm256_add_epi32(ld256(t + i), ld256(above + i)));
+  return i;
+}
+
+
+/**
+ *
+ */
+static int AVX2
+box_blur_avx2(uint8_t *d, const uint32_t *a, const uint32_t *b,
+              int n, int off, int m)
+{
+  const __m256i vm = _mm256_set1_epi32(m);
+  // Packing is done per 128 bit lane, this puts the dwords back in order
+  const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int i;
+  for(i = 0; i + 32 <= n; i += 32) {
+    __m256i r0 = box8_avx2(a + i,      b + i,      off, vm);
+    __m256i r1 = box8_avx2(a + i + 8,  b + i + 8,  off, vm);
+    __m256i r2 = box8_avx2(a + i + 16, b + i + 16, off, vm);
+    __m256i r3 = box8_avx2(a + i + 24, b + i + 24, off, vm);
+    __m256i r = _mm256_packus_epi16(_mm256_packs_epi32(r0, r1),
+                                    _mm256_packs_epi32(r2, r3));
+    _mm256_storeu_si256((__m256i *)(d + i),
+                        _mm256_permutevar8x32_epi32(r, perm));
+  }
+  return i;
+}
+
+
+/**
+ *
+ */
+static int AVX2
+shadow_bgr32_avx2(uint32_t *d, const uint32_t *a, const uint32_t *b,
+                  int n, int off, int m)
+{
+  const __m256i vm = _mm256_set1_epi32(m);
+  const __m256i c255 = _mm256_set1_epi32(255);
+  const __m256i one = _mm256_set1_epi32(1);
+  int i;
+  for(i = 0; i + 8 <= n; i += 8) {
+    const __m256i DA = box8_avx2(a + i, b + i, off, vm);
+    const __m256i px = ld256(d + i);
+    const __m256i SA = _mm256_srli_epi32(px, 24);
+
+    const __m256i FA =
+      _mm256_add_epi32(SA, div255_avx2(_mm256_mullo_epi16(_mm256_sub_epi32(c255, SA), DA)));
+    const __m256i SA2 = div_avx2(_mm256_mullo_epi16(SA, c255),
+                                 _mm256_max_epi32(FA, one));
+
+    const __m256i R = div255_avx2(_mm256_mullo_epi16(_mm256_and_si256(px, c255), SA2));
+    const __m256i G = div255_avx2(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(px, 8), c255), SA2));
+    const __m256i B = div255_avx2(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(px, 16), c255), SA2));
+
+    __m256i r = _mm256_or_si256(_mm256_slli_epi32(FA, 24),
+                                _mm256_slli_epi32(B, 16));
+    r = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(G, 8), R));
+    _mm256_storeu_si256((__m256i *)(d + i), r);
+  }
+  return i;
+}
+
+
+static inline __m256i AVX2
+shadow_ia8_avx2(__m256i px, __m256i DA)
+{
+  const __m256i c255 = _mm256_set1_epi32(255);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i SR = _mm256_and_si256(px, _mm256_set1_epi32(0xffff));
+  const __m256i SA = _mm256_srli_epi32(px, 16);
+
+  const __m256i FA =
+    _mm256_add_epi32(SA, div255_avx2(_mm256_mullo_epi16(_mm256_sub_epi32(c255, SA), DA)));
+  const __m256i SA2 = div_avx2(_mm256_mullo_epi16(SA, c255),
+                               _mm256_max_epi32(FA, one));
+  const __m256i DR = div255_avx2(_mm256_mullo_epi16(SR, SA2));
+  return _mm256_or_si256(DR, _mm256_slli_epi32(FA, 16));
+}
+
+/**
+ *
+ */
+static int AVX2
+shadow_ia_avx2(uint8_t *d, const uint32_t *a, const uint32_t *b,
+               int n, int off, int m)
+{
+  const __m256i vm = _mm256_set1_epi32(m);
+  int i;
+  for(i = 0; i + 16 <= n; i += 16) {
+    // Pixels 0-7 and 8-15 in 32 bit lanes
+    const __m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(d + i * 2)));
+    const __m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(d + i * 2 + 16)));
+    __m256i r0 = shadow_ia8_avx2(lo, box8_avx2(a + i, b + i, off, vm));
+    __m256i r1 = shadow_ia8_avx2(hi, box8_avx2(a + i + 8, b + i + 8, off, vm));
+    __m256i r = _mm256_packus_epi16(r0, r1);
+    _mm256_storeu_si256((__m256i *)(d + i * 2),
+                        _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  return i;
+}
+
+
+/**
+ *
+ */
+static int AVX2
+composite_bgr32_avx2(uint8_t *dst, const uint8_t *src,
+                     int CR, int CG, int CB, int CA, int width)
+{
+  const __m256i c255 = _mm256_set1_epi32(255);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i vCA = _mm256_set1_epi32(CA);
+  const __m256i vCR = _mm256_set1_epi32(CR);
+  const __m256i vCG = _mm256_set1_epi32(CG);
+  const __m256i vCB = _mm256_set1_epi32(CB);
+  int x;
+
+  for(x = 0; x + 8 <= width; x += 8) {
+    const __m256i s =
+      _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+    const __m256i SA = div255_avx2(_mm256_mullo_epi16(s, vCA));
+    const __m256i px = ld256(dst + x * 4);
+    const __m256i DA = _mm256_srli_epi32(px, 24);
+
+    const __m256i FA =
+      _mm256_add_epi32(SA, div255_avx2(_mm256_mullo_epi16(_mm256_sub_epi32(c255, SA), DA)));
+    const __m256i SA2 = div_avx2(_mm256_mullo_epi16(SA, c255),
+                                 _mm256_max_epi32(FA, one));
+    const __m256i DA2 = _mm256_sub_epi32(c255, SA2);
+
+#define BLEND(C, shift)                                                 \
+    div255_avx2(_mm256_add_epi32(_mm256_mullo_epi16(C, SA2),            \
+                                 _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(px, shift), c255), DA2)))
+
+    const __m256i R = BLEND(vCR, 0);
+    const __m256i G = BLEND(vCG, 8);
+    const __m256i B = BLEND(vCB, 16);
+#undef BLEND
+
+    __m256i r = _mm256_or_si256(_mm256_slli_epi32(FA, 24),
+                                _mm256_slli_epi32(B, 16));
+    r = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(G, 8), R));
+    r = _mm256_andnot_si256(_mm256_cmpeq_epi32(FA, _mm256_setzero_si256()),
+                            r);
+    _mm256_storeu_si256((__m256i *)(dst + x * 4), r);
+  }
+  return x;
+}
+
+
+/**
+ *
+ */
+static int AVX2
+composite_ia_avx2(uint8_t *dst, const uint8_t *src,
+                  int i0, int a0, int width)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i c255 = _mm256_set1_epi32(255);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i vi0 = _mm256_set1_epi32(i0);
+  const __m256i va0 = _mm256_set1_epi32(a0);
+  int x;
+
+  for(x = 0; x + 8 <= width; x += 8) {
+    const __m256i s =
+      _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+    const __m256i px =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(dst + x * 2)));
+    const __m256i I = _mm256_and_si256(px, _mm256_set1_epi32(0xffff));
+    const __m256i pa = _mm256_srli_epi32(px, 16);
+
+    const __m256i y =
+      _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi16(va0, s), c255), 8);
+    const __m256i ny = _mm256_sub_epi32(c255, y);
+    const __m256i A =
+      _mm256_add_epi32(y, _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi16(pa, ny), c255), 8));
+
+    const __m256i t1 =
+      _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi16(vi0, y), c255), 8);
+    const __m256i t3 =
+      _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_mullo_epi16(I, pa), ny), _mm256_set1_epi32(65535)), 16);
+    const __m256i t = _mm256_add_epi32(t1, t3);
+    __m256i I2 = div_avx2(_mm256_sub_epi32(_mm256_slli_epi32(t, 8), t),
+                          _mm256_max_epi32(A, one));
+    I2 = _mm256_andnot_si256(_mm256_cmpeq_epi32(A, zero), I2);
+
+    __m256i r = _mm256_or_si256(_mm256_and_si256(I2, c255),
+                                _mm256_slli_epi32(_mm256_and_si256(A, c255),
+                                                  16));
+    const __m256i keep = _mm256_cmpeq_epi32(s, zero);
+    r = _mm256_or_si256(_mm256_and_si256(keep, px),
+                        _mm256_andnot_si256(keep, r));
+    r = _mm256_packus_epi16(r, r);
+    r = _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i *)(dst + x * 2), _mm256_castsi256_si128(r));
+  }
+  return x;
+}
+
+
+static const pixmap_kernels_t pixmap_kernels_sse2 = {
+  .pk_name            = "sse2",
+  .pk_sat_add         = sat_add_sse2,
+  .pk_box_blur        = box_blur_sse2,
+  .pk_shadow_bgr32    = shadow_bgr32_sse2,
+  .pk_shadow_ia       = shadow_ia_sse2,
+  .pk_composite_bgr32 = composite_bgr32_sse2,
+  .pk_composite_ia    = composite_ia_sse2,
+};
+
+static const pixmap_kernels_t pixmap_kernels_avx2 = {
+  .pk_name            = "avx2",
+  .pk_sat_add         = sat_add_avx2,
+  .pk_box_blur        = box_blur_avx2,
+  .pk_shadow_bgr32    = shadow_bgr32_avx2,
+  .pk_shadow_ia       = shadow_ia_avx2,
+  .pk_composite_bgr32 = composite_bgr32_avx2,
+  .pk_composite_ia    = composite_ia_avx2,
+  .pk_rgb24_to_bgr32  = rgb24_to_bgr32_ssse3,
+};
+
+#endif // PIXMAP_SIMD_X86
+
+
+#ifdef PIXMAP_SIMD_NEON
+
+/**
+ * Only the integer kernels for now. ARMv7 NEON lacks vector division,
+ * the alpha blending ones would need a reciprocal estimate plus
+ * correction and are left to the C code
+ */
+
+static int
+sat_add_neon(uint32_t *t, const uint32_t *above, int n)
+{
+  int i;
+  for(i = 0; i + 4 <= n; i += 4)
+    vst1q_u32(t + i, vaddq_u32(vld1q_u32(t + i), vld1q_u32(above + i)));
+  return i;
+}
+
+
+static inline uint16x4_t
+box4_neon(const uint32_t *a, const uint32_t *b, int off, uint32x4_t m)
+{
+  uint32x4_t v = vaddq_u32(vld1q_u32(b + off), vld1q_u32(a - off));
+  v = vsubq_u32(v, vld1q_u32(b - off));
+  v = vsubq_u32(v, vld1q_u32(a + off));
+  return vmovn_u32(vshrq_n_u32(vmulq_u32(v, m), 16));
+}
+
+
+static int
+box_blur_neon(uint8_t *d, const uint32_t *a, const uint32_t *b,
+              int n, int off, int m)
+{
+  const uint32x4_t vm = vdupq_n_u32(m);
+  int i;
+  for(i = 0; i + 16 <= n; i += 16) {
+    uint16x8_t lo = vcombine_u16(box4_neon(a + i,     b + i,     off, vm),
+                                 box4_neon(a + i + 4, b + i + 4, off, vm));
+    uint16x8_t hi = vcombine_u16(box4_neon(a + i + 8,  b + i + 8,  off, vm),
+                                 box4_neon(a + i + 12, b + i + 12, off, vm));
+    vst1q_u8(d + i, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+  }
+  return i;
+}
+
+
+static int
+rgb24_to_bgr32_neon(uint32_t *dst, const uint8_t *src, int width)
+{
+  int x;
+  for(x = 0; x + 8 <= width; x += 8) {
+    uint8x8x3_t s = vld3_u8(src + x * 3);
+    uint8x8x4_t d;
+    d.val[0] = s.val[0];
+    d.val[1] = s.val[1];
+    d.val[2] = s.val[2];
+    d.val[3] = vdup_n_u8(0xff);
+    vst4_u8((uint8_t *)(dst + x), d);
+  }
+  return x;
+}
+
+
+static const pixmap_kernels_t pixmap_kernels_neon = {
+  .pk_name            = "neon",
+  .pk_sat_add         = sat_add_neon,
+  .pk_box_blur        = box_blur_neon,
+  .pk_rgb24_to_bgr32  = rgb24_to_bgr32_neon,
+};
+
+#endif // PIXMAP_SIMD_NEON
+
+
+const pixmap_kernels_t *pixmap_kernel_sets[4] = {
+  &pixmap_kernels_c,
+};
+
+
+/**
+ *
+ */
+INITIALIZER(pixmap_simd_init)
+{
+  int n = 1;
+#ifdef PIXMAP_SIMD_X86
+  // Called from a constructor, so we need to init this ourselves
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse2"))
+    pixmap_kernel_sets[n++] = &pixmap_kernels_sse2;
+  if(__builtin_cpu_supports("avx2"))
+    pixmap_kernel_sets[n++] = &pixmap_kernels_avx2;
+#endif
+#ifdef PIXMAP_SIMD_NEON
+  pixmap_kernel_sets[n++] = &pixmap_kernels_neon;
+#endif
+  pixmap_kernels = *pixmap_kernel_sets[n - 1];
+}
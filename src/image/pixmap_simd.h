@@ -0,0 +1,72 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Vectorized inner loops for the pixmap effects
+ *
+ * Each kernel handles a prefix of the span it's given and returns how
+ * many elements it processed. The rest is done by the plain C code in
+ * pixmap.c which is the reference; all kernels must produce exactly the
+ * same bytes as it does. A NULL kernel means that the C code does it all.
+ *
+ * For the box filters, 'a' and 'b' points to the summed area rows above
+ * and below the box and 'off' is the distance (in elements) from the
+ * center to the left and right edge of the box.
+ */
+typedef struct pixmap_kernels {
+  const char *pk_name;
+
+  // t[i] += above[i]
+  int (*pk_sat_add)(uint32_t *t, const uint32_t *above, int n);
+
+  // Box blur, one output byte per element (any number of channels)
+  int (*pk_box_blur)(uint8_t *d, const uint32_t *a, const uint32_t *b,
+                     int n, int off, int m);
+
+  // Drop shadow, summed area is alpha only, one element per pixel
+  int (*pk_shadow_bgr32)(uint32_t *d, const uint32_t *a, const uint32_t *b,
+                         int n, int off, int m);
+  int (*pk_shadow_ia)(uint8_t *d, const uint32_t *a, const uint32_t *b,
+                      int n, int off, int m);
+
+  // Compositing of PIXMAP_I on top of other formats
+  int (*pk_composite_bgr32)(uint8_t *dst, const uint8_t *src,
+                            int r, int g, int b, int a, int width);
+  int (*pk_composite_ia)(uint8_t *dst, const uint8_t *src,
+                         int i, int a, int width);
+
+  int (*pk_rgb24_to_bgr32)(uint32_t *dst, const uint8_t *src, int width);
+
+} pixmap_kernels_t;
+
+
+/**
+ * Currently used kernels, picked at startup based on CPU features
+ */
+extern pixmap_kernels_t pixmap_kernels;
+
+/**
+ * All kernel sets usable on this CPU, best last, NULL terminated.
+ * First entry is always the plain C one (all kernels NULL)
+ */
+extern const pixmap_kernels_t *pixmap_kernel_sets[];
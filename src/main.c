@@ -70,6 +70,9 @@
 #include "fileaccess/fileaccess.h"
 
 static LIST_HEAD(, inithelper) inithelpers;
+#if ENABLE_BENCHMARKS
+static LIST_HEAD(, benchmark) benchmarks;
+#endif
 
 /**
  *
@@ -173,6 +176,43 @@ inithelper_register(inithelper_t *ih)
 }
 
 
+#if ENABLE_BENCHMARKS
+/**
+ *
+ */
+void
+benchmark_register(benchmark_t *b)
+{
+  LIST_INSERT_HEAD(&benchmarks, b, link);
+}
+
+
+/**
+ *
+ */
+static void
+benchmark_run(const char *name)
+{
+  benchmark_t *b;
+  LIST_FOREACH(b, &benchmarks, link) {
+    if(!strcmp(b->name, name))
+      break;
+  }
+
+  if(b == NULL) {
+    printf("Unknown benchmark '%s', available benchmarks:\n", name);
+    LIST_FOREACH(b, &benchmarks, link)
+      printf("  %s\n", b->name);
+    exit(1);
+  }
+
+  TRACE(TRACE_INFO, "bench", "Running benchmark %s", name);
+  b->fn();
+  exit(0);
+}
+#endif
+
+
 /**
  *
  */
@@ -479,6 +519,11 @@ main_init(void)
   /* Asynchronous IO (Used by HTTP server, etc) */
   asyncio_start();
 
+#if ENABLE_BENCHMARKS
+  if(gconf.benchmark != NULL)
+    benchmark_run(gconf.benchmark);
+#endif
+
   runcontrol_init();
 
 }
@@ -532,6 +577,9 @@ parse_opts(int argc, char **argv)
 	     "                       Intended for plugin development\n"
 	     "   -j <path>           Load javascript file\n"
 	     "   --skin <skin>     Select skin (for GLW ui)\n"
+#if ENABLE_BENCHMARKS
+	     "   --bench <name>    Run benchmark and exit\n"
+#endif
 	     "\n"
 	     "  URL is any URL-type supported, "
 	     "e.g., \"file:///...\"\n"
@@ -650,6 +698,11 @@ parse_opts(int argc, char **argv)
     } else if (!strcmp(argv[0], "--skin") && argc > 1) {
       mystrset(&gconf.skin, argv[1]);
       argc -= 2; argv += 2;
+#if ENABLE_BENCHMARKS
+    } else if (!strcmp(argv[0], "--bench") && argc > 1) {
+      gconf.benchmark = argv[1];
+      argc -= 2; argv += 2;
+#endif
     } else if (!strcmp(argv[0], "--upgrade-path") && argc > 1) {
       mystrset(&gconf.upgrade_path, argv[1]);
       argc -= 2; argv += 2;
@@ -235,10 +235,12 @@ typedef struct gconf {
   int enable_omnigrade;
   int enable_http_debug;
   int disable_http_reuse;
+  int disable_http2;
   int enable_experimental;
   int enable_indexer;
   int enable_detailed_avdiff;
   int enable_hls_debug;
+  int enable_hls_abr_throughput;
   int enable_ftp_client_debug;
   int enable_ftp_server_debug;
   int enable_cec_debug;
@@ -278,6 +280,10 @@ typedef struct gconf {
   const char *initial_url;
   const char *initial_view;
 
+#if ENABLE_BENCHMARKS
+  const char *benchmark;
+#endif
+
   char *ui;
   char *skin;
 
@@ -377,3 +383,31 @@ extern void inithelper_register(inithelper_t *ih);
 void init_group(int group);
 
 void fini_group(int group);
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Benchmarks are run with --bench <name> after all subsystems
+ * have been initialized. The app exits when the benchmark returns.
+ *
+ * Only built with --enable-benchmarks, so any code used only by a
+ * benchmark should be inside #if ENABLE_BENCHMARKS as well
+ */
+typedef struct benchmark {
+  LIST_ENTRY(benchmark) link;
+  const char *name;
+  void (*fn)(void);
+} benchmark_t;
+
+extern void benchmark_register(benchmark_t *b);
+
+#define BENCHMARK(name_, fn_)                                      \
+  static benchmark_t HTS_JOIN(benchmark, __LINE__) = {             \
+    .name = name_,                                                 \
+    .fn = fn_,                                                     \
+  };                                                               \
+  INITIALIZER(HTS_JOIN(benchmarkctor, __LINE__))                   \
+  {                                                                \
+    benchmark_register(&HTS_JOIN(benchmark, __LINE__));            \
+  }
+#endif
@@ -305,6 +305,8 @@ mp_reset(media_pipe_t *mp)
 
   prop_set(mp->mp_prop_io, "bitrate", PROP_SET_VOID);
   prop_set(mp->mp_prop_io, "bitrateValid", PROP_SET_VOID);
+  prop_set(mp->mp_prop_io, "prefetchDepth", PROP_SET_VOID);
+  prop_set(mp->mp_prop_io, "prefetchHitRate", PROP_SET_VOID);
 
   prop_t *p = prop_create(mp->mp_prop_io, "infoNodes");
   prop_destroy_childs(p);
@@ -28,6 +28,7 @@
 #include "prop/prop_linkselected.h"
 
 #include "main.h"
+#include "task.h"
 #include "media/media.h"
 #include "htsmsg/htsmsg_json.h"
 #include "misc/str.h"
@@ -50,9 +51,9 @@
 static hts_mutex_t metadata_mutex;
 static hts_cond_t metadata_loading_cond;
 
-static int metadata_num_threads;
+static int metadata_num_tasks;
 
-static void metadata_threads_start(void);
+static void metadata_tasks_start(void);
 
 TAILQ_HEAD(metadata_lazy_prop_queue, metadata_lazy_prop);
 static struct metadata_lazy_prop_queue mlpqueue;
@@ -108,7 +109,7 @@ mlp_enqueue(metadata_lazy_prop_t *mlp)
     return;
   TAILQ_INSERT_TAIL(&mlpqueue, mlp, mlp_link);
   mlp->mlp_queued = 1;
-  metadata_threads_start();
+  metadata_tasks_start();
 }
 
 
@@ -161,6 +162,8 @@ mlp_destroy(metadata_lazy_prop_t *mlp)
 {
   if(!mlp->mlp_zombie) {
     mlp->mlp_zombie = 1;
+    // The item is gone (scrolled out of view, etc), no point probing it
+    mlp_unqueue(mlp);
     if(mlp->mlp_class->mlc_kill != NULL)
       mlp->mlp_class->mlc_kill(mlp);
   }
@@ -1987,54 +1990,47 @@ mlv_direct_query(void *db, rstr_t *url, rstr_t *filename,
 
 
 /**
- *
+ * Probe one item, then requeue ourselves so the probes are scheduled
+ * with the prefetch priority class one at a time instead of holding
+ * on to a worker until the queue is empty
  */
-static void *
-metadata_thread(void *aux)
+static void
+metadata_task(void *aux)
 {
   void *db = NULL;
 
   hts_mutex_lock(&metadata_mutex);
 
-  while(1) {
-
-    metadata_lazy_prop_t *mlp;
-
-    mlp = TAILQ_FIRST(&mlpqueue);
-    if(mlp == NULL)
-      break;
-
-    if(db == NULL)
-      db = metadb_get();
-
+  metadata_lazy_prop_t *mlp = TAILQ_FIRST(&mlpqueue);
+  if(mlp != NULL) {
     TAILQ_REMOVE(&mlpqueue, mlp, mlp_link);
     mlp->mlp_queued = 0;
-    if(!mlp->mlp_zombie)
-      mlp->mlp_class->mlc_load(db, mlp);
+    db = metadb_get();
+    mlp->mlp_class->mlc_load(db, mlp);
   }
 
-  metadata_num_threads--;
+  if(TAILQ_FIRST(&mlpqueue) != NULL)
+    task_run_prio(metadata_task, NULL, TASK_PRIO_PREFETCH, NULL, NULL);
+  else
+    metadata_num_tasks--;
 
   hts_mutex_unlock(&metadata_mutex);
 
   if(db != NULL)
     metadb_close(db);
-
-  return NULL;
 }
 
 
 /**
- *
+ * At most four probes are in flight to not hammer the metadata sources
  */
 static void
-metadata_threads_start(void)
+metadata_tasks_start(void)
 {
-  if(metadata_num_threads >= 4)
+  if(metadata_num_tasks >= 4)
     return;
-  metadata_num_threads++;
-  hts_thread_create_detached("metadata", metadata_thread, NULL,
-                             THREAD_PRIO_METADATA);
+  metadata_num_tasks++;
+  task_run_prio(metadata_task, NULL, TASK_PRIO_PREFETCH, NULL, NULL);
 }
 
 
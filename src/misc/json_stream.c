@@ -0,0 +1,518 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+#include <stdint.h>
+
+#include "json_stream.h"
+#include "str.h"
+#include "dbl.h"
+#include "compiler.h"
+
+// Parser states
+#define JS_VALUE       0  // Expecting a value
+#define JS_MAP_FIRST   1  // After '{', expecting key or '}'
+#define JS_MAP_KEY     2  // After ',' in a map, expecting key
+#define JS_COLON       3  // After key
+#define JS_LIST_FIRST  4  // After '[', expecting value or ']'
+#define JS_NEXT        5  // After a value in a map or list
+#define JS_DONE        6  // Top level value complete
+#define JS_ERROR       7
+
+
+/**
+ *
+ */
+void
+json_stream_init(json_stream_t *js)
+{
+  memset(js, 0, sizeof(json_stream_t));
+  js->js_state = JS_VALUE;
+}
+
+
+/**
+ *
+ */
+void
+json_stream_data(json_stream_t *js, const char *data, size_t len, int eof)
+{
+  js->js_data = data;
+  js->js_len = len;
+  js->js_eof = eof;
+}
+
+
+/**
+ *
+ */
+static json_token_type_t
+json_stream_error(json_stream_t *js, const char *msg)
+{
+  js->js_errmsg = msg;
+  js->js_state = JS_ERROR;
+  return JSON_TOKEN_ERROR;
+}
+
+
+/**
+ * Stop here, either we need more data or it's a premature end of data
+ */
+static json_token_type_t
+json_stream_short(json_stream_t *js)
+{
+  if(js->js_eof)
+    return json_stream_error(js, "Unexpected end of JSON message");
+  return JSON_TOKEN_NEED_MORE;
+}
+
+
+static int
+hexval(int c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+
+/**
+ * Check a multibyte UTF-8 sequence. Returns number of bytes it spans
+ * or 0 if it continues past the end of data.
+ *
+ * 'Bad' here means that a decode + encode with utf8_get() and
+ * utf8_put() would not give the same bytes back.
+ */
+static int
+utf8_check(const uint8_t *p, size_t avail, int *bad)
+{
+  int r, l, m, i;
+
+  switch(p[0]) {
+  case 194 ... 223: r = p[0] & 0x1f; l = 1; m = 0x80;      break;
+  case 224 ... 239: r = p[0] & 0xf;  l = 2; m = 0x800;     break;
+  case 240 ... 247: r = p[0] & 0x7;  l = 3; m = 0x10000;   break;
+  case 248 ... 251: r = p[0] & 0x3;  l = 4; m = 0x200000;  break;
+  case 252 ... 253: r = p[0] & 0x1;  l = 5; m = 0x4000000; break;
+  default:
+    *bad = 1;
+    return 1;
+  }
+
+  for(i = 1; i <= l; i++) {
+    if(i == avail)
+      return 0;
+    if((p[i] & 0xc0) != 0x80) {
+      *bad = 1;
+      return i;
+    }
+    r = r << 6 | (p[i] & 0x3f);
+  }
+
+  if(r < m || utf8_put(NULL, r) != l + 1)
+    *bad = 1;
+  return l + 1;
+}
+
+
+/**
+ * Scan for the end of the string starting at js_pos
+ */
+static json_token_type_t
+json_stream_string(json_stream_t *js, json_token_t *jt, json_token_type_t type)
+{
+  const uint8_t *d = (const uint8_t *)js->js_data;
+  const size_t len = js->js_len;
+  size_t p = js->js_scan ?: js->js_pos + 1;
+  int flags = js->js_scan_flags;
+  int bad = 0;
+
+  while(1) {
+
+    while(p < len && d[p] != '"' && d[p] != '\\' && d[p] < 0x80 && d[p])
+      p++;
+
+    if(p == len)
+      break;
+
+    const int c = d[p];
+
+    if(c == '"') {
+      jt->jt_type = type;
+      jt->jt_flags = flags;
+      jt->jt_offset = js->js_pos;
+      jt->jt_str = js->js_data + js->js_pos + 1;
+      jt->jt_len = p - js->js_pos - 1;
+      js->js_pos = p + 1;
+      js->js_scan = 0;
+      js->js_scan_flags = 0;
+      return type;
+    }
+
+    if(c == 0) {
+      js->js_pos = p;
+      return json_stream_error(js, "Unexpected end of JSON message");
+    }
+
+    if(c == '\\') {
+      if(p + 1 == len)
+        break;
+
+      flags |= JSON_STR_ESCAPED;
+      if(d[p + 1] == 'u') {
+        if(p + 6 > len)
+          break;
+        for(int i = 0; i < 4; i++) {
+          if(hexval(d[p + 2 + i]) == -1) {
+            js->js_pos = p;
+            return json_stream_error(js, "Incorrect escape sequence");
+          }
+        }
+        p += 6;
+      } else {
+        if(d[p + 1] >= 0x80)
+          flags |= JSON_STR_BADUTF8;
+        p += 2;
+      }
+      continue;
+    }
+
+    const int l = utf8_check(d + p, len - p, &bad);
+    if(l == 0)
+      break;
+    if(bad)
+      flags |= JSON_STR_BADUTF8;
+    p += l;
+  }
+
+  // Remember how far we got so we don't rescan it all next time
+  js->js_scan = p;
+  js->js_scan_flags = flags;
+  return json_stream_short(js);
+}
+
+
+/**
+ *
+ */
+static json_token_type_t
+json_stream_number(json_stream_t *js, json_token_t *jt)
+{
+  const char *d = js->js_data;
+  size_t p = js->js_pos;
+  int is_float = 0;
+  char tmp[64];
+
+  for(; p < js->js_len; p++) {
+    const char c = d[p];
+    if(c >= '0' && c <= '9')
+      continue;
+    if(c == '.' || c == 'e' || c == 'E')
+      is_float = 1;
+    else if(c != '-' && c != '+')
+      break;
+  }
+
+  if(p == js->js_len && !js->js_eof)
+    return JSON_TOKEN_NEED_MORE;
+
+  const size_t len = p - js->js_pos;
+  if(len >= sizeof(tmp))
+    return json_stream_error(js, "Number too long");
+
+  memcpy(tmp, d + js->js_pos, len);
+  tmp[len] = 0;
+
+  jt->jt_offset = js->js_pos;
+
+  if(!is_float) {
+    const char *s = tmp;
+    int neg = 0;
+    uint64_t v = 0;
+
+    if(*s == '-' || *s == '+')
+      neg = *s++ == '-';
+
+    if(*s >= '0' && *s <= '9') {
+      for(; *s >= '0' && *s <= '9'; s++) {
+        const int digit = *s - '0';
+        if(v > (INT64_MAX - digit) / 10)
+          break; // Overflow, treat it as a double
+        v = v * 10 + digit;
+      }
+
+      if(*s == 0) {
+        jt->jt_type = JSON_TOKEN_INTEGER;
+        jt->jt_s64 = neg ? -(int64_t)v : (int64_t)v;
+        js->js_pos = p;
+        return JSON_TOKEN_INTEGER;
+      }
+    }
+  }
+
+  const char *ep;
+  jt->jt_dbl = my_str2double(tmp, &ep);
+  if(ep == tmp)
+    return json_stream_error(js, "Unknown token");
+
+  jt->jt_type = JSON_TOKEN_DOUBLE;
+  js->js_pos += ep - tmp;
+  return JSON_TOKEN_DOUBLE;
+}
+
+
+/**
+ *
+ */
+static json_token_type_t
+json_stream_literal(json_stream_t *js, json_token_t *jt, const char *lit,
+                    json_token_type_t type, int v)
+{
+  const size_t litlen = strlen(lit);
+  const size_t avail = js->js_len - js->js_pos;
+  const char *s = js->js_data + js->js_pos;
+
+  if(avail < litlen) {
+    if(memcmp(s, lit, avail))
+      return json_stream_error(js, "Unknown token");
+    return json_stream_short(js);
+  }
+
+  if(memcmp(s, lit, litlen))
+    return json_stream_error(js, "Unknown token");
+
+  jt->jt_type = type;
+  jt->jt_offset = js->js_pos;
+  jt->jt_s64 = v;
+  js->js_pos += litlen;
+  return type;
+}
+
+
+/**
+ *
+ */
+static json_token_type_t
+json_stream_push(json_stream_t *js, json_token_t *jt, int c)
+{
+  if(js->js_depth == JSON_STREAM_MAX_DEPTH)
+    return json_stream_error(js, "Too deeply nested");
+
+  js->js_stack[js->js_depth++] = c;
+  jt->jt_offset = js->js_pos++;
+
+  if(c == '{') {
+    js->js_state = JS_MAP_FIRST;
+    return jt->jt_type = JSON_TOKEN_MAP_BEGIN;
+  } else {
+    js->js_state = JS_LIST_FIRST;
+    return jt->jt_type = JSON_TOKEN_LIST_BEGIN;
+  }
+}
+
+
+/**
+ *
+ */
+static json_token_type_t
+json_stream_pop(json_stream_t *js, json_token_t *jt)
+{
+  const int c = js->js_stack[--js->js_depth];
+  jt->jt_offset = js->js_pos++;
+  js->js_state = js->js_depth ? JS_NEXT : JS_DONE;
+  return jt->jt_type = c == '{' ? JSON_TOKEN_MAP_END : JSON_TOKEN_LIST_END;
+}
+
+
+/**
+ *
+ */
+static json_token_type_t
+json_stream_value(json_stream_t *js, json_token_t *jt, int c)
+{
+  json_token_type_t r;
+
+  switch(c) {
+  case '{':
+  case '[':
+    return json_stream_push(js, jt, c);
+
+  case '"':
+    r = json_stream_string(js, jt, JSON_TOKEN_STRING);
+    break;
+
+  case '-': case '+': case '.':
+  case '0' ... '9':
+    r = json_stream_number(js, jt);
+    break;
+
+  case 't':
+    r = json_stream_literal(js, jt, "true", JSON_TOKEN_BOOL, 1);
+    break;
+  case 'f':
+    r = json_stream_literal(js, jt, "false", JSON_TOKEN_BOOL, 0);
+    break;
+  case 'n':
+    r = json_stream_literal(js, jt, "null", JSON_TOKEN_NULL, 0);
+    break;
+
+  default:
+    return json_stream_error(js, "Unknown token");
+  }
+
+  if(r > JSON_TOKEN_END)
+    js->js_state = js->js_depth ? JS_NEXT : JS_DONE;
+  return r;
+}
+
+
+/**
+ *
+ */
+json_token_type_t
+json_stream_next(json_stream_t *js, json_token_t *jt)
+{
+  const char *d = js->js_data;
+
+  while(1) {
+
+    if(js->js_state == JS_ERROR)
+      return JSON_TOKEN_ERROR;
+
+    if(js->js_state == JS_DONE)
+      return JSON_TOKEN_END;
+
+    while(js->js_pos < js->js_len &&
+          d[js->js_pos] > 0 && d[js->js_pos] < 33)
+      js->js_pos++;
+
+    if(js->js_pos == js->js_len)
+      return json_stream_short(js);
+
+    const int c = d[js->js_pos];
+
+    switch(js->js_state) {
+    case JS_VALUE:
+      return json_stream_value(js, jt, c);
+
+    case JS_LIST_FIRST:
+      if(c == ']')
+        return json_stream_pop(js, jt);
+      return json_stream_value(js, jt, c);
+
+    case JS_MAP_FIRST:
+      if(c == '}')
+        return json_stream_pop(js, jt);
+      // FALLTHRU
+    case JS_MAP_KEY:
+      if(c != '"')
+        return json_stream_error(js, "Expected string");
+      if(json_stream_string(js, jt, JSON_TOKEN_KEY) != JSON_TOKEN_KEY)
+        return js->js_state == JS_ERROR ? JSON_TOKEN_ERROR :
+          JSON_TOKEN_NEED_MORE;
+      js->js_state = JS_COLON;
+      return JSON_TOKEN_KEY;
+
+    case JS_COLON:
+      if(c != ':')
+        return json_stream_error(js, "Expected ':'");
+      js->js_pos++;
+      js->js_state = JS_VALUE;
+      continue;
+
+    case JS_NEXT:
+      if(c == ',') {
+        js->js_pos++;
+        js->js_state =
+          js->js_stack[js->js_depth - 1] == '{' ? JS_MAP_KEY : JS_VALUE;
+        continue;
+      }
+      if(c == (js->js_stack[js->js_depth - 1] == '{' ? '}' : ']'))
+        return json_stream_pop(js, jt);
+      return json_stream_error(js, "Expected ','");
+    }
+  }
+}
+
+
+/**
+ *
+ */
+static int
+hex4(const char *s)
+{
+  return hexval(s[0]) << 12 | hexval(s[1]) << 8 |
+    hexval(s[2]) << 4 | hexval(s[3]);
+}
+
+
+/**
+ *
+ */
+size_t
+json_string_decode(char *dst, const char *src, size_t len)
+{
+  const char *s = src;
+  const char *end = src + len;
+  size_t o = 0;
+  int c;
+
+  while(s < end) {
+
+    if(*s == '\\') {
+      s++;
+      switch((c = (uint8_t)*s++)) {
+      case 'b':   c = '\b'; break;
+      case 'f':   c = '\f'; break;
+      case 'n':   c = '\n'; break;
+      case 'r':   c = '\r'; break;
+      case 't':   c = '\t'; break;
+      case 'u':
+        c = hex4(s);
+        s += 4;
+        if(c >= 0xd800 && c < 0xdc00 && end - s >= 6 &&
+           s[0] == '\\' && s[1] == 'u') {
+          // Surrogate pair
+          const int lo = hex4(s + 2);
+          if(lo >= 0xdc00 && lo < 0xe000) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+            s += 6;
+          }
+        }
+        if(c == 0)
+          continue;
+        break;
+      }
+    } else if((uint8_t)*s < 0x80) {
+      if(dst != NULL)
+        dst[o] = *s;
+      o++;
+      s++;
+      continue;
+    } else {
+      c = utf8_get(&s);
+    }
+    o += utf8_put(dst ? dst + o : NULL, c);
+  }
+  return o;
+}
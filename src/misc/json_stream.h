@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Incremental JSON tokenizer
+ *
+ * The tokenizer does not allocate or copy anything. Keys and strings
+ * are returned as slices into the input data, escape sequences are left
+ * as is and can be decoded with json_string_decode().
+ *
+ * Input can be given in pieces as it arrives. json_stream_data() is
+ * called with all data received so far (the buffer may move between
+ * calls, positions are kept as offsets). When a token is cut off at the
+ * end of the data JSON_TOKEN_NEED_MORE is returned and the tokenizer
+ * resumes from where it was once more data is available.
+ */
+
+typedef enum {
+  JSON_TOKEN_NEED_MORE,   // Token is incomplete, need more data
+  JSON_TOKEN_ERROR,       // Parse error, see js_errmsg and js_pos
+  JSON_TOKEN_END,         // Top level value is complete
+  JSON_TOKEN_MAP_BEGIN,
+  JSON_TOKEN_MAP_END,
+  JSON_TOKEN_LIST_BEGIN,
+  JSON_TOKEN_LIST_END,
+  JSON_TOKEN_KEY,
+  JSON_TOKEN_STRING,
+  JSON_TOKEN_INTEGER,
+  JSON_TOKEN_DOUBLE,
+  JSON_TOKEN_BOOL,
+  JSON_TOKEN_NULL,
+} json_token_type_t;
+
+
+typedef struct json_token {
+  json_token_type_t jt_type;
+
+  int jt_flags;
+#define JSON_STR_ESCAPED  0x1  // Contains escape sequences
+#define JSON_STR_BADUTF8  0x2  // Contains malformed UTF-8
+
+  size_t jt_offset;      // Stream offset of the token
+
+  const char *jt_str;    // JSON_TOKEN_KEY and JSON_TOKEN_STRING
+  size_t jt_len;         // Raw length, without quotes
+
+  int64_t jt_s64;        // JSON_TOKEN_INTEGER and JSON_TOKEN_BOOL
+  double jt_dbl;         // JSON_TOKEN_DOUBLE
+} json_token_t;
+
+
+#define JSON_STREAM_MAX_DEPTH 256
+
+typedef struct json_stream {
+  const char *js_data;
+  size_t js_len;
+  size_t js_pos;
+
+  // Resume point while waiting for the rest of a string
+  size_t js_scan;
+  int js_scan_flags;
+
+  int js_eof;
+  int js_state;
+  int js_depth;
+  const char *js_errmsg;
+
+  uint8_t js_stack[JSON_STREAM_MAX_DEPTH];
+} json_stream_t;
+
+
+void json_stream_init(json_stream_t *js);
+
+/**
+ * Set the data to tokenize. \p data is the entire stream received so
+ * far. \p eof is set when no more data will arrive.
+ *
+ * Slices in tokens returned earlier are not valid after this call
+ */
+void json_stream_data(json_stream_t *js, const char *data, size_t len,
+                      int eof);
+
+json_token_type_t json_stream_next(json_stream_t *js, json_token_t *jt);
+
+/**
+ * Decode a string slice. Returns length of the output. \p dst can be
+ * NULL to just compute the length.
+ *
+ * Output is never longer than input unless JSON_STR_BADUTF8 is set,
+ * so without that flag it's fine to decode in place.
+ * The output is not zero terminated.
+ */
+size_t json_string_decode(char *dst, const char *src, size_t len);
@@ -0,0 +1,673 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "htsmsg/htsbuf.h"
+#include "hpack.h"
+
+struct hpack_entry {
+  size_t he_namelen;
+  size_t he_valuelen;
+  char he_data[0];  // name \0 value \0
+};
+
+#define HPACK_ENTRY_OVERHEAD 32
+
+/**
+ * Static table, RFC 7541 Appendix A
+ */
+static const struct {
+  const char *name;
+  const char *value;
+} hpack_static_table[] = {
+  { ":authority",                  "" },
+  { ":method",                     "GET" },
+  { ":method",                     "POST" },
+  { ":path",                       "/" },
+  { ":path",                       "/index.html" },
+  { ":scheme",                     "http" },
+  { ":scheme",                     "https" },
+  { ":status",                     "200" },
+  { ":status",                     "204" },
+  { ":status",                     "206" },
+  { ":status",                     "304" },
+  { ":status",                     "400" },
+  { ":status",                     "404" },
+  { ":status",                     "500" },
+  { "accept-charset",              "" },
+  { "accept-encoding",             "gzip, deflate" },
+  { "accept-language",             "" },
+  { "accept-ranges",               "" },
+  { "accept",                      "" },
+  { "access-control-allow-origin", "" },
+  { "age",                         "" },
+  { "allow",                       "" },
+  { "authorization",               "" },
+  { "cache-control",               "" },
+  { "content-disposition",         "" },
+  { "content-encoding",            "" },
+  { "content-language",            "" },
+  { "content-length",              "" },
+  { "content-location",            "" },
+  { "content-range",               "" },
+  { "content-type",                "" },
+  { "cookie",                      "" },
+  { "date",                        "" },
+  { "etag",                        "" },
+  { "expect",                      "" },
+  { "expires",                     "" },
+  { "from",                        "" },
+  { "host",                        "" },
+  { "if-match",                    "" },
+  { "if-modified-since",           "" },
+  { "if-none-match",               "" },
+  { "if-range",                    "" },
+  { "if-unmodified-since",         "" },
+  { "last-modified",               "" },
+  { "link",                        "" },
+  { "location",                    "" },
+  { "max-forwards",                "" },
+  { "proxy-authenticate",          "" },
+  { "proxy-authorization",         "" },
+  { "range",                       "" },
+  { "referer",                     "" },
+  { "refresh",                     "" },
+  { "retry-after",                 "" },
+  { "server",                      "" },
+  { "set-cookie",                  "" },
+  { "strict-transport-security",   "" },
+  { "transfer-encoding",           "" },
+  { "user-agent",                  "" },
+  { "vary",                        "" },
+  { "via",                         "" },
+  { "www-authenticate",            "" },
+};
+
+#define HPACK_STATIC_ENTRIES \
+  (sizeof(hpack_static_table) / sizeof(hpack_static_table[0]))
+
+
+/**
+ * Huffman code from RFC 7541 Appendix B in canonical form.
+ *
+ * Codes of length N are huff_first[N] ... huff_first[N] + huff_count[N] - 1
+ * and map to huff_sym[huff_offset[N] ...]. Symbol 256 is EOS
+ */
+static const uint32_t huff_first[31] = {
+  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+  0x14, 0x5c, 0xf8, 0x0, 0x3f8, 0x7fa,
+  0xffa, 0x1ff8, 0x3ffc, 0x7ffc, 0x0, 0x0,
+  0x0, 0x7fff0, 0xfffe6, 0x1fffdc, 0x3fffd2, 0x7fffd8,
+  0xffffea, 0x1ffffec, 0x3ffffe0, 0x7ffffde, 0xfffffe2, 0x0,
+  0x3ffffffc,
+};
+static const uint8_t huff_count[31] = {
+  0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3,
+  0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+static const uint16_t huff_offset[31] = {
+  0, 0, 0, 0, 0, 0, 10, 36, 68, 74, 74, 79, 82, 84, 90, 92,
+  95, 95, 95, 95, 98, 106, 119, 145, 174, 186, 190, 205, 224, 253, 253,
+};
+static const uint16_t huff_sym[257] = {
+  48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37,
+  45, 46, 47, 51, 52, 53, 54, 55, 56, 57, 61, 65,
+  95, 98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+  58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+  77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89,
+  106, 107, 113, 118, 119, 120, 121, 122, 38, 42, 44, 59,
+  88, 90, 33, 34, 40, 41, 63, 39, 43, 124, 35, 62,
+  0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+  195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+  167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+  132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+  173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+  233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+  151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+  183, 188, 191, 197, 231, 239, 9, 142, 144, 145, 148, 159,
+  171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+  200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+  255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+  246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5,
+  6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+  21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220,
+  249, 10, 13, 22, 256,
+};
+
+
+/**
+ *
+ */
+void
+hpack_decoder_init(hpack_decoder_t *hd, size_t max_size)
+{
+  memset(hd, 0, sizeof(hpack_decoder_t));
+  hd->hd_max_size = max_size;
+  hd->hd_max_size_limit = max_size;
+}
+
+
+/**
+ *
+ */
+void
+hpack_decoder_free(hpack_decoder_t *hd)
+{
+  for(int i = 0; i < hd->hd_num_entries; i++)
+    free(hd->hd_entries[i]);
+  free(hd->hd_entries);
+  hd->hd_entries = NULL;
+  hd->hd_num_entries = 0;
+  hd->hd_size = 0;
+}
+
+
+/**
+ * Evict oldest entries until the table plus 'extra' fits
+ */
+static void
+hpack_evict(hpack_decoder_t *hd, size_t extra)
+{
+  while(hd->hd_num_entries > 0 && hd->hd_size + extra > hd->hd_max_size) {
+    hpack_entry_t *he = hd->hd_entries[--hd->hd_num_entries];
+    hd->hd_size -= he->he_namelen + he->he_valuelen + HPACK_ENTRY_OVERHEAD;
+    free(he);
+  }
+}
+
+
+/**
+ *
+ */
+static void
+hpack_insert(hpack_decoder_t *hd, const char *name, size_t namelen,
+             const char *value, size_t valuelen)
+{
+  const size_t size = namelen + valuelen + HPACK_ENTRY_OVERHEAD;
+  hpack_entry_t *he = NULL;
+
+  // 'name' may refer to an entry that is about to be evicted so it
+  // must be copied before evicting (RFC 7541 4.4)
+  if(size <= hd->hd_max_size) {
+    he = malloc(sizeof(hpack_entry_t) + namelen + valuelen + 2);
+    he->he_namelen = namelen;
+    he->he_valuelen = valuelen;
+    memcpy(he->he_data, name, namelen);
+    he->he_data[namelen] = 0;
+    memcpy(he->he_data + namelen + 1, value, valuelen);
+    he->he_data[namelen + 1 + valuelen] = 0;
+  }
+
+  hpack_evict(hd, size);
+
+  if(he == NULL)
+    return; // Entry does not fit, table is now empty
+
+  if(hd->hd_num_entries == hd->hd_capacity) {
+    hd->hd_capacity = hd->hd_capacity * 2 + 16;
+    hd->hd_entries = realloc(hd->hd_entries,
+                             hd->hd_capacity * sizeof(hpack_entry_t *));
+  }
+  memmove(hd->hd_entries + 1, hd->hd_entries,
+          hd->hd_num_entries * sizeof(hpack_entry_t *));
+  hd->hd_entries[0] = he;
+  hd->hd_num_entries++;
+  hd->hd_size += size;
+}
+
+
+/**
+ * Resolve index (1-based, static table first) into name and value
+ */
+static int
+hpack_lookup(const hpack_decoder_t *hd, uint32_t idx,
+             const char **name, const char **value)
+{
+  if(idx == 0)
+    return -1;
+
+  if(idx <= HPACK_STATIC_ENTRIES) {
+    *name  = hpack_static_table[idx - 1].name;
+    *value = hpack_static_table[idx - 1].value;
+    return 0;
+  }
+
+  idx -= HPACK_STATIC_ENTRIES + 1;
+  if(idx >= hd->hd_num_entries)
+    return -1;
+
+  const hpack_entry_t *he = hd->hd_entries[idx];
+  *name  = he->he_data;
+  *value = he->he_data + he->he_namelen + 1;
+  return 0;
+}
+
+
+/**
+ * Decode integer with N bit prefix (RFC 7541 5.1)
+ */
+static int
+hpack_decode_int(const uint8_t **pp, const uint8_t *end, int prefix,
+                 uint32_t *out)
+{
+  const uint8_t *p = *pp;
+  const uint32_t max = (1 << prefix) - 1;
+
+  if(p == end)
+    return -1;
+
+  uint32_t v = *p++ & max;
+
+  if(v == max) {
+    int shift = 0;
+    uint8_t b;
+    do {
+      if(p == end || shift > 21)
+        return -1;
+      b = *p++;
+      v += (b & 0x7f) << shift;
+      shift += 7;
+    } while(b & 0x80);
+  }
+  *pp = p;
+  *out = v;
+  return 0;
+}
+
+
+/**
+ *
+ */
+static int
+hpack_huffman_decode(char *dst, const uint8_t *src, size_t len)
+{
+  char *d = dst;
+  uint32_t code = 0;
+  int codelen = 0;
+
+  for(size_t i = 0; i < len; i++) {
+    for(int b = 7; b >= 0; b--) {
+      code = (code << 1) | ((src[i] >> b) & 1);
+      codelen++;
+
+      if(codelen > 30)
+        return -1;
+
+      uint32_t idx = code - huff_first[codelen];
+      if(idx >= huff_count[codelen])
+        continue;
+
+      int sym = huff_sym[huff_offset[codelen] + idx];
+      if(sym == 256)
+        return -1; // EOS in string is an error
+
+      *d++ = sym;
+      code = 0;
+      codelen = 0;
+    }
+  }
+
+  // Padding must be less than 8 bits and consist of the EOS MSBs (all ones)
+  if(codelen > 7 || code != (1U << codelen) - 1)
+    return -1;
+
+  return d - dst;
+}
+
+
+/**
+ * Decode string literal (RFC 7541 5.2). Returns a malloced string
+ */
+static char *
+hpack_decode_string(const uint8_t **pp, const uint8_t *end, size_t *lenp)
+{
+  const uint8_t *p = *pp;
+  uint32_t len;
+
+  if(p == end)
+    return NULL;
+
+  const int huffman = *p & 0x80;
+
+  if(hpack_decode_int(&p, end, 7, &len) || len > end - p)
+    return NULL;
+
+  char *r;
+  int outlen;
+
+  if(huffman) {
+    // Shortest code is 5 bits
+    r = malloc(len * 8 / 5 + 1);
+    outlen = hpack_huffman_decode(r, p, len);
+    if(outlen < 0) {
+      free(r);
+      return NULL;
+    }
+  } else {
+    r = malloc(len + 1);
+    memcpy(r, p, len);
+    outlen = len;
+  }
+  r[outlen] = 0;
+  *lenp = outlen;
+  *pp = p + len;
+  return r;
+}
+
+
+/**
+ *
+ */
+int
+hpack_decode(hpack_decoder_t *hd, const uint8_t *p, size_t len,
+             hpack_header_cb_t *cb, void *opaque)
+{
+  const uint8_t *end = p + len;
+  uint32_t idx;
+
+  while(p < end) {
+    const uint8_t b = *p;
+    const char *name, *value;
+
+    if(b & 0x80) {
+      // Indexed header field
+      if(hpack_decode_int(&p, end, 7, &idx) ||
+         hpack_lookup(hd, idx, &name, &value))
+        return -1;
+      cb(opaque, name, value);
+      continue;
+    }
+
+    if((b & 0xe0) == 0x20) {
+      // Dynamic table size update
+      if(hpack_decode_int(&p, end, 5, &idx) || idx > hd->hd_max_size_limit)
+        return -1;
+      hd->hd_max_size = idx;
+      hpack_evict(hd, 0);
+      continue;
+    }
+
+    // Literal header field, with (0x40) or without (0x00, 0x10) indexing
+    const int indexing = b & 0x40;
+    size_t namelen, valuelen;
+    char *namebuf = NULL;
+
+    if(hpack_decode_int(&p, end, indexing ? 6 : 4, &idx))
+      return -1;
+
+    if(idx) {
+      if(hpack_lookup(hd, idx, &name, &value))
+        return -1;
+      namelen = strlen(name);
+    } else {
+      if((namebuf = hpack_decode_string(&p, end, &namelen)) == NULL)
+        return -1;
+      name = namebuf;
+    }
+
+    char *valuebuf = hpack_decode_string(&p, end, &valuelen);
+    if(valuebuf == NULL) {
+      free(namebuf);
+      return -1;
+    }
+
+    cb(opaque, name, valuebuf);
+
+    if(indexing)
+      hpack_insert(hd, name, namelen, valuebuf, valuelen);
+
+    free(namebuf);
+    free(valuebuf);
+  }
+  return 0;
+}
+
+
+/**
+ *
+ */
+static void
+hpack_encode_int(htsbuf_queue_t *q, uint8_t first, int prefix, uint32_t v)
+{
+  const uint32_t max = (1 << prefix) - 1;
+
+  if(v < max) {
+    htsbuf_append_byte(q, first | v);
+    return;
+  }
+  htsbuf_append_byte(q, first | max);
+  v -= max;
+  while(v >= 0x80) {
+    htsbuf_append_byte(q, 0x80 | (v & 0x7f));
+    v >>= 7;
+  }
+  htsbuf_append_byte(q, v);
+}
+
+
+/**
+ *
+ */
+static void
+hpack_encode_string(htsbuf_queue_t *q, const char *str)
+{
+  const size_t len = strlen(str);
+  hpack_encode_int(q, 0, 7, len);
+  htsbuf_append(q, str, len);
+}
+
+
+/**
+ *
+ */
+void
+hpack_encode(htsbuf_queue_t *q, const char *name, const char *value)
+{
+  int name_idx = 0;
+
+  for(int i = 0; i < HPACK_STATIC_ENTRIES; i++) {
+    if(strcmp(hpack_static_table[i].name, name))
+      continue;
+
+    if(!strcmp(hpack_static_table[i].value, value)) {
+      // Indexed header field
+      hpack_encode_int(q, 0x80, 7, i + 1);
+      return;
+    }
+    if(name_idx == 0)
+      name_idx = i + 1;
+  }
+
+  // Literal header field without indexing
+  hpack_encode_int(q, 0x00, 4, name_idx);
+  if(name_idx == 0)
+    hpack_encode_string(q, name);
+  hpack_encode_string(q, value);
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Decoder test and benchmark
+ *
+ * RFC 7541 C.3 - C.5 plus a literal with incremental indexing whose
+ * name refers to the entry it evicts
+ */
+static const struct {
+  int new_decoder;  // Start over with a decoder of this table size
+  int len;
+  const char *data;
+  const char *headers;
+} hpack_test_blocks[] = {
+  { 4096, 20,
+    "\x82\x86\x84" "A\x0fwww.example.com",
+    ":method: GET\n"
+    ":scheme: http\n"
+    ":path: /\n"
+    ":authority: www.example.com\n"
+  },
+  { 0, 14,
+    "\x82\x86\x84\xbeX\x08no-cache",
+    ":method: GET\n"
+    ":scheme: http\n"
+    ":path: /\n"
+    ":authority: www.example.com\n"
+    "cache-control: no-cache\n"
+  },
+  { 0, 29,
+    "\x82\x87\x85\xbf@\x0a" "custom-key\x0c" "custom-value",
+    ":method: GET\n"
+    ":scheme: https\n"
+    ":path: /index.html\n"
+    ":authority: www.example.com\n"
+    "custom-key: custom-value\n"
+  },
+  { 4096, 17,
+    "\x82\x86\x84" "A\x8c\xf1\xe3\xc2\xe5\xf2:k\xa0\xab\x90\xf4\xff",
+    ":method: GET\n"
+    ":scheme: http\n"
+    ":path: /\n"
+    ":authority: www.example.com\n"
+  },
+  { 0, 12,
+    "\x82\x86\x84\xbeX\x86\xa8\xeb\x10" "d\x9c\xbf",
+    ":method: GET\n"
+    ":scheme: http\n"
+    ":path: /\n"
+    ":authority: www.example.com\n"
+    "cache-control: no-cache\n"
+  },
+  { 0, 24,
+    "\x82\x87\x85\xbf@\x88%\xa8I\xe9[\xa9}\x7f\x89%\xa8I\xe9[\xb8"
+    "\xe8\xb4\xbf",
+    ":method: GET\n"
+    ":scheme: https\n"
+    ":path: /index.html\n"
+    ":authority: www.example.com\n"
+    "custom-key: custom-value\n"
+  },
+  { 256, 70,
+    "H\x03" "302X\x07privatea\x1dMon, 21 Oct 2013 20:13:21 GMTn\x17"
+    "https://www.example.com",
+    ":status: 302\n"
+    "cache-control: private\n"
+    "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+    "location: https://www.example.com\n"
+  },
+  { 0, 8,
+    "H\x03" "307\xc1\xc0\xbf",
+    ":status: 307\n"
+    "cache-control: private\n"
+    "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+    "location: https://www.example.com\n"
+  },
+  { 0, 98,
+    "\x88\xc1" "a\x1dMon, 21 Oct 2013 20:13:22 GMT\xc0Z\x04gzipw8"
+    "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1",
+    ":status: 200\n"
+    "cache-control: private\n"
+    "date: Mon, 21 Oct 2013 20:13:22 GMT\n"
+    "location: https://www.example.com\n"
+    "content-encoding: gzip\n"
+    "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n"
+  },
+  { 64, 22,
+    "@\x12x-long-header-name\x01" "a",
+    "x-long-header-name: a\n"
+  },
+  { 0, 3,
+    "~\x01" "b",
+    "x-long-header-name: b\n"
+  },
+  { 0, 1,
+    "\xbe",
+    "x-long-header-name: b\n"
+  },
+};
+
+
+static void
+hpack_test_cb(void *opaque, const char *name, const char *value)
+{
+  htsbuf_qprintf(opaque, "%s: %s\n", name, value);
+}
+
+
+static void
+hpack_bench(void)
+{
+  const int num_blocks = sizeof(hpack_test_blocks) /
+    sizeof(hpack_test_blocks[0]);
+  hpack_decoder_t hd;
+  htsbuf_queue_t hq;
+  int ok = 0;
+
+  htsbuf_queue_init(&hq, 0);
+  hpack_decoder_init(&hd, 4096);
+
+  for(int i = 0; i < num_blocks; i++) {
+    if(hpack_test_blocks[i].new_decoder) {
+      hpack_decoder_free(&hd);
+      hpack_decoder_init(&hd, hpack_test_blocks[i].new_decoder);
+    }
+
+    int r = hpack_decode(&hd, (const uint8_t *)hpack_test_blocks[i].data,
+                         hpack_test_blocks[i].len, hpack_test_cb, &hq);
+    char *headers = htsbuf_to_string(&hq);
+
+    if(!r && !strcmp(headers, hpack_test_blocks[i].headers)) {
+      ok++;
+    } else {
+      TRACE(TRACE_ERROR, "bench", "hpack: Block %d decoded to:\n%s",
+            i, headers);
+    }
+    free(headers);
+  }
+  hpack_decoder_free(&hd);
+
+  TRACE(TRACE_INFO, "bench", "hpack: %d/%d test blocks OK", ok, num_blocks);
+
+  const int rounds = 100000;
+  size_t bytes = 0;
+  int64_t ts = arch_get_ts();
+
+  for(int j = 0; j < rounds; j++) {
+    for(int i = 0; i < num_blocks; i++) {
+      if(hpack_test_blocks[i].new_decoder) {
+        hpack_decoder_free(&hd);
+        hpack_decoder_init(&hd, hpack_test_blocks[i].new_decoder);
+      }
+      hpack_decode(&hd, (const uint8_t *)hpack_test_blocks[i].data,
+                   hpack_test_blocks[i].len, hpack_test_cb, &hq);
+      bytes += hpack_test_blocks[i].len;
+      htsbuf_queue_flush(&hq);
+    }
+  }
+  ts = arch_get_ts() - ts;
+  hpack_decoder_free(&hd);
+
+  TRACE(TRACE_INFO, "bench", "hpack: Decoded %d header blocks, %.1f MB/s",
+        rounds * num_blocks, (double)bytes / ts);
+}
+
+BENCHMARK("hpack", hpack_bench);
+#endif
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct htsbuf_queue;
+
+/**
+ * HPACK (RFC 7541) header compression for HTTP/2
+ */
+
+typedef struct hpack_entry hpack_entry_t;
+
+typedef struct hpack_decoder {
+  hpack_entry_t **hd_entries;   // Dynamic table, newest entry first
+  int hd_num_entries;
+  int hd_capacity;
+  size_t hd_size;               // Size as defined by RFC 7541 section 4.1
+  size_t hd_max_size;           // Current max size (from size updates)
+  size_t hd_max_size_limit;     // What we've advertised in SETTINGS
+} hpack_decoder_t;
+
+typedef void (hpack_header_cb_t)(void *opaque,
+                                 const char *name, const char *value);
+
+void hpack_decoder_init(hpack_decoder_t *hd, size_t max_size);
+
+void hpack_decoder_free(hpack_decoder_t *hd);
+
+/**
+ * Decode a complete header block. The callback is invoked for each
+ * header field in order.
+ *
+ * Returns 0 on success, -1 on compression error (which is fatal for
+ * the connection as the dynamic table is out of sync)
+ */
+int hpack_decode(hpack_decoder_t *hd, const uint8_t *data, size_t len,
+                 hpack_header_cb_t *cb, void *opaque);
+
+/**
+ * Encode a header field. We never insert anything into the peer's
+ * dynamic table, so the encoder is stateless. Name must be lowercase
+ */
+void hpack_encode(struct htsbuf_queue *q, const char *name, const char *value);
@@ -0,0 +1,1610 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+
+#include "main.h"
+#include "arch/threads.h"
+#include "arch/atomic.h"
+#include "misc/queue.h"
+#include "misc/minmax.h"
+#include "misc/bytestream.h"
+#include "misc/str.h"
+#include "net_i.h"
+#include "hpack.h"
+#include "http2.h"
+
+#define H2_FRAME_DATA          0x0
+#define H2_FRAME_HEADERS       0x1
+#define H2_FRAME_PRIORITY      0x2
+#define H2_FRAME_RST_STREAM    0x3
+#define H2_FRAME_SETTINGS      0x4
+#define H2_FRAME_PUSH_PROMISE  0x5
+#define H2_FRAME_PING          0x6
+#define H2_FRAME_GOAWAY        0x7
+#define H2_FRAME_WINDOW_UPDATE 0x8
+#define H2_FRAME_CONTINUATION  0x9
+
+#define H2_FLAG_END_STREAM  0x1
+#define H2_FLAG_ACK         0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED      0x8
+#define H2_FLAG_PRIORITY    0x20
+
+#define H2_SETTINGS_HEADER_TABLE_SIZE      0x1
+#define H2_SETTINGS_ENABLE_PUSH            0x2
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE    0x4
+#define H2_SETTINGS_MAX_FRAME_SIZE         0x5
+
+#define H2_NO_ERROR          0x0
+#define H2_PROTOCOL_ERROR    0x1
+#define H2_FLOW_CONTROL_ERROR 0x3
+#define H2_FRAME_SIZE_ERROR  0x6
+#define H2_CANCEL            0x8
+#define H2_COMPRESSION_ERROR 0x9
+
+#define H2_DEFAULT_WINDOW     65535
+#define H2_STREAM_WINDOW      (1024 * 1024)     // What we advertise per stream
+#define H2_CONN_WINDOW        (8 * 1024 * 1024) // .. and for the connection
+#define H2_MAX_FRAME_SIZE     16384
+#define H2_HEADER_TABLE_SIZE  4096
+#define H2_MAX_HEADER_BLOCK   (256 * 1024)
+
+/**
+ * Leaves room for a full frame plus a full TLS record on each read
+ */
+#define H2_RXBUF_SIZE (64 * 1024)
+
+/**
+ * Don't retry HTTP/2 for hosts that negotiated something else for
+ * this many seconds
+ */
+#define H2_NEGATIVE_CACHE_TIME 600
+
+
+LIST_HEAD(http2_host_list, http2_host);
+LIST_HEAD(http2_stream_list, http2_stream);
+
+struct http2_session;
+
+/**
+ * One per host:port we've connected to. Never freed
+ *
+ * Protected by http2_mutex
+ */
+typedef struct http2_host {
+  LIST_ENTRY(http2_host) hh_link;
+  char *hh_hostname;
+  int hh_port;
+  int hh_flags;
+
+  char hh_connecting;
+  time_t hh_no_h2;
+
+  struct http2_session *hh_session;
+
+} http2_host_t;
+
+
+/**
+ * A HTTP/2 connection. The session thread is the only one touching
+ * the socket. Everybody else talk to it via hs_txq (and kick it via
+ * the pipe)
+ */
+typedef struct http2_session {
+  atomic_t hs_refcount;
+  http2_host_t *hs_host;
+  tcpcon_t *hs_tc;
+  int hs_id;
+  int hs_pipe[2];
+
+  hts_mutex_t hs_mutex;
+  hts_cond_t hs_cond;
+
+  // Everything below is protected by hs_mutex
+
+  htsbuf_queue_t hs_txq;
+  char hs_kicked;
+  char hs_dead;      // Connection lost
+  char hs_goaway;    // No new streams may be created
+  char hs_debug;
+
+  int hs_users;      // Number of http2_stream_t attached
+
+  struct http2_stream_list hs_streams;  // Streams with open exchange
+  int hs_num_streams;
+  uint32_t hs_next_stream_id;
+
+  // Peer settings
+  int hs_max_streams;
+  int hs_max_frame_size;
+  int32_t hs_initial_send_window;
+
+  int32_t hs_send_window;
+  int hs_recv_unacked;
+
+  hpack_decoder_t hs_hpack;
+
+  // Header block being assembled (HEADERS + CONTINUATION)
+  uint32_t hs_hdr_stream;
+  int hs_hdr_flags;
+  uint8_t *hs_hdr_buf;
+  size_t hs_hdr_len;
+
+} http2_session_t;
+
+
+/**
+ * A stream as seen by the HTTP client. Looks like a tcpcon_t
+ */
+typedef struct http2_stream {
+  tcpcon_t st_tc;  // Must be first
+  http2_session_t *st_session;
+
+  LIST_ENTRY(http2_stream) st_link;
+  uint32_t st_id;  // Non-zero when linked in hs_streams
+
+  // Request
+  char *st_reqbuf;
+  size_t st_reqlen;
+  int64_t st_body_remain;
+  int32_t st_send_window;
+  char st_head;
+
+  // Response
+  htsbuf_queue_t st_rxq;
+  int st_rx_unconsumed;
+  int st_rx_consumed;
+  int st_read_timeout;
+
+  char st_got_headers;
+  char st_chunked;
+  char st_eos;
+  char st_reset;
+  char st_shutdown;
+
+} http2_stream_t;
+
+
+static hts_mutex_t http2_mutex;
+static hts_cond_t http2_cond;
+static struct http2_host_list http2_hosts;
+static atomic_t http2_session_tally;
+
+#define H2_TRACE(hs, x, ...) do {                                       \
+    if((hs)->hs_debug)                                                  \
+      TRACE(TRACE_DEBUG, "HTTP2", "%s:%d (sid=%d) " x,                  \
+            (hs)->hs_host->hh_hostname, (hs)->hs_host->hh_port,         \
+            (hs)->hs_id, ##__VA_ARGS__);                                \
+  } while(0)
+
+
+/**
+ *
+ */
+static void
+http2_frame_hdr(htsbuf_queue_t *q, int len, int type, int flags,
+                uint32_t stream_id)
+{
+  uint8_t hdr[9];
+  hdr[0] = len >> 16;
+  hdr[1] = len >> 8;
+  hdr[2] = len;
+  hdr[3] = type;
+  hdr[4] = flags;
+  wr32_be(hdr + 5, stream_id);
+  htsbuf_append(q, hdr, 9);
+}
+
+
+/**
+ *
+ */
+static void
+http2_send_u32(http2_session_t *hs, int type, uint32_t stream_id,
+               uint32_t value)
+{
+  uint8_t buf[4];
+  wr32_be(buf, value);
+  http2_frame_hdr(&hs->hs_txq, 4, type, 0, stream_id);
+  htsbuf_append(&hs->hs_txq, buf, 4);
+}
+
+
+/**
+ *
+ */
+static void
+http2_send_goaway(http2_session_t *hs, uint32_t error)
+{
+  uint8_t buf[8];
+  wr32_be(buf, 0);  // We never accept any streams from the server
+  wr32_be(buf + 4, error);
+  http2_frame_hdr(&hs->hs_txq, 8, H2_FRAME_GOAWAY, 0, 0);
+  htsbuf_append(&hs->hs_txq, buf, 8);
+}
+
+
+/**
+ * Wake up session thread. hs_mutex must be held
+ */
+static void
+http2_kick(http2_session_t *hs)
+{
+  if(hs->hs_kicked)
+    return;
+  hs->hs_kicked = 1;
+  if(write(hs->hs_pipe[1], "", 1) != 1) {}
+}
+
+
+/**
+ *
+ */
+static void
+http2_session_release(http2_session_t *hs)
+{
+  if(atomic_dec(&hs->hs_refcount))
+    return;
+
+  hpack_decoder_free(&hs->hs_hpack);
+  htsbuf_queue_flush(&hs->hs_txq);
+  free(hs->hs_hdr_buf);
+  hts_cond_destroy(&hs->hs_cond);
+  hts_mutex_destroy(&hs->hs_mutex);
+  free(hs);
+}
+
+
+/**
+ *
+ */
+static http2_stream_t *
+http2_stream_find(http2_session_t *hs, uint32_t id)
+{
+  http2_stream_t *st;
+  LIST_FOREACH(st, &hs->hs_streams, st_link)
+    if(st->st_id == id)
+      return st;
+  return NULL;
+}
+
+
+/**
+ * Exchange is over (from the protocol's point of view)
+ */
+static void
+http2_stream_unlink(http2_session_t *hs, http2_stream_t *st)
+{
+  if(st->st_id == 0)
+    return;
+  LIST_REMOVE(st, st_link);
+  hs->hs_num_streams--;
+  st->st_id = 0;
+  hts_cond_broadcast(&hs->hs_cond);
+}
+
+
+/**
+ *
+ */
+static void
+http2_stream_abort(http2_session_t *hs, http2_stream_t *st, uint32_t error)
+{
+  if(st->st_id == 0)
+    return;
+  http2_send_u32(hs, H2_FRAME_RST_STREAM, st->st_id, error);
+  http2_stream_unlink(hs, st);
+  http2_kick(hs);
+}
+
+
+/**
+ *
+ */
+static void
+http2_stream_finish(http2_session_t *hs, http2_stream_t *st)
+{
+  if(st->st_chunked)
+    htsbuf_append(&st->st_rxq, "0\r\n\r\n", 5);
+  st->st_eos = 1;
+  http2_stream_unlink(hs, st);
+}
+
+
+/**
+ * Response header translation
+ */
+typedef struct http2_header_ctx {
+  htsbuf_queue_t q;
+  int status;
+  int has_content_length;
+} http2_header_ctx_t;
+
+
+/**
+ *
+ */
+static void
+http2_header_cb(void *opaque, const char *name, const char *value)
+{
+  http2_header_ctx_t *ctx = opaque;
+
+  if(name[0] == ':') {
+    if(!strcmp(name, ":status"))
+      ctx->status = atoi(value);
+    return;
+  }
+
+  if(!strcmp(name, "connection") ||
+     !strcmp(name, "keep-alive") ||
+     !strcmp(name, "transfer-encoding"))
+    return;
+
+  if(!strcmp(name, "content-length"))
+    ctx->has_content_length = 1;
+
+  // Content-Type style capitalization
+  char tmp[128];
+  snprintf(tmp, sizeof(tmp), "%s", name);
+  int upper = 1;
+  for(char *s = tmp; *s; s++) {
+    if(upper && *s >= 'a' && *s <= 'z')
+      *s -= 32;
+    upper = *s == '-';
+  }
+  htsbuf_qprintf(&ctx->q, "%s: %s\r\n", tmp, value);
+}
+
+
+/**
+ *
+ */
+static int
+http2_headers_complete(http2_session_t *hs)
+{
+  http2_stream_t *st = http2_stream_find(hs, hs->hs_hdr_stream);
+  const int flags = hs->hs_hdr_flags;
+  http2_header_ctx_t ctx = {};
+
+  htsbuf_queue_init(&ctx.q, 0);
+
+  // Must always decode to keep the dynamic table in sync
+  int r = hpack_decode(&hs->hs_hpack, hs->hs_hdr_buf, hs->hs_hdr_len,
+                       http2_header_cb, &ctx);
+
+  hs->hs_hdr_stream = 0;
+  hs->hs_hdr_len = 0;
+
+  if(r) {
+    htsbuf_queue_flush(&ctx.q);
+    return H2_COMPRESSION_ERROR;
+  }
+
+  if(st == NULL) {
+    htsbuf_queue_flush(&ctx.q);
+    return 0;
+  }
+
+  if(!st->st_got_headers) {
+
+    if(ctx.status == 0) {
+      htsbuf_queue_flush(&ctx.q);
+      http2_stream_abort(hs, st, H2_PROTOCOL_ERROR);
+      st->st_reset = 1;
+      return 0;
+    }
+
+    if(ctx.status < 200) {
+      // Informational response, wait for the real one
+      htsbuf_queue_flush(&ctx.q);
+      return 0;
+    }
+
+    st->st_got_headers = 1;
+    htsbuf_qprintf(&st->st_rxq, "HTTP/1.1 %d\r\n", ctx.status);
+    htsbuf_appendq(&st->st_rxq, &ctx.q);
+
+    if(!ctx.has_content_length && !st->st_head &&
+       ctx.status != 204 && ctx.status != 304) {
+      if(flags & H2_FLAG_END_STREAM) {
+        htsbuf_qprintf(&st->st_rxq, "Content-Length: 0\r\n");
+      } else {
+        htsbuf_qprintf(&st->st_rxq, "Transfer-Encoding: chunked\r\n");
+        st->st_chunked = 1;
+      }
+    }
+    htsbuf_append(&st->st_rxq, "\r\n", 2);
+
+  } else {
+    // Trailers
+    htsbuf_queue_flush(&ctx.q);
+  }
+
+  if(flags & H2_FLAG_END_STREAM)
+    http2_stream_finish(hs, st);
+
+  hts_cond_broadcast(&hs->hs_cond);
+  return 0;
+}
+
+
+/**
+ *
+ */
+static int
+http2_header_block_append(http2_session_t *hs, const uint8_t *data, int len)
+{
+  if(hs->hs_hdr_len + len > H2_MAX_HEADER_BLOCK)
+    return -1;
+  hs->hs_hdr_buf = realloc(hs->hs_hdr_buf, hs->hs_hdr_len + len);
+  memcpy(hs->hs_hdr_buf + hs->hs_hdr_len, data, len);
+  hs->hs_hdr_len += len;
+  return 0;
+}
+
+
+/**
+ * Strip padding (and priority fields for HEADERS)
+ */
+static int
+http2_strip_padding(const uint8_t **pp, int *lenp, int flags, int prio)
+{
+  const uint8_t *p = *pp;
+  int len = *lenp;
+  int padlen = 0;
+
+  if(flags & H2_FLAG_PADDED) {
+    if(len < 1)
+      return -1;
+    padlen = p[0];
+    p++;
+    len--;
+  }
+
+  if(prio && flags & H2_FLAG_PRIORITY) {
+    if(len < 5)
+      return -1;
+    p += 5;
+    len -= 5;
+  }
+
+  if(padlen > len)
+    return -1;
+
+  *pp = p;
+  *lenp = len - padlen;
+  return 0;
+}
+
+
+/**
+ *
+ */
+static int
+http2_data_input(http2_session_t *hs, uint32_t id, int flags,
+                 const uint8_t *p, int len)
+{
+  if(id == 0)
+    return H2_PROTOCOL_ERROR;
+
+  // Entire payload counts for flow control, connection window is
+  // credited right away. Streams are credited as the reader consumes data
+  hs->hs_recv_unacked += len;
+  if(hs->hs_recv_unacked >= H2_CONN_WINDOW / 2) {
+    http2_send_u32(hs, H2_FRAME_WINDOW_UPDATE, 0, hs->hs_recv_unacked);
+    hs->hs_recv_unacked = 0;
+  }
+
+  const int framelen = len;
+  if(http2_strip_padding(&p, &len, flags, 0))
+    return H2_PROTOCOL_ERROR;
+
+  http2_stream_t *st = http2_stream_find(hs, id);
+  if(st == NULL || !st->st_got_headers)
+    return 0;
+
+  st->st_rx_unconsumed += len;
+  st->st_rx_consumed += framelen - len;
+
+  if(len > 0) {
+    if(st->st_chunked) {
+      htsbuf_qprintf(&st->st_rxq, "%x\r\n", len);
+      htsbuf_append(&st->st_rxq, p, len);
+      htsbuf_append(&st->st_rxq, "\r\n", 2);
+    } else {
+      htsbuf_append(&st->st_rxq, p, len);
+    }
+  }
+
+  if(flags & H2_FLAG_END_STREAM)
+    http2_stream_finish(hs, st);
+
+  hts_cond_broadcast(&hs->hs_cond);
+  return 0;
+}
+
+
+/**
+ *
+ */
+static int
+http2_settings_input(http2_session_t *hs, int flags, const uint8_t *p,
+                     int len)
+{
+  http2_stream_t *st;
+
+  if(flags & H2_FLAG_ACK)
+    return 0;
+
+  if(len % 6)
+    return H2_FRAME_SIZE_ERROR;
+
+  for(; len > 0; p += 6, len -= 6) {
+    const int id = (p[0] << 8) | p[1];
+    const uint32_t v = rd32_be(p + 2);
+
+    switch(id) {
+    case H2_SETTINGS_MAX_CONCURRENT_STREAMS:
+      hs->hs_max_streams = MIN(v, 1000);
+      break;
+
+    case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+      if(v > 0x7fffffff)
+        return H2_FLOW_CONTROL_ERROR;
+      LIST_FOREACH(st, &hs->hs_streams, st_link)
+        st->st_send_window += v - hs->hs_initial_send_window;
+      hs->hs_initial_send_window = v;
+      break;
+
+    case H2_SETTINGS_MAX_FRAME_SIZE:
+      if(v < 16384 || v > 16777215)
+        return H2_PROTOCOL_ERROR;
+      hs->hs_max_frame_size = v;
+      break;
+    }
+  }
+
+  http2_frame_hdr(&hs->hs_txq, 0, H2_FRAME_SETTINGS, H2_FLAG_ACK, 0);
+  hts_cond_broadcast(&hs->hs_cond);
+  return 0;
+}
+
+
+/**
+ * Returns HTTP/2 error code on connection errors
+ */
+static int
+http2_frame_input(http2_session_t *hs, const uint8_t *hdr)
+{
+  int len = (hdr[0] << 16) | (hdr[1] << 8) | hdr[2];
+  const int type = hdr[3];
+  const int flags = hdr[4];
+  const uint32_t id = rd32_be(hdr + 5) & 0x7fffffff;
+  const uint8_t *p = hdr + 9;
+  http2_stream_t *st;
+  uint32_t v;
+
+  if(hs->hs_hdr_stream && type != H2_FRAME_CONTINUATION)
+    return H2_PROTOCOL_ERROR;
+
+  switch(type) {
+  case H2_FRAME_DATA:
+    return http2_data_input(hs, id, flags, p, len);
+
+  case H2_FRAME_HEADERS:
+    if(id == 0 || http2_strip_padding(&p, &len, flags, 1))
+      return H2_PROTOCOL_ERROR;
+    hs->hs_hdr_stream = id;
+    hs->hs_hdr_flags = flags;
+    hs->hs_hdr_len = 0;
+    // FALLTHRU
+  case H2_FRAME_CONTINUATION:
+    if(id == 0 || id != hs->hs_hdr_stream)
+      return H2_PROTOCOL_ERROR;
+    if(http2_header_block_append(hs, p, len))
+      return H2_PROTOCOL_ERROR;
+    if(flags & H2_FLAG_END_HEADERS)
+      return http2_headers_complete(hs);
+    return 0;
+
+  case H2_FRAME_RST_STREAM:
+    if(len != 4)
+      return H2_FRAME_SIZE_ERROR;
+    if((st = http2_stream_find(hs, id)) != NULL) {
+      H2_TRACE(hs, "Stream %d reset by peer, error %d", id, rd32_be(p));
+      st->st_reset = 1;
+      http2_stream_unlink(hs, st);
+    }
+    return 0;
+
+  case H2_FRAME_SETTINGS:
+    if(id != 0)
+      return H2_PROTOCOL_ERROR;
+    return http2_settings_input(hs, flags, p, len);
+
+  case H2_FRAME_PUSH_PROMISE:
+    return H2_PROTOCOL_ERROR; // We've disabled push
+
+  case H2_FRAME_PING:
+    if(len != 8)
+      return H2_FRAME_SIZE_ERROR;
+    if(!(flags & H2_FLAG_ACK)) {
+      http2_frame_hdr(&hs->hs_txq, 8, H2_FRAME_PING, H2_FLAG_ACK, 0);
+      htsbuf_append(&hs->hs_txq, p, 8);
+    }
+    return 0;
+
+  case H2_FRAME_GOAWAY:
+    if(len < 8)
+      return H2_FRAME_SIZE_ERROR;
+    v = rd32_be(p) & 0x7fffffff;
+    H2_TRACE(hs, "GOAWAY received, last stream %d, error %d",
+             v, rd32_be(p + 4));
+    hs->hs_goaway = 1;
+    // Streams above last stream id were never processed
+    http2_stream_t *next;
+    for(st = LIST_FIRST(&hs->hs_streams); st != NULL; st = next) {
+      next = LIST_NEXT(st, st_link);
+      if(st->st_id > v) {
+        st->st_reset = 1;
+        http2_stream_unlink(hs, st);
+      }
+    }
+    hts_cond_broadcast(&hs->hs_cond);
+    return 0;
+
+  case H2_FRAME_WINDOW_UPDATE:
+    if(len != 4)
+      return H2_FRAME_SIZE_ERROR;
+    v = rd32_be(p) & 0x7fffffff;
+    if(id == 0) {
+      if(v == 0 || (int64_t)hs->hs_send_window + v > 0x7fffffff)
+        return H2_FLOW_CONTROL_ERROR;
+      hs->hs_send_window += v;
+    } else if((st = http2_stream_find(hs, id)) != NULL) {
+      st->st_send_window += v;
+    }
+    hts_cond_broadcast(&hs->hs_cond);
+    return 0;
+
+  default:
+    // PRIORITY and unknown frames are ignored
+    return 0;
+  }
+}
+
+
+/**
+ * Write everything in q, returns 0 if OK
+ */
+static int
+http2_write_queue(tcpcon_t *tc, htsbuf_queue_t *q)
+{
+  htsbuf_data_t *hd;
+  int r = 0;
+
+  while((hd = TAILQ_FIRST(&q->hq_q)) != NULL) {
+    if(!r)
+      r = tc->write(tc, hd->hd_data + hd->hd_data_off,
+                    hd->hd_data_len - hd->hd_data_off);
+    htsbuf_data_free(q, hd);
+  }
+  q->hq_size = 0;
+  return r;
+}
+
+
+/**
+ *
+ */
+static void *
+http2_session_thread(void *aux)
+{
+  http2_session_t *hs = aux;
+  tcpcon_t *tc = hs->hs_tc;
+  uint8_t *rxbuf = malloc(H2_RXBUF_SIZE);
+  size_t rxlen = 0;
+  htsbuf_queue_t txq;
+  struct pollfd fds[2];
+  int write_error = 0;
+  char tmp[64];
+
+  htsbuf_queue_init(&txq, 0);
+
+  hts_mutex_lock(&hs->hs_mutex);
+
+  while(!hs->hs_dead) {
+
+    if(hs->hs_txq.hq_size) {
+      htsbuf_appendq(&txq, &hs->hs_txq);
+      hts_mutex_unlock(&hs->hs_mutex);
+      write_error = http2_write_queue(tc, &txq);
+      hts_mutex_lock(&hs->hs_mutex);
+      if(write_error) {
+        H2_TRACE(hs, "Write error");
+        break;
+      }
+      continue;
+    }
+
+    if(hs->hs_users == 0) {
+      H2_TRACE(hs, "No more users, closing");
+      http2_send_goaway(hs, H2_NO_ERROR);
+      break;
+    }
+
+    hts_mutex_unlock(&hs->hs_mutex);
+
+    if(tcp_read_pending(tc) == 0) {
+      fds[0].fd = tcp_get_fd(tc);
+      fds[0].events = POLLIN;
+      fds[1].fd = hs->hs_pipe[0];
+      fds[1].events = POLLIN;
+
+      if(poll(fds, 2, -1) < 0 && errno != EINTR) {
+        hts_mutex_lock(&hs->hs_mutex);
+        break;
+      }
+
+      if(fds[1].revents & POLLIN) {
+        if(read(hs->hs_pipe[0], tmp, sizeof(tmp)) < 0) {}
+        hts_mutex_lock(&hs->hs_mutex);
+        hs->hs_kicked = 0;
+        continue;
+      }
+
+      if(!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+        hts_mutex_lock(&hs->hs_mutex);
+        continue;
+      }
+    }
+
+    int r = tcp_read_data_nowait(tc, (char *)rxbuf + rxlen,
+                                 H2_RXBUF_SIZE - rxlen);
+
+    hts_mutex_lock(&hs->hs_mutex);
+
+    if(r <= 0) {
+      H2_TRACE(hs, "Connection lost");
+      break;
+    }
+
+    rxlen += r;
+
+    size_t off = 0;
+    int err = 0;
+    while(rxlen - off >= 9) {
+      const uint8_t *hdr = rxbuf + off;
+      const int len = (hdr[0] << 16) | (hdr[1] << 8) | hdr[2];
+      if(len > H2_MAX_FRAME_SIZE) {
+        err = H2_FRAME_SIZE_ERROR;
+        break;
+      }
+      if(rxlen - off < 9 + len)
+        break;
+
+      if((err = http2_frame_input(hs, hdr)) != 0)
+        break;
+      off += 9 + len;
+    }
+
+    if(err) {
+      TRACE(TRACE_ERROR, "HTTP2", "%s:%d protocol error %d, disconnecting",
+            hs->hs_host->hh_hostname, hs->hs_host->hh_port, err);
+      http2_send_goaway(hs, err);
+      break;
+    }
+
+    memmove(rxbuf, rxbuf + off, rxlen - off);
+    rxlen -= off;
+  }
+
+  hs->hs_dead = 1;
+
+  http2_stream_t *st;
+  while((st = LIST_FIRST(&hs->hs_streams)) != NULL) {
+    st->st_reset = 1;
+    http2_stream_unlink(hs, st);
+  }
+  hts_cond_broadcast(&hs->hs_cond);
+
+  htsbuf_appendq(&txq, &hs->hs_txq);
+  hts_mutex_unlock(&hs->hs_mutex);
+
+  if(!write_error)
+    http2_write_queue(tc, &txq);
+  htsbuf_queue_flush(&txq);
+
+  hts_mutex_lock(&http2_mutex);
+  if(hs->hs_host->hh_session == hs)
+    hs->hs_host->hh_session = NULL;
+  hts_mutex_unlock(&http2_mutex);
+
+  H2_TRACE(hs, "Session closed");
+
+  tcp_close(tc);
+  close(hs->hs_pipe[0]);
+  close(hs->hs_pipe[1]);
+  free(rxbuf);
+  http2_session_release(hs);
+  return NULL;
+}
+
+
+/**
+ * Called with hs_mutex held
+ */
+static void
+http2_stream_consumed(http2_session_t *hs, http2_stream_t *st, int bytes)
+{
+  const int c = MIN(bytes, st->st_rx_unconsumed);
+  st->st_rx_unconsumed -= c;
+  st->st_rx_consumed += c;
+
+  if(st->st_rx_consumed >= H2_STREAM_WINDOW / 2) {
+    if(st->st_id && !st->st_eos) {
+      http2_send_u32(hs, H2_FRAME_WINDOW_UPDATE, st->st_id,
+                     st->st_rx_consumed);
+      http2_kick(hs);
+    }
+    st->st_rx_consumed = 0;
+  }
+}
+
+
+/**
+ *
+ */
+static int
+http2_stream_read(tcpcon_t *tc, void *buf, size_t len, int all,
+                  net_read_cb_t *cb, void *opaque)
+{
+  http2_stream_t *st = (http2_stream_t *)tc;
+  http2_session_t *hs = st->st_session;
+  const int64_t deadline =
+    st->st_read_timeout ? arch_get_ts() + st->st_read_timeout * 1000LL : 0;
+  size_t got = 0;
+
+  hts_mutex_lock(&hs->hs_mutex);
+
+  while(1) {
+
+    if(st->st_rxq.hq_size) {
+      int n = htsbuf_read(&st->st_rxq, buf + got, len - got);
+      got += n;
+      http2_stream_consumed(hs, st, n);
+
+      if(!all || got == len)
+        break;
+
+      if(cb != NULL) {
+        hts_mutex_unlock(&hs->hs_mutex);
+        cb(opaque, got);
+        hts_mutex_lock(&hs->hs_mutex);
+      }
+      continue;
+    }
+
+    if(st->st_id == 0 || st->st_shutdown)
+      break; // Response complete, reset or no request in progress
+
+    if(deadline) {
+      if(hts_cond_wait_timeout_abs(&hs->hs_cond, &hs->hs_mutex, deadline))
+        break;
+    } else {
+      hts_cond_wait(&hs->hs_cond, &hs->hs_mutex);
+    }
+  }
+
+  hts_mutex_unlock(&hs->hs_mutex);
+
+  if(got == 0 || (all && got != len))
+    return -1;
+  return got;
+}
+
+
+/**
+ * Send request body. Called with hs_mutex held
+ */
+static int
+http2_stream_send_body(http2_session_t *hs, http2_stream_t *st,
+                       const uint8_t *data, size_t len)
+{
+  while(len > 0) {
+
+    if(st->st_id == 0 || st->st_shutdown || hs->hs_dead)
+      return ECONNRESET;
+
+    const int window = MIN(st->st_send_window, hs->hs_send_window);
+
+    if(window <= 0) {
+      hts_cond_wait(&hs->hs_cond, &hs->hs_mutex);
+      continue;
+    }
+
+    const int n = MIN(MIN(len, window),
+                      MIN(hs->hs_max_frame_size, st->st_body_remain));
+    st->st_body_remain -= n;
+    st->st_send_window -= n;
+    hs->hs_send_window -= n;
+
+    http2_frame_hdr(&hs->hs_txq, n, H2_FRAME_DATA,
+                    st->st_body_remain ? 0 : H2_FLAG_END_STREAM, st->st_id);
+    htsbuf_append(&hs->hs_txq, data, n);
+    http2_kick(hs);
+
+    data += n;
+    len -= n;
+
+    if(st->st_body_remain == 0)
+      break; // Excess data is silently dropped
+  }
+  return 0;
+}
+
+
+/**
+ * Translate a HTTP/1.1 request header into HEADERS frame(s) and open
+ * a new stream. Called with hs_mutex held
+ */
+static int
+http2_stream_start(http2_session_t *hs, http2_stream_t *st, char *req)
+{
+  char *lines[128];
+  int num_lines = 0;
+  const char *authority = st->st_session->hs_host->hh_hostname;
+  int64_t content_length = 0;
+  char *s, *saveptr;
+
+  for(s = strtok_r(req, "\r\n", &saveptr); s != NULL && num_lines < 128;
+      s = strtok_r(NULL, "\r\n", &saveptr))
+    lines[num_lines++] = s;
+
+  if(num_lines == 0)
+    return -1;
+
+  char *method = lines[0];
+  char *path = strchr(method, ' ');
+  if(path == NULL)
+    return -1;
+  *path++ = 0;
+  char *x = strchr(path, ' ');
+  if(x != NULL)
+    *x = 0;
+
+  htsbuf_queue_t hdrs;
+  htsbuf_queue_init(&hdrs, 0);
+
+  for(int i = 1; i < num_lines; i++) {
+    char *name = lines[i];
+    char *value = strchr(name, ':');
+    if(value == NULL)
+      continue;
+    *value++ = 0;
+    while(*value == ' ')
+      value++;
+
+    for(s = name; *s; s++)
+      if(*s >= 'A' && *s <= 'Z')
+        *s += 32;
+
+    if(!strcmp(name, "host")) {
+      authority = value;
+      continue;
+    }
+
+    if(!strcmp(name, "connection") ||
+       !strcmp(name, "keep-alive") ||
+       !strcmp(name, "proxy-connection") ||
+       !strcmp(name, "transfer-encoding") ||
+       !strcmp(name, "upgrade") ||
+       !strcmp(name, "te"))
+      continue;
+
+    if(!strcmp(name, "content-length"))
+      content_length = strtoll(value, NULL, 10);
+
+    hpack_encode(&hdrs, name, value);
+  }
+
+  // Wait for a free stream slot
+
+  while(hs->hs_num_streams >= hs->hs_max_streams &&
+        !hs->hs_dead && !hs->hs_goaway && !st->st_shutdown)
+    hts_cond_wait(&hs->hs_cond, &hs->hs_mutex);
+
+  if(hs->hs_next_stream_id > 0x7fffffff)
+    hs->hs_goaway = 1; // Stream ids exhausted, session must be replaced
+
+  // A shut down stream only fails itself, the session is still usable
+  if(hs->hs_dead || hs->hs_goaway || st->st_shutdown) {
+    htsbuf_queue_flush(&hdrs);
+    return -1;
+  }
+
+  htsbuf_queue_t block;
+  htsbuf_queue_init(&block, 0);
+  hpack_encode(&block, ":method", method);
+  hpack_encode(&block, ":scheme", "https");
+  hpack_encode(&block, ":authority", authority);
+  hpack_encode(&block, ":path", path);
+  htsbuf_appendq(&block, &hdrs);
+
+  st->st_id = hs->hs_next_stream_id;
+  hs->hs_next_stream_id += 2;
+  LIST_INSERT_HEAD(&hs->hs_streams, st, st_link);
+  hs->hs_num_streams++;
+
+  st->st_head = !strcmp(method, "HEAD");
+  st->st_body_remain = content_length;
+  st->st_send_window = hs->hs_initial_send_window;
+  st->st_got_headers = 0;
+  st->st_chunked = 0;
+  st->st_eos = 0;
+  st->st_reset = 0;
+  st->st_rx_unconsumed = 0;
+  st->st_rx_consumed = 0;
+  // Drop whatever the caller did not read of the previous response
+  htsbuf_queue_flush(&st->st_rxq);
+  htsbuf_queue_flush(&st->st_tc.spill);
+
+  H2_TRACE(hs, "Stream %d: %s %s", st->st_id, method, path);
+
+  // Split header block into HEADERS + CONTINUATION frames
+  int type = H2_FRAME_HEADERS;
+  int flags = content_length ? 0 : H2_FLAG_END_STREAM;
+  do {
+    const int n = MIN(block.hq_size, hs->hs_max_frame_size);
+    const int last = n == block.hq_size;
+    uint8_t *buf = malloc(n);
+    htsbuf_read(&block, buf, n);
+    http2_frame_hdr(&hs->hs_txq, n, type,
+                    flags | (last ? H2_FLAG_END_HEADERS : 0), st->st_id);
+    htsbuf_append_prealloc(&hs->hs_txq, buf, n);
+    type = H2_FRAME_CONTINUATION;
+    flags = 0;
+  } while(block.hq_size);
+
+  http2_kick(hs);
+  return 0;
+}
+
+
+/**
+ *
+ */
+static int
+http2_stream_write(tcpcon_t *tc, const void *data, size_t len)
+{
+  http2_stream_t *st = (http2_stream_t *)tc;
+  http2_session_t *hs = st->st_session;
+  int r = 0;
+
+  hts_mutex_lock(&hs->hs_mutex);
+
+  if(st->st_body_remain) {
+    r = http2_stream_send_body(hs, st, data, len);
+    hts_mutex_unlock(&hs->hs_mutex);
+    return r;
+  }
+
+  const size_t prev = st->st_reqlen;
+  st->st_reqbuf = realloc(st->st_reqbuf, st->st_reqlen + len + 1);
+  memcpy(st->st_reqbuf + st->st_reqlen, data, len);
+  st->st_reqlen += len;
+  st->st_reqbuf[st->st_reqlen] = 0;
+
+  char *end = strstr(st->st_reqbuf + (prev > 3 ? prev - 3 : 0), "\r\n\r\n");
+  if(end != NULL) {
+    // Previous exchange not completed, cancel it
+    if(st->st_id)
+      http2_stream_abort(hs, st, H2_CANCEL);
+
+    const size_t hdrlen = end + 4 - st->st_reqbuf;
+    *end = 0;
+
+    if(http2_stream_start(hs, st, st->st_reqbuf)) {
+      r = ECONNRESET;
+    } else if(st->st_reqlen > hdrlen && st->st_body_remain) {
+      r = http2_stream_send_body(hs, st,
+                                 (const uint8_t *)st->st_reqbuf + hdrlen,
+                                 st->st_reqlen - hdrlen);
+    }
+    free(st->st_reqbuf);
+    st->st_reqbuf = NULL;
+    st->st_reqlen = 0;
+  }
+
+  hts_mutex_unlock(&hs->hs_mutex);
+  return r;
+}
+
+
+/**
+ *
+ */
+static void
+http2_stream_shutdown(tcpcon_t *tc)
+{
+  http2_stream_t *st = (http2_stream_t *)tc;
+  http2_session_t *hs = st->st_session;
+
+  hts_mutex_lock(&hs->hs_mutex);
+  st->st_shutdown = 1;
+  hts_cond_broadcast(&hs->hs_cond);
+  hts_mutex_unlock(&hs->hs_mutex);
+}
+
+
+/**
+ *
+ */
+static void
+http2_stream_set_read_timeout(tcpcon_t *tc, int ms)
+{
+  http2_stream_t *st = (http2_stream_t *)tc;
+  st->st_read_timeout = ms;
+}
+
+
+/**
+ *
+ */
+static void
+http2_stream_close(tcpcon_t *tc)
+{
+  http2_stream_t *st = (http2_stream_t *)tc;
+  http2_session_t *hs = st->st_session;
+
+  hts_mutex_lock(&hs->hs_mutex);
+  if(st->st_id)
+    http2_stream_abort(hs, st, H2_CANCEL);
+  hs->hs_users--;
+  if(hs->hs_users == 0)
+    http2_kick(hs);
+  hts_mutex_unlock(&hs->hs_mutex);
+
+  htsbuf_queue_flush(&st->st_rxq);
+  free(st->st_reqbuf);
+  free(st);
+  http2_session_release(hs);
+}
+
+
+/**
+ * Attach a new stream to the session. Called with http2_mutex held
+ */
+static tcpcon_t *
+http2_stream_create(http2_session_t *hs)
+{
+  hts_mutex_lock(&hs->hs_mutex);
+  if(hs->hs_dead || hs->hs_goaway) {
+    hts_mutex_unlock(&hs->hs_mutex);
+    return NULL;
+  }
+  hs->hs_users++;
+  atomic_inc(&hs->hs_refcount);
+  hts_mutex_unlock(&hs->hs_mutex);
+
+  http2_stream_t *st = calloc(1, sizeof(http2_stream_t));
+  st->st_session = hs;
+  htsbuf_queue_init(&st->st_rxq, 0);
+
+  tcpcon_t *tc = &st->st_tc;
+  tc->fd = -1;
+  htsbuf_queue_init(&tc->spill, 0);
+  tc->read = http2_stream_read;
+  tc->write = http2_stream_write;
+  tc->close = http2_stream_close;
+  tc->shutdown = http2_stream_shutdown;
+  tc->set_read_timeout = http2_stream_set_read_timeout;
+  return tc;
+}
+
+
+/**
+ * Create session for a connection that negotiated h2. The session thread
+ * is started by the caller once the first stream is attached.
+ * Called with http2_mutex held
+ */
+static http2_session_t *
+http2_session_create(http2_host_t *hh, tcpcon_t *tc, int dbg)
+{
+  http2_session_t *hs = calloc(1, sizeof(http2_session_t));
+
+  if(pipe(hs->hs_pipe)) {
+    free(hs);
+    return NULL;
+  }
+
+  atomic_set(&hs->hs_refcount, 1); // Owned by thread
+  hs->hs_host = hh;
+  hs->hs_tc = tc;
+  hs->hs_debug = dbg;
+  hs->hs_id = atomic_add_and_fetch(&http2_session_tally, 1);
+  hts_mutex_init(&hs->hs_mutex);
+  hts_cond_init(&hs->hs_cond, &hs->hs_mutex);
+  htsbuf_queue_init(&hs->hs_txq, 0);
+  hpack_decoder_init(&hs->hs_hpack, H2_HEADER_TABLE_SIZE);
+
+  hs->hs_next_stream_id = 1;
+  hs->hs_max_streams = 100;  // Until peer tells us otherwise
+  hs->hs_max_frame_size = 16384;
+  hs->hs_initial_send_window = H2_DEFAULT_WINDOW;
+  hs->hs_send_window = H2_DEFAULT_WINDOW;
+
+  // Connection preface
+  htsbuf_append(&hs->hs_txq, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+
+  uint8_t settings[12];
+  settings[0] = 0;
+  settings[1] = H2_SETTINGS_ENABLE_PUSH;
+  wr32_be(settings + 2, 0);
+  settings[6] = 0;
+  settings[7] = H2_SETTINGS_INITIAL_WINDOW_SIZE;
+  wr32_be(settings + 8, H2_STREAM_WINDOW);
+  http2_frame_hdr(&hs->hs_txq, sizeof(settings), H2_FRAME_SETTINGS, 0, 0);
+  htsbuf_append(&hs->hs_txq, settings, sizeof(settings));
+
+  http2_send_u32(hs, H2_FRAME_WINDOW_UPDATE, 0,
+                 H2_CONN_WINDOW - H2_DEFAULT_WINDOW);
+
+  tcp_set_cancellable(tc, NULL);
+
+  H2_TRACE(hs, "Session established");
+  return hs;
+}
+
+
+/**
+ * Called with http2_mutex held
+ */
+static http2_host_t *
+http2_host_get(const char *hostname, int port, int flags)
+{
+  http2_host_t *hh;
+
+  LIST_FOREACH(hh, &http2_hosts, hh_link)
+    if(!strcmp(hh->hh_hostname, hostname) && hh->hh_port == port &&
+       hh->hh_flags == flags)
+      return hh;
+
+  hh = calloc(1, sizeof(http2_host_t));
+  hh->hh_hostname = strdup(hostname);
+  hh->hh_port = port;
+  hh->hh_flags = flags;
+  LIST_INSERT_HEAD(&http2_hosts, hh, hh_link);
+  return hh;
+}
+
+
+/**
+ *
+ */
+tcpcon_t *
+http2_connect(const char *hostname, int port, int flags,
+              char *errbuf, size_t errlen, int timeout, cancellable_t *c)
+{
+  tcpcon_t *tc;
+  time_t now;
+
+  hts_mutex_lock(&http2_mutex);
+
+  http2_host_t *hh = http2_host_get(hostname, port, flags & TCP_SSL_VERIFY);
+
+  // If someone else is connecting, wait for it so we can share the session
+  while(hh->hh_connecting)
+    hts_cond_wait(&http2_cond, &http2_mutex);
+
+  if(hh->hh_session != NULL &&
+     (tc = http2_stream_create(hh->hh_session)) != NULL) {
+    hts_mutex_unlock(&http2_mutex);
+    return tc;
+  }
+
+  time(&now);
+  if(hh->hh_no_h2 + H2_NEGATIVE_CACHE_TIME > now) {
+    hts_mutex_unlock(&http2_mutex);
+    return tcp_connect(hostname, port, errbuf, errlen, timeout, flags, c);
+  }
+
+  hh->hh_connecting = 1;
+  hts_mutex_unlock(&http2_mutex);
+
+  tc = tcp_connect(hostname, port, errbuf, errlen, timeout,
+                   flags | TCP_SSL_ALPN_H2, c);
+
+  hts_mutex_lock(&http2_mutex);
+  hh->hh_connecting = 0;
+  hts_cond_broadcast(&http2_cond);
+
+  if(tc != NULL) {
+    const char *alpn = tcp_get_alpn(tc);
+
+    if(alpn == NULL || strcmp(alpn, "h2")) {
+      hh->hh_no_h2 = now;
+    } else {
+      http2_session_t *hs = http2_session_create(hh, tc, flags & TCP_DEBUG);
+      if(hs == NULL) {
+        snprintf(errbuf, errlen, "Unable to create HTTP/2 session");
+        tcp_close(tc);
+        tc = NULL;
+      } else {
+        hh->hh_session = hs;
+        tc = http2_stream_create(hs);
+        hts_thread_create_detached("http2", http2_session_thread, hs,
+                                   THREAD_PRIO_FILESYSTEM);
+      }
+    }
+  }
+  hts_mutex_unlock(&http2_mutex);
+  return tc;
+}
+
+
+/**
+ *
+ */
+int
+http2_is_stream(const tcpcon_t *tc)
+{
+  return tc->read == http2_stream_read;
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Benchmark and test against a local HTTP/2 server. It must offer h2
+ * via ALPN, for example:
+ *
+ *   nghttpd -d /tmp/www 8443 server.key server.crt
+ *
+ * The server and path are taken from $MOVIAN_H2_SERVER as host:port/path
+ * (default localhost:8443/)
+ */
+#define H2_BENCH_STREAMS  8
+#define H2_BENCH_REQUESTS 200
+
+typedef struct http2_bench {
+  char host[128];
+  char path[128];
+  int port;
+  atomic_t slot;
+  int requests;
+  int errors;
+  int sessions[H2_BENCH_STREAMS];
+} http2_bench_t;
+
+
+/**
+ * Read one response (as translated to HTTP/1.1) and discard the body
+ */
+static int
+http2_bench_response(tcpcon_t *tc)
+{
+  char line[1024];
+  int code = -1, chunked = 0;
+  int64_t len = -1;
+
+  if(tcp_read_line(tc, line, sizeof(line)) ||
+     sscanf(line, "HTTP/%*s %d", &code) != 1)
+    return -1;
+
+  while(1) {
+    if(tcp_read_line(tc, line, sizeof(line)))
+      return -1;
+    if(line[0] == 0)
+      break;
+    if(!strncasecmp(line, "content-length:", 15))
+      len = strtoll(line + 15, NULL, 10);
+    else if(!strncasecmp(line, "transfer-encoding:", 18))
+      chunked = strstr(line, "chunked") != NULL;
+  }
+
+  if(chunked) {
+    while(1) {
+      if(tcp_read_line(tc, line, sizeof(line)))
+        return -1;
+      const int64_t n = strtoll(line, NULL, 16);
+      if(n == 0)
+        return tcp_read_line(tc, line, sizeof(line)) ? -1 : code;
+      if(tcp_read_data(tc, NULL, n, NULL, NULL) ||
+         tcp_read_line(tc, line, sizeof(line)))
+        return -1;
+    }
+  }
+  if(len > 0 && tcp_read_data(tc, NULL, len, NULL, NULL))
+    return -1;
+  return code;
+}
+
+
+/**
+ *
+ */
+static int
+http2_bench_get(tcpcon_t *tc, const http2_bench_t *hb)
+{
+  char *req = fmtstr("GET %s HTTP/1.1\r\nHost: %s:%d\r\n\r\n",
+                     hb->path, hb->host, hb->port);
+  const int err = tcp_write_data(tc, req, strlen(req));
+  free(req);
+  if(err)
+    return -1;
+  return http2_bench_response(tc);
+}
+
+
+/**
+ *
+ */
+static tcpcon_t *
+http2_bench_connect(const http2_bench_t *hb)
+{
+  char errbuf[256];
+  tcpcon_t *tc = http2_connect(hb->host, hb->port, TCP_SSL,
+                               errbuf, sizeof(errbuf), 5000, NULL);
+  if(tc == NULL)
+    TRACE(TRACE_ERROR, "bench", "http2: Unable to connect to %s:%d -- %s",
+          hb->host, hb->port, errbuf);
+  return tc;
+}
+
+
+/**
+ *
+ */
+static int
+http2_bench_session(tcpcon_t *tc)
+{
+  return http2_is_stream(tc) ? ((http2_stream_t *)tc)->st_session->hs_id : 0;
+}
+
+
+/**
+ *
+ */
+static void *
+http2_bench_thread(void *aux)
+{
+  http2_bench_t *hb = aux;
+  const int me = atomic_add_and_fetch(&hb->slot, 1) - 1;
+  tcpcon_t *tc = http2_bench_connect(hb);
+  int errors = 0;
+
+  if(tc == NULL) {
+    errors = H2_BENCH_REQUESTS;
+  } else {
+    hb->sessions[me] = http2_bench_session(tc);
+    for(int i = 0; i < H2_BENCH_REQUESTS; i++)
+      if(http2_bench_get(tc, hb) != 200)
+        errors++;
+    tcp_close(tc);
+  }
+
+  hts_mutex_lock(&http2_mutex);
+  hb->requests += H2_BENCH_REQUESTS;
+  hb->errors += errors;
+  hts_mutex_unlock(&http2_mutex);
+  return NULL;
+}
+
+
+/**
+ *
+ */
+static void
+http2_bench(void)
+{
+  http2_bench_t hb = {.port = 8443, .path = "/"};
+  const char *server = getenv("MOVIAN_H2_SERVER");
+  if(server == NULL || *server == 0)
+    server = "localhost:8443";
+  hts_thread_t tids[H2_BENCH_STREAMS];
+
+  snprintf(hb.host, sizeof(hb.host), "%s", server);
+  char *slash = strchr(hb.host, '/');
+  if(slash != NULL) {
+    snprintf(hb.path, sizeof(hb.path), "%s", slash);
+    *slash = 0;
+  }
+  char *colon = strchr(hb.host, ':');
+  if(colon != NULL) {
+    *colon = 0;
+    hb.port = atoi(colon + 1);
+  }
+
+  // Keeps the session alive while streams come and go
+  tcpcon_t *keeper = http2_bench_connect(&hb);
+  if(keeper == NULL)
+    return;
+
+  if(!http2_is_stream(keeper)) {
+    TRACE(TRACE_ERROR, "bench", "http2: %s:%d did not negotiate h2",
+          hb.host, hb.port);
+    tcp_close(keeper);
+    return;
+  }
+
+  http2_session_t *hs = ((http2_stream_t *)keeper)->st_session;
+  const int session = hs->hs_id;
+
+  // A request on a shut down stream must fail without killing the session
+  tcpcon_t *tc = http2_bench_connect(&hb);
+  if(tc == NULL) {
+    tcp_close(keeper);
+    return;
+  }
+  tcp_shutdown(tc);
+  const int shutdown_failed = http2_bench_get(tc, &hb) < 0;
+  tcp_close(tc);
+
+  hts_mutex_lock(&hs->hs_mutex);
+  const int goaway = hs->hs_goaway;
+  hts_mutex_unlock(&hs->hs_mutex);
+
+  TRACE(TRACE_INFO, "bench",
+        "http2: Request on shut down stream %s, session goaway:%d",
+        shutdown_failed ? "failed" : "did not fail", goaway);
+
+  int64_t ts = arch_get_ts();
+  for(int i = 0; i < H2_BENCH_STREAMS; i++)
+    hts_thread_create_joinable("h2bench", &tids[i], http2_bench_thread, &hb,
+                               THREAD_PRIO_FILESYSTEM);
+  for(int i = 0; i < H2_BENCH_STREAMS; i++)
+    hts_thread_join(&tids[i]);
+  ts = arch_get_ts() - ts;
+
+  tcp_close(keeper);
+
+  int reused = 0;
+  for(int i = 0; i < H2_BENCH_STREAMS; i++)
+    reused += hb.sessions[i] == session;
+
+  TRACE(TRACE_INFO, "bench",
+        "http2: %d requests for %s on %d streams, %d errors, %.0f req/s, "
+        "%d/%d streams on original session",
+        hb.requests, hb.path, H2_BENCH_STREAMS, hb.errors,
+        hb.requests * 1000000.0 / ts, reused, H2_BENCH_STREAMS);
+}
+
+BENCHMARK("http2", http2_bench);
+#endif
+
+
+/**
+ *
+ */
+static void
+http2_init(void)
+{
+  hts_mutex_init(&http2_mutex);
+  hts_cond_init(&http2_cond, &http2_mutex);
+}
+
+INITME(INIT_GROUP_NET, http2_init, NULL, 0);
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+#include "net.h"
+
+/**
+ * Connect to a TLS server offering HTTP/2 via ALPN.
+ *
+ * If the server speaks HTTP/2 the returned connection is a stream on a
+ * session shared by all callers connecting to the same host. It behaves
+ * like a HTTP/1.1 connection: Requests written to it are translated into
+ * HEADERS and DATA frames and the response is delivered as a HTTP/1.1
+ * response (with chunked transfer encoding if the length is not known).
+ * Each request written starts a new stream so the connection can be
+ * kept alive and reused just like a plain one.
+ *
+ * If the server does not speak HTTP/2 a normal TLS connection is returned.
+ *
+ * 'flags' are the TCP_ flags passed to tcp_connect()
+ */
+tcpcon_t *http2_connect(const char *hostname, int port, int flags,
+                        char *errbuf, size_t errlen, int timeout,
+                        struct cancellable *c);
+
+/**
+ * Returns 1 if connection is a HTTP/2 stream
+ */
+int http2_is_stream(const tcpcon_t *tc);
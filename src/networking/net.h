@@ -48,6 +48,7 @@ typedef struct tcpcon tcpcon_t;
 #define TCP_DEBUG    0x2
 #define TCP_NO_PROXY 0x4
 #define TCP_SSL_VERIFY 0x8
+#define TCP_SSL_ALPN_H2 0x10  // Offer HTTP/2 via ALPN
 
 tcpcon_t *tcp_connect(const char *hostname, int port, char *errbuf,
 		      size_t errbufsize, int timeout, int flags,
@@ -87,6 +88,9 @@ void tcp_shutdown(tcpcon_t *tc);
 
 void tcp_set_read_timeout(tcpcon_t *tc, int ms);
 
+int tcp_read_pending(tcpcon_t *tc);
+
+const char *tcp_get_alpn(const tcpcon_t *tc);
 
 
 int net_resolve(const char *hostname, net_addr_t *addr, const char **errmsg);
@@ -97,7 +97,7 @@ ssl_write_func(SSLConnectionRef connection, const void *data, size_t *len)
  */
 int
 tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
-             int verify)
+             int flags)
 {
   tc->ssl = SSLCreateContext(NULL, kSSLClientSide, kSSLStreamType);
 
@@ -128,6 +128,18 @@ tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
 }
 
 
+/**
+ *
+ */
+int
+tcp_ssl_pending(tcpcon_t *tc)
+{
+  size_t len = 0;
+  SSLGetBufferedReadSize(tc->ssl, &len);
+  return len;
+}
+
+
 /**
  *
  */
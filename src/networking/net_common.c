@@ -332,6 +332,55 @@ tcp_get_fd(const tcpcon_t *tc)
 }
 
 
+/**
+ * Number of bytes that can be read without blocking on the socket
+ */
+int
+tcp_read_pending(tcpcon_t *tc)
+{
+  int r = tc->spill.hq_size;
+  if(tc->ssl != NULL)
+    r += tcp_ssl_pending(tc);
+  return r;
+}
+
+
+/**
+ *
+ */
+const char *
+tcp_get_alpn(const tcpcon_t *tc)
+{
+  return tc->alpn;
+}
+
+
+/**
+ *
+ */
+void
+tcp_shutdown(tcpcon_t *tc)
+{
+  if(tc->shutdown != NULL)
+    tc->shutdown(tc);
+  else
+    tcp_shutdown_arch(tc);
+}
+
+
+/**
+ *
+ */
+void
+tcp_set_read_timeout(tcpcon_t *tc, int ms)
+{
+  if(tc->set_read_timeout != NULL)
+    tc->set_read_timeout(tc, ms);
+  else
+    tcp_set_read_timeout_arch(tc, ms);
+}
+
+
 /**
  *
  */
@@ -528,7 +577,7 @@ tcp_connect(const char *hostname, int port,
  connected:
   if(flags & TCP_SSL) {
 
-    if(tcp_ssl_open(tc, errbuf, errlen, hostname, flags & TCP_SSL_VERIFY)) {
+    if(tcp_ssl_open(tc, errbuf, errlen, hostname, flags)) {
       tcp_close(tc);
       return NULL;
     }
@@ -550,6 +599,13 @@ tcp_close(tcpcon_t *tc)
 
   htsbuf_queue_flush(&tc->spill);
 
+  free(tc->alpn);
+
+  if(tc->close != NULL) {
+    tc->close(tc);
+    return;
+  }
+
   tcp_close_arch(tc);
 
   free(tc);
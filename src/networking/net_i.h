@@ -63,6 +63,16 @@ struct tcpcon {
 
   cancellable_t *cancellable;
 
+  char *alpn;  // Protocol negotiated via TLS ALPN (NULL if none)
+
+  /**
+   * Hooks for connections that are not backed by a socket of their own
+   * (such as HTTP/2 streams). NULL means use the arch implementation
+   */
+  void (*close)(struct tcpcon *);
+  void (*shutdown)(struct tcpcon *);
+  void (*set_read_timeout)(struct tcpcon *, int ms);
+
 };
 
 void tcp_cancel(void *aux);
@@ -73,7 +83,13 @@ tcpcon_t *tcp_connect_arch(const net_addr_t *addr, char *errbuf,
 
 void tcp_close_arch(tcpcon_t *tc);
 
+void tcp_shutdown_arch(tcpcon_t *tc);
+
+void tcp_set_read_timeout_arch(tcpcon_t *tc, int ms);
+
 int tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen,
-                 const char *hostname, int verify);
+                 const char *hostname, int flags);
+
+int tcp_ssl_pending(tcpcon_t *tc);
 
 void tcp_ssl_close(tcpcon_t *tc);
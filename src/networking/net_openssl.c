@@ -86,7 +86,7 @@ ssl_write(tcpcon_t *tc, const void *data, size_t len)
 
 int
 tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
-             int verify)
+             int flags)
 {
   if(app_ssl_ctx == NULL) {
     snprintf(errbuf, errlen, "SSL not initialized");
@@ -101,6 +101,13 @@ tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
   }
   SSL_set_tlsext_host_name(tc->ssl, hostname);
 
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+  if(flags & TCP_SSL_ALPN_H2) {
+    static const unsigned char protos[] = "\x02h2\x08http/1.1";
+    SSL_set_alpn_protos(tc->ssl, protos, sizeof(protos) - 1);
+  }
+#endif
+
   if(SSL_set_fd(tc->ssl, tc->fd) == 0) {
     ERR_error_string(ERR_get_error(), errmsg);
     snprintf(errbuf, errlen, "SSL fd: %s", errmsg);
@@ -113,11 +120,19 @@ tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
     return -1;
   }
 
-  if(verify) {
+  if(flags & TCP_SSL_VERIFY) {
     if(openssl_verify_connection(tc->ssl, hostname, errbuf, errlen, 1))
       return -1;
   }
 
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+  const unsigned char *alpn;
+  unsigned int alpnlen;
+  SSL_get0_alpn_selected(tc->ssl, &alpn, &alpnlen);
+  if(alpnlen)
+    tc->alpn = strndup((const char *)alpn, alpnlen);
+#endif
+
   SSL_set_mode(tc->ssl, SSL_MODE_AUTO_RETRY);
   tc->read = ssl_read;
   tc->write = ssl_write;
@@ -125,6 +140,16 @@ tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
 }
 
 
+/**
+ *
+ */
+int
+tcp_ssl_pending(tcpcon_t *tc)
+{
+  return SSL_pending(tc->ssl);
+}
+
+
 /**
  *
  */
@@ -257,7 +257,7 @@ tcp_close_arch(tcpcon_t *tc)
  *
  */
 void
-tcp_shutdown(tcpcon_t *tc)
+tcp_shutdown_arch(tcpcon_t *tc)
 {
   ppb_tcpsocket->Close(tc->fd);
 }
@@ -277,7 +277,7 @@ tcp_huge_buffer(tcpcon_t *tc)
  *
  */
 void
-tcp_set_read_timeout(tcpcon_t *tc, int ms)
+tcp_set_read_timeout_arch(tcpcon_t *tc, int ms)
 {
   //  TRACE(TRACE_DEBUG, "NET", "%s NOT IMPLEMENTED", __FUNCTION__);
 }
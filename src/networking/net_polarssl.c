@@ -99,7 +99,7 @@ printdbg(void *aux, int level, const char *txt)
  */
 int
 tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
-             int verify)
+             int flags)
 {
   int ret;
   entropy_context entropy;
@@ -141,6 +141,12 @@ tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
 
   ssl_set_bio(tc->ssl, raw_recv, tc, raw_send, tc);
 
+#if defined(POLARSSL_SSL_ALPN)
+  static const char *h2_protos[] = {"h2", "http/1.1", NULL};
+  if(flags & TCP_SSL_ALPN_H2)
+    ssl_set_alpn_protocols(tc->ssl, h2_protos);
+#endif
+
   while((ret = ssl_handshake(tc->ssl)) != 0) {
     if(ret != POLARSSL_ERR_NET_WANT_READ &&
        ret != POLARSSL_ERR_NET_WANT_WRITE) {
@@ -149,6 +155,12 @@ tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
     }
   }
 
+#if defined(POLARSSL_SSL_ALPN)
+  const char *alpn = ssl_get_alpn_protocol(tc->ssl);
+  if(alpn != NULL)
+    tc->alpn = strdup(alpn);
+#endif
+
   tc->read = polarssl_read;
   tc->write = polarssl_write;
 
@@ -157,6 +169,16 @@ tcp_ssl_open(tcpcon_t *tc, char *errbuf, size_t errlen, const char *hostname,
 
 
 
+/**
+ *
+ */
+int
+tcp_ssl_pending(tcpcon_t *tc)
+{
+  return ssl_get_bytes_avail(tc->ssl);
+}
+
+
 void
 tcp_ssl_close(tcpcon_t *tc)
 {
@@ -344,7 +344,7 @@ tcp_close_arch(tcpcon_t *tc)
  *
  */
 void
-tcp_shutdown(tcpcon_t *tc)
+tcp_shutdown_arch(tcpcon_t *tc)
 {
   shutdown(tc->fd, SHUT_RDWR);
 }
@@ -365,7 +365,7 @@ tcp_huge_buffer(tcpcon_t *tc)
  *
  */
 void
-tcp_set_read_timeout(tcpcon_t *tc, int ms)
+tcp_set_read_timeout_arch(tcpcon_t *tc, int ms)
 {
   struct timeval tv;
   tv.tv_sec  = ms / 1000;
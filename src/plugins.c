@@ -811,9 +811,7 @@ repo_get(const char *repo, char *errbuf, size_t errlen)
   if(b == NULL)
     return REPO_ERROR_NETWORK;
 
-  json = htsmsg_json_deserialize(buf_cstr(b));
-
-  buf_release(b);
+  json = htsmsg_json_deserialize_buf(b, NULL, 0);
 
   if(json == NULL) {
     snprintf(errbuf, errlen, "Malformed JSON in repository");
@@ -424,6 +424,13 @@ void prop_request_delete_multi(prop_vec_t *pv);
 
 #define PROP_COURIER_TRACE_TIMES 0x1
 
+/**
+ * Pending value notifications (string, int, float, uri) for a
+ * subscription are overwritten by newer ones instead of being queued
+ * up. Subscribers only see the most recent value
+ */
+#define PROP_COURIER_COALESCE    0x2
+
 prop_courier_t *prop_courier_create_thread(hts_mutex_t *entrymutex,
 					   const char *name,
                                            int flags);
@@ -454,6 +461,11 @@ void prop_notify_dispatch(struct prop_notify_queue *q, const char *tracename);
 
 void prop_courier_stop(prop_courier_t *pc);
 
+void prop_courier_set_flags(prop_courier_t *pc, int flags);
+
+void prop_courier_get_stats(prop_courier_t *pc, int *notifies,
+                            int *coalesced);
+
 // Does not create properties, can't be used over remote connections
 prop_t *prop_find(prop_t *parent, ...) attribute_null_sentinel;
 
@@ -499,10 +511,13 @@ int prop_is_marked(prop_t *p);
 void prop_destroy_marked_childs(prop_t *p);
 
 
-void *prop_dispatch_group_create(void);
+void *prop_dispatch_group_create(int flags);
 
 void prop_dispatch_group_destroy(void *group);
 
+void prop_dispatch_group_get_stats(void *group, int *notifies,
+                                   int *coalesced);
+
 /**
  * Property tags
  */
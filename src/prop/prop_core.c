@@ -1017,6 +1017,7 @@ prop_courier(void *aux)
 
     TAILQ_MOVE(&q_exp, &pc->pc_queue_exp, hpn_link);
     TAILQ_INIT(&pc->pc_queue_exp);
+    pc->pc_generation++;
 
     TAILQ_INIT(&q_nor);
     if((n = TAILQ_FIRST(&pc->pc_queue_nor)) != NULL) {
@@ -1082,6 +1083,9 @@ prop_global_dispatch_thread(void *aux)
     n = TAILQ_FIRST(&psd->psd_notifications);
     assert(n != NULL);
 
+    if(n->hpn_sub->hps_coalesce_notify == n)
+      n->hpn_sub->hps_coalesce_notify = NULL;
+
     hts_mutex_unlock(&prop_mutex);
     int r = prop_dispatch_one(n, LOCKMGR_TRY);
     hts_mutex_lock(&prop_mutex);
@@ -1189,24 +1193,110 @@ courier_notify(prop_courier_t *pc)
 
 
 /**
+ * Value notifications where only the latest one is of interest
+ */
+static int
+prop_notify_coalescable(const prop_notify_t *n)
+{
+  switch(n->hpn_event) {
+  case PROP_SET_RSTRING:
+  case PROP_SET_CSTRING:
+  case PROP_SET_INT:
+  case PROP_SET_FLOAT:
+  case PROP_SET_URI:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+/**
+ * Return the still pending notification that a new value notification
+ * enqueued with 'expedite' can replace.
  *
+ * Only the last notification enqueued for the subscription is
+ * considered, so ordering in relation to other notifications on the
+ * same subscription is retained. It must also be waiting in the queue
+ * the new one goes to, or an expedited value would end up delivered
+ * with normal priority (or vice versa)
+ */
+static prop_notify_t *
+prop_notify_coalesce_target(prop_sub_t *s, int expedite)
+{
+  const prop_courier_t *pc;
+  const prop_sub_dispatch_t *psd;
+
+  if(s->hps_coalesce_notify == NULL)
+    return NULL;
+
+  switch(s->hps_dispatch_mode) {
+  case PROP_SUB_DISPATCH_MODE_COURIER:
+    pc = s->hps_dispatch;
+    if(!(pc->pc_flags & PROP_COURIER_COALESCE) ||
+       s->hps_coalesce_gen != pc->pc_generation ||
+       s->hps_coalesce_exp != !!expedite)
+      return NULL;
+    return s->hps_coalesce_notify;
+
+  case PROP_SUB_DISPATCH_MODE_GROUP:
+    // hps_coalesce_notify is cleared when notification is picked
+    // for dispatch
+    psd = s->hps_dispatch;
+    if(!(psd->psd_flags & PROP_COURIER_COALESCE))
+      return NULL;
+    return s->hps_coalesce_notify;
+
+  default:
+    return NULL;
+  }
+}
+
+
+/**
+ * Enqueue a notification for delivery.
+ *
+ * If it replaces a pending value notification (see above) the old one
+ * is dropped and the new one is appended as usual. Overwriting the old
+ * one in place would deliver the new value ahead of notifications
+ * (for other subscriptions) that were enqueued in between
  */
 static void
 courier_enqueue0(prop_sub_t *s, prop_notify_t *n, int expedite)
 {
   prop_courier_t *pc;
   prop_sub_dispatch_t *psd;
+  prop_notify_t *o = NULL;
+
+  if(prop_notify_coalescable(n)) {
+    o = prop_notify_coalesce_target(s, expedite);
+    s->hps_coalesce_notify = n;
+  } else {
+    s->hps_coalesce_notify = NULL;
+  }
 
   switch(s->hps_dispatch_mode) {
   case PROP_SUB_DISPATCH_MODE_COURIER:
     pc = s->hps_dispatch;
+    s->hps_coalesce_gen = pc->pc_generation;
+    s->hps_coalesce_exp = !!expedite;
 
-    if(expedite)
+    if(expedite) {
+      if(o != NULL)
+        TAILQ_REMOVE(&pc->pc_queue_exp, o, hpn_link);
       TAILQ_INSERT_TAIL(&pc->pc_queue_exp, n, hpn_link);
-    else
+    } else {
+      if(o != NULL)
+        TAILQ_REMOVE(&pc->pc_queue_nor, o, hpn_link);
       TAILQ_INSERT_TAIL(&pc->pc_queue_nor, n, hpn_link);
+    }
 
-    courier_notify(pc);
+    if(o != NULL) {
+      pc->pc_num_coalesced++;
+    } else {
+      pc->pc_num_notifies++;
+      courier_notify(pc);
+    }
     break;
 
 
@@ -1216,6 +1306,7 @@ courier_enqueue0(prop_sub_t *s, prop_notify_t *n, int expedite)
       psd = s->hps_dispatch = pool_get(psd_pool);
       TAILQ_INIT(&psd->psd_notifications);
       TAILQ_INIT(&psd->psd_wait_queue);
+      psd->psd_flags = 0;
       TAILQ_INSERT_TAIL(&prop_global_dispatch_queue, psd, psd_link);
       prop_global_dispatch_wakeup();
     }
@@ -1229,9 +1320,22 @@ courier_enqueue0(prop_sub_t *s, prop_notify_t *n, int expedite)
       TAILQ_INSERT_TAIL(&prop_global_dispatch_queue, psd, psd_link);
       prop_global_dispatch_wakeup();
     }
+    // Append before removing 'o' so the psd is not queued twice
     TAILQ_INSERT_TAIL(&psd->psd_notifications, n, hpn_link);
+
+    if(o != NULL) {
+      TAILQ_REMOVE(&psd->psd_notifications, o, hpn_link);
+      psd->psd_num_coalesced++;
+    } else {
+      psd->psd_num_notifies++;
+    }
     break;
   }
+
+  if(o != NULL) {
+    assert(o->hpn_sub == s);
+    prop_notify_free(o);
+  }
 }
 
 
@@ -1866,6 +1970,223 @@ prop_clean(prop_t *p)
 }
 
 
+/**
+ * Name index for directories with many childs
+ *
+ * Looking up a named child is a linear scan over hp_childs. For
+ * directories that grows large we lazily build an open addressing
+ * (linear probing) hash table over the named childs. The index is
+ * created by prop_find_child() once a scan has to step over
+ * PROP_CHILD_INDEX_THRESHOLD childs and it's then kept in sync on
+ * every insert / remove until the directory is torn down.
+ *
+ * Names are not required to be unique within a directory (a prop
+ * can be reparented into a dir that already got a child with the same
+ * name). In that case we must return the first one in list order, so
+ * when the index sees duplicates it defers to the linear scan.
+ */
+#define PROP_CHILD_INDEX_THRESHOLD 32
+
+typedef struct prop_child_index_slot {
+  prop_t *pcis_prop;
+  unsigned int pcis_hash;
+} prop_child_index_slot_t;
+
+typedef struct prop_child_index {
+  unsigned int pci_mask;
+  unsigned int pci_count;
+  prop_child_index_slot_t pci_slots[0];
+} prop_child_index_t;
+
+
+/**
+ *
+ */
+static prop_child_index_t *
+prop_child_index_alloc(unsigned int size)
+{
+  prop_child_index_t *pci =
+    calloc(1, sizeof(prop_child_index_t) +
+           sizeof(prop_child_index_slot_t) * size);
+  pci->pci_mask = size - 1;
+  return pci;
+}
+
+
+/**
+ *
+ */
+static void
+prop_child_index_insert_slot(prop_child_index_t *pci, prop_t *p,
+                             unsigned int hash)
+{
+  unsigned int i = hash & pci->pci_mask;
+  while(pci->pci_slots[i].pcis_prop != NULL)
+    i = (i + 1) & pci->pci_mask;
+  pci->pci_slots[i].pcis_prop = p;
+  pci->pci_slots[i].pcis_hash = hash;
+  pci->pci_count++;
+}
+
+
+/**
+ * Resize so load factor stays below 50%
+ */
+static prop_child_index_t *
+prop_child_index_resize(prop_child_index_t *old, unsigned int count)
+{
+  unsigned int size = 16;
+  while(size < count * 2)
+    size *= 2;
+
+  prop_child_index_t *pci = prop_child_index_alloc(size);
+
+  if(old != NULL) {
+    for(int i = 0; i <= old->pci_mask; i++) {
+      const prop_child_index_slot_t *s = &old->pci_slots[i];
+      if(s->pcis_prop != NULL)
+        prop_child_index_insert_slot(pci, s->pcis_prop, s->pcis_hash);
+    }
+    free(old);
+  }
+  return pci;
+}
+
+
+/**
+ *
+ */
+static void
+prop_child_index_build(prop_t *parent, int count)
+{
+  prop_t *c;
+  prop_child_index_t *pci = prop_child_index_resize(NULL, count);
+
+  TAILQ_FOREACH(c, &parent->hp_childs, hp_parent_link)
+    if(c->hp_name != NULL)
+      prop_child_index_insert_slot(pci, c, mystrhash(c->hp_name));
+
+  parent->hp_child_index = pci;
+}
+
+
+/**
+ *
+ */
+static void
+prop_child_index_destroy(prop_t *parent)
+{
+  free(parent->hp_child_index);
+  parent->hp_child_index = NULL;
+}
+
+
+/**
+ * Must be called after child has been linked into parent's hp_childs
+ */
+static void
+prop_child_index_add(prop_t *parent, prop_t *c)
+{
+  prop_child_index_t *pci = parent->hp_child_index;
+
+  if(pci == NULL || c->hp_name == NULL)
+    return;
+
+  if((pci->pci_count + 1) * 2 > pci->pci_mask + 1)
+    pci = parent->hp_child_index =
+      prop_child_index_resize(pci, pci->pci_count + 1);
+
+  prop_child_index_insert_slot(pci, c, mystrhash(c->hp_name));
+}
+
+
+/**
+ * Remove using backward shift deletion so we never need tombstones
+ */
+static void
+prop_child_index_remove(prop_t *parent, prop_t *c)
+{
+  prop_child_index_t *pci = parent->hp_child_index;
+
+  if(pci == NULL || c->hp_name == NULL)
+    return;
+
+  const unsigned int mask = pci->pci_mask;
+  unsigned int i = mystrhash(c->hp_name) & mask;
+
+  while(pci->pci_slots[i].pcis_prop != c) {
+    assert(pci->pci_slots[i].pcis_prop != NULL);
+    i = (i + 1) & mask;
+  }
+
+  unsigned int j = i;
+  while(1) {
+    j = (j + 1) & mask;
+    const prop_child_index_slot_t *s = &pci->pci_slots[j];
+    if(s->pcis_prop == NULL)
+      break;
+    const unsigned int k = s->pcis_hash & mask;
+    if(i <= j ? (i < k && k <= j) : (i < k || k <= j))
+      continue;
+    pci->pci_slots[i] = *s;
+    i = j;
+  }
+  pci->pci_slots[i].pcis_prop = NULL;
+  pci->pci_count--;
+
+  if(pci->pci_count < PROP_CHILD_INDEX_THRESHOLD / 2)
+    prop_child_index_destroy(parent);
+}
+
+
+/**
+ *
+ */
+static prop_t *
+prop_find_child_linear(prop_t *parent, const char *name)
+{
+  prop_t *c;
+  int steps = 0;
+
+  TAILQ_FOREACH(c, &parent->hp_childs, hp_parent_link) {
+    if(c->hp_name != NULL && !strcmp(c->hp_name, name))
+      return c;
+    steps++;
+  }
+
+  if(steps >= PROP_CHILD_INDEX_THRESHOLD && parent->hp_child_index == NULL)
+    prop_child_index_build(parent, steps);
+  return NULL;
+}
+
+
+/**
+ * Find named child of a PROP_DIR
+ */
+static prop_t *
+prop_find_child(prop_t *parent, const char *name)
+{
+  const prop_child_index_t *pci = parent->hp_child_index;
+
+  if(pci == NULL)
+    return prop_find_child_linear(parent, name);
+
+  const unsigned int hash = mystrhash(name);
+  unsigned int i = hash & pci->pci_mask;
+  prop_t *r = NULL;
+
+  for(; pci->pci_slots[i].pcis_prop != NULL; i = (i + 1) & pci->pci_mask) {
+    const prop_child_index_slot_t *s = &pci->pci_slots[i];
+    if(s->pcis_hash != hash || strcmp(s->pcis_prop->hp_name, name))
+      continue;
+    if(r != NULL)
+      return prop_find_child_linear(parent, name); // Duplicate names
+    r = s->pcis_prop;
+  }
+  return r;
+}
+
+
 /**
  *
  */
@@ -1880,6 +2201,7 @@ prop_make_dir(prop_t *p, prop_sub_t *skipme, const char *origin)
   
   TAILQ_INIT(&p->hp_childs);
   p->hp_selected = NULL;
+  p->hp_child_index = NULL;
   p->hp_type = PROP_DIR;
   
   prop_notify_value(p, skipme, origin);
@@ -1895,9 +2217,11 @@ prop_insert(prop_t *p, prop_t *parent, prop_t *before, prop_sub_t *skipme)
   if(before != NULL) {
     assert(before->hp_parent == parent);
     TAILQ_INSERT_BEFORE(before, p, hp_parent_link);
+    prop_child_index_add(parent, p);
     prop_notify_child2(p, parent, before, PROP_ADD_CHILD_BEFORE, skipme, 0);
   } else {
     TAILQ_INSERT_TAIL(&parent->hp_childs, p, hp_parent_link);
+    prop_child_index_add(parent, p);
     prop_notify_child(p, parent, PROP_ADD_CHILD, skipme, 0);
   }
 }
@@ -1948,21 +2272,17 @@ prop_create0(prop_t *parent, const char *name, prop_sub_t *skipme, int noalloc)
 
   prop_make_dir(parent, skipme, "prop_create()");
 
-  if(name != NULL) {
-    TAILQ_FOREACH(hp, &parent->hp_childs, hp_parent_link) {
-      if(hp->hp_name != NULL && !strcmp(hp->hp_name, name)) {
-
-	if(!(hp->hp_flags & PROP_NAME_NOT_ALLOCATED) && noalloc) {
-	  // Trick: We have a pointer to a compile time constant string
-	  // and the current prop does not have that, we could switch to
-	  // it and thus save some memory allocation
-	  free((void *)hp->hp_name);
-	  hp->hp_name = name;
-	  hp->hp_flags |= PROP_NAME_NOT_ALLOCATED;
-	}
-	return hp;
-      }
+  if(name != NULL && (hp = prop_find_child(parent, name)) != NULL) {
+
+    if(!(hp->hp_flags & PROP_NAME_NOT_ALLOCATED) && noalloc) {
+      // Trick: We have a pointer to a compile time constant string
+      // and the current prop does not have that, we could switch to
+      // it and thus save some memory allocation
+      free((void *)hp->hp_name);
+      hp->hp_name = name;
+      hp->hp_flags |= PROP_NAME_NOT_ALLOCATED;
     }
+    return hp;
   }
 
   hp = prop_make(name, noalloc, parent);
@@ -2054,9 +2374,7 @@ prop_create_after(prop_t *parent, const char *name, prop_t *after,
 
     prop_make_dir(parent, skipme, "prop_create_after()");
 
-    TAILQ_FOREACH(p, &parent->hp_childs, hp_parent_link)
-      if(p->hp_name != NULL && !strcmp(p->hp_name, name))
-	break;
+    p = prop_find_child(parent, name);
 
     if(p == NULL) {
 
@@ -2067,6 +2385,7 @@ prop_create_after(prop_t *parent, const char *name, prop_t *after,
       } else {
 	TAILQ_INSERT_AFTER(&parent->hp_childs, after, p, hp_parent_link);
       }
+      prop_child_index_add(parent, p);
 
       prop_t *next = TAILQ_NEXT(p, hp_parent_link);
       if(next == NULL) {
@@ -2181,6 +2500,7 @@ prop_set_parent_vector(prop_vec_t *pv, prop_t *parent, prop_t *before,
       } else {
 	TAILQ_INSERT_TAIL(&parent->hp_childs, p, hp_parent_link);
       }
+      prop_child_index_add(parent, p);
     }
     prop_notify_childv(pv, parent, before ? PROP_ADD_CHILD_VECTOR_BEFORE : 
 		       PROP_ADD_CHILD_VECTOR, skipme, before);
@@ -2204,6 +2524,7 @@ prop_unparent0(prop_t *p, prop_sub_t *skipme)
   prop_notify_child(p, parent, PROP_DEL_CHILD, NULL, 0);
   
   TAILQ_REMOVE(&parent->hp_childs, p, hp_parent_link);
+  prop_child_index_remove(parent, p);
   p->hp_parent = NULL;
   
   if(parent->hp_selected == p)
@@ -2248,6 +2569,7 @@ prop_destroy_child(prop_t *p, prop_t *c)
   if(!prop_destroy0(c)) {
     prop_notify_child(c, p, PROP_DEL_CHILD, NULL, 0);
     TAILQ_REMOVE(&p->hp_childs, c, hp_parent_link);
+    prop_child_index_remove(p, c);
     c->hp_parent = NULL;
   }
 }
@@ -2315,6 +2637,7 @@ prop_destroy0(prop_t *p)
       next = TAILQ_NEXT(c, hp_parent_link);
       prop_destroy_child(p, c);
     }
+    prop_child_index_destroy(p);
     break;
 
   case PROP_RSTRING:
@@ -2386,6 +2709,7 @@ prop_destroy0(prop_t *p)
         prop_build_notify_child(s, p, PROP_DEL_CHILD, 0, 0);
 
     TAILQ_REMOVE(&parent->hp_childs, p, hp_parent_link);
+    prop_child_index_remove(parent, p);
     p->hp_parent = NULL;
 
     if(parent->hp_selected == p)
@@ -2425,6 +2749,7 @@ prop_destroy_childs0(prop_t *p)
   struct prop_queue childs;
   TAILQ_MOVE(&childs, &p->hp_childs, hp_parent_link);
   TAILQ_INIT(&p->hp_childs);
+  prop_child_index_destroy(p);
 
   p->hp_type = PROP_VOID;
   p->hp_selected = NULL;
@@ -2510,12 +2835,8 @@ prop_destroy_by_name(prop_t *p, const char *name)
 	  prop_destroy_child(p, c);
       }
     } else {
-      TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link) {
-	if(c->hp_name != NULL && !strcmp(c->hp_name, name)) {
-	  prop_destroy_child(p, c);
-	  break;
-	}
-      }
+      if((c = prop_find_child(p, name)) != NULL)
+	prop_destroy_child(p, c);
     }
   }
   hts_mutex_unlock(&prop_mutex);
@@ -2703,6 +3024,7 @@ prop_subfind(prop_t *p, const char **name, int follow_symlinks,
 
       TAILQ_INIT(&p->hp_childs);
       p->hp_selected = NULL;
+      p->hp_child_index = NULL;
       p->hp_type = PROP_DIR;
 
       prop_notify_value(p, NULL, "prop_subfind()");
@@ -2721,11 +3043,7 @@ prop_subfind(prop_t *p, const char **name, int follow_symlinks,
 	return NULL;
       }
     } else {
-
-      TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link) {
-	if(c->hp_name != NULL && !strcmp(c->hp_name, name[0]))
-	  break;
-      }
+      c = prop_find_child(p, name[0]);
     }
     p = c ?: prop_create0(p, name[0], NULL, 0);    
     name++;
@@ -3202,6 +3520,7 @@ prop_subscribe_ex(const char *file, int line, int flags, ...)
   s->hps_multiple_origins = 0;
   s->hps_origin = NULL;
   s->hps_zombie = 0;
+  s->hps_coalesce_notify = NULL;
   s->hps_flags = flags;
   s->hps_trampoline = trampoline;
   s->hps_callback = cb;
@@ -5063,9 +5382,7 @@ prop_findv(prop_t *p, char **names)
       break;
     }
 
-    TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link)
-      if(c->hp_name != NULL && !strcmp(c->hp_name, n))
-	break;
+    c = prop_find_child(p, n);
     if(c == NULL)
       break;
 
@@ -5095,9 +5412,7 @@ prop_find0(prop_t *p, va_list ap)
       break;
     }
 
-    TAILQ_FOREACH(c, &p->hp_childs, hp_parent_link)
-      if(c->hp_name != NULL && !strcmp(c->hp_name, n))
-	break;
+    c = prop_find_child(p, n);
     if(c == NULL)
 	return NULL;
     p = c;
@@ -5292,6 +5607,7 @@ prop_courier_wait(prop_courier_t *pc, struct prop_notify_queue *q, int timeout)
 
   TAILQ_MOVE(q, &pc->pc_queue_exp, hpn_link);
   TAILQ_MERGE(q, &pc->pc_queue_nor, hpn_link);
+  pc->pc_generation++;
   hts_mutex_unlock(&prop_mutex);
   return r;
 }
@@ -5376,6 +5692,32 @@ prop_courier_stop(prop_courier_t *pc)
 }
 
 
+/**
+ *
+ */
+void
+prop_courier_set_flags(prop_courier_t *pc, int flags)
+{
+  hts_mutex_lock(&prop_mutex);
+  pc->pc_flags |= flags;
+  hts_mutex_unlock(&prop_mutex);
+}
+
+
+/**
+ * Number of notifications enqueued and number of notifications that
+ * was overwritten by a newer value before being dispatched
+ */
+void
+prop_courier_get_stats(prop_courier_t *pc, int *notifies, int *coalesced)
+{
+  hts_mutex_lock(&prop_mutex);
+  *notifies  = pc->pc_num_notifies;
+  *coalesced = pc->pc_num_coalesced;
+  hts_mutex_unlock(&prop_mutex);
+}
+
+
 /**
  *
  */
@@ -5386,6 +5728,7 @@ prop_courier_poll(prop_courier_t *pc)
   hts_mutex_lock(&prop_mutex);
   TAILQ_MOVE(&q, &pc->pc_queue_exp, hpn_link);
   TAILQ_MERGE(&q, &pc->pc_queue_nor, hpn_link);
+  pc->pc_generation++;
   hts_mutex_unlock(&prop_mutex);
   prop_notify_dispatch(&q, 0);
 }
@@ -5405,6 +5748,7 @@ prop_courier_poll_timed(prop_courier_t *pc, int maxtime)
   if(!hts_mutex_trylock(&prop_mutex)) {
     TAILQ_MERGE(&pc->pc_dispatch_queue, &pc->pc_queue_exp, hpn_link);
     TAILQ_MERGE(&pc->pc_dispatch_queue, &pc->pc_queue_nor, hpn_link);
+    pc->pc_generation++;
 
     for(n = TAILQ_FIRST(&pc->pc_free_queue); n != NULL; n = next) {
       next = TAILQ_NEXT(n, hpn_link);
@@ -5848,13 +6192,16 @@ prop_destroy_marked_childs(prop_t *p)
 
 
 void *
-prop_dispatch_group_create(void)
+prop_dispatch_group_create(int flags)
 {
   hts_mutex_lock(&prop_mutex);
   prop_sub_dispatch_t *psd = pool_get(psd_pool);
   TAILQ_INIT(&psd->psd_notifications);
   TAILQ_INIT(&psd->psd_wait_queue);
   psd->psd_refcount = 1;
+  psd->psd_flags = flags;
+  psd->psd_num_notifies = 0;
+  psd->psd_num_coalesced = 0;
   hts_mutex_unlock(&prop_mutex);
   return psd;
 }
@@ -5868,6 +6215,20 @@ prop_dispatch_group_destroy(void *g)
 }
 
 
+/**
+ * Same as prop_courier_get_stats() but for a dispatch group
+ */
+void
+prop_dispatch_group_get_stats(void *g, int *notifies, int *coalesced)
+{
+  const prop_sub_dispatch_t *psd = g;
+  hts_mutex_lock(&prop_mutex);
+  *notifies  = psd->psd_num_notifies;
+  *coalesced = psd->psd_num_coalesced;
+  hts_mutex_unlock(&prop_mutex);
+}
+
+
 #ifdef PROP_SUB_RECORD_SOURCE
 
 static void
@@ -6055,11 +6416,68 @@ prop_report_stats(callout_t *c, void *aux)
 
 #endif
 
+/**
+ * Lock contention monitor
+ *
+ * The whole prop tree is protected by prop_mutex. Instead of
+ * instrumenting every lock site a low priority thread samples the lock
+ * at a fixed interval. A sample that finds the lock taken counts as busy
+ * and the thread then measures how long it has to wait to get it, which
+ * is what any other thread contending at that point would see.
+ *
+ * Busy samples / total samples estimates the fraction of time the lock
+ * is held, ie. hold time per second of wall clock.
+ */
+#define PROP_LOCK_SAMPLE_INTERVAL 20000  // us
+#define PROP_LOCK_REPORT_INTERVAL 10     // seconds
+
+static void *
+prop_lock_monitor(void *aux)
+{
+  const int samples = PROP_LOCK_REPORT_INTERVAL * 1000000 /
+    PROP_LOCK_SAMPLE_INTERVAL;
+
+  while(1) {
+    int busy = 0;
+    int64_t wait_total = 0, wait_max = 0;
+
+    for(int i = 0; i < samples; i++) {
+      usleep(PROP_LOCK_SAMPLE_INTERVAL);
+
+      if(!hts_mutex_trylock(&prop_mutex)) {
+        hts_mutex_unlock(&prop_mutex);
+        continue;
+      }
+
+      const int64_t ts = arch_get_ts();
+      hts_mutex_lock(&prop_mutex);
+      hts_mutex_unlock(&prop_mutex);
+      const int64_t wait = arch_get_ts() - ts;
+
+      busy++;
+      wait_total += wait;
+      if(wait > wait_max)
+        wait_max = wait;
+    }
+
+    tracelog(TRACE_NO_PROP, TRACE_DEBUG, "prop",
+             "Lock busy in %d of %d samples (%.1f%%), "
+             "wait avg %dus max %dus",
+             busy, samples, busy * 100.0 / samples,
+             busy ? (int)(wait_total / busy) : 0, (int)wait_max);
+  }
+  return NULL;
+}
+
+
 extern void prop_test(void);
 
 void
 prop_init_late(void)
 {
+  hts_thread_create_detached("proplockmon", prop_lock_monitor, NULL,
+                             THREAD_PRIO_BGTASK);
+
 #ifdef PROP_SUB_STATS
   callout_arm(&prop_stats_callout, prop_report_stats, NULL, 1);
 #endif
@@ -72,6 +72,15 @@ struct prop_courier {
 
   int pc_refcount;
   char *pc_name;
+
+  /**
+   * Bumped every time the queues are drained for dispatch. Used to
+   * know if a subscription's last notification is still pending
+   */
+  unsigned int pc_generation;
+
+  int pc_num_notifies;
+  int pc_num_coalesced;
 };
 
 
@@ -338,6 +347,7 @@ struct prop {
     struct {
       struct prop_queue childs;
       struct prop *selected;
+      struct prop_child_index *index;
     } c;
     struct pixmap *pixmap;
     struct {
@@ -359,6 +369,7 @@ struct prop {
 #define hp_int      u.i.val
 #define hp_childs   u.c.childs
 #define hp_selected u.c.selected
+#define hp_child_index u.c.index
 #define hp_pixmap   u.pixmap
 #define hp_uri_title u.uri.title
 #define hp_uri       u.uri.uri
@@ -398,9 +409,12 @@ typedef struct prop_sub_dispatch {
 
   struct prop_sub_dispatch_queue psd_wait_queue;
 
-  // The refcount is only in use for subscriptions in
+  // The refcount, flags and stats are only in use for subscriptions in
   // PROP_SUB_DISPATCH_MODE_GROUP
   int psd_refcount;
+  int psd_flags;
+  int psd_num_notifies;
+  int psd_num_coalesced;
 
 } prop_sub_dispatch_t;
 
@@ -501,6 +515,15 @@ struct prop_sub {
   };
 
 
+  /**
+   * Last notification enqueued for this subscription if it carries
+   * a value that may be overwritten by a later one. Protected by
+   * global mutex
+   */
+  prop_notify_t *hps_coalesce_notify;
+  unsigned int hps_coalesce_gen;
+  uint8_t hps_coalesce_exp;  // hps_coalesce_notify is on pc_queue_exp
+
   /**
    * Refcount. Not protected by mutex. Modification needs to be issued
    * using atomic ops.
@@ -28,6 +28,7 @@
 
 #include "arch/atomic.h"
 
+#include "main.h"
 #include "prop.h"
 #include "prop_i.h"
 
@@ -318,6 +319,41 @@ prop_test2(void)
 
 
 
+/**
+ * Measure cost of named child lookup as directory grows.
+ * With the child index in place this should stay roughly flat
+ */
+static void
+prop_test_child_lookup(void)
+{
+  char name[32];
+  const int lookups = 100000;
+
+  printf("Child lookup benchmark\n");
+
+  for(int childs = 8; childs <= 16384; childs *= 4) {
+    prop_t *r = prop_create_root(NULL);
+
+    for(int i = 0; i < childs; i++) {
+      snprintf(name, sizeof(name), "child%d", i);
+      prop_create(r, name);
+    }
+
+    int64_t ts = arch_get_ts();
+    for(int i = 0; i < lookups; i++) {
+      snprintf(name, sizeof(name), "child%d", (i * 7919) % childs);
+      if(prop_create(r, name) == NULL)
+        exit(1);
+    }
+    ts = arch_get_ts() - ts;
+
+    printf("  %6d childs: %6.1f ns/lookup\n", childs,
+           ts * 1000.0 / lookups);
+    prop_destroy(r);
+  }
+}
+
+
 /**
  *
  */
@@ -326,5 +362,6 @@ prop_test(void)
 {
   prop_test1();
   prop_test2();
+  prop_test_child_lookup();
 }
 #endif
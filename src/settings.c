@@ -1568,9 +1568,17 @@ init_dev_settings(void)
   add_dev_bool("Disable HTTP connection reuse",
 	       "nohttpreuse", &gconf.disable_http_reuse);
 
+#if ENABLE_HTTP2
+  add_dev_bool("Disable HTTP/2",
+	       "nohttp2", &gconf.disable_http2);
+#endif
+
   add_dev_bool("Enable indexer option",
 	       "enable_indexer", &gconf.enable_indexer);
 
+  add_dev_bool("Use throughput based HLS bitrate selection",
+	       "hlsabrthroughput", &gconf.enable_hls_abr_throughput);
+
   if(gconf.arch_dev_opts)
     gconf.arch_dev_opts(&add_dev_bool);
 
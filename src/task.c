@@ -18,40 +18,80 @@
  *  For more information, contact andreas@lonelycoder.com
  */
 #include <assert.h>
+#include <unistd.h>
 
 #include "main.h"
 #include "arch/threads.h"
+#include "arch/atomic.h"
 
 #include "task.h"
 #include "misc/queue.h"
 
-#define MAX_TASK_THREADS 16
-#define MAX_IDLE_TASK_THREADS 2
+/**
+ * Tasks are queued on per worker queues. Tasks submitted from a worker
+ * thread goes to its own queue, other submitters distribute tasks
+ * round robin over the core workers. A worker that runs out of work
+ * steals from the other workers before going to sleep.
+ *
+ * The number of core workers is the same as the number of CPUs and
+ * these never exit. Since tasks are allowed to block (doing I/O, etc)
+ * we spawn overflow workers when there is a backlog and no worker is
+ * idle. Overflow workers exit after lingering idle for a while.
+ *
+ * Each worker queue is split per priority class. Workers always pick
+ * the highest priority task available, stealing if needed, before
+ * looking at lower classes.
+ */
+#define TASK_MAX_WORKERS 32
+#define TASK_OVERFLOW_LINGER 2000 // ms
 
 TAILQ_HEAD(task_queue, task);
-TAILQ_HEAD(task_group_queue, task_group);
-
-struct task_group {
-  atomic_t tg_refcount;
-  struct task_queue tg_tasks;
-  TAILQ_ENTRY(task_group) tg_link;
-};
-
 
 typedef struct task {
   TAILQ_ENTRY(task) t_link;
   task_fn_t *t_fn;
   void *t_opaque;
   task_group_t *t_group;
+  cancellable_t *t_cancellable;
+  task_fn_t *t_cancelled;
+  task_prio_t t_prio;
 } task_t;
 
 
-static struct task_queue tasks = TAILQ_HEAD_INITIALIZER(tasks);
-static struct task_group_queue task_groups =TAILQ_HEAD_INITIALIZER(task_groups);
-static unsigned int num_task_threads;
-static unsigned int num_task_threads_avail;
-static hts_mutex_t task_mutex;
-static hts_cond_t task_cond;
+struct task_group {
+  atomic_t tg_refcount;
+  struct task_queue tg_tasks;  // Protected by task_group_mutex
+
+  // Queued on a worker when the group has tasks. t_fn is NULL
+  task_t tg_runner;
+};
+
+
+typedef struct task_worker {
+  hts_mutex_t tw_mutex;
+  struct task_queue tw_tasks[TASK_PRIO_num];
+  int tw_index;
+  int tw_overflow;
+  int tw_running;     // Protected by task_sched_mutex
+  task_t *tw_current; // Only accessed by the worker itself
+} task_worker_t;
+
+
+static task_worker_t task_workers[TASK_MAX_WORKERS];
+static int task_num_core_workers;
+static int task_num_workers;        // High water mark of worker slots used
+static int task_num_threads;        // Protected by task_sched_mutex
+
+static atomic_t task_pending;       // Tasks sitting in worker queues
+static atomic_t task_idle;          // Workers waiting on task_sched_cond
+static atomic_t task_rr;
+
+static hts_mutex_t task_sched_mutex;
+static hts_cond_t task_sched_cond;
+static hts_mutex_t task_group_mutex;
+static hts_key_t task_worker_key;
+
+static void *task_thread(void *aux);
 
 
 /**
@@ -70,85 +110,241 @@ task_group_release(task_group_t *tg)
 /**
  *
  */
-static void *
-task_thread(void *aux)
+static int
+task_get_num_core_workers(void)
 {
-  task_t *t;
-  task_group_t *tg;
+  int n = task_num_core_workers;
+  if(n == 0) {
+    hts_mutex_lock(&task_sched_mutex);
+    n = gconf.concurrency > 0 ? gconf.concurrency : 2;
+    if(n > TASK_MAX_WORKERS / 2)
+      n = TASK_MAX_WORKERS / 2;
+    // Core queues may receive tasks before their thread is started
+    // so they must always be included when looking for work
+    if(task_num_workers < n)
+      task_num_workers = n;
+    task_num_core_workers = n;
+    hts_mutex_unlock(&task_sched_mutex);
+  }
+  return n;
+}
 
-  hts_mutex_lock(&task_mutex);
-  while(1) {
-    t = TAILQ_FIRST(&tasks);
-    tg = TAILQ_FIRST(&task_groups);
 
-    if(t == NULL && tg == NULL) {
-      if(num_task_threads_avail == MAX_IDLE_TASK_THREADS)
-        break;
+/**
+ * Must be called with task_sched_mutex held
+ */
+static void
+task_spawn_worker(int cores)
+{
+  task_worker_t *tw = NULL;
 
-      num_task_threads_avail++;
-      hts_cond_wait(&task_cond, &task_mutex);
-      num_task_threads_avail--;
-      continue;
+  for(int i = 0; i < TASK_MAX_WORKERS; i++) {
+    if(!task_workers[i].tw_running) {
+      tw = &task_workers[i];
+      break;
     }
+  }
 
-    if(t != NULL) {
-      TAILQ_REMOVE(&tasks, t, t_link);
-      hts_mutex_unlock(&task_mutex);
-      t->t_fn(t->t_opaque);
-      free(t);
-      hts_mutex_lock(&task_mutex);
-      // Released lock, must recheck for task groups
-      tg = TAILQ_FIRST(&task_groups);
-    }
+  if(tw == NULL)
+    return;
 
-    if(tg != NULL) {
-      // Remove task group while processing as we don't want anyone
-      // else to dispatch from this group
-      TAILQ_REMOVE(&task_groups, tg, tg_link);
+  tw->tw_running = 1;
+  tw->tw_overflow = tw->tw_index >= cores;
+  task_num_threads++;
+  if(tw->tw_index >= task_num_workers)
+    task_num_workers = tw->tw_index + 1;
 
-      t = TAILQ_FIRST(&tg->tg_tasks);
-      hts_mutex_unlock(&task_mutex);
-      t->t_fn(t->t_opaque);
-      hts_mutex_lock(&task_mutex);
+  hts_thread_create_detached("tasks", task_thread, tw, THREAD_PRIO_BGTASK);
+}
 
-      // Note that we remove _after_ execution because we don't want
-      // any newly inserted task in this group to cause the group
-      // to activate (ie, get inserted in task_groups)
-      TAILQ_REMOVE(&tg->tg_tasks, t, t_link);
-      free(t);
 
-      if(TAILQ_FIRST(&tg->tg_tasks) != NULL) {
-        // Still more tasks to work on in this group
-        // Reinsert group at tail to maintain fairness between groups
-        TAILQ_INSERT_TAIL(&task_groups, tg, tg_link);
-      }
+/**
+ * Called after a task has been queued, make sure someone will pick it up
+ */
+static void
+task_schedule(void)
+{
+  if(atomic_get(&task_idle) > 0) {
+    hts_mutex_lock(&task_sched_mutex);
+    hts_cond_signal(&task_sched_cond);
+    hts_mutex_unlock(&task_sched_mutex);
+    return;
+  }
 
-      // Decrease refcount owned by task
-      task_group_release(tg);
-    }
+  const int cores = task_get_num_core_workers();
+
+  if(task_num_threads >= cores &&
+     atomic_get(&task_pending) <= task_num_threads)
+    return;
+
+  hts_mutex_lock(&task_sched_mutex);
+  if(atomic_get(&task_idle) == 0 &&
+     (task_num_threads < cores ||
+      atomic_get(&task_pending) > task_num_threads))
+    task_spawn_worker(cores);
+  hts_mutex_unlock(&task_sched_mutex);
+}
+
+
+/**
+ *
+ */
+static void
+task_push(task_t *t)
+{
+  task_worker_t *tw = hts_thread_get_specific(task_worker_key);
+
+  if(tw == NULL) {
+    unsigned int rr = atomic_add_and_fetch(&task_rr, 1);
+    tw = &task_workers[rr % task_get_num_core_workers()];
   }
 
-  num_task_threads--;
-  hts_mutex_unlock(&task_mutex);
-  return NULL;
+  hts_mutex_lock(&tw->tw_mutex);
+  TAILQ_INSERT_TAIL(&tw->tw_tasks[t->t_prio], t, t_link);
+  hts_mutex_unlock(&tw->tw_mutex);
+
+  // Must be a full barrier before task_schedule() checks task_idle.
+  // Pairs with the atomic_inc(&task_idle) in task_thread()
+  atomic_inc(&task_pending);
+  task_schedule();
 }
 
 
 /**
  *
  */
+static task_t *
+task_dequeue(task_worker_t *tw, int prio)
+{
+  // Unlocked peek, it's just a hint to avoid taking every lock
+  if(TAILQ_FIRST(&tw->tw_tasks[prio]) == NULL)
+    return NULL;
+
+  hts_mutex_lock(&tw->tw_mutex);
+  task_t *t = TAILQ_FIRST(&tw->tw_tasks[prio]);
+  if(t != NULL)
+    TAILQ_REMOVE(&tw->tw_tasks[prio], t, t_link);
+  hts_mutex_unlock(&tw->tw_mutex);
+  return t;
+}
+
+
+/**
+ *
+ */
+static task_t *
+task_get(task_worker_t *self)
+{
+  task_t *t;
+  const int n = task_num_workers;
+
+  for(int prio = 0; prio < TASK_PRIO_num; prio++) {
+    if((t = task_dequeue(self, prio)) != NULL)
+      return t;
+
+    for(int i = 1; i < n; i++) {
+      task_worker_t *tw = &task_workers[(self->tw_index + i) % n];
+      if((t = task_dequeue(tw, prio)) != NULL)
+        return t;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * Run the first task in a group. The task is removed from the group
+ * _after_ execution because we don't want any newly inserted task in
+ * this group to cause the group to activate (ie, get queued)
+ */
 static void
-task_schedule()
-{
-  if(num_task_threads_avail > 0) {
-    hts_cond_signal(&task_cond);
-  } else {
-    if(num_task_threads < MAX_TASK_THREADS) {
-      num_task_threads++;
-      hts_thread_create_detached("tasks", task_thread, NULL,
-                                 THREAD_PRIO_BGTASK);
+task_group_run(task_group_t *tg)
+{
+  hts_mutex_lock(&task_group_mutex);
+  task_t *t = TAILQ_FIRST(&tg->tg_tasks);
+  hts_mutex_unlock(&task_group_mutex);
+
+  t->t_fn(t->t_opaque);
+
+  hts_mutex_lock(&task_group_mutex);
+  TAILQ_REMOVE(&tg->tg_tasks, t, t_link);
+  const int more = TAILQ_FIRST(&tg->tg_tasks) != NULL;
+  hts_mutex_unlock(&task_group_mutex);
+  free(t);
+
+  // Still more tasks to work on in this group. Requeue at tail
+  // to maintain fairness between groups
+  if(more)
+    task_push(&tg->tg_runner);
+
+  // Decrease refcount owned by task
+  task_group_release(tg);
+}
+
+
+/**
+ *
+ */
+static void *
+task_thread(void *aux)
+{
+  task_worker_t *tw = aux;
+  task_t *t;
+
+  hts_thread_set_specific(task_worker_key, tw);
+
+  while(1) {
+
+    if((t = task_get(tw)) != NULL) {
+      atomic_dec(&task_pending);
+
+      if(t->t_fn == NULL) {
+        task_group_run(t->t_group);
+        continue;
+      }
+
+      if(t->t_cancellable != NULL &&
+         cancellable_is_cancelled(t->t_cancellable)) {
+        if(t->t_cancelled != NULL)
+          t->t_cancelled(t->t_opaque);
+      } else {
+        tw->tw_current = t;
+        t->t_fn(t->t_opaque);
+        tw->tw_current = NULL;
+      }
+      cancellable_release(t->t_cancellable);
+      free(t);
+      continue;
+    }
+
+    hts_mutex_lock(&task_sched_mutex);
+
+    // Must be a full barrier before checking task_pending.
+    // Pairs with the atomic_inc(&task_pending) in task_push()
+    atomic_inc(&task_idle);
+
+    if(atomic_get(&task_pending) == 0) {
+      if(!tw->tw_overflow) {
+        hts_cond_wait(&task_sched_cond, &task_sched_mutex);
+      } else if(hts_cond_wait_timeout(&task_sched_cond, &task_sched_mutex,
+                                      TASK_OVERFLOW_LINGER) &&
+                atomic_get(&task_pending) == 0) {
+        // Only we can queue on our own queue, so it's empty here
+        for(int prio = 0; prio < TASK_PRIO_num; prio++)
+          assert(TAILQ_FIRST(&tw->tw_tasks[prio]) == NULL);
+        atomic_dec(&task_idle);
+        tw->tw_running = 0;
+        task_num_threads--;
+        hts_mutex_unlock(&task_sched_mutex);
+        break;
+      }
     }
+    atomic_dec(&task_idle);
+    hts_mutex_unlock(&task_sched_mutex);
   }
+
+  hts_thread_set_specific(task_worker_key, NULL);
+  return NULL;
 }
 
 
@@ -157,17 +353,40 @@ task_schedule()
  */
 void
 task_run(task_fn_t *fn, void *opaque)
+{
+  task_run_prio(fn, opaque, TASK_PRIO_INTERACTIVE, NULL, NULL);
+}
+
+
+/**
+ *
+ */
+void
+task_run_prio(task_fn_t *fn, void *opaque, task_prio_t prio,
+              cancellable_t *c, task_fn_t *cancelled)
 {
   task_t *t = calloc(1, sizeof(task_t));
   t->t_fn = fn;
   t->t_opaque = opaque;
-  hts_mutex_lock(&task_mutex);
-  TAILQ_INSERT_TAIL(&tasks, t, t_link);
-  task_schedule();
-  hts_mutex_unlock(&task_mutex);
+  t->t_prio = prio;
+  t->t_cancellable = cancellable_retain(c);
+  t->t_cancelled = cancelled;
+  task_push(t);
 }
 
 
+/**
+ *
+ */
+cancellable_t *
+task_cancellable(void)
+{
+  task_worker_t *tw = hts_thread_get_specific(task_worker_key);
+  if(tw == NULL || tw->tw_current == NULL)
+    return NULL;
+  return tw->tw_current->t_cancellable;
+}
+
 
 /**
  *
@@ -178,6 +397,7 @@ task_group_create(void)
   task_group_t *tg = calloc(1, sizeof(task_group_t));
   atomic_set(&tg->tg_refcount, 1);
   TAILQ_INIT(&tg->tg_tasks);
+  tg->tg_runner.t_group = tg;
   return tg;
 }
 
@@ -203,13 +423,14 @@ task_run_in_group(task_fn_t *fn, void *opaque, task_group_t *tg)
   t->t_opaque = opaque;
   t->t_group = tg;
   atomic_inc(&tg->tg_refcount);
-  hts_mutex_lock(&task_mutex);
-  if(TAILQ_FIRST(&tg->tg_tasks) == NULL)
-    TAILQ_INSERT_TAIL(&task_groups, tg, tg_link);
 
+  hts_mutex_lock(&task_group_mutex);
+  const int activate = TAILQ_FIRST(&tg->tg_tasks) == NULL;
   TAILQ_INSERT_TAIL(&tg->tg_tasks, t, t_link);
-  task_schedule();
-  hts_mutex_unlock(&task_mutex);
+  hts_mutex_unlock(&task_group_mutex);
+
+  if(activate)
+    task_push(&tg->tg_runner);
 }
 
 
@@ -218,6 +439,165 @@ task_run_in_group(task_fn_t *fn, void *opaque, task_group_t *tg)
  */
 INITIALIZER(taskinit)
 {
-  hts_mutex_init(&task_mutex);
-  hts_cond_init(&task_cond, &task_mutex);
+  hts_mutex_init(&task_sched_mutex);
+  hts_cond_init(&task_sched_cond, &task_sched_mutex);
+  hts_mutex_init(&task_group_mutex);
+  hts_thread_key_create(&task_worker_key, NULL);
+
+  for(int i = 0; i < TASK_MAX_WORKERS; i++) {
+    task_worker_t *tw = &task_workers[i];
+    hts_mutex_init(&tw->tw_mutex);
+    for(int prio = 0; prio < TASK_PRIO_num; prio++)
+      TAILQ_INIT(&tw->tw_tasks[prio]);
+    tw->tw_index = i;
+  }
 }
+
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Benchmark
+ */
+static atomic_t bench_done;
+static atomic_t bench_skipped;
+static int64_t bench_latency;
+static HTS_MUTEX_DECL(bench_mutex);
+static int bench_order_errors;
+
+static void
+bench_nop(void *aux)
+{
+  atomic_inc(&bench_done);
+}
+
+static void
+bench_skip(void *aux)
+{
+  atomic_inc(&bench_skipped);
+  atomic_inc(&bench_done);
+}
+
+static void
+bench_latency_task(void *aux)
+{
+  int64_t *ts = aux;
+  hts_mutex_lock(&bench_mutex);
+  bench_latency += arch_get_ts() - *ts;
+  hts_mutex_unlock(&bench_mutex);
+  free(ts);
+  atomic_inc(&bench_done);
+}
+
+static void
+bench_spin(void *aux)
+{
+  int64_t ts = arch_get_ts();
+  while(arch_get_ts() < ts + 50) {}
+  atomic_inc(&bench_done);
+}
+
+static void
+bench_fanout(void *aux)
+{
+  intptr_t depth = (intptr_t)aux;
+  if(depth > 0) {
+    task_run(bench_fanout, (void *)(depth - 1));
+    task_run(bench_fanout, (void *)(depth - 1));
+  }
+  atomic_inc(&bench_done);
+}
+
+static void
+bench_group_task(void *aux)
+{
+  static intptr_t expect;
+  if((intptr_t)aux != expect)
+    bench_order_errors++;
+  expect = (intptr_t)aux + 1;
+  atomic_inc(&bench_done);
+}
+
+static void
+bench_wait(int count)
+{
+  while(atomic_get(&bench_done) < count)
+    usleep(100);
+  atomic_set(&bench_done, 0);
+}
+
+static void
+bench_submit_latency(int count, int delay)
+{
+  bench_latency = 0;
+  for(int i = 0; i < count; i++) {
+    int64_t *p = malloc(sizeof(int64_t));
+    *p = arch_get_ts();
+    task_run(bench_latency_task, p);
+    usleep(delay);
+  }
+}
+
+static void
+task_bench(void)
+{
+  const int count = 1000000;
+  int64_t ts;
+
+  ts = arch_get_ts();
+  for(int i = 0; i < count; i++)
+    task_run(bench_nop, NULL);
+  bench_wait(count);
+  ts = arch_get_ts() - ts;
+  TRACE(TRACE_INFO, "bench", "task: %d external tasks in %dms, %.0f tasks/s",
+        count, (int)(ts / 1000), count * 1000000.0 / ts);
+
+  const int fcount = (1 << 20) - 1;
+  ts = arch_get_ts();
+  task_run(bench_fanout, (void *)(intptr_t)19);
+  bench_wait(fcount);
+  ts = arch_get_ts() - ts;
+  TRACE(TRACE_INFO, "bench", "task: %d fanout tasks in %dms, %.0f tasks/s",
+        fcount, (int)(ts / 1000), fcount * 1000000.0 / ts);
+
+  const int lcount = 10000;
+  bench_submit_latency(lcount, 50);
+  bench_wait(lcount);
+  TRACE(TRACE_INFO, "bench", "task: Average dispatch latency: %dus",
+        (int)(bench_latency / lcount));
+
+  const int bgcount = 2000;
+  for(int i = 0; i < bgcount; i++)
+    task_run_prio(bench_spin, NULL, TASK_PRIO_BACKGROUND, NULL, NULL);
+  bench_submit_latency(100, 100);
+  bench_wait(bgcount + 100);
+  TRACE(TRACE_INFO, "bench",
+        "task: Average dispatch latency with background load: %dus",
+        (int)(bench_latency / 100));
+
+  // Cancel a backlog, everything not yet started should be skipped
+  const int ccount = 100000;
+  cancellable_t *c = cancellable_create();
+  for(int i = 0; i < ccount; i++)
+    task_run_prio(bench_spin, NULL, TASK_PRIO_BACKGROUND, c, bench_skip);
+  ts = arch_get_ts();
+  cancellable_cancel(c);
+  bench_wait(ccount);
+  ts = arch_get_ts() - ts;
+  cancellable_release(c);
+  TRACE(TRACE_INFO, "bench",
+        "task: %d of %d cancelled tasks skipped, backlog gone in %dms",
+        atomic_get(&bench_skipped), ccount, (int)(ts / 1000));
+
+  const int gcount = 100000;
+  task_group_t *tg = task_group_create();
+  for(int i = 0; i < gcount; i++)
+    task_run_in_group(bench_group_task, (void *)(intptr_t)i, tg);
+  bench_wait(gcount);
+  task_group_destroy(tg);
+  TRACE(TRACE_INFO, "bench", "task: Group ordering errors: %d",
+        bench_order_errors);
+}
+
+BENCHMARK("task", task_bench);
+#endif
@@ -19,12 +19,46 @@
  */
 #pragma once
 
+#include "misc/cancellable.h"
+
 typedef struct task_group task_group_t;
 
 typedef void (task_fn_t)(void *opaque);
 
+/**
+ * Workers always pick tasks from the highest priority class available.
+ * task_run() and task groups use TASK_PRIO_INTERACTIVE
+ */
+typedef enum {
+  TASK_PRIO_INTERACTIVE,  // User is waiting for the result
+  TASK_PRIO_PREFETCH,     // Speculative work that might be needed soon
+  TASK_PRIO_BACKGROUND,   // Housekeeping, reporting, etc
+  TASK_PRIO_num
+} task_prio_t;
+
 void task_run(task_fn_t *fn, void *opaque);
 
+/**
+ * Run a task with the given priority.
+ *
+ * 'c' is the handle for the task, it's retained until the task is gone.
+ * If 'c' is cancelled while the task is still queued 'fn' is never
+ * invoked. 'cancelled' (if non-NULL) is called instead so 'opaque' can
+ * be released.
+ *
+ * Once running, cancellation is cooperative. 'fn' can get 'c' via
+ * task_cancellable() and is expected to pass it on to any I/O and
+ * decoding it does
+ */
+void task_run_prio(task_fn_t *fn, void *opaque, task_prio_t prio,
+                   cancellable_t *c, task_fn_t *cancelled);
+
+/**
+ * Return the cancellable of the task executing on the calling thread,
+ * NULL if there is none
+ */
+cancellable_t *task_cancellable(void);
+
 task_group_t *task_group_create(void);
 
 void task_group_destroy(task_group_t *tg);
@@ -118,11 +118,15 @@ typedef struct glyph {
 
   FT_BBox bbox;
 
+  pixmap_t *pm;  // Coverage, shared with images via TR_RENDER_GLYPHS
+  uint32_t id;
+
 } glyph_t;
 
 static struct glyph_list glyph_hash[GLYPH_HASH_SIZE];
 static struct glyph_queue allglyphs;
 static int num_glyphs;
+static uint32_t glyph_id_tally;
 
 /**
  *
@@ -173,6 +177,8 @@ glyph_destroy(glyph_t *g)
     FT_Done_Glyph(g->bmp);
   if(g->outline)
     FT_Done_Glyph(g->outline);
+  if(g->pm != NULL)
+    pixmap_release(g->pm);
   free(g);
   num_glyphs--;
 }
@@ -680,6 +686,40 @@ draw_glyph(pixmap_t *pm, int left, int top, FT_Bitmap *bmp, int color)
 }
 
 
+/**
+ * Place a glyph in an image instead of drawing it
+ *
+ * The coverage bitmap is kept with the glyph so all images
+ * referring to it share the same pixmap (and id)
+ */
+static void
+place_glyph(image_component_glyphs_t *igs, glyph_t *g, int left, int top,
+            const FT_Bitmap *bmp, uint32_t color)
+{
+  if(bmp->width == 0 || bmp->rows == 0)
+    return;
+
+  if(g->pm == NULL) {
+    g->pm = pixmap_create(bmp->width, bmp->rows, PIXMAP_I, 0);
+    if(g->pm == NULL)
+      return;
+
+    for(int y = 0; y < bmp->rows; y++)
+      memcpy(g->pm->pm_data + y * g->pm->pm_linesize,
+             bmp->buffer + y * bmp->pitch, bmp->width);
+
+    g->id = ++glyph_id_tally;
+  }
+
+  image_glyph_t *ig = &igs->ig_glyphs[igs->ig_count++];
+  ig->pm = pixmap_dup(g->pm);
+  ig->id = g->id;
+  ig->color = color;
+  ig->x = left;
+  ig->y = top;
+}
+
+
 /**
  *
  */
@@ -740,7 +780,8 @@ static void
 draw_glyphs(pixmap_t *pm, struct line_queue *lq, int target_height,
 	    int siz_x, item_t *items, int start_x, int start_y,
 	    int origin_y, int margin, int pass,
-            image_component_text_info_t *ti)
+            image_component_text_info_t *ti,
+            image_component_glyphs_t *igs)
 {
   FT_Vector pen;
   line_t *li;
@@ -754,6 +795,9 @@ draw_glyphs(pixmap_t *pm, struct line_queue *lq, int target_height,
     pen_y -= li->height * 64;
 
     if(li->type == LINE_TYPE_HR) {
+      if(pm == NULL)
+        continue;
+
       int ypos = 0;
       ypos = target_height - (pen_y + li->height * 64);
 
@@ -891,11 +935,13 @@ draw_glyphs(pixmap_t *pm, struct line_queue *lq, int target_height,
 
       if(pass == 2 && g->bmp != NULL) {
 	FT_BitmapGlyph bmp = (FT_BitmapGlyph)g->bmp;
-	draw_glyph(pm,
-		   bmp->left + margin + pen.x,
-		   target_height - bmp->top + margin - pen.y,
-		   &bmp->bitmap,
-		   items[i].color);
+        const int left = bmp->left + margin + pen.x;
+        const int top = target_height - bmp->top + margin - pen.y;
+
+        if(igs != NULL)
+          place_glyph(igs, g, left, top, &bmp->bitmap, items[i].color);
+        else
+          draw_glyph(pm, left, top, &bmp->bitmap, items[i].color);
 
 	if(ti != NULL && ti->ti_charpos != NULL) {
 	  ti->ti_charpos[i * 2 + 0] = bmp->left + pen.x;
@@ -957,6 +1003,7 @@ text_render0(const uint32_t *uc, const int len,
 
   int need_shadow_pass = 0;
   int need_outline_pass = 0;
+  int have_hr = 0;
 
   const char *current_font = default_font;
   int current_domain = default_domain;
@@ -1038,6 +1085,7 @@ text_render0(const uint32_t *uc, const int len,
       li->color = current_color | current_alpha;
       TAILQ_INSERT_TAIL(&lq, li, link);
       li = NULL;
+      have_hr = 1;
       continue;
 
     case TR_CODE_CENTER_ON:
@@ -1402,8 +1450,21 @@ text_render0(const uint32_t *uc, const int len,
   img->im_margin = margin;
 
   pixmap_t *pm = NULL;
+  image_component_glyphs_t *igs = NULL;
+
+  // Shadows, outlines and rulers are only drawn into bitmaps
+
+  const int glyph_output = flags & TR_RENDER_GLYPHS &&
+    !(flags & TR_RENDER_DEBUG) &&
+    !need_shadow_pass && !need_outline_pass && !have_hr;
 
-  if(!(flags & TR_RENDER_NO_OUTPUT)) {
+  if(flags & TR_RENDER_NO_OUTPUT) {
+    // Only dimensioning
+  } else if(glyph_output) {
+    img->im_components[1].type = IMAGE_GLYPHS;
+    igs = &img->im_components[1].glyphs;
+    igs->ig_glyphs = malloc(sizeof(image_glyph_t) * MAX(out, 1));
+  } else {
     pm = pixmap_create(target_width, target_height,
                        color_output ? PIXMAP_BGR32 : PIXMAP_IA, margin);
 
@@ -1422,7 +1483,12 @@ text_render0(const uint32_t *uc, const int len,
     ti->ti_charpos = malloc(2 * len * sizeof(int));
   }
 
-  if(pm != NULL) {
+  if(igs != NULL) {
+
+    draw_glyphs(NULL, &lq, target_height, siz_x, items, start_x, start_y,
+                origin_y, margin, 2, ti, igs);
+
+  } else if(pm != NULL) {
 
     if(flags & TR_RENDER_DEBUG) {
       uint8_t *data = pm->pm_data;
@@ -1438,17 +1504,17 @@ text_render0(const uint32_t *uc, const int len,
 
     if(need_shadow_pass) {
       draw_glyphs(pm, &lq, target_height, siz_x, items, start_x, start_y,
-                  origin_y, margin, 0, NULL);
+                  origin_y, margin, 0, NULL, NULL);
       pixmap_box_blur(pm, 4, 4);
     }
 
     if(need_outline_pass)
       draw_glyphs(pm, &lq, target_height, siz_x, items, start_x, start_y,
-                  origin_y, margin, 1, NULL);
+                  origin_y, margin, 1, NULL, NULL);
 
 
     draw_glyphs(pm, &lq, target_height, siz_x, items, start_x, start_y,
-                origin_y, margin, 2, ti);
+                origin_y, margin, 2, ti, NULL);
   }
   free(items);
 
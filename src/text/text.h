@@ -74,6 +74,8 @@ struct prop;
 #define TR_RENDER_OUTLINE       0x40
 #define TR_RENDER_NO_OUTPUT     0x80
 #define TR_RENDER_SUBS          0x100  // Render for subtitles
+#define TR_RENDER_GLYPHS        0x200  /* Output placed glyphs instead
+                                          of a bitmap when possible */
 
 #define TR_ALIGN_AUTO      0
 #define TR_ALIGN_LEFT      1
@@ -221,6 +221,7 @@ glw_init4(glw_root_t *gr,
 
   gr->gr_prop_dispatcher = dispatcher;
   gr->gr_courier = courier;
+  prop_courier_set_flags(courier, PROP_COURIER_COALESCE);
   gr->gr_init_flags = flags;
   gr->gr_prop_maxtime = -1;
 
@@ -260,6 +261,8 @@ glw_init4(glw_root_t *gr,
   gr->gr_prop_width         = prop_create(gr->gr_prop_ui, "width");
   gr->gr_prop_height        = prop_create(gr->gr_prop_ui, "height");
   gr->gr_prop_aspect        = prop_create(gr->gr_prop_ui, "aspect");
+  gr->gr_prop_render_jobs   = prop_create(gr->gr_prop_ui, "renderJobs");
+  gr->gr_prop_draw_calls    = prop_create(gr->gr_prop_ui, "drawCalls");
 
   prop_set_int(gr->gr_screensaver_active, 0);
 
@@ -364,6 +367,7 @@ glw_fini(glw_root_t *gr)
   free(gr->gr_vtmp_buffer);
   free(gr->gr_render_jobs);
   free(gr->gr_render_order);
+  free(gr->gr_batch_jobs);
   free(gr->gr_vertex_buffer);
   free(gr->gr_index_buffer);
   rstr_release(gr->gr_pending_focus);
@@ -441,6 +445,38 @@ update_in_path(glw_t *w)
 }
 
 
+/**
+ *
+ */
+static inline void
+glw_class_layout(glw_root_t *gr, glw_t *w, const glw_rctx_t *rc)
+{
+#if ENABLE_BENCHMARKS
+  if(unlikely(gr->gr_layout_hook != NULL)) {
+    gr->gr_layout_hook(w, rc);
+    return;
+  }
+#endif
+  w->glw_class->gc_layout(w, rc);
+}
+
+
+/**
+ *
+ */
+static inline void
+glw_class_render(glw_root_t *gr, glw_t *w, const glw_rctx_t *rc)
+{
+#if ENABLE_BENCHMARKS
+  if(unlikely(gr->gr_render_hook != NULL)) {
+    gr->gr_render_hook(w, rc);
+    return;
+  }
+#endif
+  w->glw_class->gc_render(w, rc);
+}
+
+
 /**
  *
  */
@@ -485,9 +521,9 @@ glw_layout0(glw_t *w, const glw_rctx_t *rc)
     if(rc0.rc_width < 1 || rc0.rc_height < 1)
       return;
 
-    w->glw_class->gc_layout(w, &rc0);
+    glw_class_layout(gr, w, &rc0);
   } else {
-    w->glw_class->gc_layout(w, rc);
+    glw_class_layout(gr, w, rc);
   }
 }
 
@@ -495,6 +531,8 @@ glw_layout0(glw_t *w, const glw_rctx_t *rc)
 void
 glw_render0(glw_t *w, const glw_rctx_t *rc)
 {
+  glw_root_t *gr = w->glw_root;
+
   if(unlikely(w->glw_zoffset)) {
     glw_rctx_t rc0 = *rc;
     int zmax = 0;
@@ -511,7 +549,7 @@ glw_render0(glw_t *w, const glw_rctx_t *rc)
       if(rc0.rc_width < 1 || rc0.rc_height < 1)
         return;
     }
-    w->glw_class->gc_render(w, &rc0);
+    glw_class_render(gr, w, &rc0);
 
   } else if(unlikely(w->glw_flags & GLW_HAVE_MARGINS)) {
     glw_rctx_t rc0 = *rc;
@@ -523,13 +561,13 @@ glw_render0(glw_t *w, const glw_rctx_t *rc)
     if(rc0.rc_width < 1 || rc0.rc_height < 1)
       return;
 
-    w->glw_class->gc_render(w, &rc0);
+    glw_class_render(gr, w, &rc0);
   } else {
-    w->glw_class->gc_render(w, rc);
+    glw_class_render(gr, w, rc);
   }
 
   if(unlikely(w->glw_flags2 & GLW2_DEBUG))
-    glw_wirebox(w->glw_root, rc);
+    glw_wirebox(gr, rc);
 }
 
 
@@ -707,6 +745,13 @@ glw_prepare_frame(glw_root_t *gr, int flags)
   if(gr->gr_prop_dispatcher != NULL)
     gr->gr_prop_dispatcher(gr->gr_courier, gr->gr_prop_maxtime);
 
+  if((gr->gr_frames & 0xf) == 0) {
+    int notifies, coalesced;
+    prop_courier_get_stats(gr->gr_courier, &notifies, &coalesced);
+    prop_set(gr->gr_prop_ui, "propNotifies", PROP_SET_INT, notifies);
+    prop_set(gr->gr_prop_ui, "propCoalesced", PROP_SET_INT, coalesced);
+  }
+
   LIST_FOREACH(w, &gr->gr_every_frame_list, glw_every_frame_link)
     w->glw_class->gc_newframe(w, flags);
 
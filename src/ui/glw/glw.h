@@ -109,6 +109,8 @@ typedef struct glw_rect {
 #include "glw_gx.h"
 #elif CONFIG_GLW_BACKEND_RSX
 #include "glw_rsx.h"
+#elif CONFIG_GLW_BACKEND_NULL
+#include "glw_null.h"
 #else
 #error No backend for glw
 #endif
@@ -803,6 +805,7 @@ typedef struct glw_root {
   struct glw *gr_universe;
 
   LIST_HEAD(, glw_cached_view) gr_views;
+  LIST_HEAD(, glw_view_file) gr_view_files;
 
   char *gr_skin;
 
@@ -830,6 +833,8 @@ typedef struct glw_root {
   prop_t *gr_prop_width;
   prop_t *gr_prop_height;
   prop_t *gr_prop_aspect;
+  prop_t *gr_prop_render_jobs;
+  prop_t *gr_prop_draw_calls;
 
   float gr_mouse_x;
   float gr_mouse_y;
@@ -885,12 +890,16 @@ typedef struct glw_root {
   rstr_t *gr_default_font;
   int gr_font_domain;
 
+  struct glw_glyph_atlas *gr_glyph_atlas;
+  int gr_glyph_atlas_flush_frame;
+
   /**
    * Image/Texture loader
    */
   int gr_tex_threads_running;
 #define GLW_TEXTURE_THREADS 6
   hts_thread_t gr_tex_threads[GLW_TEXTURE_THREADS];
+  int gr_tex_tasks;  // Load tasks in flight, see glt_enqueue()
 
   LIST_HEAD(,  glw_image) gr_icons;
   hts_cond_t gr_tex_load_cond;
@@ -898,7 +907,7 @@ typedef struct glw_root {
 #define LQ_SKIN       0
 #define LQ_TENTATIVE  1
 #define LQ_THUMBS     2
-#define LQ_OTHER      3
+#define LQ_OTHER      3  // Loaded by tasks
 #define LQ_REFRESH    4
 #define LQ_num        5
 
@@ -953,6 +962,16 @@ typedef struct glw_root {
   glw_backend_root_t gr_be;
   void (*gr_be_render_unlocked)(struct glw_root *gr);
   struct pixmap *(*gr_br_read_pixels)(struct glw_root *gr);
+
+#if ENABLE_BENCHMARKS
+  /**
+   * If set, these are invoked instead of gc_layout / gc_render.
+   * Used by the headless frontend for accounting cost per widget class
+   */
+  void (*gr_layout_hook)(struct glw *w, const struct glw_rctx *rc);
+  void (*gr_render_hook)(struct glw *w, const struct glw_rctx *rc);
+#endif
+
   /**
    * Settings
    */
@@ -1008,6 +1027,10 @@ typedef struct glw_root {
   struct glw_render_job *gr_render_jobs;
   struct glw_render_order *gr_render_order;
 
+  int gr_num_unbatched_jobs;  // gr_num_render_jobs before batching
+  int gr_batch_jobs_capacity;
+  struct glw_render_job *gr_batch_jobs;
+
   float *gr_vertex_buffer;
   int gr_vertex_buffer_capacity;
   int gr_vertex_offset;
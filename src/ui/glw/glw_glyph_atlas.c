@@ -0,0 +1,406 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+#include <stdio.h>
+
+#include "main.h"
+#include "glw.h"
+#include "glw_texture.h"
+#include "glw_glyph_atlas.h"
+#include "image/image.h"
+#include "image/pixmap.h"
+#include "text/text.h"
+
+/**
+ * Glyph atlas
+ *
+ * Glyphs from text_render(TR_RENDER_GLYPHS) are packed into a single
+ * luminance + alpha texture shared by all text widgets in a root, so
+ * a caption is just a set of quads. Glyphs are packed on shelves
+ * (rows of glyphs of similar height). When the atlas is full it's
+ * flushed and the generation is bumped. Users compare the generation
+ * to know when their texture coordinates are stale.
+ */
+
+#define GGA_WIDTH       1024
+#define GGA_HEIGHT      1024
+#define GGA_MAX_SHELVES 128
+#define GGA_PADDING     1
+
+#define GGA_HASH_SIZE 256
+#define GGA_HASH_MASK (GGA_HASH_SIZE-1)
+
+LIST_HEAD(glw_atlas_glyph_list, glw_atlas_glyph);
+
+typedef struct gga_shelf {
+  int16_t gs_y;
+  int16_t gs_height;
+  int16_t gs_x;  // Next free position
+} gga_shelf_t;
+
+
+struct glw_glyph_atlas {
+  pixmap_t *gga_pm;
+  glw_backend_texture_t gga_texture;
+
+  struct glw_atlas_glyph_list gga_hash[GGA_HASH_SIZE];
+
+  gga_shelf_t gga_shelves[GGA_MAX_SHELVES];
+  int gga_num_shelves;
+  int gga_next_y;
+
+  int gga_generation;
+  char gga_dirty;
+};
+
+
+/**
+ * Luminance is always max, glyph coverage goes into alpha
+ */
+static void
+gga_clear(glw_glyph_atlas_t *gga)
+{
+  pixmap_t *pm = gga->gga_pm;
+
+  for(int y = 0; y < pm->pm_height; y++) {
+    uint8_t *d = pm->pm_data + y * pm->pm_linesize;
+    for(int x = 0; x < pm->pm_width; x++) {
+      *d++ = 0xff;
+      *d++ = 0;
+    }
+  }
+  gga->gga_dirty = 1;
+}
+
+
+/**
+ *
+ */
+glw_glyph_atlas_t *
+glw_glyph_atlas_create(void)
+{
+  glw_glyph_atlas_t *gga = calloc(1, sizeof(glw_glyph_atlas_t));
+
+  gga->gga_pm = pixmap_create(GGA_WIDTH, GGA_HEIGHT, PIXMAP_IA, 0);
+  if(gga->gga_pm == NULL) {
+    free(gga);
+    return NULL;
+  }
+  gga_clear(gga);
+  return gga;
+}
+
+
+/**
+ *
+ */
+static void
+gga_free_glyphs(glw_glyph_atlas_t *gga)
+{
+  glw_atlas_glyph_t *gag;
+
+  for(int i = 0; i < GGA_HASH_SIZE; i++) {
+    while((gag = LIST_FIRST(&gga->gga_hash[i])) != NULL) {
+      LIST_REMOVE(gag, gag_link);
+      free(gag);
+    }
+  }
+  gga->gga_num_shelves = 0;
+  gga->gga_next_y = 0;
+}
+
+
+/**
+ *
+ */
+void
+glw_glyph_atlas_destroy(glw_root_t *gr, glw_glyph_atlas_t *gga)
+{
+  gga_free_glyphs(gga);
+  glw_tex_destroy(gr, &gga->gga_texture);
+  pixmap_release(gga->gga_pm);
+  free(gga);
+}
+
+
+/**
+ * Drop all glyphs and the texture (we might have lost the GL context)
+ */
+void
+glw_glyph_atlas_flush(glw_root_t *gr, glw_glyph_atlas_t *gga)
+{
+  gga_free_glyphs(gga);
+  gga_clear(gga);
+  glw_tex_destroy(gr, &gga->gga_texture);
+  gga->gga_generation++;
+}
+
+
+/**
+ * Find a shelf with room for a w x h glyph, open a new one if
+ * the existing ones are full or much too tall
+ */
+static gga_shelf_t *
+gga_shelf_find(glw_glyph_atlas_t *gga, int w, int h)
+{
+  gga_shelf_t *best = NULL;
+
+  if(w > GGA_WIDTH)
+    return NULL;
+
+  for(int i = 0; i < gga->gga_num_shelves; i++) {
+    gga_shelf_t *gs = &gga->gga_shelves[i];
+    if(gs->gs_height < h || gs->gs_x + w > GGA_WIDTH)
+      continue;
+    if(best == NULL || gs->gs_height < best->gs_height)
+      best = gs;
+  }
+
+  if(best != NULL && best->gs_height * 3 <= h * 4)
+    return best;
+
+  const int height = (h + 3) & ~3;
+
+  if(gga->gga_num_shelves == GGA_MAX_SHELVES ||
+     gga->gga_next_y + height > GGA_HEIGHT)
+    return best;
+
+  gga_shelf_t *gs = &gga->gga_shelves[gga->gga_num_shelves++];
+  gs->gs_y = gga->gga_next_y;
+  gs->gs_height = height;
+  gs->gs_x = 0;
+  gga->gga_next_y += height;
+  return gs;
+}
+
+
+/**
+ * Return the atlas location of a glyph, inserting it if needed.
+ *
+ * Returns NULL if the atlas is full
+ */
+const glw_atlas_glyph_t *
+glw_glyph_atlas_get(glw_glyph_atlas_t *gga, const image_glyph_t *ig)
+{
+  struct glw_atlas_glyph_list *l = &gga->gga_hash[ig->id & GGA_HASH_MASK];
+  glw_atlas_glyph_t *gag;
+
+  LIST_FOREACH(gag, l, gag_link)
+    if(gag->gag_id == ig->id)
+      return gag;
+
+  const pixmap_t *src = ig->pm;
+  gga_shelf_t *gs = gga_shelf_find(gga,
+                                   src->pm_width  + GGA_PADDING,
+                                   src->pm_height + GGA_PADDING);
+  if(gs == NULL)
+    return NULL;
+
+  gag = malloc(sizeof(glw_atlas_glyph_t));
+  gag->gag_id = ig->id;
+  gag->gag_x = gs->gs_x;
+  gag->gag_y = gs->gs_y;
+  gag->gag_width  = src->pm_width;
+  gag->gag_height = src->pm_height;
+  LIST_INSERT_HEAD(l, gag, gag_link);
+
+  gs->gs_x += src->pm_width + GGA_PADDING;
+
+  const pixmap_t *dst = gga->gga_pm;
+  for(int y = 0; y < src->pm_height; y++) {
+    const uint8_t *s = src->pm_data + y * src->pm_linesize;
+    uint8_t *d = dst->pm_data + (gag->gag_y + y) * dst->pm_linesize +
+      gag->gag_x * 2 + 1;
+    for(int x = 0; x < src->pm_width; x++)
+      d[x * 2] = s[x];
+  }
+
+  gga->gga_dirty = 1;
+  return gag;
+}
+
+
+/**
+ *
+ */
+int
+glw_glyph_atlas_generation(const glw_glyph_atlas_t *gga)
+{
+  return gga->gga_generation;
+}
+
+
+/**
+ *
+ */
+int
+glw_glyph_atlas_width(const glw_glyph_atlas_t *gga)
+{
+  return GGA_WIDTH;
+}
+
+
+/**
+ *
+ */
+int
+glw_glyph_atlas_height(const glw_glyph_atlas_t *gga)
+{
+  return GGA_HEIGHT;
+}
+
+
+/**
+ * Return the atlas texture, uploading it first if glyphs has been added.
+ *
+ * Must be called on the GL thread. Calling this from the render pass
+ * (after all widgets have done layout) makes sure we upload at most
+ * once per frame
+ */
+const glw_backend_texture_t *
+glw_glyph_atlas_texture(glw_root_t *gr, glw_glyph_atlas_t *gga)
+{
+  if(gga->gga_dirty || !glw_is_tex_inited(&gga->gga_texture)) {
+    glw_tex_upload(gr, &gga->gga_texture, gga->gga_pm, 0);
+    gga->gga_dirty = 0;
+  }
+  return &gga->gga_texture;
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Text benchmark, run with --bench glyphatlas
+ *
+ * Simulates a scrolling list with a clock: Each frame one new list row
+ * caption and a new clock caption are rendered. Compares rendering each
+ * caption into its own bitmap (which must be uploaded as a texture) with
+ * rendering placed glyphs and packing them into the atlas (which is only
+ * uploaded when glyphs are added). No GL is needed
+ */
+#define GGA_BENCH_FRAMES 2000
+
+static image_t *
+gga_bench_render(const char *str, int flags)
+{
+  int len;
+  uint32_t *uc = text_parse(str, &len, 0, NULL, 0, 0);
+  if(uc == NULL)
+    return NULL;
+  image_t *img = text_render(uc, len, flags, 20, 1.0f, TR_ALIGN_LEFT,
+                             1000, 1, NULL, 0, 0);
+  free(uc);
+  return img;
+}
+
+
+static void
+gga_bench_caption(char *buf, size_t len, int frame, int clock)
+{
+  if(clock)
+    snprintf(buf, len, "%02d:%02d:%02d",
+             (frame / 3600) % 24, (frame / 60) % 60, frame % 60);
+  else
+    snprintf(buf, len, "%d. The Quick Brown Fox (%d) - Season %d",
+             frame + 1, 1950 + frame % 70, frame % 12 + 1);
+}
+
+
+static void
+glw_glyph_atlas_bench(void)
+{
+  char str[128];
+  int64_t bitmap_ts = 0, glyph_ts = 0, atlas_ts = 0;
+  int64_t bitmap_bytes = 0, atlas_bytes = 0;
+  int glyphs = 0, uploads = 0, failed = 0;
+
+  glw_glyph_atlas_t *gga = glw_glyph_atlas_create();
+  if(gga == NULL)
+    return;
+
+  for(int f = 0; f < GGA_BENCH_FRAMES; f++) {
+    for(int c = 0; c < 2; c++) {
+      gga_bench_caption(str, sizeof(str), f, c);
+
+      int64_t ts = arch_get_ts();
+      image_t *img = gga_bench_render(str, 0);
+      bitmap_ts += arch_get_ts() - ts;
+      if(img == NULL) {
+        failed++;
+        continue;
+      }
+      const image_component_t *ic = image_find_component(img, IMAGE_PIXMAP);
+      if(ic != NULL)
+        bitmap_bytes += ic->pm->pm_linesize * ic->pm->pm_height;
+      image_release(img);
+
+      ts = arch_get_ts();
+      img = gga_bench_render(str, TR_RENDER_GLYPHS);
+      glyph_ts += arch_get_ts() - ts;
+      if(img == NULL) {
+        failed++;
+        continue;
+      }
+      ic = image_find_component(img, IMAGE_GLYPHS);
+      if(ic == NULL) {
+        failed++;
+        image_release(img);
+        continue;
+      }
+
+      ts = arch_get_ts();
+      for(int i = 0; i < ic->glyphs.ig_count; i++)
+        if(glw_glyph_atlas_get(gga, &ic->glyphs.ig_glyphs[i]) == NULL)
+          failed++;
+      atlas_ts += arch_get_ts() - ts;
+      glyphs += ic->glyphs.ig_count;
+      image_release(img);
+    }
+
+    // What glw_glyph_atlas_texture() would upload this frame
+    if(gga->gga_dirty) {
+      atlas_bytes += gga->gga_pm->pm_linesize * gga->gga_pm->pm_height;
+      uploads++;
+      gga->gga_dirty = 0;
+    }
+  }
+
+  const int captions = GGA_BENCH_FRAMES * 2;
+
+  TRACE(TRACE_INFO, "bench",
+        "glyphatlas: %d frames, %d captions, %d glyphs, %d failed",
+        GGA_BENCH_FRAMES, captions, glyphs, failed);
+  TRACE(TRACE_INFO, "bench",
+        "glyphatlas: bitmap %.1f us/caption, %d kB texture uploads",
+        (double)bitmap_ts / captions, (int)(bitmap_bytes / 1024));
+  TRACE(TRACE_INFO, "bench",
+        "glyphatlas: glyphs %.1f us/caption + atlas %.2f us/caption, "
+        "%d kB texture uploads (%d frames), %d shelves, %d%% height used",
+        (double)glyph_ts / captions, (double)atlas_ts / captions,
+        (int)(atlas_bytes / 1024), uploads, gga->gga_num_shelves,
+        gga->gga_next_y * 100 / GGA_HEIGHT);
+
+  gga_free_glyphs(gga);
+  pixmap_release(gga->gga_pm);
+  free(gga);
+}
+
+BENCHMARK("glyphatlas", glw_glyph_atlas_bench);
+#endif
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#ifndef GLW_GLYPH_ATLAS_H
+#define GLW_GLYPH_ATLAS_H
+
+struct image_glyph;
+
+typedef struct glw_glyph_atlas glw_glyph_atlas_t;
+
+/**
+ * Location of a glyph in the atlas texture
+ */
+typedef struct glw_atlas_glyph {
+  LIST_ENTRY(glw_atlas_glyph) gag_link;
+  uint32_t gag_id;
+  int16_t gag_x;
+  int16_t gag_y;
+  int16_t gag_width;
+  int16_t gag_height;
+} glw_atlas_glyph_t;
+
+glw_glyph_atlas_t *glw_glyph_atlas_create(void);
+
+void glw_glyph_atlas_destroy(glw_root_t *gr, glw_glyph_atlas_t *gga);
+
+void glw_glyph_atlas_flush(glw_root_t *gr, glw_glyph_atlas_t *gga);
+
+const glw_atlas_glyph_t *glw_glyph_atlas_get(glw_glyph_atlas_t *gga,
+                                             const struct image_glyph *ig);
+
+int glw_glyph_atlas_generation(const glw_glyph_atlas_t *gga);
+
+int glw_glyph_atlas_width(const glw_glyph_atlas_t *gga);
+
+int glw_glyph_atlas_height(const glw_glyph_atlas_t *gga);
+
+const glw_backend_texture_t *glw_glyph_atlas_texture(glw_root_t *gr,
+                                                     glw_glyph_atlas_t *gga);
+
+#endif /* GLW_GLYPH_ATLAS_H */
@@ -0,0 +1,483 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "glw.h"
+#include "main.h"
+#include "navigator.h"
+#include "arch/linux/linux.h"
+
+/**
+ * Headless GLW frontend
+ *
+ * Runs the full UI (universe.view of the selected skin) against the null
+ * backend. Nothing is displayed but all layout and rendering, down to
+ * the tesselated render jobs, is done as usual.
+ *
+ * When built with --enable-benchmarks, run with --bench glw to measure
+ * frame cost, optionally with --skin
+ */
+
+#define GH_WIDTH          1920
+#define GH_HEIGHT         1080
+
+#if ENABLE_BENCHMARKS
+#define GH_WARMUP_FRAMES  120
+#define GH_BENCH_FRAMES   600
+
+#define GH_CLASS_HASH_SIZE 128
+
+/**
+ * Self cost of a widget class (ie, excluding its children)
+ */
+typedef struct gh_class_stats {
+  const glw_class_t *gcs_class;
+  int64_t gcs_layout_ns;
+  int64_t gcs_render_ns;
+  int gcs_layout_calls;
+  int gcs_render_calls;
+  int gcs_jobs;
+} gh_class_stats_t;
+#endif
+
+
+typedef struct glw_headless {
+  glw_root_t gh_gr;  // Must be first
+
+  hts_thread_t gh_thread;
+  int gh_running;
+
+  int gh_force_refresh;
+
+#if ENABLE_BENCHMARKS
+  // Time and jobs spent in children of the widget currently profiled
+  int64_t gh_child_ns;
+  int gh_child_jobs;
+
+  gh_class_stats_t gh_classes[GH_CLASS_HASH_SIZE];
+#endif
+
+} glw_headless_t;
+
+
+/**
+ *
+ */
+typedef struct gh_frame_time {
+  int64_t prepare;
+  int64_t layout;
+  int64_t render;
+  int64_t post;
+} gh_frame_time_t;
+
+
+/**
+ *
+ */
+static int64_t
+gh_get_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ *
+ */
+static gh_class_stats_t *
+gh_class_stats_get(glw_headless_t *gh, const glw_class_t *gc)
+{
+  unsigned int i = ((intptr_t)gc >> 4) & (GH_CLASS_HASH_SIZE - 1);
+
+  while(gh->gh_classes[i].gcs_class != gc) {
+    if(gh->gh_classes[i].gcs_class == NULL) {
+      gh->gh_classes[i].gcs_class = gc;
+      break;
+    }
+    i = (i + 1) & (GH_CLASS_HASH_SIZE - 1);
+  }
+  return &gh->gh_classes[i];
+}
+
+
+/**
+ *
+ */
+static void
+gh_layout_hook(glw_t *w, const glw_rctx_t *rc)
+{
+  glw_headless_t *gh = (glw_headless_t *)w->glw_root;
+  gh_class_stats_t *gcs = gh_class_stats_get(gh, w->glw_class);
+  const int64_t saved_child_ns = gh->gh_child_ns;
+
+  gh->gh_child_ns = 0;
+  const int64_t ts = gh_get_ns();
+  w->glw_class->gc_layout(w, rc);
+  const int64_t d = gh_get_ns() - ts;
+
+  gcs->gcs_layout_ns += d - gh->gh_child_ns;
+  gcs->gcs_layout_calls++;
+  gh->gh_child_ns = saved_child_ns + d;
+}
+
+
+/**
+ *
+ */
+static void
+gh_render_hook(glw_t *w, const glw_rctx_t *rc)
+{
+  glw_headless_t *gh = (glw_headless_t *)w->glw_root;
+  glw_root_t *gr = &gh->gh_gr;
+  gh_class_stats_t *gcs = gh_class_stats_get(gh, w->glw_class);
+  const int64_t saved_child_ns = gh->gh_child_ns;
+  const int saved_child_jobs = gh->gh_child_jobs;
+  const int jobs = gr->gr_num_render_jobs;
+
+  gh->gh_child_ns = 0;
+  gh->gh_child_jobs = 0;
+  const int64_t ts = gh_get_ns();
+  w->glw_class->gc_render(w, rc);
+  const int64_t d = gh_get_ns() - ts;
+  const int dj = gr->gr_num_render_jobs - jobs;
+
+  gcs->gcs_render_ns += d - gh->gh_child_ns;
+  gcs->gcs_render_calls++;
+  gcs->gcs_jobs += dj - gh->gh_child_jobs;
+  gh->gh_child_ns = saved_child_ns + d;
+  gh->gh_child_jobs = saved_child_jobs + dj;
+}
+#endif
+
+
+/**
+ *
+ */
+static void
+glw_headless_frame(glw_headless_t *gh, gh_frame_time_t *gft)
+{
+  glw_root_t *gr = &gh->gh_gr;
+  int64_t ts[5];
+
+  ts[0] = gh_get_ns();
+
+  glw_lock(gr);
+
+  glw_prepare_frame(gr, 0);
+  int refresh = gr->gr_need_refresh | gh->gh_force_refresh;
+  gr->gr_need_refresh = 0;
+
+  ts[1] = ts[2] = gh_get_ns();
+
+  if(refresh) {
+    glw_rctx_t rc;
+    int zmax = 0;
+    glw_rctx_init(&rc, gr->gr_width, gr->gr_height, 1, &zmax);
+
+    glw_layout0(gr->gr_universe, &rc);
+    ts[2] = gh_get_ns();
+
+    if(refresh & GLW_REFRESH_FLAG_RENDER)
+      glw_render0(gr->gr_universe, &rc);
+  }
+
+  ts[3] = gh_get_ns();
+  glw_unlock(gr);
+
+  glw_post_scene(gr);
+  ts[4] = gh_get_ns();
+
+  if(gft != NULL) {
+    gft->prepare = ts[1] - ts[0];
+    gft->layout  = ts[2] - ts[1];
+    gft->render  = ts[3] - ts[2];
+    gft->post    = ts[4] - ts[3];
+  }
+}
+
+
+/**
+ *
+ */
+static glw_headless_t *
+glw_headless_create(prop_t *nav)
+{
+  glw_headless_t *gh = calloc(1, sizeof(glw_headless_t));
+  glw_root_t *gr = &gh->gh_gr;
+
+  gr->gr_prop_ui = prop_create_root("ui");
+  gr->gr_prop_nav = nav ?: nav_spawn();
+
+  if(glw_init(gr)) {
+    prop_destroy(gr->gr_prop_ui);
+    free(gh);
+    return NULL;
+  }
+
+  glw_null_init_context(gr);
+  gr->gr_width  = GH_WIDTH;
+  gr->gr_height = GH_HEIGHT;
+
+  glw_lock(gr);
+  glw_load_universe(gr);
+  glw_unlock(gr);
+  return gh;
+}
+
+
+/**
+ *
+ */
+static prop_t *
+glw_headless_destroy(glw_headless_t *gh)
+{
+  glw_root_t *gr = &gh->gh_gr;
+  prop_t *nav = gr->gr_prop_nav;
+
+  glw_lock(gr);
+  glw_unload_universe(gr);
+  glw_unlock(gr);
+  glw_reap(gr);
+  glw_reap(gr);
+
+  glw_fini(gr);
+  prop_destroy(gr->gr_prop_ui);
+  glw_release_root(gr);
+  return nav;
+}
+
+
+/**
+ *
+ */
+static void *
+glw_headless_thread(void *aux)
+{
+  glw_headless_t *gh = aux;
+
+  while(gh->gh_running) {
+    glw_headless_frame(gh, NULL);
+    usleep(gh->gh_gr.gr_frameduration);
+  }
+  return NULL;
+}
+
+
+/**
+ *
+ */
+static void *
+glw_headless_start(struct prop *nav)
+{
+  glw_headless_t *gh = glw_headless_create(nav);
+  if(gh == NULL)
+    return NULL;
+
+  gh->gh_running = 1;
+  hts_thread_create_joinable("glw", &gh->gh_thread,
+			     glw_headless_thread, gh, 0);
+  return gh;
+}
+
+
+/**
+ *
+ */
+static prop_t *
+glw_headless_stop(void *aux)
+{
+  glw_headless_t *gh = aux;
+
+  if(gh == NULL)
+    return NULL;
+
+  gh->gh_running = 0;
+  hts_thread_join(&gh->gh_thread);
+  return glw_headless_destroy(gh);
+}
+
+
+const linux_ui_t ui_glw = {
+  .start = glw_headless_start,
+  .stop  = glw_headless_stop,
+};
+
+
+#if ENABLE_BENCHMARKS
+/**
+ *
+ */
+static int
+int64_cmp(const void *A, const void *B)
+{
+  const int64_t *a = A;
+  const int64_t *b = B;
+  return (*a > *b) - (*a < *b);
+}
+
+
+/**
+ *
+ */
+static int
+gh_class_stats_cmp(const void *A, const void *B)
+{
+  const gh_class_stats_t *a = A;
+  const gh_class_stats_t *b = B;
+  const int64_t ta = a->gcs_layout_ns + a->gcs_render_ns;
+  const int64_t tb = b->gcs_layout_ns + b->gcs_render_ns;
+  return (tb > ta) - (tb < ta);
+}
+
+
+/**
+ * Frame time is measured without the per class hooks installed and
+ * then the run is repeated with them to get the breakdown. The class
+ * numbers thus include some profiling overhead
+ */
+static void
+glw_headless_bench(void)
+{
+  glw_headless_t *gh = glw_headless_create(NULL);
+  if(gh == NULL) {
+    TRACE(TRACE_ERROR, "bench", "glw: Unable to initialize UI");
+    return;
+  }
+
+  glw_root_t *gr = &gh->gh_gr;
+  const int frames = GH_BENCH_FRAMES;
+  gh_frame_time_t *gft = calloc(frames, sizeof(gh_frame_time_t));
+  int64_t *total = calloc(frames, sizeof(int64_t));
+  gh_frame_time_t sum = {0};
+
+  // Let views, fonts and images load at a normal frame rate
+  for(int i = 0; i < GH_WARMUP_FRAMES; i++) {
+    glw_headless_frame(gh, NULL);
+    usleep(gr->gr_frameduration);
+  }
+
+  gh->gh_force_refresh = GLW_REFRESH_FLAG_LAYOUT | GLW_REFRESH_FLAG_RENDER;
+
+  glw_null_stats_t *gns = &gr->gr_be.gbr_stats;
+  glw_null_stats_t last = {0};
+  int last_jobs = 0;
+  int uploads = 0;
+  int64_t upload_bytes = 0;
+
+  for(int i = 0; i < frames; i++) {
+    memset(gns, 0, sizeof(glw_null_stats_t));
+    glw_headless_frame(gh, &gft[i]);
+
+    total[i] = gft[i].prepare + gft[i].layout + gft[i].render + gft[i].post;
+    sum.prepare += gft[i].prepare;
+    sum.layout  += gft[i].layout;
+    sum.render  += gft[i].render;
+    sum.post    += gft[i].post;
+    uploads      += gns->gns_texture_uploads;
+    upload_bytes += gns->gns_texture_bytes;
+    last = *gns;
+    last_jobs = gr->gr_num_unbatched_jobs;
+  }
+
+  qsort(total, frames, sizeof(int64_t), int64_cmp);
+
+  TRACE(TRACE_INFO, "bench",
+        "glw: %d frames at %dx%d (%s)",
+        frames, gr->gr_width, gr->gr_height, gr->gr_skin);
+
+  TRACE(TRACE_INFO, "bench",
+        "glw: frame us avg:%d min:%d p50:%d p95:%d max:%d",
+        (int)((sum.prepare + sum.layout + sum.render + sum.post) /
+              frames / 1000),
+        (int)(total[0] / 1000),
+        (int)(total[frames / 2] / 1000),
+        (int)(total[frames * 95 / 100] / 1000),
+        (int)(total[frames - 1] / 1000));
+
+  TRACE(TRACE_INFO, "bench",
+        "glw: avg us prepare:%.1f layout:%.1f render:%.1f post:%.1f",
+        sum.prepare / frames / 1000.0,
+        sum.layout  / frames / 1000.0,
+        sum.render  / frames / 1000.0,
+        sum.post    / frames / 1000.0);
+
+  TRACE(TRACE_INFO, "bench",
+        "glw: per frame jobs:%d draw-calls:%d triangles:%d vertices:%d "
+        "texture-switches:%d blend-switches:%d",
+        last_jobs, last.gns_draw_calls, last.gns_triangles, last.gns_vertices,
+        last.gns_texture_switches, last.gns_blendmode_switches);
+
+  TRACE(TRACE_INFO, "bench",
+        "glw: %d texture uploads (%d kB) during %d frames",
+        uploads, (int)(upload_bytes / 1024), frames);
+
+  int notifies, coalesced;
+  prop_courier_get_stats(gr->gr_courier, &notifies, &coalesced);
+  TRACE(TRACE_INFO, "bench",
+        "glw: %d prop notifications dispatched, %d coalesced away "
+        "since UI start", notifies, coalesced);
+
+  // Second pass with per class accounting
+
+  gr->gr_layout_hook = gh_layout_hook;
+  gr->gr_render_hook = gh_render_hook;
+
+  for(int i = 0; i < frames; i++)
+    glw_headless_frame(gh, NULL);
+
+  gr->gr_layout_hook = NULL;
+  gr->gr_render_hook = NULL;
+
+  qsort(gh->gh_classes, GH_CLASS_HASH_SIZE, sizeof(gh_class_stats_t),
+        gh_class_stats_cmp);
+
+  TRACE(TRACE_INFO, "bench",
+        "glw: %-20s %8s %8s %8s %8s %6s",
+        "class", "layouts", "ns", "renders", "ns", "jobs");
+
+  for(int i = 0; i < GH_CLASS_HASH_SIZE; i++) {
+    const gh_class_stats_t *gcs = &gh->gh_classes[i];
+    if(gcs->gcs_class == NULL)
+      continue;
+
+    TRACE(TRACE_INFO, "bench",
+          "glw: %-20s %8d %8d %8d %8d %6d",
+          gcs->gcs_class->gc_name,
+          gcs->gcs_layout_calls / frames,
+          (int)(gcs->gcs_layout_ns / frames),
+          gcs->gcs_render_calls / frames,
+          (int)(gcs->gcs_render_ns / frames),
+          gcs->gcs_jobs / frames);
+  }
+
+  free(total);
+  free(gft);
+  glw_headless_destroy(gh);
+}
+
+BENCHMARK("glw", glw_headless_bench);
+#endif
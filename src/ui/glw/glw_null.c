@@ -0,0 +1,135 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include "glw.h"
+#include "glw_renderer.h"
+
+
+/**
+ * Account the jobs in the same order as a real backend would draw them.
+ *
+ * Stats are accumulated, it's up to the frontend to clear them
+ */
+static void
+null_render_unlocked(glw_root_t *gr)
+{
+  glw_null_stats_t *gns = &gr->gr_be.gbr_stats;
+  const struct glw_backend_texture *t0 = NULL;
+  int blendmode = GLW_BLEND_NORMAL;
+
+  for(int j = 0; j < gr->gr_num_render_jobs; j++) {
+    const glw_render_job_t *rj = gr->gr_render_order[j].job;
+
+    if(unlikely(rj->num_vertices == 0))
+      continue;
+
+    gns->gns_draw_calls++;
+    gns->gns_vertices += rj->num_vertices;
+
+    if(rj->primitive_type == GLW_DRAW_TRIANGLES)
+      gns->gns_triangles += rj->num_indices / 3;
+
+    if(rj->t0 != t0) {
+      t0 = rj->t0;
+      gns->gns_texture_switches++;
+    }
+
+    if(rj->blendmode != blendmode) {
+      blendmode = rj->blendmode;
+      gns->gns_blendmode_switches++;
+    }
+  }
+}
+
+
+/**
+ *
+ */
+void
+glw_null_init_context(glw_root_t *gr)
+{
+  gr->gr_be_render_unlocked = null_render_unlocked;
+}
+
+
+/**
+ *
+ */
+void
+glw_rtt_init(glw_root_t *gr, glw_rtt_t *grtt, int width, int height,
+	     int alpha)
+{
+  grtt->grtt_width  = width;
+  grtt->grtt_height = height;
+  grtt->grtt_texture.id = ++gr->gr_be.gbr_texture_tally;
+  grtt->grtt_texture.width  = width;
+  grtt->grtt_texture.height = height;
+  grtt->grtt_texture.opaque = !alpha;
+}
+
+
+/**
+ *
+ */
+void
+glw_rtt_enter(glw_root_t *gr, glw_rtt_t *grtt, glw_rctx_t *rc)
+{
+  glw_rctx_init(rc, grtt->grtt_width, grtt->grtt_height, 0, NULL);
+}
+
+
+/**
+ *
+ */
+void
+glw_rtt_restore(glw_root_t *gr, glw_rtt_t *grtt)
+{
+}
+
+
+/**
+ *
+ */
+void
+glw_rtt_destroy(glw_root_t *gr, glw_rtt_t *grtt)
+{
+  grtt->grtt_texture.id = 0;
+}
+
+
+/**
+ * There are no shaders, widgets using custom programs will
+ * fall back to the default ones
+ */
+struct glw_program *
+glw_make_program(struct glw_root *gr,
+		 const char *vertex_shader,
+		 const char *fragment_shader)
+{
+  return NULL;
+}
+
+
+/**
+ *
+ */
+void
+glw_destroy_program(struct glw_root *gr, struct glw_program *gp)
+{
+}
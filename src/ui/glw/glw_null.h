@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#pragma once
+
+/**
+ * Null backend
+ *
+ * Does not draw anything. The render jobs produced by the renderer are
+ * just counted, textures only keep their dimensions. Used by the headless
+ * frontend to measure layout and render cost without a GPU
+ */
+
+struct glw_rctx;
+struct glw_root;
+
+#define GLW_DRAW_TRIANGLES 0
+#define GLW_DRAW_LINE_LOOP 1
+#define GLW_DRAW_LINES     2
+
+
+/**
+ *
+ */
+struct glw_program {
+  int gp_dummy;
+};
+
+
+/**
+ * Statistics for the last rendered frame
+ */
+typedef struct glw_null_stats {
+  int gns_draw_calls;
+  int gns_triangles;
+  int gns_vertices;
+  int gns_texture_switches;
+  int gns_blendmode_switches;
+  int gns_texture_uploads;
+  int64_t gns_texture_bytes;
+} glw_null_stats_t;
+
+
+/**
+ *
+ */
+typedef struct glw_backend_root {
+
+  glw_null_stats_t gbr_stats;
+
+  int gbr_texture_tally;  // For handing out texture ids
+
+} glw_backend_root_t;
+
+
+/**
+ *
+ */
+typedef struct glw_backend_texture {
+  int id;
+  uint16_t width;
+  uint16_t height;
+  uint8_t opaque;
+} glw_backend_texture_t;
+
+#define glw_tex_width(gbt) ((gbt)->width)
+#define glw_tex_height(gbt) ((gbt)->height)
+
+#define glw_is_tex_inited(n) ((n)->id != 0)
+
+void glw_null_init_context(struct glw_root *gr);
+
+
+/**
+ * Render to texture support
+ */
+typedef struct {
+
+  glw_backend_texture_t grtt_texture;
+
+  int grtt_width;
+  int grtt_height;
+
+} glw_rtt_t;
+
+void glw_rtt_init(struct glw_root *gr, glw_rtt_t *grtt, int width, int height,
+		  int alpha);
+
+void glw_rtt_enter(struct glw_root *gr, glw_rtt_t *grtt, struct glw_rctx *rc0);
+
+void glw_rtt_restore(struct glw_root *gr, glw_rtt_t *grtt);
+
+void glw_rtt_destroy(struct glw_root *gr, glw_rtt_t *grtt);
+
+#define glw_rtt_texture(grtt) ((grtt)->grtt_texture)
@@ -1421,6 +1421,145 @@ render_order_cmp(const void *A, const void *B)
 }
 
 
+/**
+ * Check if job 'b' can be drawn in the same draw call as job 'a'.
+ *
+ * Matrix and color multiplier may differ, those are baked into the
+ * vertices when merging. Everything else that ends up as uniforms or
+ * other GPU state must be equal
+ */
+static int
+batch_compatible(const glw_render_order_t *a, const glw_render_order_t *b)
+{
+  const glw_render_job_t *x = a->job;
+  const glw_render_job_t *y = b->job;
+
+  return a->zindex == b->zindex &&
+    x->gpa == NULL && y->gpa == NULL &&
+    x->primitive_type == GLW_DRAW_TRIANGLES &&
+    y->primitive_type == GLW_DRAW_TRIANGLES &&
+    x->t0 == y->t0 &&
+    x->t1 == y->t1 &&
+    x->blur == y->blur &&
+    x->flags == y->flags &&
+    x->blendmode == y->blendmode &&
+    x->frontface == y->frontface &&
+    glw_rgb_cmp(&x->rgb_off, &y->rgb_off);
+}
+
+
+/**
+ * Move the vertices of a job to eyespace with color multiplier applied
+ * and append its indices to the batch
+ */
+static void
+batch_append(glw_root_t *gr, glw_render_job_t *b, const glw_render_job_t *rj)
+{
+  float *v = gr->gr_vertex_buffer + rj->vertex_offset * VERTEX_SIZE;
+
+  if(!rj->eyespace) {
+    PMtx pmtx;
+    Vec4 V;
+
+    glw_pmtx_mul_prepare(&pmtx, &rj->m);
+    for(int i = 0; i < rj->num_vertices; i++) {
+      float *p = v + i * VERTEX_SIZE;
+      glw_pmtx_mul_vec4_i(V, &pmtx, glw_vec4_get(p));
+      glw_vec4_store(p, V);
+    }
+  }
+
+  if(!glw_rgb_cmp(&rj->rgb_mul, &white) || rj->alpha != 1) {
+    for(int i = 0; i < rj->num_vertices; i++) {
+      float *c = v + i * VERTEX_SIZE + 4;
+      c[0] *= rj->rgb_mul.r;
+      c[1] *= rj->rgb_mul.g;
+      c[2] *= rj->rgb_mul.b;
+      c[3] *= rj->alpha;
+    }
+  }
+
+  memcpy(gr->gr_index_buffer + b->index_offset + b->num_indices,
+         gr->gr_index_buffer + rj->index_offset,
+         rj->num_indices * sizeof(uint16_t));
+
+  b->num_indices  += rj->num_indices;
+  b->num_vertices += rj->num_vertices;
+}
+
+
+/**
+ * Merge runs of consecutive (in render order) jobs with compatible
+ * state into single jobs. Merged jobs get their indices copied to the
+ * end of the index buffer. The vertices are still in the shared vertex
+ * buffer, they are just rewritten in place
+ */
+static void
+glw_renderer_batch(glw_root_t *gr)
+{
+  const int n = gr->gr_num_render_jobs;
+  int out = 0;
+  int batches = 0;
+
+  if(gr->gr_batch_jobs_capacity < n / 2) {
+    gr->gr_batch_jobs_capacity = n;
+    gr->gr_batch_jobs = realloc(gr->gr_batch_jobs,
+                                sizeof(glw_render_job_t) * n);
+  }
+
+  for(int i = 0; i < n;) {
+    const glw_render_order_t *ro = gr->gr_render_order + i;
+    int num_indices  = ro->job->num_indices;
+    int num_vertices = ro->job->num_vertices;
+    int j;
+
+    for(j = i + 1; j < n; j++) {
+      const glw_render_job_t *rj = gr->gr_render_order[j].job;
+      if(!batch_compatible(ro, gr->gr_render_order + j) ||
+         num_indices  + rj->num_indices  > INT16_MAX ||
+         num_vertices + rj->num_vertices > INT16_MAX)
+        break;
+      num_indices  += rj->num_indices;
+      num_vertices += rj->num_vertices;
+    }
+
+    if(j == i + 1) {
+      gr->gr_render_order[out++] = *ro;
+      i = j;
+      continue;
+    }
+
+    if(gr->gr_index_offset + num_indices > gr->gr_index_buffer_capacity) {
+      gr->gr_index_buffer_capacity = 100 + num_indices +
+        gr->gr_index_buffer_capacity * 2;
+
+      gr->gr_index_buffer = realloc(gr->gr_index_buffer,
+                                    sizeof(uint16_t) *
+                                    gr->gr_index_buffer_capacity);
+    }
+
+    glw_render_job_t *b = gr->gr_batch_jobs + batches++;
+    *b = *ro->job;
+    b->eyespace = 1;
+    b->rgb_mul = white;
+    b->alpha = 1;
+    b->index_offset = gr->gr_index_offset;
+    b->num_indices = 0;
+    b->num_vertices = 0;
+
+    for(; i < j; i++)
+      batch_append(gr, b, gr->gr_render_order[i].job);
+
+    gr->gr_index_offset += b->num_indices;
+
+    gr->gr_render_order[out].job = b;
+    gr->gr_render_order[out].zindex = ro->zindex;
+    out++;
+  }
+  gr->gr_num_render_jobs = out;
+}
+
+
 /**
  *
  */
@@ -1435,5 +1574,12 @@ glw_renderer_render(glw_root_t *gr)
   qsort(gr->gr_render_order, gr->gr_num_render_jobs,
         sizeof(glw_render_order_t), render_order_cmp);
 
+  gr->gr_num_unbatched_jobs = gr->gr_num_render_jobs;
+
+  glw_renderer_batch(gr);
+
+  prop_set_int(gr->gr_prop_render_jobs, gr->gr_num_unbatched_jobs);
+  prop_set_int(gr->gr_prop_draw_calls, gr->gr_num_render_jobs);
+
   gr->gr_be_render_unlocked(gr);
 }
@@ -33,6 +33,7 @@
 #include "glw_texture.h"
 #include "glw_renderer.h"
 #include "glw_text_bitmap.h"
+#include "glw_glyph_atlas.h"
 #include "misc/str.h"
 #include "text/text.h"
 #include "event.h"
@@ -66,6 +67,9 @@ typedef struct glw_text_bitmap {
   glw_renderer_t gtb_text_renderer;
   glw_renderer_t gtb_cursor_renderer;
   glw_renderer_t gtb_background_renderer;
+  glw_renderer_t gtb_glyph_renderer;
+
+  int gtb_atlas_generation;
 
 
   uint32_t *gtb_uc_buffer; /* unicode buffer */
@@ -112,6 +116,8 @@ typedef struct glw_text_bitmap {
   uint8_t gtb_need_layout : 1;
   uint8_t gtb_deferred_realize : 1;
   uint8_t gtb_caption_dirty : 1;
+  uint8_t gtb_glyph_mode : 1;  // Text is drawn from the glyph atlas
+  uint8_t gtb_no_atlas : 1;    // Did not fit in atlas, use bitmap
 
 } glw_text_bitmap_t;
 
@@ -122,6 +128,129 @@ static void gtb_caption_refresh(glw_text_bitmap_t *gtb);
 static glw_class_t glw_text, glw_label;
 
 
+/**
+ * Emit one quad per glyph, clipped to the visible part of the text.
+ *
+ * 'left' and 'top' is where the top left corner of the text image goes
+ *
+ * Returns -1 if the glyphs does not fit in the atlas
+ */
+static int
+gtb_emit_glyphs(glw_text_bitmap_t *gtb, const glw_rctx_t *rc,
+                const image_component_glyphs_t *igs,
+                int left, int top, int width, int height)
+{
+  glw_glyph_atlas_t *gga = gtb->w.glw_root->gr_glyph_atlas;
+  glw_renderer_t *r = &gtb->gtb_glyph_renderer;
+  const int count = igs->ig_count;
+  const float aw = glw_glyph_atlas_width(gga);
+  const float ah = glw_glyph_atlas_height(gga);
+  const float sx = 2.0f / rc->rc_width;
+  const float sy = 2.0f / rc->rc_height;
+
+  if(glw_renderer_initialized(r) && r->gr_num_vertices != count * 4)
+    glw_renderer_free(r);
+
+  if(!glw_renderer_initialized(r)) {
+    glw_renderer_init(r, count * 4, count * 2, NULL);
+    for(int i = 0; i < count; i++) {
+      glw_renderer_triangle(r, i * 2 + 0, i * 4, i * 4 + 1, i * 4 + 2);
+      glw_renderer_triangle(r, i * 2 + 1, i * 4, i * 4 + 2, i * 4 + 3);
+    }
+  }
+
+  for(int i = 0; i < count; i++) {
+    const image_glyph_t *ig = &igs->ig_glyphs[i];
+    const glw_atlas_glyph_t *gag = glw_glyph_atlas_get(gga, ig);
+    const int v = i * 4;
+
+    if(gag == NULL)
+      return -1;
+
+    const int x1 = MAX(ig->x, 0);
+    const int y1 = MAX(ig->y, 0);
+    const int x2 = MIN(ig->x + gag->gag_width,  width);
+    const int y2 = MIN(ig->y + gag->gag_height, height);
+
+    if(x1 >= x2 || y1 >= y2) {
+      // Outside, make it degenerate
+      for(int j = 0; j < 4; j++)
+        glw_renderer_vtx_pos(r, v + j, 0, 0, 0);
+      continue;
+    }
+
+    const float s1 = (gag->gag_x + x1 - ig->x) / aw;
+    const float s2 = (gag->gag_x + x2 - ig->x) / aw;
+    const float t1 = (gag->gag_y + y1 - ig->y) / ah;
+    const float t2 = (gag->gag_y + y2 - ig->y) / ah;
+
+    const float vx1 = -1.0f + (left + x1) * sx;
+    const float vx2 = -1.0f + (left + x2) * sx;
+    const float vy1 = -1.0f + (top  - y2) * sy;
+    const float vy2 = -1.0f + (top  - y1) * sy;
+
+    glw_renderer_vtx_pos(r, v + 0, vx1, vy1, 0);
+    glw_renderer_vtx_st (r, v + 0, s1,  t2);
+
+    glw_renderer_vtx_pos(r, v + 1, vx2, vy1, 0);
+    glw_renderer_vtx_st (r, v + 1, s2,  t2);
+
+    glw_renderer_vtx_pos(r, v + 2, vx2, vy2, 0);
+    glw_renderer_vtx_st (r, v + 2, s2,  t1);
+
+    glw_renderer_vtx_pos(r, v + 3, vx1, vy2, 0);
+    glw_renderer_vtx_st (r, v + 3, s1,  t1);
+
+    const uint32_t c = ig->color;
+    const float cr = (uint8_t)(c      ) / 255.0f;
+    const float cg = (uint8_t)(c >>  8) / 255.0f;
+    const float cb = (uint8_t)(c >> 16) / 255.0f;
+    const float ca = (uint8_t)(c >> 24) / 255.0f;
+
+    for(int j = 0; j < 4; j++)
+      glw_renderer_vtx_col(r, v + j, cr, cg, cb, ca);
+  }
+
+  gtb->gtb_atlas_generation = glw_glyph_atlas_generation(gga);
+  return 0;
+}
+
+
+/**
+ *
+ */
+static void
+gtb_layout_glyphs(glw_text_bitmap_t *gtb, const glw_rctx_t *rc,
+                  const image_component_glyphs_t *igs,
+                  int left, int top, int width, int height)
+{
+  glw_root_t *gr = gtb->w.glw_root;
+
+  if(!gtb_emit_glyphs(gtb, rc, igs, left, top, width, height)) {
+    gtb->gtb_glyph_mode = 1;
+    return;
+  }
+
+  // Atlas is full, start over unless we already did that this frame
+
+  if(gr->gr_glyph_atlas_flush_frame != gr->gr_frames) {
+    glw_glyph_atlas_flush(gr, gr->gr_glyph_atlas);
+    gr->gr_glyph_atlas_flush_frame = gr->gr_frames;
+
+    if(!gtb_emit_glyphs(gtb, rc, igs, left, top, width, height)) {
+      gtb->gtb_glyph_mode = 1;
+      return;
+    }
+  }
+
+  // Visible text does not fit in the atlas, render this one to a bitmap
+  gtb->gtb_glyph_mode = 0;
+  gtb->gtb_no_atlas = 1;
+  if(gtb->gtb_state == GTB_VALID)
+    gtb->gtb_state = GTB_NEED_RENDER;
+}
+
+
 /**
  *
  */
@@ -161,8 +290,27 @@ glw_text_bitmap_layout(glw_t *w, const glw_rctx_t *rc)
     gtb->gtb_need_layout = 1;
   }
 
-  const int tex_width  = glw_tex_width(&gtb->gtb_texture);
-  const int tex_height = glw_tex_height(&gtb->gtb_texture);
+  int tex_width, tex_height;
+
+  ic = image_find_component(gtb->gtb_image, IMAGE_GLYPHS);
+  const image_component_glyphs_t *igs = ic ? &ic->glyphs : NULL;
+
+  if(igs != NULL) {
+    // Glyphs are drawn from the atlas, no texture of our own
+    glw_tex_destroy(gr, &gtb->gtb_texture);
+    gtb->gtb_margin = gtb->gtb_image->im_margin;
+    tex_width  = gtb->gtb_image->im_width;
+    tex_height = gtb->gtb_image->im_height;
+
+    if(gtb->gtb_atlas_generation !=
+       glw_glyph_atlas_generation(gr->gr_glyph_atlas))
+      gtb->gtb_need_layout = 1;
+
+  } else {
+    gtb->gtb_glyph_mode = 0;
+    tex_width  = glw_tex_width(&gtb->gtb_texture);
+    tex_height = glw_tex_height(&gtb->gtb_texture);
+  }
 
   ic = image_find_component(gtb->gtb_image, IMAGE_TEXT_INFO);
   image_component_text_info_t *ti = ic ? &ic->text_info : NULL;
@@ -306,27 +454,31 @@ glw_text_bitmap_layout(glw_t *w, const glw_rctx_t *rc)
     }
 
 
-    x1 = -1.0f + 2.0f * left   / (float)rc->rc_width;
-    x2 = -1.0f + 2.0f * right  / (float)rc->rc_width;
+    if(igs != NULL) {
+      gtb_layout_glyphs(gtb, rc, igs, left, top, text_width, text_height);
+    } else {
 
+      x1 = -1.0f + 2.0f * left   / (float)rc->rc_width;
+      x2 = -1.0f + 2.0f * right  / (float)rc->rc_width;
 
-    const float s = text_width  / (float)tex_width;
-    const float t = text_height / (float)tex_height;
+      const float s = text_width  / (float)tex_width;
+      const float t = text_height / (float)tex_height;
 
-    if(gtb->w.glw_flags2 & GLW2_DEBUG)
-      printf("  s=%f t=%f\n", s, t);
+      if(gtb->w.glw_flags2 & GLW2_DEBUG)
+        printf("  s=%f t=%f\n", s, t);
 
-    glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 0, x1, y1, 0.0);
-    glw_renderer_vtx_st (&gtb->gtb_text_renderer, 0, 0, t);
+      glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 0, x1, y1, 0.0);
+      glw_renderer_vtx_st (&gtb->gtb_text_renderer, 0, 0, t);
 
-    glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 1, x2, y1, 0.0);
-    glw_renderer_vtx_st (&gtb->gtb_text_renderer, 1, s, t);
+      glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 1, x2, y1, 0.0);
+      glw_renderer_vtx_st (&gtb->gtb_text_renderer, 1, s, t);
 
-    glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 2, x2, y2, 0.0);
-    glw_renderer_vtx_st (&gtb->gtb_text_renderer, 2, s, 0);
+      glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 2, x2, y2, 0.0);
+      glw_renderer_vtx_st (&gtb->gtb_text_renderer, 2, s, 0);
 
-    glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 3, x1, y2, 0.0);
-    glw_renderer_vtx_st (&gtb->gtb_text_renderer, 3, 0, 0);
+      glw_renderer_vtx_pos(&gtb->gtb_text_renderer, 3, x1, y2, 0.0);
+      glw_renderer_vtx_st (&gtb->gtb_text_renderer, 3, 0, 0);
+    }
   }
 
   if(w->glw_class == &glw_text && gtb->gtb_update_cursor) {
@@ -419,7 +571,21 @@ glw_text_bitmap_render(glw_t *w, const glw_rctx_t *rc)
     glw_zinc(&rc0);
   }
 
-  if(glw_is_tex_inited(&gtb->gtb_texture) && gtb->gtb_image != NULL) {
+  if(gtb->gtb_glyph_mode) {
+    glw_root_t *gr = w->glw_root;
+    glw_glyph_atlas_t *gga = gr->gr_glyph_atlas;
+
+    if(gtb->gtb_atlas_generation == glw_glyph_atlas_generation(gga)) {
+      glw_renderer_draw(&gtb->gtb_glyph_renderer, gr, &rc0,
+                        glw_glyph_atlas_texture(gr, gga), NULL,
+                        &gtb->gtb_color, NULL, alpha, blur, NULL);
+    } else {
+      // Atlas was flushed after our layout, redo it next frame
+      gtb->gtb_need_layout = 1;
+      glw_need_refresh(gr, 0);
+    }
+
+  } else if(glw_is_tex_inited(&gtb->gtb_texture) && gtb->gtb_image != NULL) {
     glw_renderer_draw(&gtb->gtb_text_renderer, w->glw_root, &rc0,
 		      &gtb->gtb_texture, NULL,
 		      &gtb->gtb_color, NULL, alpha, blur, NULL);
@@ -460,6 +626,7 @@ glw_text_bitmap_dtor(glw_t *w)
   glw_renderer_free(&gtb->gtb_text_renderer);
   glw_renderer_free(&gtb->gtb_cursor_renderer);
   glw_renderer_free(&gtb->gtb_background_renderer);
+  glw_renderer_free(&gtb->gtb_glyph_renderer);
 
   switch(gtb->gtb_state) {
   case GTB_IDLE:
@@ -541,8 +708,9 @@ gtb_inactive(glw_text_bitmap_t *gtb)
 {
   glw_tex_destroy(gtb->w.glw_root, &gtb->gtb_texture);
 
-  // Make sure it is rerendered once we get back to life
-  if(gtb->gtb_state == GTB_VALID)
+  // Make sure it is rerendered once we get back to life.
+  // Text drawn from the glyph atlas has nothing to lose
+  if(gtb->gtb_state == GTB_VALID && !gtb->gtb_glyph_mode)
     gtb->gtb_state = GTB_NEED_RENDER;
 }
 
@@ -1217,6 +1385,9 @@ do_render(glw_text_bitmap_t *gtb, glw_root_t *gr, int no_output)
   if(gtb->gtb_flags & GTB_OUTLINE)
     flags |= TR_RENDER_OUTLINE;
 
+  if(gr->gr_glyph_atlas != NULL && !gtb->gtb_no_atlas)
+    flags |= TR_RENDER_GLYPHS;
+
   if(gtb->w.glw_class == &glw_text)
     flags |= TR_RENDER_CHARACTER_POS;
 
@@ -1293,6 +1464,7 @@ do_render(glw_text_bitmap_t *gtb, glw_root_t *gr, int no_output)
     image_release(gtb->gtb_image);
     gtb->gtb_image = im;
     gtb->gtb_update_cursor = 1;
+    gtb->gtb_need_layout = 1;
     if(im != NULL && gtb->gtb_maxlines > 1) {
       gtb_set_constraints(gr, gtb, im);
     }
@@ -1365,7 +1537,12 @@ void
 glw_text_flush(glw_root_t *gr)
 {
   glw_text_bitmap_t *gtb;
+
+  if(gr->gr_glyph_atlas != NULL)
+    glw_glyph_atlas_flush(gr, gr->gr_glyph_atlas);
+
   LIST_FOREACH(gtb, &gr->gr_gtbs, gtb_global_link) {
+    gtb->gtb_no_atlas = 0;
     gtb_inactive(gtb);
     gtb_realize(gtb);
   }
@@ -1423,6 +1600,9 @@ glw_text_bitmap_init(glw_root_t *gr)
 
   hts_cond_init(&gr->gr_gtb_work_cond, &gr->gr_mutex);
 
+  gr->gr_glyph_atlas = glw_glyph_atlas_create();
+  gr->gr_glyph_atlas_flush_frame = -1;
+
   gr->gr_font_thread_running = 1;
   hts_thread_create_joinable("GLW font renderer", &gr->gr_font_thread,
 			     font_render_thread, gr,
@@ -1442,6 +1622,10 @@ glw_text_bitmap_fini(glw_root_t *gr)
   hts_mutex_unlock(&gr->gr_mutex);
   hts_thread_join(&gr->gr_font_thread);
   hts_cond_destroy(&gr->gr_gtb_work_cond);
+
+  if(gr->gr_glyph_atlas != NULL)
+    glw_glyph_atlas_destroy(gr, gr->gr_glyph_atlas);
+  gr->gr_glyph_atlas = NULL;
 }
 
 
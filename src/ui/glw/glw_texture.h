@@ -77,6 +77,7 @@ typedef struct glw_loadable_texture {
 
   uint8_t glt_orientation;
   uint8_t glt_stash;
+  uint8_t glt_tasks;  // Load tasks holding a reference
   uint8_t glt_origin_type;
   uint8_t glt_opaque;
 
@@ -28,6 +28,7 @@
 
 #include "backend/backend.h"
 #include "fileaccess/fileaccess.h"
+#include "task.h"
 
 #if 0
 /**
@@ -202,7 +203,8 @@ loader_get_work(loaderaux_t *la)
     if(gr->gr_tex_threads_running == 0)
       return NULL;
     for(i = 0; i <= last_queue; i++)
-      if((glt = TAILQ_FIRST(&gr->gr_tex_load_queue[i])) != NULL)
+      if(i != LQ_OTHER &&
+         (glt = TAILQ_FIRST(&gr->gr_tex_load_queue[i])) != NULL)
 	return glt;
 
     hts_cond_wait(&gr->gr_tex_load_cond, &gr->gr_mutex);
@@ -210,8 +212,19 @@ loader_get_work(loaderaux_t *la)
 }
 
 
+static void glt_load_task(void *aux);
+
+static void glt_load_cancelled(void *aux);
+
 /**
+ * Textures not found in the cache (LQ_OTHER) are usually thumbnails
+ * that need to be fetched and decoded. They are loaded by tasks with
+ * the texture's cancellable as handle, so a task for an image that is
+ * no longer wanted (scrolled out of view) is skipped. Everything else
+ * is served by the loader threads.
  *
+ * The task holds a reference of its own (counted in glt_tasks) in
+ * addition to the one held by the queue
  */
 static void
 glt_enqueue(glw_root_t *gr, glw_loadable_texture_t *glt, int q)
@@ -222,7 +235,14 @@ glt_enqueue(glw_root_t *gr, glw_loadable_texture_t *glt, int q)
   TAILQ_INSERT_TAIL(&gr->gr_tex_load_queue[q], glt, glt_work_link);
   glt_set_state(glt, GLT_STATE_QUEUED);
 
-  if(q > LQ_TENTATIVE)
+  if(q == LQ_OTHER) {
+    glt->glt_refcnt++;
+    glt->glt_tasks++;
+    gr->gr_tex_tasks++;
+    cancellable_reset(glt->glt_cancellable);
+    task_run_prio(glt_load_task, glt, TASK_PRIO_INTERACTIVE,
+                  glt->glt_cancellable, glt_load_cancelled);
+  } else if(q > LQ_TENTATIVE)
     hts_cond_broadcast(&gr->gr_tex_load_cond);
   else
     hts_cond_signal(&gr->gr_tex_load_cond);
@@ -258,177 +278,272 @@ glt_incremental_update(void *opaque, pixmap_t *pm)
 
 
 /**
- *
+ * Load the image for a texture, called with glw_lock held and
+ * the texture in GLT_STATE_LOADING
  */
-static void *
-loader_thread(void *aux)
+static void
+glt_load(glw_root_t *gr, glw_loadable_texture_t *glt)
 {
-  loaderaux_t *la = aux;
-  glw_root_t *gr = la->la_gr;
-  glw_loadable_texture_t *glt;
   image_t *img;
   char errbuf[128];
   image_meta_t im = {0};
   int cache_control = 0;
   int *ccptr = NULL;
 
+  rstr_t *url = rstr_dup(glt->glt_url);
+
+  im.im_req_width  = glt->glt_req_xs;
+  im.im_req_height = glt->glt_req_ys;
+  im.im_max_width  = gr->gr_width;
+  im.im_max_height = gr->gr_height;
+  im.im_can_mono = 1;
+  im.im_corner_radius = glt->glt_radius;
+  im.im_force_local_load =
+    !!(glt->glt_source_flags & GLW_SOURCE_FLAG_ALWAYS_LOCAL);
+  im.im_intensity_analysis =
+    !!(glt->glt_flags & GLW_TEX_INTENSITY_ANALYSIS);
+  im.im_primary_color_analysis =
+    !!(glt->glt_flags & GLW_TEX_PRIMARY_COLOR_ANALYSIS);
+
+  im.im_corner_selection = glt->glt_flags & (GLW_TEX_CORNER_TOPLEFT |
+                                             GLW_TEX_CORNER_TOPRIGHT |
+                                             GLW_TEX_CORNER_BOTTOMLEFT |
+                                             GLW_TEX_CORNER_BOTTOMRIGHT);
+  im.im_shadow = glt->glt_shadow;
+  im.im_req_aspect = glt->glt_req_aspect;
+
+  im.im_incremental = glt_incremental_update;
+  im.im_opaque = glt;
+
+  if(glt->glt_q == &gr->gr_tex_load_queue[LQ_TENTATIVE]) {
+    cache_control = 0;
+    ccptr = &cache_control;
+
+  } else if(glt->glt_q == &gr->gr_tex_load_queue[LQ_REFRESH]) {
+    ccptr = BYPASS_CACHE;
+  } else {
+    ccptr = NULL;
+  }
+
+  cancellable_reset(glt->glt_cancellable);
+
+  glw_unlock(gr);
+  img = backend_imageloader(url, &im,
+                            errbuf, sizeof(errbuf),
+                            ccptr, glt->glt_cancellable,
+                            glt->glt_backend);
+
   glw_lock(gr);
 
-  while((glt = loader_get_work(la)) != NULL) {
+#if 0
+  if(pm != NULL && pm != NOT_MODIFIED) {
+    static int fail_simulator;
+    fail_simulator++;
+    if(fail_simulator == 10) {
+      fail_simulator = 0;
+      pixmap_release(pm);
+      pm = NULL;
+      snprintf(errbuf, sizeof(errbuf), "Simulated failure");
+    }
+  }
+#endif
 
-    TAILQ_REMOVE(glt->glt_q, glt, glt_work_link);
-    glt_set_state(glt, GLT_STATE_LOADING);
+  if(glt->glt_state == GLT_STATE_LOAD_ABORT) {
+    if(img != NULL && img != NOT_MODIFIED)
+      image_release(img);
 
-    if(glt->glt_refcnt > 1) {
-      rstr_t *url = rstr_dup(glt->glt_url);
-
-      im.im_req_width  = glt->glt_req_xs;
-      im.im_req_height = glt->glt_req_ys;
-      im.im_max_width  = gr->gr_width;
-      im.im_max_height = gr->gr_height;
-      im.im_can_mono = 1;
-      im.im_corner_radius = glt->glt_radius;
-      im.im_force_local_load =
-        !!(glt->glt_source_flags & GLW_SOURCE_FLAG_ALWAYS_LOCAL);
-      im.im_intensity_analysis =
-        !!(glt->glt_flags & GLW_TEX_INTENSITY_ANALYSIS);
-      im.im_primary_color_analysis =
-        !!(glt->glt_flags & GLW_TEX_PRIMARY_COLOR_ANALYSIS);
-
-      im.im_corner_selection = glt->glt_flags & (GLW_TEX_CORNER_TOPLEFT |
-                                                 GLW_TEX_CORNER_TOPRIGHT |
-                                                 GLW_TEX_CORNER_BOTTOMLEFT |
-                                                 GLW_TEX_CORNER_BOTTOMRIGHT);
-      im.im_shadow = glt->glt_shadow;
-      im.im_req_aspect = glt->glt_req_aspect;
-
-      im.im_incremental = glt_incremental_update;
-      im.im_opaque = glt;
-
-      if(glt->glt_q == &gr->gr_tex_load_queue[LQ_TENTATIVE]) {
-	cache_control = 0;
-	ccptr = &cache_control;
-
-      } else if(glt->glt_q == &gr->gr_tex_load_queue[LQ_REFRESH]) {
-	ccptr = BYPASS_CACHE;
-      } else {
-	ccptr = NULL;
+    if(gconf.enable_image_debug)
+      TRACE(TRACE_DEBUG, "GLW", "Load of %s was aborted", rstr_get(url));
+
+    glt_set_state(glt, GLT_STATE_INACTIVE);
+  } else if(img == NULL) {
+
+    if(glt->glt_q == &gr->gr_tex_load_queue[LQ_TENTATIVE]) {
+
+      if(glt->glt_state == GLT_STATE_LOADING)
+        glt_enqueue(gr, glt, LQ_OTHER);
+
+    } else if(glt->glt_q == &gr->gr_tex_load_queue[LQ_REFRESH]) {
+
+      if(gconf.enable_image_debug)
+        TRACE(TRACE_DEBUG, "GLW",
+              "Unable to load image %s -- %s -- using cached copy",
+              rstr_get(url), errbuf);
+
+      glt_set_state(glt, GLT_STATE_VALID);
+    } else {
+      // if glt->glt_url is NULL we have aborted so don't ERR log
+
+      if(gconf.enable_image_debug) {
+
+        if(glt->glt_url != NULL)
+          TRACE(TRACE_ERROR, "GLW", "Unable to load image %s -- %s",
+                rstr_get(url), errbuf);
+        else
+          TRACE(TRACE_DEBUG, "GLW", "Aborted load of %s",
+                rstr_get(url));
       }
 
-      cancellable_reset(glt->glt_cancellable);
+      glt_set_state(glt, GLT_STATE_ERROR);
+      LIST_REMOVE(glt, glt_flush_link);
+      glw_need_refresh(gr, 0);
+    }
 
-      glw_unlock(gr);
-      img = backend_imageloader(url, &im,
-                                errbuf, sizeof(errbuf),
-                                ccptr, glt->glt_cancellable,
-                                glt->glt_backend);
+  } else {
 
-      glw_lock(gr);
+    if(glt->glt_state == GLT_STATE_LOADING) {
 
-#if 0
-      if(pm != NULL && pm != NOT_MODIFIED) {
-	static int fail_simulator;
-	fail_simulator++;
-	if(fail_simulator == 10) {
-	  fail_simulator = 0;
-	  pixmap_release(pm);
-	  pm = NULL;
-	  snprintf(errbuf, sizeof(errbuf), "Simulated failure");
-	}
+      if(glt->glt_q == &gr->gr_tex_load_queue[LQ_TENTATIVE] &&
+         cache_control == 1) {
+        glt_enqueue(gr, glt, LQ_REFRESH);
+      } else {
+        glt_set_state(glt, GLT_STATE_VALID);
       }
-#endif
 
-      if(glt->glt_state == GLT_STATE_LOAD_ABORT) {
-	if(img != NULL && img != NOT_MODIFIED)
-	  image_release(img);
+      if(img != NOT_MODIFIED) {
+
+        // Actually upload the texture to the render backend
+
+        image_component_t *ic = image_find_component(img, IMAGE_PIXMAP);
+
+        assert(ic != NULL);
+
+        pixmap_t *pm = ic->pm;
+
+        glt->glt_aspect        = pm->pm_aspect;
+        glt->glt_margin        = pm->pm_margin;
+        glt->glt_xs            = pm->pm_width;
+        glt->glt_ys            = pm->pm_height;
+
+        glt->glt_origin_type   = img->im_origin_coded_type;
+        glt->glt_orientation   = img->im_orientation;
+        glt->glt_intensity     = pm->pm_intensity;
+        glt->glt_primary_color[0] = pm->pm_primary_color[0];
+        glt->glt_primary_color[1] = pm->pm_primary_color[1];
+        glt->glt_primary_color[2] = pm->pm_primary_color[2];
+        glt->glt_opaque = !!(pm->pm_flags & PIXMAP_OPAQUE);
 
         if(gconf.enable_image_debug)
-          TRACE(TRACE_DEBUG, "GLW", "Load of %s was aborted", rstr_get(url));
+          TRACE(TRACE_DEBUG, "GLW",
+                "Loaded %s (%d x %d)",
+                rstr_get(url), pm->pm_width, pm->pm_height);
 
-        glt_set_state(glt, GLT_STATE_INACTIVE);
-      } else if(img == NULL) {
 
-	if(glt->glt_q == &gr->gr_tex_load_queue[LQ_TENTATIVE]) {
+        glt->glt_size          = glw_tex_backend_load(gr, glt, pm);
+        glw_need_refresh(gr, 0);
+      }
+    }
 
-          if(glt->glt_state == GLT_STATE_LOADING)
-            glt_enqueue(gr, glt, LQ_OTHER);
+    if(img != NOT_MODIFIED)
+      image_release(img);
+  }
+  rstr_release(url);
+}
 
-	} else if(glt->glt_q == &gr->gr_tex_load_queue[LQ_REFRESH]) {
 
-          if(gconf.enable_image_debug)
-            TRACE(TRACE_DEBUG, "GLW",
-                  "Unable to load image %s -- %s -- using cached copy",
-                  rstr_get(url), errbuf);
+/**
+ * Drop the reference held by a load task
+ */
+static void
+glt_task_done(glw_root_t *gr, glw_loadable_texture_t *glt)
+{
+  glt->glt_tasks--;
+  gr->gr_tex_tasks--;
+  glw_tex_deref(gr, glt);
+  if(gr->gr_tex_tasks == 0)
+    hts_cond_broadcast(&gr->gr_tex_load_cond);
+}
+
 
-          glt_set_state(glt, GLT_STATE_VALID);
-	} else {
-	  // if glt->glt_url is NULL we have aborted so don't ERR log
+/**
+ *
+ */
+static int
+glt_on_task_queue(glw_root_t *gr, const glw_loadable_texture_t *glt)
+{
+  return glt->glt_state == GLT_STATE_QUEUED &&
+    glt->glt_q == &gr->gr_tex_load_queue[LQ_OTHER];
+}
 
-          if(gconf.enable_image_debug) {
 
-            if(glt->glt_url != NULL)
-              TRACE(TRACE_ERROR, "GLW", "Unable to load image %s -- %s",
-                    rstr_get(url), errbuf);
-            else
-              TRACE(TRACE_DEBUG, "GLW", "Aborted load of %s",
-                    rstr_get(url));
-          }
+/**
+ *
+ */
+static void
+glt_load_task(void *aux)
+{
+  glw_loadable_texture_t *glt = aux;
+  glw_root_t *gr = glt->glt_gr;
 
-          glt_set_state(glt, GLT_STATE_ERROR);
-	  LIST_REMOVE(glt, glt_flush_link);
-          glw_need_refresh(gr, 0);
-	}
+  glw_lock(gr);
 
-      } else {
+  // If the texture was flushed and requeued, another task will do it
+  if(glt_on_task_queue(gr, glt)) {
+    TAILQ_REMOVE(glt->glt_q, glt, glt_work_link);
+    glt_set_state(glt, GLT_STATE_LOADING);
 
-	if(glt->glt_state == GLT_STATE_LOADING) {
+    // The queue reference keeps us alive until glw_tex_deref() below
+    glt->glt_refcnt--;
+    glt->glt_tasks--;
+    gr->gr_tex_tasks--;
 
-	  if(glt->glt_q == &gr->gr_tex_load_queue[LQ_TENTATIVE] &&
-	     cache_control == 1) {
-	    glt_enqueue(gr, glt, LQ_REFRESH);
-	  } else {
-            glt_set_state(glt, GLT_STATE_VALID);
-	  }
+    if(glt->glt_refcnt - glt->glt_tasks > 1)
+      glt_load(gr, glt);
 
-	  if(img != NOT_MODIFIED) {
+    glw_tex_deref(gr, glt);
+    if(gr->gr_tex_tasks == 0)
+      hts_cond_broadcast(&gr->gr_tex_load_cond);
+  } else {
+    glt_task_done(gr, glt);
+  }
+  glw_unlock(gr);
+}
 
-            // Actually upload the texture to the render backend
 
-            image_component_t *ic = image_find_component(img, IMAGE_PIXMAP);
+/**
+ * Task was cancelled while queued. Do what glw_tex_flush_all() does for
+ * queued textures, if it's wanted again it will be requeued on the next
+ * layout
+ */
+static void
+glt_load_cancelled(void *aux)
+{
+  glw_loadable_texture_t *glt = aux;
+  glw_root_t *gr = glt->glt_gr;
 
-            assert(ic != NULL);
+  glw_lock(gr);
+  if(glt_on_task_queue(gr, glt) && glt->glt_tasks == 1) {
+    LIST_REMOVE(glt, glt_flush_link);
+    TAILQ_REMOVE(glt->glt_q, glt, glt_work_link);
+    glt_set_state(glt, GLT_STATE_INACTIVE);
+    glw_tex_deref(gr, glt);
+    glw_need_refresh(gr, 0);
+  }
+  glt_task_done(gr, glt);
+  glw_unlock(gr);
+}
 
-            pixmap_t *pm = ic->pm;
 
-	    glt->glt_aspect        = pm->pm_aspect;
-	    glt->glt_margin        = pm->pm_margin;
-            glt->glt_xs            = pm->pm_width;
-            glt->glt_ys            = pm->pm_height;
+/**
+ *
+ */
+static void *
+loader_thread(void *aux)
+{
+  loaderaux_t *la = aux;
+  glw_root_t *gr = la->la_gr;
+  glw_loadable_texture_t *glt;
 
-            glt->glt_origin_type   = img->im_origin_coded_type;
-	    glt->glt_orientation   = img->im_orientation;
-            glt->glt_intensity     = pm->pm_intensity;
-            glt->glt_primary_color[0] = pm->pm_primary_color[0];
-            glt->glt_primary_color[1] = pm->pm_primary_color[1];
-            glt->glt_primary_color[2] = pm->pm_primary_color[2];
-            glt->glt_opaque = !!(pm->pm_flags & PIXMAP_OPAQUE);
+  glw_lock(gr);
 
-            if(gconf.enable_image_debug)
-              TRACE(TRACE_DEBUG, "GLW",
-                    "Loaded %s (%d x %d)",
-                    rstr_get(url), pm->pm_width, pm->pm_height);
+  while((glt = loader_get_work(la)) != NULL) {
 
+    TAILQ_REMOVE(glt->glt_q, glt, glt_work_link);
+    glt_set_state(glt, GLT_STATE_LOADING);
 
-	    glt->glt_size          = glw_tex_backend_load(gr, glt, pm);
-	    glw_need_refresh(gr, 0);
-	  }
-	}
+    if(glt->glt_refcnt - glt->glt_tasks > 1)
+      glt_load(gr, glt);
 
-	if(img != NOT_MODIFIED)
-	  image_release(img);
-      }
-      rstr_release(url);
-    }
     glw_tex_deref(gr, glt);
   }
  
@@ -488,6 +603,15 @@ glw_tex_fini(glw_root_t *gr)
 
   for(i = 0; i < GLW_TEXTURE_THREADS; i++)
     hts_thread_join(&gr->gr_tex_threads[i]);
+
+  // Load tasks reference the root, wait for them
+  glw_lock(gr);
+  glw_loadable_texture_t *glt;
+  TAILQ_FOREACH(glt, &gr->gr_tex_load_queue[LQ_OTHER], glt_work_link)
+    glt_cancel(glt);
+  while(gr->gr_tex_tasks > 0)
+    hts_cond_wait(&gr->gr_tex_load_cond, &gr->gr_mutex);
+  glw_unlock(gr);
 }
 
 /**
@@ -571,8 +695,14 @@ glw_tex_deref(glw_root_t *gr, glw_loadable_texture_t *glt)
   if(glt->glt_refcnt > 0) {
 
     // Loading state holds a ref, so this means that we're the only one
-    if(glt->glt_refcnt == 1 && glt->glt_state == GLT_STATE_LOADING)
-      goto unlink;
+    if(glt->glt_refcnt - glt->glt_tasks == 1) {
+      if(glt->glt_state == GLT_STATE_LOADING)
+        goto unlink;
+
+      // Only the queue and load tasks left, skip them
+      if(glt->glt_tasks && glt->glt_state == GLT_STATE_QUEUED)
+        glt_cancel(glt);
+    }
     return;
   }
 
@@ -0,0 +1,167 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include "glw.h"
+#include "glw_texture.h"
+
+/**
+ * Textures in the null backend just keeps their size. Uploads are
+ * counted so the cost of texture churn is visible in the stats
+ */
+static void
+null_account_upload(glw_root_t *gr, const pixmap_t *pm)
+{
+  glw_null_stats_t *gns = &gr->gr_be.gbr_stats;
+  gns->gns_texture_uploads++;
+  gns->gns_texture_bytes += pm->pm_linesize * pm->pm_height;
+}
+
+
+/**
+ * Free texture (always invoked in main rendering thread)
+ */
+void
+glw_tex_backend_free_render_resources(glw_root_t *gr,
+				      glw_loadable_texture_t *glt)
+{
+  glt->glt_texture.id = 0;
+}
+
+
+/**
+ * Free resources created by glw_tex_backend_decode()
+ */
+void
+glw_tex_backend_free_loader_resources(glw_loadable_texture_t *glt)
+{
+  if(glt->glt_pixmap != NULL) {
+    pixmap_release(glt->glt_pixmap);
+    glt->glt_pixmap = NULL;
+  }
+}
+
+
+/**
+ * Invoked on every frame when status == VALID
+ */
+void
+glw_tex_backend_layout(glw_root_t *gr, glw_loadable_texture_t *glt)
+{
+  if(glt->glt_pixmap == NULL)
+    return;
+
+  if(glt->glt_texture.id == 0)
+    glt->glt_texture.id = ++gr->gr_be.gbr_texture_tally;
+
+  glt->glt_texture.width  = glt->glt_xs;
+  glt->glt_texture.height = glt->glt_ys;
+  glt->glt_texture.opaque = glt->glt_opaque;
+
+  if(glt->glt_tex_width && glt->glt_tex_height) {
+    glt->glt_s = (float)glt->glt_xs / (float)glt->glt_tex_width;
+    glt->glt_t = (float)glt->glt_ys / (float)glt->glt_tex_height;
+  } else {
+    glt->glt_s = 1;
+    glt->glt_t = 1;
+  }
+
+  null_account_upload(gr, glt->glt_pixmap);
+
+  glw_tex_backend_free_loader_resources(glt);
+}
+
+
+/**
+ *
+ */
+int
+glw_tex_backend_load(glw_root_t *gr, glw_loadable_texture_t *glt, pixmap_t *pm)
+{
+  int size;
+
+  switch(pm->pm_type) {
+  default:
+    return 0;
+
+  case PIXMAP_RGB24:
+  case PIXMAP_BGR32:
+  case PIXMAP_RGBA:
+  case PIXMAP_BGRA:
+    size = pm->pm_width * pm->pm_height * 4;
+    break;
+
+  case PIXMAP_IA:
+    size = pm->pm_width * pm->pm_height * 2;
+    break;
+
+  case PIXMAP_I:
+    size = pm->pm_width * pm->pm_height;
+    break;
+  }
+
+  glt->glt_format = pm->pm_type;
+  glt->glt_internal_format = pm->pm_type;
+
+  if(glt->glt_pixmap != NULL)
+    pixmap_release(glt->glt_pixmap);
+
+  glt->glt_pixmap = pixmap_dup(pm);
+
+  return size;
+}
+
+
+/**
+ *
+ */
+void
+glw_tex_upload(glw_root_t *gr, glw_backend_texture_t *tex,
+	       const pixmap_t *pm, int flags)
+{
+  switch(pm->pm_type) {
+  case PIXMAP_BGR32:
+  case PIXMAP_RGBA:
+  case PIXMAP_BGRA:
+  case PIXMAP_RGB24:
+  case PIXMAP_IA:
+    break;
+
+  default:
+    return;
+  }
+
+  if(tex->id == 0)
+    tex->id = ++gr->gr_be.gbr_texture_tally;
+
+  tex->width  = pm->pm_width;
+  tex->height = pm->pm_height;
+  tex->opaque = !!(pm->pm_flags & PIXMAP_OPAQUE);
+
+  null_account_upload(gr, pm);
+}
+
+
+/**
+ *
+ */
+void
+glw_tex_destroy(glw_root_t *gr, glw_backend_texture_t *tex)
+{
+  tex->id = 0;
+}
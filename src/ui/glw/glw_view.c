@@ -218,17 +218,28 @@ gcv_load(glw_root_t *gr, glw_cached_view_t *gcv, int may_unlock)
   char errbuf[512];
   buf_t *buf;
   errorinfo_t ei;
+  glw_view_deps_t deps;
+  int r;
+
+  token_t *sof = glw_view_cache_load(gr, gcv->gcv_url, may_unlock);
+  if(sof != NULL)
+    goto parse;
+
+  glw_view_deps_init(&deps);
 
   if(may_unlock)
     glw_unlock(gr);
 
   rstr_t *file = gcv->gcv_url;
+  glw_view_deps_add(&deps, file);
   buf = fa_load(rstr_get(gcv->gcv_url),
                 FA_LOAD_ERRBUF(errbuf, sizeof(errbuf)),
                 NULL);
 
   if(buf == NULL && gcv->gcv_alturl != NULL) {
     file = gcv->gcv_alturl;
+    // Only views loaded from their primary URL are stored
+    deps.gvd_unknown = 1;
     buf = fa_load(rstr_get(gcv->gcv_alturl),
                   FA_LOAD_ERRBUF(errbuf, sizeof(errbuf)),
                   NULL);
@@ -243,27 +254,38 @@ gcv_load(glw_root_t *gr, glw_cached_view_t *gcv, int may_unlock)
     snprintf(errmsg, sizeof(errmsg), "Unable to open \"%s\" -- %s",
              rstr_get(file), errbuf);
     gcv->gcv_error = strdup(errmsg);
+    glw_view_deps_free(&deps);
     return;
   }
 
-  token_t *sof = glw_view_token_alloc(gr);
+  sof = glw_view_token_alloc(gr);
   sof->type = TOKEN_START;
   sof->file = rstr_dup(file);
 
   token_t *l = glw_view_lexer(gr, buf_cstr(buf), &ei, file, sof);
   buf_release(buf);
-  if(l == NULL) {
+  if(l != NULL) {
+    token_t *eof = glw_view_token_alloc(gr);
+    eof->type = TOKEN_END;
+    eof->file = rstr_dup(file);
+    l->next = eof;
+
+    r = glw_view_preproc(gr, sof, &ei, may_unlock, &deps);
+    if(!r)
+      glw_view_cache_store(gr, gcv->gcv_url, sof, &deps, may_unlock);
+  } else {
+    r = -1;
+  }
+
+  glw_view_deps_free(&deps);
+
+  if(r) {
     glw_view_free_chain(gr, sof);
     goto bad;
   }
 
-  token_t *eof = glw_view_token_alloc(gr);
-  eof->type = TOKEN_END;
-  eof->file = rstr_dup(file);
-  l->next = eof;
-
-  if(glw_view_preproc(gr, sof, &ei, may_unlock) ||
-     glw_view_parse(sof, &ei, gr)) {
+ parse:
+  if(glw_view_parse(sof, &ei, gr)) {
     glw_view_free_chain(gr, sof);
     goto bad;
   }
@@ -469,4 +491,6 @@ glw_view_cache_flush(glw_root_t *gr)
     LIST_REMOVE(gcv, gcv_link);
     gcv_release(gr, gcv);
   }
+
+  glw_view_cache_flush_files(gr);
 }
@@ -294,8 +294,19 @@ void glw_view_token_free(glw_root_t *gr, token_t *t);
 
 token_t *glw_view_token_copy(glw_root_t *gr, token_t *src);
 
+/**
+ * Files (and the version of them we read) a view is built from.
+ * See glw_view_cache.c
+ */
+LIST_HEAD(glw_view_dep_list, glw_view_dep);
+
+typedef struct glw_view_deps {
+  struct glw_view_dep_list gvd_list;
+  int gvd_unknown;  // Some file has no known version, can't store view
+} glw_view_deps_t;
+
 token_t *glw_view_load1(glw_root_t *gr, rstr_t *url, errorinfo_t *ei,
-                        token_t *prev, int may_unlock);
+                        token_t *prev, int may_unlock, glw_view_deps_t *deps);
 
 token_t *glw_view_lexer(glw_root_t *gr, const char *src, errorinfo_t *ei,
                         rstr_t *file, token_t *prev);
@@ -325,13 +336,34 @@ int glw_view_eval_block(token_t *t, glw_view_eval_context_t *ec,
 
 int glw_view_eval_rpn(token_t *t, glw_view_eval_context_t *pec, int *copyp);
 
+void glw_view_fold_constants(glw_root_t *gr, token_t *rpn);
+
+void glw_view_bytecode_free(token_t *rpn);
+
 int glw_view_preproc(glw_root_t *gr, token_t *p, errorinfo_t *ei,
-                     int may_unlock);
+                     int may_unlock, glw_view_deps_t *deps);
 
 token_t *glw_view_clone_chain(glw_root_t *gr, token_t *src, token_t **lp);
 
 void glw_view_cache_flush(glw_root_t *gr);
 
+token_t *glw_view_cache_load_file(glw_root_t *gr, rstr_t *url,
+                                  errorinfo_t *ei, token_t *prev,
+                                  int may_unlock, glw_view_deps_t *deps);
+
+void glw_view_cache_flush_files(glw_root_t *gr);
+
+token_t *glw_view_cache_load(glw_root_t *gr, rstr_t *url, int may_unlock);
+
+void glw_view_cache_store(glw_root_t *gr, rstr_t *url, token_t *sof,
+                          const glw_view_deps_t *deps, int may_unlock);
+
+void glw_view_deps_init(glw_view_deps_t *deps);
+
+void glw_view_deps_add(glw_view_deps_t *deps, rstr_t *url);
+
+void glw_view_deps_free(glw_view_deps_t *deps);
+
 struct glw_prop_sub_slist;
 void glw_prop_subscription_destroy_list(glw_root_t *gr,
 					struct glw_prop_sub_slist *l);
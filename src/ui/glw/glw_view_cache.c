@@ -0,0 +1,872 @@
+/*
+ *  Copyright (C) 2007-2015 Lonelycoder AB
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  This program is also available under a commercial proprietary license.
+ *  For more information, contact andreas@lonelycoder.com
+ */
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "glw.h"
+#include "glw_view.h"
+#include "blobcache.h"
+#include "fileaccess/fileaccess.h"
+#include "metadata/metadata.h"
+
+/**
+ * View token cache
+ *
+ * Files pulled in with #include and #import (theme.view and friends)
+ * are lexed once and kept in memory per root. Every further use is
+ * just a clone of the cached token chain.
+ *
+ * The preprocessed token stream of a top level view is serialized
+ * into the blobcache together with the version of every file it was
+ * built from, so on next start the view can go straight to the parser.
+ * A preprocessed stream only contains lexer tokens (operators, strings
+ * and numbers) so it's stored as a flat array of tokens referring to
+ * a table of strings by index.
+ */
+
+#define GVC_STASH     "glw-views"
+#define GVC_MAGIC     0x31435647 // 'GVC1'
+#define GVC_NO_STRING 0xffffffff
+
+/**
+ * A file a view depends on
+ */
+typedef struct glw_view_dep {
+  LIST_ENTRY(glw_view_dep) gvd_link;
+  rstr_t *gvd_url;
+  char *gvd_etag;
+  time_t gvd_mtime;
+} glw_view_dep_t;
+
+
+/**
+ * A lexed file
+ */
+typedef struct glw_view_file {
+  LIST_ENTRY(glw_view_file) gvf_link;
+  rstr_t *gvf_url;
+  token_t *gvf_tokens;
+  char *gvf_etag;
+  time_t gvf_mtime;
+  int gvf_has_version;
+} glw_view_file_t;
+
+
+/**
+ * Serialized view is laid out as
+ *
+ *   gvc_hdr_t
+ *   gvc_dep_t   [num_deps]
+ *   gvc_token_t [num_tokens]
+ *   strings     [num_strings] (uint32_t length followed by data)
+ */
+typedef struct gvc_hdr {
+  uint32_t magic;
+  uint32_t version;  // String index of appversion
+  uint32_t num_deps;
+  uint32_t num_tokens;
+  uint32_t num_strings;
+  uint32_t reserved;
+} gvc_hdr_t;
+
+typedef struct gvc_dep {
+  int64_t mtime;
+  uint32_t url;
+  uint32_t etag;
+} gvc_dep_t;
+
+typedef struct gvc_token {
+  uint8_t type;
+  uint8_t rstrtype;
+  uint16_t reserved;
+  uint32_t file;
+  int32_t line;
+  union {
+    uint32_t str;
+    float f;
+    int32_t i;
+  } u;
+} gvc_token_t;
+
+
+/**
+ *
+ */
+void
+glw_view_deps_init(glw_view_deps_t *deps)
+{
+  LIST_INIT(&deps->gvd_list);
+  deps->gvd_unknown = 0;
+}
+
+
+/**
+ *
+ */
+static void
+deps_add(glw_view_deps_t *deps, rstr_t *url, const char *etag, time_t mtime,
+         int has_version)
+{
+  glw_view_dep_t *gvd;
+
+  if(!has_version) {
+    deps->gvd_unknown = 1;
+    return;
+  }
+
+  LIST_FOREACH(gvd, &deps->gvd_list, gvd_link)
+    if(rstr_eq(gvd->gvd_url, url))
+      return;
+
+  gvd = malloc(sizeof(glw_view_dep_t));
+  gvd->gvd_url = rstr_dup(url);
+  gvd->gvd_etag = etag != NULL ? strdup(etag) : NULL;
+  gvd->gvd_mtime = mtime;
+  LIST_INSERT_HEAD(&deps->gvd_list, gvd, gvd_link);
+}
+
+
+/**
+ * Add the current version of 'url'. Should be called before the
+ * file is loaded so we never record a version newer than what we read
+ */
+void
+glw_view_deps_add(glw_view_deps_t *deps, rstr_t *url)
+{
+  char *etag;
+  time_t mtime;
+  int is_expired;
+
+  int r = fa_get_version(rstr_get(url), &etag, &mtime, &is_expired);
+  deps_add(deps, url, etag, mtime, !r);
+  free(etag);
+}
+
+
+/**
+ *
+ */
+void
+glw_view_deps_free(glw_view_deps_t *deps)
+{
+  glw_view_dep_t *gvd;
+
+  while((gvd = LIST_FIRST(&deps->gvd_list)) != NULL) {
+    LIST_REMOVE(gvd, gvd_link);
+    rstr_release(gvd->gvd_url);
+    free(gvd->gvd_etag);
+    free(gvd);
+  }
+}
+
+
+/**
+ *
+ */
+static int
+same_version(const char *etag1, time_t mtime1,
+             const char *etag2, time_t mtime2)
+{
+  if(mtime1 != mtime2)
+    return 0;
+  if(etag1 == NULL || etag2 == NULL)
+    return etag1 == etag2;
+  return !strcmp(etag1, etag2);
+}
+
+
+/**
+ *
+ */
+static void
+gvf_destroy(glw_root_t *gr, glw_view_file_t *gvf)
+{
+  LIST_REMOVE(gvf, gvf_link);
+  glw_view_free_chain(gr, gvf->gvf_tokens);
+  rstr_release(gvf->gvf_url);
+  free(gvf->gvf_etag);
+  free(gvf);
+}
+
+
+/**
+ *
+ */
+static glw_view_file_t *
+gvf_find(glw_root_t *gr, rstr_t *url)
+{
+  glw_view_file_t *gvf;
+
+  LIST_FOREACH(gvf, &gr->gr_view_files, gvf_link)
+    if(rstr_eq(gvf->gvf_url, url))
+      return gvf;
+  return NULL;
+}
+
+
+/**
+ * Load and lex a file and add it to the cache
+ */
+static glw_view_file_t *
+gvf_load(glw_root_t *gr, rstr_t *url, errorinfo_t *ei, token_t *prev,
+         int may_unlock)
+{
+  char errbuf[256];
+  char *etag;
+  time_t mtime;
+  int is_expired;
+  token_t head;
+  glw_view_file_t *gvf;
+
+  if(may_unlock)
+    glw_unlock(gr);
+
+  int has_version = !fa_get_version(rstr_get(url), &etag, &mtime,
+                                    &is_expired);
+
+  buf_t *b = fa_load(rstr_get(url),
+                     FA_LOAD_ERRBUF(errbuf, sizeof(errbuf)),
+                     NULL);
+
+  if(may_unlock)
+    glw_lock(gr);
+
+  if(b == NULL) {
+    snprintf(ei->error, sizeof(ei->error), "Unable to open \"%s\" -- %s",
+	     rstr_get(url), errbuf);
+    snprintf(ei->file,  sizeof(ei->file),  "%s", rstr_get(prev->file));
+    ei->line = prev->line;
+    free(etag);
+    return NULL;
+  }
+
+  head.next = NULL;
+  token_t *last = glw_view_lexer(gr, buf_cstr(b), ei, url, &head);
+  buf_release(b);
+
+  if(last == NULL) {
+    glw_view_free_chain(gr, head.next);
+    free(etag);
+    return NULL;
+  }
+
+  // Someone else might have loaded it while we were unlocked
+  if((gvf = gvf_find(gr, url)) != NULL) {
+    glw_view_free_chain(gr, head.next);
+    free(etag);
+    return gvf;
+  }
+
+  gvf = calloc(1, sizeof(glw_view_file_t));
+  gvf->gvf_url = rstr_dup(url);
+  gvf->gvf_tokens = head.next;
+  gvf->gvf_etag = etag;
+  gvf->gvf_mtime = mtime;
+  gvf->gvf_has_version = has_version;
+  LIST_INSERT_HEAD(&gr->gr_view_files, gvf, gvf_link);
+  return gvf;
+}
+
+
+/**
+ * Add the tokens of file 'url' (already resolved) after 'prev'
+ *
+ * Returns pointer to last token, or NULL if an error occured.
+ * If an error occured 'ei' will be filled with data
+ */
+token_t *
+glw_view_cache_load_file(glw_root_t *gr, rstr_t *url, errorinfo_t *ei,
+                         token_t *prev, int may_unlock, glw_view_deps_t *deps)
+{
+  glw_view_file_t *gvf = gvf_find(gr, url);
+
+  if(gvf == NULL && (gvf = gvf_load(gr, url, ei, prev, may_unlock)) == NULL)
+    return NULL;
+
+  deps_add(deps, gvf->gvf_url, gvf->gvf_etag, gvf->gvf_mtime,
+           gvf->gvf_has_version);
+
+  token_t *last = prev;
+  token_t *t = glw_view_clone_chain(gr, gvf->gvf_tokens, &last);
+  if(t != NULL)
+    prev->next = t;
+  return last;
+}
+
+
+/**
+ *
+ */
+void
+glw_view_cache_flush_files(glw_root_t *gr)
+{
+  glw_view_file_t *gvf;
+
+  while((gvf = LIST_FIRST(&gr->gr_view_files)) != NULL)
+    gvf_destroy(gr, gvf);
+}
+
+
+/**
+ * Views are resolved relative to the skin so it's part of the key
+ */
+static void
+gvc_key(char *dst, size_t dstlen, glw_root_t *gr, rstr_t *url)
+{
+  snprintf(dst, dstlen, "%s|%s", gr->gr_skin ?: "", rstr_get(url));
+}
+
+
+/**
+ * Only tokens the lexer produces can be serialized
+ */
+static int
+gvc_token_ok(int type)
+{
+  switch(type) {
+  case TOKEN_RSTRING:
+  case TOKEN_FLOAT:
+  case TOKEN_INT:
+  case TOKEN_IDENTIFIER:
+  case TOKEN_VOID:
+    return 1;
+  default:
+    return type >= TOKEN_START && type <= TOKEN_COLON;
+  }
+}
+
+
+/**
+ * String table used when serializing
+ */
+typedef struct gvc_strtab {
+  const char **strings;
+  uint32_t *slots;  // Index + 1 into strings, 0 == free
+  unsigned int mask;
+  uint32_t num;
+  size_t size;      // Serialized size
+} gvc_strtab_t;
+
+
+/**
+ *
+ */
+static uint32_t
+gvc_intern(gvc_strtab_t *st, const char *str)
+{
+  uint32_t h = 2166136261U;
+
+  for(const char *s = str; *s; s++)
+    h = (h ^ (uint8_t)*s) * 16777619;
+
+  unsigned int i = h & st->mask;
+  while(st->slots[i]) {
+    if(!strcmp(st->strings[st->slots[i] - 1], str))
+      return st->slots[i] - 1;
+    i = (i + 1) & st->mask;
+  }
+
+  st->strings[st->num] = str;
+  st->size += sizeof(uint32_t) + strlen(str);
+  st->slots[i] = ++st->num;
+  return st->num - 1;
+}
+
+
+/**
+ * Store the preprocessed token stream 'sof' for view 'url'
+ */
+void
+glw_view_cache_store(glw_root_t *gr, rstr_t *url, token_t *sof,
+                     const glw_view_deps_t *deps, int may_unlock)
+{
+  char key[URL_MAX];
+  const glw_view_dep_t *gvd;
+  gvc_strtab_t st = {};
+  int num_tokens = 0, num_deps = 0;
+  token_t *t;
+
+  if(deps->gvd_unknown)
+    return;
+
+  for(t = sof; t != NULL; t = t->next) {
+    if(!gvc_token_ok(t->type) || t->child != NULL)
+      return;
+    num_tokens++;
+  }
+
+  LIST_FOREACH(gvd, &deps->gvd_list, gvd_link)
+    num_deps++;
+
+  const int max_strings = 1 + num_tokens * 2 + num_deps * 2;
+  unsigned int slots = 64;
+  while(slots < max_strings * 2)
+    slots *= 2;
+
+  st.strings = malloc(sizeof(const char *) * max_strings);
+  st.slots = calloc(slots, sizeof(uint32_t));
+  st.mask = slots - 1;
+
+  gvc_hdr_t hdr = {};
+  hdr.magic = GVC_MAGIC;
+  hdr.version = gvc_intern(&st, appversion);
+  hdr.num_deps = num_deps;
+  hdr.num_tokens = num_tokens;
+
+  gvc_dep_t *gds = malloc(sizeof(gvc_dep_t) * num_deps);
+  gvc_token_t *gts = calloc(num_tokens, sizeof(gvc_token_t));
+
+  gvc_dep_t *gd = gds;
+  LIST_FOREACH(gvd, &deps->gvd_list, gvd_link) {
+    gd->mtime = gvd->gvd_mtime;
+    gd->url = gvc_intern(&st, rstr_get(gvd->gvd_url));
+    gd->etag = gvd->gvd_etag ? gvc_intern(&st, gvd->gvd_etag) : GVC_NO_STRING;
+    gd++;
+  }
+
+  gvc_token_t *gt = gts;
+  for(t = sof; t != NULL; t = t->next, gt++) {
+    gt->type = t->type;
+    gt->file = gvc_intern(&st, rstr_get(t->file) ?: "");
+    gt->line = t->line;
+
+    switch(t->type) {
+    case TOKEN_RSTRING:
+      gt->rstrtype = t->t_rstrtype;
+      // FALLTHRU
+    case TOKEN_IDENTIFIER:
+      gt->u.str = gvc_intern(&st, rstr_get(t->t_rstring) ?: "");
+      break;
+    case TOKEN_FLOAT:
+      gt->u.f = t->t_float;
+      break;
+    case TOKEN_INT:
+      gt->u.i = t->t_int;
+      break;
+    default:
+      break;
+    }
+  }
+
+  hdr.num_strings = st.num;
+
+  const size_t size = sizeof(gvc_hdr_t) +
+    sizeof(gvc_dep_t) * num_deps +
+    sizeof(gvc_token_t) * num_tokens +
+    st.size;
+
+  buf_t *b = buf_create(size);
+  if(b != NULL) {
+    uint8_t *p = b->b_ptr;
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    memcpy(p, gds, sizeof(gvc_dep_t) * num_deps);
+    p += sizeof(gvc_dep_t) * num_deps;
+    memcpy(p, gts, sizeof(gvc_token_t) * num_tokens);
+    p += sizeof(gvc_token_t) * num_tokens;
+
+    for(int i = 0; i < st.num; i++) {
+      const uint32_t len = strlen(st.strings[i]);
+      memcpy(p, &len, sizeof(uint32_t));
+      memcpy(p + sizeof(uint32_t), st.strings[i], len);
+      p += sizeof(uint32_t) + len;
+    }
+  }
+
+  free(st.strings);
+  free(st.slots);
+  free(gds);
+  free(gts);
+
+  if(b == NULL)
+    return;
+
+  gvc_key(key, sizeof(key), gr, url);
+
+  if(may_unlock)
+    glw_unlock(gr);
+
+  // Validity is governed by the version of the dependencies
+  blobcache_put(key, GVC_STASH, b, 30 * 86400, NULL, 0, 0);
+
+  if(may_unlock)
+    glw_lock(gr);
+
+  buf_release(b);
+}
+
+
+/**
+ * Check that a serialized view is sane and still matches the files
+ * it was built from. Returns the string table
+ */
+static rstr_t **
+gvc_validate(const buf_t *b)
+{
+  const gvc_hdr_t *hdr = buf_data(b);
+  const uint8_t *p = buf_data(b);
+  const uint8_t *end = p + buf_size(b);
+
+  if(buf_size(b) < sizeof(gvc_hdr_t) || hdr->magic != GVC_MAGIC)
+    return NULL;
+
+  const size_t fixed = sizeof(gvc_hdr_t) +
+    sizeof(gvc_dep_t) * (size_t)hdr->num_deps +
+    sizeof(gvc_token_t) * (size_t)hdr->num_tokens;
+
+  if(buf_size(b) < fixed || hdr->num_strings > buf_size(b) ||
+     hdr->num_tokens < 2)
+    return NULL;
+
+  const gvc_dep_t *gds = (const void *)(p + sizeof(gvc_hdr_t));
+  const gvc_token_t *gts = (const void *)(gds + hdr->num_deps);
+  const int n = hdr->num_strings;
+  rstr_t **strings = calloc(n, sizeof(rstr_t *));
+  int i;
+
+  p += fixed;
+  for(i = 0; i < n; i++) {
+    uint32_t len;
+    if(end - p < sizeof(uint32_t))
+      goto bad;
+    memcpy(&len, p, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+    if(end - p < len)
+      goto bad;
+    strings[i] = rstr_allocl((const char *)p, len);
+    p += len;
+  }
+
+  if(hdr->version >= n || strcmp(rstr_get(strings[hdr->version]), appversion))
+    goto bad;
+
+  for(i = 0; i < hdr->num_tokens; i++) {
+    const gvc_token_t *gt = &gts[i];
+    if(!gvc_token_ok(gt->type) || gt->file >= n)
+      goto bad;
+    if((gt->type == TOKEN_RSTRING || gt->type == TOKEN_IDENTIFIER) &&
+       gt->u.str >= n)
+      goto bad;
+  }
+
+  if(gts[0].type != TOKEN_START || gts[hdr->num_tokens - 1].type != TOKEN_END)
+    goto bad;
+
+  for(i = 0; i < hdr->num_deps; i++) {
+    const gvc_dep_t *gd = &gds[i];
+    char *etag;
+    time_t mtime;
+    int is_expired;
+
+    if(gd->url >= n || (gd->etag != GVC_NO_STRING && gd->etag >= n))
+      goto bad;
+
+    if(fa_get_version(rstr_get(strings[gd->url]), &etag, &mtime, &is_expired))
+      goto bad;
+
+    const char *cached_etag =
+      gd->etag != GVC_NO_STRING ? rstr_get(strings[gd->etag]) : NULL;
+
+    int same = same_version(etag, mtime, cached_etag, gd->mtime);
+    free(etag);
+    if(!same)
+      goto bad;
+  }
+  return strings;
+
+ bad:
+  for(i = 0; i < n; i++)
+    rstr_release(strings[i]);
+  free(strings);
+  return NULL;
+}
+
+
+/**
+ * Return the preprocessed token stream for view 'url' if we have one
+ * that's still valid
+ */
+token_t *
+glw_view_cache_load(glw_root_t *gr, rstr_t *url, int may_unlock)
+{
+  char key[URL_MAX];
+  rstr_t **strings = NULL;
+
+  gvc_key(key, sizeof(key), gr, url);
+
+  if(may_unlock)
+    glw_unlock(gr);
+
+  buf_t *b = blobcache_get(key, GVC_STASH, 0, NULL, NULL, NULL);
+  if(b != NULL) {
+    strings = gvc_validate(b);
+    if(strings == NULL)
+      blobcache_evict(key, GVC_STASH);
+  }
+
+  if(may_unlock)
+    glw_lock(gr);
+
+  if(strings == NULL) {
+    if(b != NULL)
+      buf_release(b);
+    return NULL;
+  }
+
+  const gvc_hdr_t *hdr = buf_data(b);
+  const gvc_token_t *gt = (const void *)(buf_c8(b) + sizeof(gvc_hdr_t) +
+                                         sizeof(gvc_dep_t) * hdr->num_deps);
+  token_t *sof = NULL, **pp = &sof;
+
+  for(int i = 0; i < hdr->num_tokens; i++, gt++) {
+    token_t *t = glw_view_token_alloc(gr);
+    t->type = gt->type;
+    t->file = rstr_dup(strings[gt->file]);
+    t->line = gt->line;
+
+    switch(t->type) {
+    case TOKEN_RSTRING:
+      t->t_rstrtype = gt->rstrtype;
+      // FALLTHRU
+    case TOKEN_IDENTIFIER:
+      t->t_rstring = rstr_dup(strings[gt->u.str]);
+      break;
+    case TOKEN_FLOAT:
+      t->t_float = gt->u.f;
+      break;
+    case TOKEN_INT:
+      t->t_int = gt->u.i;
+      break;
+    default:
+      break;
+    }
+    *pp = t;
+    pp = &t->next;
+  }
+
+  for(int i = 0; i < hdr->num_strings; i++)
+    rstr_release(strings[i]);
+  free(strings);
+  buf_release(b);
+  return sof;
+}
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Startup benchmark
+ *
+ * Loads every view in the skin (--skin or the default one) the way
+ * the view loader does and reports the time for
+ *
+ *   baseline   Each view lexes all the files it pulls in (no caching)
+ *   cold       First start, in memory file cache, filling the blobcache
+ *   warm       Next start, views come straight from the blobcache
+ *
+ * Each figure is the best of GVC_BENCH_PASSES passes. Fragments that
+ * only parse when included from another view, or that use widgets not
+ * built in, are reported as failed
+ */
+#define GVC_BENCH_PASSES 10
+
+static void
+gvc_bench_scan(const char *path, rstr_t ***views, int *num)
+{
+  char errbuf[256];
+  fa_dir_t *fd = fa_scandir(path, errbuf, sizeof(errbuf));
+  if(fd == NULL)
+    return;
+
+  fa_dir_entry_t *fde;
+  RB_FOREACH(fde, &fd->fd_entries, fde_link) {
+    const char *url = rstr_get(fde->fde_url);
+    if(fde->fde_type == CONTENT_DIR) {
+      gvc_bench_scan(url, views, num);
+      continue;
+    }
+    const char *ext = strrchr(url, '.');
+    if(ext == NULL || strcmp(ext, ".view"))
+      continue;
+    *views = realloc(*views, sizeof(rstr_t *) * (*num + 1));
+    (*views)[(*num)++] = rstr_dup(fde->fde_url);
+  }
+  fa_dir_free(fd);
+}
+
+
+/**
+ * Same steps as gcv_load() in glw_view.c, returns number of tokens
+ * handed to the parser or -1 on error
+ */
+static int
+gvc_bench_load(glw_root_t *gr, rstr_t *url, int use_cache, int *hits)
+{
+  errorinfo_t ei;
+  glw_view_deps_t deps;
+  int r;
+
+  token_t *sof = use_cache ? glw_view_cache_load(gr, url, 0) : NULL;
+
+  if(sof != NULL) {
+    (*hits)++;
+  } else {
+    buf_t *b = fa_load(rstr_get(url), NULL);
+    if(b == NULL)
+      return -1;
+
+    sof = glw_view_token_alloc(gr);
+    sof->type = TOKEN_START;
+    sof->file = rstr_dup(url);
+
+    token_t *l = glw_view_lexer(gr, buf_cstr(b), &ei, url, sof);
+    buf_release(b);
+    if(l == NULL) {
+      glw_view_free_chain(gr, sof);
+      return -1;
+    }
+
+    token_t *eof = glw_view_token_alloc(gr);
+    eof->type = TOKEN_END;
+    eof->file = rstr_dup(url);
+    l->next = eof;
+
+    glw_view_deps_init(&deps);
+    glw_view_deps_add(&deps, url);
+    r = glw_view_preproc(gr, sof, &ei, 0, &deps);
+    if(!r && use_cache)
+      glw_view_cache_store(gr, url, sof, &deps, 0);
+    glw_view_deps_free(&deps);
+
+    if(r) {
+      glw_view_free_chain(gr, sof);
+      return -1;
+    }
+  }
+
+  int tokens = 0;
+  for(const token_t *t = sof; t != NULL; t = t->next)
+    tokens++;
+
+  r = glw_view_parse(sof, &ei, gr);
+  glw_view_free_chain(gr, sof);
+  return r ? -1 : tokens;
+}
+
+
+static void
+glw_view_cache_bench(void)
+{
+  static const char *modes[] = {"baseline", "cold", "warm"};
+  char key[URL_MAX];
+  rstr_t **views = NULL;
+  int num_views = 0;
+
+  glw_root_t *gr = calloc(1, sizeof(glw_root_t));
+  gr->gr_prop_ui = prop_create_root("ui");
+
+  if(glw_init(gr)) {
+    TRACE(TRACE_ERROR, "bench", "viewcache: Unable to initialize UI");
+    prop_destroy(gr->gr_prop_ui);
+    free(gr);
+    return;
+  }
+
+  // The blobcache drops writes until it's fully started
+  buf_t *probe = buf_create_and_copy(4, "gvc");
+  while(!blobcache_put("bench", GVC_STASH, probe, 60, NULL, 0, 0))
+    usleep(100000);
+  blobcache_evict("bench", GVC_STASH);
+  buf_release(probe);
+
+  gvc_bench_scan(gr->gr_skin, &views, &num_views);
+  if(num_views == 0) {
+    TRACE(TRACE_ERROR, "bench", "viewcache: No views found in %s",
+          gr->gr_skin);
+    goto done;
+  }
+
+  glw_lock(gr);
+
+  for(int mode = 0; mode < ARRAYSIZE(modes); mode++) {
+    int64_t best = INT64_MAX;
+    int hits = 0, failed = 0, files = 0;
+    int64_t tokens = 0;
+
+    for(int pass = 0; pass < GVC_BENCH_PASSES; pass++) {
+      // Every pass is a new start, the in memory file cache is per run
+      glw_view_cache_flush_files(gr);
+
+      if(mode == 1) {
+        for(int i = 0; i < num_views; i++) {
+          gvc_key(key, sizeof(key), gr, views[i]);
+          blobcache_evict(key, GVC_STASH);
+        }
+      }
+
+      hits = failed = 0;
+      tokens = 0;
+
+      const int64_t t0 = arch_get_ts();
+      for(int i = 0; i < num_views; i++) {
+        if(mode == 0)
+          glw_view_cache_flush_files(gr);
+        int n = gvc_bench_load(gr, views[i], mode > 0, &hits);
+        if(n < 0) {
+          failed++;
+          continue;
+        }
+        tokens += n;
+      }
+      const int64_t ts = arch_get_ts() - t0;
+      if(ts < best)
+        best = ts;
+
+      files = 0;
+      glw_view_file_t *gvf;
+      LIST_FOREACH(gvf, &gr->gr_view_files, gvf_link)
+        files++;
+    }
+
+    TRACE(TRACE_INFO, "bench",
+          "viewcache: %-8s %3d views %7.2f ms  %6"PRId64" tokens parsed  "
+          "%3d files kept lexed  %3d cache hits  %d failed",
+          modes[mode], num_views, best / 1000.0, tokens,
+          files, hits, failed);
+  }
+
+  glw_view_cache_flush_files(gr);
+  glw_unlock(gr);
+
+  TRACE(TRACE_INFO, "bench", "viewcache: skin %s", gr->gr_skin);
+
+ done:
+  for(int i = 0; i < num_views; i++)
+    rstr_release(views[i]);
+  free(views);
+
+  glw_fini(gr);
+  prop_destroy(gr->gr_prop_ui);
+  glw_release_root(gr);
+}
+
+BENCHMARK("viewcache", glw_view_cache_bench);
+#endif
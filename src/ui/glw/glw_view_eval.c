@@ -22,6 +22,7 @@
 #include <stdarg.h>
 #include <math.h>
 
+#include "main.h"
 #include "misc/strtab.h"
 #include "misc/str.h"
 #include "glw_view.h"
@@ -274,6 +275,8 @@ static void eval_dynamic(glw_t *w, token_t *rpn, struct glw_rctx *rc,
 
 static int glw_view_eval_rpn0(token_t *t0, glw_view_eval_context_t *ec);
 
+static int eval_rpn_dynamic(token_t *t, glw_view_eval_context_t *ec);
+
 /**
  *
  */
@@ -316,6 +319,28 @@ eval_alloc(token_t *src, glw_view_eval_context_t *ec, token_type_t type)
 }
 
 
+/**
+ * Allocate a result token, or use 'slot' if given.
+ *
+ * Slots are register slots owned by the bytecode interpreter (see
+ * gvb_exec()). They are never freed so only tokens that don't hold
+ * any references (numbers, float vectors, void) can be put there
+ */
+static token_t *
+eval_result(token_t *src, glw_view_eval_context_t *ec, token_type_t type,
+            token_t *slot)
+{
+  if(slot == NULL)
+    return eval_alloc(src, ec, type);
+
+  memset(slot, 0, sizeof(token_t));
+  slot->file = src->file;
+  slot->line = src->line;
+  slot->type = type;
+  return slot;
+}
+
+
 /**
  *
  */
@@ -514,20 +539,16 @@ token_rgbstr_to_vec(token_t *t, glw_view_eval_context_t *ec)
 /**
  *
  */
-static int
-eval_op(glw_view_eval_context_t *ec, struct token *self)
+static token_t *
+eval_op_tokens(glw_view_eval_context_t *ec, struct token *self,
+               token_t *a, token_t *b, token_t *slot)
 {
-  token_t *b = eval_pop(ec), *a = eval_pop(ec), *r;
+  token_t *r;
   float (*f_fn)(float, float);
   int   (*i_fn)(int, int);
   int i;
   const char *aa, *bb;
 
-  if((a = token_resolve(ec, a)) == NULL)
-    return -1;
-  if((b = token_resolve(ec, b)) == NULL)
-    return -1;
-
   if(a->type == TOKEN_VOID)
     a = &t_zero;
 
@@ -566,8 +587,7 @@ eval_op(glw_view_eval_context_t *ec, struct token *self)
       else
 	memcpy(rstr_data(r->t_rstring) + al, bb, bl);
 
-      eval_push(ec, r);
-      return 0;
+      return r;
     }
 
     f_fn = eval_op_fadd;
@@ -598,25 +618,26 @@ eval_op(glw_view_eval_context_t *ec, struct token *self)
   if(a->type == TOKEN_INT && b->type == TOKEN_INT) {
 
     if(i_fn == NULL) {
-      r = eval_alloc(self, ec, TOKEN_FLOAT);
+      r = eval_result(self, ec, TOKEN_FLOAT, slot);
       r->t_float = f_fn(a->t_int, b->t_int);
     } else {
-      r = eval_alloc(self, ec, TOKEN_INT);
+      r = eval_result(self, ec, TOKEN_INT, slot);
       r->t_int = i_fn(a->t_int, b->t_int);
     }
 
   } else if(token_floatish(a) && token_floatish(b)) {
-    r = eval_alloc(self, ec, TOKEN_FLOAT);
+    r = eval_result(self, ec, TOKEN_FLOAT, slot);
     r->t_float = f_fn(token2float(ec, a), token2float(ec, b));
 
   } else if(a->type == TOKEN_VECTOR_FLOAT && b->type == TOKEN_VECTOR_FLOAT) {
 
-    if(a->t_elements != b->t_elements)
-      return glw_view_seterr(ec->ei, self,
-			      "Arithmetic op is invalid for "
-			      "non-equal sized vectors");
+    if(a->t_elements != b->t_elements) {
+      glw_view_seterr(ec->ei, self,
+                      "Arithmetic op is invalid for non-equal sized vectors");
+      return NULL;
+    }
 
-    r = eval_alloc(self, ec, TOKEN_VECTOR_FLOAT);
+    r = eval_result(self, ec, TOKEN_VECTOR_FLOAT, slot);
 
     r->t_elements = a->t_elements;
     for(i = 0; i < a->t_elements; i++)
@@ -627,7 +648,7 @@ eval_op(glw_view_eval_context_t *ec, struct token *self)
 
     float v = token2float(ec, b);
 
-    r = eval_alloc(self, ec, TOKEN_VECTOR_FLOAT);
+    r = eval_result(self, ec, TOKEN_VECTOR_FLOAT, slot);
 
     r->t_elements = a->t_elements;
     for(i = 0; i < a->t_elements; i++)
@@ -637,15 +658,33 @@ eval_op(glw_view_eval_context_t *ec, struct token *self)
 
     float v = token2float(ec, a);
 
-    r = eval_alloc(self, ec, TOKEN_VECTOR_FLOAT);
+    r = eval_result(self, ec, TOKEN_VECTOR_FLOAT, slot);
 
     r->t_elements = b->t_elements;
     for(i = 0; i < b->t_elements; i++)
       r->t_float_vector[i] = f_fn(v, b->t_float_vector[i]);
   } else {
-    r = eval_alloc(self, ec, TOKEN_VOID);
+    r = eval_result(self, ec, TOKEN_VOID, slot);
   }
+  return r;
+}
 
+
+/**
+ *
+ */
+static int
+eval_op(glw_view_eval_context_t *ec, struct token *self)
+{
+  token_t *b = eval_pop(ec), *a = eval_pop(ec), *r;
+
+  if((a = token_resolve(ec, a)) == NULL)
+    return -1;
+  if((b = token_resolve(ec, b)) == NULL)
+    return -1;
+
+  if((r = eval_op_tokens(ec, self, a, b, NULL)) == NULL)
+    return -1;
   eval_push(ec, r);
   return 0;
 }
@@ -658,18 +697,14 @@ static int eval_op_and(int a, int b) { return a & b; }
 /**
  *
  */
-static int
-eval_bool_op(glw_view_eval_context_t *ec, struct token *self)
+static token_t *
+eval_bool_op_tokens(glw_view_eval_context_t *ec, struct token *self,
+                    token_t *a, token_t *b, token_t *slot)
 {
-  token_t *b = eval_pop(ec), *a = eval_pop(ec), *r;
+  token_t *r;
   int   (*fn)(int, int);
   int aa, bb;
 
-  if((a = token_resolve(ec, a)) == NULL)
-    return -1;
-  if((b = token_resolve(ec, b)) == NULL)
-    return -1;
-
   aa = token2bool(a);
   bb = token2bool(b);
 
@@ -689,27 +724,55 @@ eval_bool_op(glw_view_eval_context_t *ec, struct token *self)
     break;
   }
 
-  r = eval_alloc(self, ec, TOKEN_INT);
+  r = eval_result(self, ec, TOKEN_INT, slot);
   r->t_int = fn(aa, bb);
-  eval_push(ec, r);
+  return r;
+}
+
+
+/**
+ *
+ */
+static int
+eval_bool_op(glw_view_eval_context_t *ec, struct token *self)
+{
+  token_t *b = eval_pop(ec), *a = eval_pop(ec);
+
+  if((a = token_resolve(ec, a)) == NULL)
+    return -1;
+  if((b = token_resolve(ec, b)) == NULL)
+    return -1;
+
+  eval_push(ec, eval_bool_op_tokens(ec, self, a, b, NULL));
   return 0;
 }
 
 
+/**
+ *
+ */
+static token_t *
+eval_bool_not_token(glw_view_eval_context_t *ec, struct token *self,
+                    token_t *a, token_t *slot)
+{
+  token_t *r = eval_result(self, ec, TOKEN_INT, slot);
+  r->t_int = !token2bool(a);
+  return r;
+}
+
+
 /**
  *
  */
 static int
 eval_bool_not(glw_view_eval_context_t *ec, struct token *self)
 {
-  token_t *a = eval_pop(ec), *r;
+  token_t *a = eval_pop(ec);
 
   if((a = token_resolve(ec, a)) == NULL)
     return -1;
 
-  r = eval_alloc(self, ec, TOKEN_INT);
-  r->t_int = !token2bool(a);
-  eval_push(ec, r);
+  eval_push(ec, eval_bool_not_token(ec, self, a, NULL));
   return 0;
 }
 
@@ -717,16 +780,13 @@ eval_bool_not(glw_view_eval_context_t *ec, struct token *self)
 /**
  *
  */
-static int
-eval_eq(glw_view_eval_context_t *ec, struct token *self, int neq)
+static token_t *
+eval_eq_tokens(glw_view_eval_context_t *ec, struct token *self,
+               token_t *a, token_t *b, token_t *slot)
 {
-  token_t *b = eval_pop(ec), *a = eval_pop(ec), *r;
+  token_t *r;
   int rr;
   const char *aa, *bb;
-  if((a = token_resolve(ec, a)) == NULL)
-    return -1;
-  if((b = token_resolve(ec, b)) == NULL)
-    return -1;
 
   if((aa = token_as_string(a)) != NULL &&
      (bb = token_as_string(b)) != NULL) {
@@ -754,10 +814,9 @@ eval_eq(glw_view_eval_context_t *ec, struct token *self, int neq)
     }
   }
 
-  r = eval_alloc(self, ec, TOKEN_INT);
-  r->t_int = rr ^ neq;
-  eval_push(ec, r);
-  return 0;
+  r = eval_result(self, ec, TOKEN_INT, slot);
+  r->t_int = rr ^ (self->type == TOKEN_NEQ);
+  return r;
 }
 
 
@@ -765,24 +824,55 @@ eval_eq(glw_view_eval_context_t *ec, struct token *self, int neq)
  *
  */
 static int
-eval_lt(glw_view_eval_context_t *ec, struct token *self, int gt)
+eval_eq(glw_view_eval_context_t *ec, struct token *self)
 {
-  token_t *b = eval_pop(ec), *a = eval_pop(ec), *r;
-  int rr;
+  token_t *b = eval_pop(ec), *a = eval_pop(ec);
 
   if((a = token_resolve(ec, a)) == NULL)
     return -1;
   if((b = token_resolve(ec, b)) == NULL)
     return -1;
 
-  if(gt)
+  eval_push(ec, eval_eq_tokens(ec, self, a, b, NULL));
+  return 0;
+}
+
+
+/**
+ *
+ */
+static token_t *
+eval_lt_tokens(glw_view_eval_context_t *ec, struct token *self,
+               token_t *a, token_t *b, token_t *slot)
+{
+  token_t *r;
+  int rr;
+
+  if(self->type == TOKEN_GT)
     rr = token2float(ec, a) > token2float(ec, b);
   else
     rr = token2float(ec, a) < token2float(ec, b);
 
-  r = eval_alloc(self, ec, TOKEN_INT);
+  r = eval_result(self, ec, TOKEN_INT, slot);
   r->t_int = rr;
-  eval_push(ec, r);
+  return r;
+}
+
+
+/**
+ *
+ */
+static int
+eval_lt(glw_view_eval_context_t *ec, struct token *self)
+{
+  token_t *b = eval_pop(ec), *a = eval_pop(ec);
+
+  if((a = token_resolve(ec, a)) == NULL)
+    return -1;
+  if((b = token_resolve(ec, b)) == NULL)
+    return -1;
+
+  eval_push(ec, eval_lt_tokens(ec, self, a, b, NULL));
   return 0;
 }
 
@@ -1116,7 +1206,7 @@ eval_dynamic(glw_t *w, token_t *rpn, struct glw_rctx *rc, glw_scope_t *scope)
 
   ec.sublist = &w->glw_prop_subscriptions;
 
-  glw_view_eval_rpn0(rpn, &ec);
+  eval_rpn_dynamic(rpn, &ec);
   rpn->t_dynamic_eval = ec.dynamic_eval;
   w->glw_dynamic_eval |= ec.dynamic_eval;
 
@@ -1158,7 +1248,7 @@ run_dynamics(glw_t *w, glw_view_eval_context_t *ec, int mask)
 
   while(t != NULL) {
     if(t->t_dynamic_eval & mask) {
-      glw_view_eval_rpn0(t, ec);
+      eval_rpn_dynamic(t, ec);
       t->t_dynamic_eval = ec->dynamic_eval;
     }
     all_flags |= t->t_dynamic_eval;
@@ -2661,14 +2751,80 @@ make_vector(glw_view_eval_context_t *ec, token_t *t)
 
 
 /**
- *
+ * Evaluate an operator, operands are on the stack
  */
 static int
-glw_view_eval_rpn0(token_t *t0, glw_view_eval_context_t *ec)
+eval_operator(glw_view_eval_context_t *ec, token_t *t)
 {
-  token_t *t;
+  switch(t->type) {
+  case TOKEN_ADD:
+  case TOKEN_SUB:
+  case TOKEN_MULTIPLY:
+  case TOKEN_DIVIDE:
+  case TOKEN_MODULO:
+    return eval_op(ec, t);
+
+  case TOKEN_BOOLEAN_OR:
+  case TOKEN_BOOLEAN_XOR:
+  case TOKEN_BOOLEAN_AND:
+    return eval_bool_op(ec, t);
+
+  case TOKEN_BOOLEAN_NOT:
+    return eval_bool_not(ec, t);
+
+  case TOKEN_NULL_COALESCE:
+    return eval_null_coalesce(ec, t);
 
-  for(t = t0->child; t != NULL; t = t->next) {
+  case TOKEN_EQ:
+  case TOKEN_NEQ:
+    return eval_eq(ec, t);
+
+  case TOKEN_LT:
+  case TOKEN_GT:
+    return eval_lt(ec, t);
+
+  case TOKEN_FUNCTION:
+#if 0
+    printf("Invoking %s with %d arguments\n",
+           t->t_func->name, t->t_num_args);
+#endif
+    return invoke_func(ec, t);
+
+  case TOKEN_LEFT_BRACKET:
+    return make_vector(ec, t);
+
+  case TOKEN_ASSIGNMENT:
+    return eval_assign(ec, t, 0);
+
+  case TOKEN_COND_ASSIGNMENT:
+    return eval_assign(ec, t, 1);
+
+  case TOKEN_DEBUG_ASSIGNMENT:
+    return eval_assign(ec, t, 2);
+
+  case TOKEN_REF_ASSIGNMENT:
+    return eval_assign(ec, t, 3);
+
+  case TOKEN_LINK_ASSIGNMENT:
+    return eval_link_assign(ec, t);
+
+  case TOKEN_TENARY:
+    return eval_tenary(ec, t);
+
+  default:
+    fprintf(stderr, "Can not handle token %s\n", token2name(t));
+    abort();
+  }
+}
+
+
+/**
+ *
+ */
+static int
+eval_rpn_tokens(token_t *t, glw_view_eval_context_t *ec)
+{
+  for(; t != NULL; t = t->next) {
     switch(t->type) {
     case TOKEN_BLOCK:
     case TOKEN_RSTRING:
@@ -2688,94 +2844,565 @@ glw_view_eval_rpn0(token_t *t0, glw_view_eval_context_t *ec)
       eval_push(ec, t);
       break;
 
-    case TOKEN_ADD:
-    case TOKEN_SUB:
-    case TOKEN_MULTIPLY:
-    case TOKEN_DIVIDE:
-    case TOKEN_MODULO:
-      if(eval_op(ec, t))
-	return -1;
+    default:
+      if(eval_operator(ec, t))
+        return -1;
       break;
+    }
+  }
+  return 0;
+}
 
-    case TOKEN_BOOLEAN_OR:
-    case TOKEN_BOOLEAN_XOR:
-    case TOKEN_BOOLEAN_AND:
-      if(eval_bool_op(ec, t))
-	return -1;
-      break;
 
-    case TOKEN_BOOLEAN_NOT:
-      if(eval_bool_not(ec, t))
-	return -1;
-      break;
+/**
+ *
+ */
+static int
+glw_view_eval_rpn0(token_t *t0, glw_view_eval_context_t *ec)
+{
+  return eval_rpn_tokens(t0->child, ec);
+}
 
-    case TOKEN_NULL_COALESCE:
-      if(eval_null_coalesce(ec, t))
-	return -1;
-      break;
 
-    case TOKEN_EQ:
-    case TOKEN_NEQ:
-      if(eval_eq(ec, t, t->type == TOKEN_NEQ))
-	return -1;
-      break;
+/**
+ * Bytecode for dynamic expressions
+ *
+ * Expressions that are re-evaluated when props, signals or the layout
+ * changes (see run_dynamics() and eval_dynamic()) are compiled into a
+ * register program the first time they are re-evaluated.
+ *
+ * Leaf tokens are preloaded into registers and each operator writes
+ * its result to a register of its own. Operators that produce numbers
+ * put the result in a token slot on the C stack instead of allocating
+ * a token. Operators without a fast path (functions, vectors,
+ * assignments) get their operands pushed on the eval stack and are
+ * run by eval_operator() so the semantics are exactly those of
+ * glw_view_eval_rpn0(), which is also used for expressions that can't
+ * be compiled.
+ */
 
-    case TOKEN_LT:
-    case TOKEN_GT:
-      if(eval_lt(ec, t, t->type == TOKEN_GT))
-	return -1;
-      break;
+#define GVB_MAX_TOKENS 64
 
-    case TOKEN_FUNCTION:
-#if 0
-      printf("Invoking %s with %d arguments\n",
-	     t->t_func->name, t->t_num_args);
-#endif
-      if(invoke_func(ec, t))
-	return -1;
+typedef enum {
+  GVB_OP,
+  GVB_BOOL_OP,
+  GVB_BOOL_NOT,
+  GVB_EQ,
+  GVB_LT,
+  GVB_NULL_COALESCE,
+  GVB_TENARY,
+  GVB_ATTRIB,  // Plain or conditional assignment to a resolved attribute
+  GVB_STACK,   // Push operands and run eval_operator()
+} gvb_opcode_t;
+
+
+typedef struct gvb_insn {
+  token_t *gi_self;
+  uint8_t gi_op;
+  uint8_t gi_nargs;
+  uint8_t gi_resolve;   // Number of operands to resolve before the op
+  uint8_t gi_args;      // Offset of operand registers in gvb_args
+} gvb_insn_t;
+
+
+typedef struct glw_view_bytecode {
+  int gvb_num_leaves;
+  int gvb_num_insns;
+  token_t **gvb_leaves;
+  gvb_insn_t *gvb_insns;
+  uint8_t *gvb_args;
+} glw_view_bytecode_t;
+
+/**
+ * Marks RPNs that we failed to compile
+ */
+static glw_view_bytecode_t gvb_interpret;
+
+
+/**
+ * Number of operands for an operator, -1 for leaf tokens and -2 for
+ * tokens we don't know how to deal with
+ */
+static int
+gvb_num_operands(const token_t *t)
+{
+  switch(t->type) {
+  case TOKEN_BLOCK:
+  case TOKEN_RSTRING:
+  case TOKEN_CSTRING:
+  case TOKEN_URI:
+  case TOKEN_FLOAT:
+  case TOKEN_EM:
+  case TOKEN_INT:
+  case TOKEN_IDENTIFIER:
+  case TOKEN_RESOLVED_ATTRIBUTE:
+  case TOKEN_UNRESOLVED_ATTRIBUTE:
+  case TOKEN_VOID:
+  case TOKEN_PROPERTY_REF:
+  case TOKEN_PROPERTY_OWNER:
+  case TOKEN_PROPERTY_NAME:
+  case TOKEN_PROPERTY_SUBSCRIPTION:
+    return -1;
+
+  case TOKEN_BOOLEAN_NOT:
+    return 1;
+
+  case TOKEN_ADD:
+  case TOKEN_SUB:
+  case TOKEN_MULTIPLY:
+  case TOKEN_DIVIDE:
+  case TOKEN_MODULO:
+  case TOKEN_BOOLEAN_OR:
+  case TOKEN_BOOLEAN_XOR:
+  case TOKEN_BOOLEAN_AND:
+  case TOKEN_NULL_COALESCE:
+  case TOKEN_EQ:
+  case TOKEN_NEQ:
+  case TOKEN_LT:
+  case TOKEN_GT:
+  case TOKEN_ASSIGNMENT:
+  case TOKEN_COND_ASSIGNMENT:
+  case TOKEN_DEBUG_ASSIGNMENT:
+  case TOKEN_REF_ASSIGNMENT:
+  case TOKEN_LINK_ASSIGNMENT:
+    return 2;
+
+  case TOKEN_TENARY:
+    return 3;
+
+  case TOKEN_FUNCTION:
+  case TOKEN_LEFT_BRACKET:
+    return t->t_num_args;
+
+  default:
+    return -2;
+  }
+}
+
+
+/**
+ *
+ */
+static void
+gvb_set_op(gvb_insn_t *gi, const token_t *t)
+{
+  switch(t->type) {
+  case TOKEN_ADD:
+  case TOKEN_SUB:
+  case TOKEN_MULTIPLY:
+  case TOKEN_DIVIDE:
+  case TOKEN_MODULO:
+    gi->gi_op = GVB_OP;
+    gi->gi_resolve = 2;
+    break;
+  case TOKEN_BOOLEAN_OR:
+  case TOKEN_BOOLEAN_XOR:
+  case TOKEN_BOOLEAN_AND:
+    gi->gi_op = GVB_BOOL_OP;
+    gi->gi_resolve = 2;
+    break;
+  case TOKEN_BOOLEAN_NOT:
+    gi->gi_op = GVB_BOOL_NOT;
+    gi->gi_resolve = 1;
+    break;
+  case TOKEN_EQ:
+  case TOKEN_NEQ:
+    gi->gi_op = GVB_EQ;
+    gi->gi_resolve = 2;
+    break;
+  case TOKEN_LT:
+  case TOKEN_GT:
+    gi->gi_op = GVB_LT;
+    gi->gi_resolve = 2;
+    break;
+  case TOKEN_NULL_COALESCE:
+    gi->gi_op = GVB_NULL_COALESCE;
+    gi->gi_resolve = 2;
+    break;
+  case TOKEN_TENARY:
+    gi->gi_op = GVB_TENARY;
+    gi->gi_resolve = 1;
+    break;
+  default:
+    gi->gi_op = GVB_STACK;
+    gi->gi_resolve = 0;
+    break;
+  }
+}
+
+
+/**
+ * Compile an RPN, returns NULL if it can't be done
+ */
+static glw_view_bytecode_t *
+gvb_compile(token_t *rpn)
+{
+  int num_tokens = 0, num_leaves = 0, num_args = 0, depth = 0;
+  token_t *t;
+
+  for(t = rpn->child; t != NULL; t = t->next) {
+    const int n = gvb_num_operands(t);
+    if(n == -2 || ++num_tokens > GVB_MAX_TOKENS)
+      return NULL;
+
+    if(n == -1) {
+      num_leaves++;
+      depth++;
+      continue;
+    }
+
+    if(n > depth)
+      return NULL;
+    depth -= n;
+    num_args += n;
+    if(t->type != TOKEN_LINK_ASSIGNMENT)
+      depth++;
+  }
+
+  const int num_insns = num_tokens - num_leaves;
+  if(num_insns == 0)
+    return NULL;
+
+  glw_view_bytecode_t *gvb =
+    malloc(sizeof(glw_view_bytecode_t) +
+           num_insns * sizeof(gvb_insn_t) +
+           num_leaves * sizeof(token_t *) +
+           num_args);
+
+  gvb->gvb_num_leaves = num_leaves;
+  gvb->gvb_num_insns = num_insns;
+  gvb->gvb_insns = (void *)(gvb + 1);
+  gvb->gvb_leaves = (void *)(gvb->gvb_insns + num_insns);
+  gvb->gvb_args = (void *)(gvb->gvb_leaves + num_leaves);
+
+  uint8_t stack[GVB_MAX_TOKENS];
+  int sp = 0, leaf = 0, insn = 0, arg = 0;
+
+  for(t = rpn->child; t != NULL; t = t->next) {
+    const int n = gvb_num_operands(t);
+
+    if(n == -1) {
+      gvb->gvb_leaves[leaf] = t;
+      stack[sp++] = leaf++;
+      continue;
+    }
+
+    gvb_insn_t *gi = &gvb->gvb_insns[insn];
+    gi->gi_self = t;
+    gi->gi_nargs = n;
+    gi->gi_args = arg;
+    gvb_set_op(gi, t);
+
+    sp -= n;
+    memcpy(gvb->gvb_args + arg, stack + sp, n);
+
+    if((t->type == TOKEN_ASSIGNMENT || t->type == TOKEN_COND_ASSIGNMENT) &&
+       stack[sp] < num_leaves) {
+      const token_t *left = gvb->gvb_leaves[stack[sp]];
+      if(left->type == TOKEN_RESOLVED_ATTRIBUTE &&
+         !(left->t_attrib->flags & GLW_ATTRIB_FLAG_NO_SUBSCRIPTION))
+        gi->gi_op = GVB_ATTRIB;
+    }
+    arg += n;
+
+    if(t->type != TOKEN_LINK_ASSIGNMENT)
+      stack[sp++] = num_leaves + insn;
+    insn++;
+  }
+  return gvb;
+}
+
+
+/**
+ * An operator run via eval_operator() did not leave exactly one
+ * result on the stack (widget() and friends push nothing), so the
+ * register assignment made by gvb_compile() is wrong from here on.
+ *
+ * Rebuild the eval stack as glw_view_eval_rpn0() would have it after
+ * 'self' and interpret the rest of the RPN. 'out' is what the operator
+ * pushed.
+ */
+static int
+gvb_resume(token_t *rpn, const glw_view_bytecode_t *gvb,
+           glw_view_eval_context_t *ec, token_t **regs,
+           token_t *self, token_t *out)
+{
+  uint8_t stack[GVB_MAX_TOKENS];
+  int sp = 0, leaf = 0, insn = 0, i;
+  token_t *t, *next, *rev = NULL;
+
+  for(t = rpn->child; t != self; t = t->next) {
+    const int n = gvb_num_operands(t);
+    if(n == -1) {
+      stack[sp++] = leaf++;
+      continue;
+    }
+    sp -= n;
+    if(t->type != TOKEN_LINK_ASSIGNMENT)
+      stack[sp++] = gvb->gvb_num_leaves + insn;
+    insn++;
+  }
+  sp -= gvb_num_operands(self);
+
+  for(i = 0; i < sp; i++)
+    eval_push(ec, regs[stack[i]]);
+
+  for(; out != NULL; out = next) {
+    next = out->tmp;
+    out->tmp = rev;
+    rev = out;
+  }
+  for(; rev != NULL; rev = next) {
+    next = rev->tmp;
+    eval_push(ec, rev);
+  }
+  return eval_rpn_tokens(self->next, ec);
+}
+
+
+/**
+ * Run a compiled RPN
+ */
+static int
+gvb_exec(token_t *rpn, const glw_view_bytecode_t *gvb,
+         glw_view_eval_context_t *ec)
+{
+  token_t *regs[gvb->gvb_num_leaves + gvb->gvb_num_insns];
+  token_t slots[gvb->gvb_num_insns];
+  token_t **res = regs + gvb->gvb_num_leaves;
+  token_t *stack = ec->stack;
+  token_t *v[3];
+  int i, j;
+
+  memcpy(regs, gvb->gvb_leaves, gvb->gvb_num_leaves * sizeof(token_t *));
+
+  for(i = 0; i < gvb->gvb_num_insns; i++) {
+    const gvb_insn_t *gi = &gvb->gvb_insns[i];
+    const uint8_t *args = gvb->gvb_args + gi->gi_args;
+    token_t *self = gi->gi_self;
+
+    for(j = 0; j < gi->gi_resolve; j++)
+      if((v[j] = token_resolve(ec, regs[args[j]])) == NULL)
+        goto bad;
+
+    switch(gi->gi_op) {
+    case GVB_OP:
+      if((res[i] = eval_op_tokens(ec, self, v[0], v[1], &slots[i])) == NULL)
+        goto bad;
       break;
 
-    case TOKEN_LEFT_BRACKET:
-      if(make_vector(ec, t))
-	return -1;
+    case GVB_BOOL_OP:
+      res[i] = eval_bool_op_tokens(ec, self, v[0], v[1], &slots[i]);
       break;
 
-    case TOKEN_ASSIGNMENT:
-      if(eval_assign(ec, t, 0))
-	return -1;
+    case GVB_BOOL_NOT:
+      res[i] = eval_bool_not_token(ec, self, v[0], &slots[i]);
       break;
 
-    case TOKEN_COND_ASSIGNMENT:
-      if(eval_assign(ec, t, 1))
-	return -1;
+    case GVB_EQ:
+      res[i] = eval_eq_tokens(ec, self, v[0], v[1], &slots[i]);
       break;
 
-    case TOKEN_DEBUG_ASSIGNMENT:
-      if(eval_assign(ec, t, 2))
-	return -1;
+    case GVB_LT:
+      res[i] = eval_lt_tokens(ec, self, v[0], v[1], &slots[i]);
       break;
 
-    case TOKEN_REF_ASSIGNMENT:
-      if(eval_assign(ec, t, 3))
-	return -1;
+    case GVB_NULL_COALESCE:
+      res[i] = v[0]->type == TOKEN_VOID ? v[1] : v[0];
       break;
 
-    case TOKEN_LINK_ASSIGNMENT:
-      if(eval_link_assign(ec, t))
-	return -1;
+    case GVB_TENARY:
+      res[i] = token2bool(v[0]) ? regs[args[1]] : regs[args[2]];
       break;
 
-    case TOKEN_TENARY:
-      if(eval_tenary(ec, t))
-        return -1;
+    case GVB_ATTRIB:
+      // Same as eval_assign() for this case, except blocks
+      if(regs[args[1]] != NULL && regs[args[1]]->type != TOKEN_BLOCK) {
+        token_t *left = regs[args[0]];
+
+        if((res[i] = token_resolve(ec, regs[args[1]])) == NULL)
+          goto bad;
+
+        if(self->type == TOKEN_COND_ASSIGNMENT &&
+           res[i]->type == TOKEN_VOID)
+          break;
+
+        if(left->t_attrib->set(ec, left->t_attrib, res[i]))
+          goto bad;
+        break;
+      }
+      // FALLTHRU
+    case GVB_STACK:
+      ec->stack = NULL;
+      for(j = 0; j < gi->gi_nargs; j++) {
+        if(regs[args[j]] == NULL) {
+          glw_view_seterr(ec->ei, self, "Missing operand");
+          goto bad;
+        }
+        eval_push(ec, regs[args[j]]);
+      }
+
+      if(eval_operator(ec, self))
+        goto bad;
+
+      if(self->type == TOKEN_LINK_ASSIGNMENT)
+        break;
+
+      if((ec->stack == NULL || ec->stack->tmp != NULL) &&
+         i + 1 < gvb->gvb_num_insns) {
+        token_t *out = ec->stack;
+        ec->stack = stack;
+        j = gvb_resume(rpn, gvb, ec, regs, self, out);
+        ec->stack = stack;
+        rpn->t_extra = &gvb_interpret;
+        free((void *)gvb);
+        return j;
+      }
+      res[i] = eval_pop(ec);
       break;
+    }
+  }
+  ec->stack = stack;
+  return 0;
+
+ bad:
+  ec->stack = stack;
+  return -1;
+}
+
+
+/**
+ * Re-evaluate a dynamic expression, compiling it first if needed
+ */
+static int
+eval_rpn_dynamic(token_t *t, glw_view_eval_context_t *ec)
+{
+  glw_view_bytecode_t *gvb = t->t_extra;
+
+  if(gvb == NULL) {
+    gvb = gvb_compile(t);
+    if(gvb == NULL)
+      gvb = &gvb_interpret;
+    t->t_extra = gvb;
+  }
+
+  if(gvb == &gvb_interpret)
+    return glw_view_eval_rpn0(t, ec);
+
+  return gvb_exec(t, gvb, ec);
+}
+
+
+/**
+ *
+ */
+void
+glw_view_bytecode_free(token_t *rpn)
+{
+  if(rpn->t_extra != &gvb_interpret)
+    free(rpn->t_extra);
+}
+
+
+/**
+ * Replace operators that only have numeric constants as operands
+ * with their result.
+ *
+ * The operands are the tokens just before the operator so this is done
+ * in a single pass. The same code as in the evaluator is used so the
+ * result is exactly what we would get at runtime
+ */
+void
+glw_view_fold_constants(glw_root_t *gr, token_t *rpn)
+{
+  glw_view_eval_context_t ec;
+  token_t *t, *next, *r, slot;
+  int n = 0, sp = 0;
 
+  for(t = rpn->child; t != NULL; t = t->next)
+    n++;
+
+  token_t **v = alloca(n * sizeof(token_t *));
+
+  memset(&ec, 0, sizeof(ec));
+  ec.gr = gr;
+
+  for(t = rpn->child; t != NULL; t = next) {
+    next = t->next;
+
+    int nargs;
+    switch(t->type) {
+    case TOKEN_MODULO:
+    case TOKEN_ADD:
+    case TOKEN_SUB:
+    case TOKEN_MULTIPLY:
+    case TOKEN_DIVIDE:
+    case TOKEN_BOOLEAN_OR:
+    case TOKEN_BOOLEAN_XOR:
+    case TOKEN_BOOLEAN_AND:
+    case TOKEN_EQ:
+    case TOKEN_NEQ:
+    case TOKEN_LT:
+    case TOKEN_GT:
+      nargs = 2;
+      break;
+    case TOKEN_BOOLEAN_NOT:
+      nargs = 1;
+      break;
     default:
-      fprintf(stderr, "Can not handle token %s\n", token2name(t));
-      abort();
+      nargs = 0;
+      break;
     }
+
+    int constant = nargs > 0 && sp >= nargs;
+    for(int i = 1; i <= nargs && constant; i++)
+      constant = v[sp - i]->type == TOKEN_INT || v[sp - i]->type == TOKEN_FLOAT;
+
+    // Don't trap on modulo by zero here, leave that to runtime
+    if(constant && t->type == TOKEN_MODULO &&
+       (int)token2float(&ec, v[sp - 1]) == 0)
+      constant = 0;
+
+    if(constant) {
+      token_t *a = v[sp - nargs], *b = v[sp - 1];
+
+      switch(t->type) {
+      case TOKEN_BOOLEAN_OR:
+      case TOKEN_BOOLEAN_XOR:
+      case TOKEN_BOOLEAN_AND:
+        r = eval_bool_op_tokens(&ec, t, a, b, &slot);
+        break;
+      case TOKEN_EQ:
+      case TOKEN_NEQ:
+        r = eval_eq_tokens(&ec, t, a, b, &slot);
+        break;
+      case TOKEN_LT:
+      case TOKEN_GT:
+        r = eval_lt_tokens(&ec, t, a, b, &slot);
+        break;
+      case TOKEN_BOOLEAN_NOT:
+        r = eval_bool_not_token(&ec, t, a, &slot);
+        break;
+      default:
+        r = eval_op_tokens(&ec, t, a, b, &slot);
+        break;
+      }
+
+      if(r != NULL) {
+        t->type = r->type;
+        t->u = r->u;
+        while(nargs--)
+          glw_view_token_free(gr, v[--sp]);
+      }
+    }
+    v[sp++] = t;
+  }
+
+  rpn->child = NULL;
+  while(sp > 0) {
+    v[sp - 1]->next = rpn->child;
+    rpn->child = v[--sp];
   }
-  return 0;
 }
 
 
@@ -7418,3 +8045,183 @@ glw_view_function_resolve(glw_root_t *gr, errorinfo_t *ei, token_t *t)
   glw_view_seterr(ei, t, "Unknown function: %s", fname);
   return NULL;
 }
+
+
+#if ENABLE_BENCHMARKS
+/**
+ * Microbenchmark of dynamic expressions, run with --bench glwexpr
+ *
+ * Each expression is parsed and evaluated on a widget with $view bound
+ * to fixed values. The resulting dynamic RPN is then re-evaluated the
+ * way a prop change does it, both with the interpreter and the
+ * bytecode. Figures are ns per evaluation, best of GVE_BENCH_PASSES
+ */
+#define GVE_BENCH_PASSES 10
+#define GVE_BENCH_EVALS  100000
+
+static const char *gve_bench_exprs[] = {
+  "alpha: 0.3 + 0.7 * $view.a;",
+  "focusable: !$view.c && $view.d;",
+  "weight: $view.a == 3 || $view.b > 0.5;",
+  "weight: ($view.a + 4) / 2 - 1;",
+  "alpha: 1.5em * $view.b;",
+  "alpha: 2 * 0.25 + 0.5 * $view.b;",
+  "weight: select($view.c, $view.a * 2, 1);",
+  "alpha: clamp($view.b * 3, 0, 1);",
+  "alpha: $view.s == \"foo\";",
+  "alpha: $view.c ? 1 : 0.2;",
+  "alpha: $view.v ?? 0.5;",
+};
+
+
+static int64_t
+gve_bench_run(glw_t *w, token_t *rpn, int compiled, float *result)
+{
+  glw_view_eval_context_t ec;
+  errorinfo_t ei;
+  int64_t best = INT64_MAX;
+
+  for(int pass = 0; pass < GVE_BENCH_PASSES; pass++) {
+    const int64_t t0 = arch_get_ts();
+    for(int i = 0; i < GVE_BENCH_EVALS; i++) {
+      memset(&ec, 0, sizeof(ec));
+      ec.w = w;
+      ec.gr = w->glw_root;
+      ec.ei = &ei;
+      ec.scope = w->glw_scope;
+      ec.sublist = &w->glw_prop_subscriptions;
+
+      if(compiled)
+        eval_rpn_dynamic(rpn, &ec);
+      else
+        glw_view_eval_rpn0(rpn, &ec);
+      glw_view_free_chain(ec.gr, ec.alloc);
+    }
+    const int64_t ts = arch_get_ts() - t0;
+    if(ts < best)
+      best = ts;
+  }
+  *result = w->glw_alpha + w->glw_focus_weight + w->glw_req_weight;
+  return best;
+}
+
+
+static void
+glw_view_eval_bench(void)
+{
+  const int num = ARRAYSIZE(gve_bench_exprs);
+  int64_t sum[2] = {0};
+  int mismatch = 0;
+
+  glw_root_t *gr = calloc(1, sizeof(glw_root_t));
+  gr->gr_prop_ui = prop_create_root("ui");
+
+  if(glw_init(gr)) {
+    TRACE(TRACE_ERROR, "bench", "glwexpr: Unable to initialize UI");
+    prop_destroy(gr->gr_prop_ui);
+    free(gr);
+    return;
+  }
+
+  prop_t *view = prop_create_root(NULL);
+  prop_set(view, "a", PROP_SET_INT, 3);
+  prop_set(view, "b", PROP_SET_FLOAT, 0.25);
+  prop_set(view, "c", PROP_SET_INT, 1);
+  prop_set(view, "d", PROP_SET_INT, 1);
+  prop_set(view, "s", PROP_SET_STRING, "foo");
+  prop_set(view, "v", PROP_SET_VOID);
+
+  glw_scope_t *scope = glw_scope_create();
+  scope->gs_roots[GLW_ROOT_VIEW].p = prop_ref_inc(view);
+
+  const glw_class_t *gc = glw_class_find_by_name("container_z");
+  rstr_t *file = rstr_alloc("bench");
+
+  glw_lock(gr);
+
+  for(int i = 0; i < num; i++) {
+    errorinfo_t ei;
+    int64_t ts[2];
+    float result[2];
+
+    token_t *sof = glw_view_token_alloc(gr);
+    sof->type = TOKEN_START;
+    sof->file = rstr_dup(file);
+
+    token_t *l = glw_view_lexer(gr, gve_bench_exprs[i], &ei, file, sof);
+    if(l == NULL) {
+      TRACE(TRACE_ERROR, "bench", "glwexpr: %s -- %s",
+            gve_bench_exprs[i], ei.error);
+      glw_view_free_chain(gr, sof);
+      continue;
+    }
+    token_t *eof = glw_view_token_alloc(gr);
+    eof->type = TOKEN_END;
+    eof->file = rstr_dup(file);
+    l->next = eof;
+
+    glw_t *parent = glw_create(gr, gc, NULL, NULL, NULL, scope, file, 0);
+    glw_t *w = glw_create(gr, gc, parent, NULL, NULL, scope, file, 0);
+
+    glw_view_eval_context_t ec = {};
+    ec.gr = gr;
+    ec.w = w;
+    ec.ei = &ei;
+    ec.scope = scope;
+    ec.sublist = &w->glw_prop_subscriptions;
+
+    if(glw_view_parse(sof, &ei, gr) || glw_view_eval_block(sof, &ec, NULL)) {
+      TRACE(TRACE_ERROR, "bench", "glwexpr: %s -- %s",
+            gve_bench_exprs[i], ei.error);
+    } else {
+      // Deliver the prop values to the subscriptions
+      prop_courier_poll(gr->gr_courier);
+
+      token_t *rpn = w->glw_dynamic_expressions;
+      if(rpn == NULL) {
+        TRACE(TRACE_INFO, "bench", "glwexpr: %-42s static",
+              gve_bench_exprs[i]);
+      } else {
+        ts[0] = gve_bench_run(w, rpn, 0, &result[0]);
+        ts[1] = gve_bench_run(w, rpn, 1, &result[1]);
+        sum[0] += ts[0];
+        sum[1] += ts[1];
+        if(result[0] != result[1])
+          mismatch++;
+
+        TRACE(TRACE_INFO, "bench",
+              "glwexpr: %-42s %5.1f -> %5.1f ns%s%s",
+              gve_bench_exprs[i],
+              ts[0] * 1000.0 / GVE_BENCH_EVALS,
+              ts[1] * 1000.0 / GVE_BENCH_EVALS,
+              rpn->t_extra == &gvb_interpret ? " (interpreted)" : "",
+              result[0] != result[1] ? " (results differ)" : "");
+      }
+    }
+
+    glw_destroy(parent);
+    glw_view_free_chain(gr, sof);
+  }
+
+  glw_unlock(gr);
+  glw_reap(gr);
+
+  if(sum[1] > 0)
+    TRACE(TRACE_INFO, "bench",
+          "glwexpr: all %d expressions %.1f -> %.1f ns (%.2fx), "
+          "%d with different results",
+          num, sum[0] * 1000.0 / GVE_BENCH_EVALS / num,
+          sum[1] * 1000.0 / GVE_BENCH_EVALS / num,
+          (double)sum[0] / sum[1], mismatch);
+
+  rstr_release(file);
+  glw_scope_release(scope);
+  prop_destroy(view);
+
+  glw_fini(gr);
+  prop_destroy(gr->gr_prop_ui);
+  glw_release_root(gr);
+}
+
+BENCHMARK("glwexpr", glw_view_eval_bench);
+#endif
@@ -19,7 +19,6 @@
  */
 #include "glw.h"
 #include "glw_view.h"
-#include "fileaccess/fileaccess.h"
 #include "misc/str.h"
 
 /**
@@ -388,39 +387,18 @@ glw_view_lexer(glw_root_t *gr, const char *src, errorinfo_t *ei,
 /**
  * Load a view file and do lexographical parsing
  *
+ * The lexed file is kept in the view cache (see glw_view_cache.c) so
+ * files included from many views are only read and lexed once.
+ *
  * Returns pointer to last token, or NULL if an error occured.
  * If an error occured 'ei' will be filled with data
  */
 token_t *
 glw_view_load1(glw_root_t *gr, rstr_t *url, errorinfo_t *ei, token_t *prev,
-               int may_unlock)
+               int may_unlock, glw_view_deps_t *deps)
 {
-  token_t *last;
-  char errbuf[256];
-
   rstr_t *p = glw_resolve_path(url, prev->file, gr, NULL);
-
-  if(may_unlock)
-    glw_unlock(gr);
-
-  buf_t *b = fa_load(rstr_get(p),
-                     FA_LOAD_ERRBUF(errbuf, sizeof(errbuf)),
-                     NULL);
-
-  if(may_unlock)
-    glw_lock(gr);
-
-  if(b == NULL) {
-    snprintf(ei->error, sizeof(ei->error), "Unable to open \"%s\" -- %s",
-	     rstr_get(p), errbuf);
-    snprintf(ei->file,  sizeof(ei->file),  "%s", rstr_get(prev->file));
-    ei->line = prev->line;
-    rstr_release(p);
-    return NULL;
-  }
-
-  last = glw_view_lexer(gr, buf_cstr(b), ei, p, prev);
-  buf_release(b);
+  token_t *last = glw_view_cache_load_file(gr, p, ei, prev, may_unlock, deps);
   rstr_release(p);
   return last;
 }
@@ -635,6 +635,7 @@ parse_one_expression(token_t *prev, token_t *first, errorinfo_t *ei,
       if(parse_prep_expression(t, ei, gr))
         return -1;
 
+      glw_view_fold_constants(gr, t);
       scan_prop_names(t, prev, gr);
       optimize_attribute_assignment(t, prev, gr);
       return 0;
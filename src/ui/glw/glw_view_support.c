@@ -105,8 +105,6 @@ glw_view_token_free(glw_root_t *gr, token_t *t)
   case TOKEN_LT:
   case TOKEN_GT:
   case TOKEN_EXPR:
-  case TOKEN_RPN:
-  case TOKEN_PURE_RPN:
   case TOKEN_BLOCK:
   case TOKEN_NOP:
   case TOKEN_COLON:
@@ -126,6 +124,11 @@ glw_view_token_free(glw_root_t *gr, token_t *t)
       rstr_release(t->t_pnvec[i]);
     break;
 
+  case TOKEN_RPN:
+  case TOKEN_PURE_RPN:
+    glw_view_bytecode_free(t);
+    break;
+
   case TOKEN_GEM:
     glw_event_map_destroy(gr, t->t_gem);
     break;